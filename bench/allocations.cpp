@@ -0,0 +1,262 @@
+/**
+ * Counts the heap allocations made while speaking, from the conversion of
+ * each fragment's text through the formatting and recording of the message
+ * which reports it to the driver.
+ *
+ * The "per-fragment strings" figures reproduce the engine's previous
+ * strategy, in which each fragment's text was converted to a new string,
+ * passed by value, and concatenated into new strings for the capture journal
+ * and the driver. The "arena" figures use `SpeakPipeline` with a sink which
+ * formats and records messages as the engine's does. Once the arena and the
+ * message buffer have grown to fit the workload, speaking should not
+ * allocate at all.
+ */
+#include "bench.h"
+#include "CaptureJournal.h"
+#include "MessageFormat.h"
+#include "SpeakPipeline.h"
+#include "Utf8.h"
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> s_allocations{0};
+
+void* operator new(size_t size)
+{
+    s_allocations += 1;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    s_allocations += 1;
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+class PollingSite : public SpeakSite
+{
+public:
+    size_t events = 0;
+
+    uint32_t getActions() { return 0; }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t numEvents)
+    {
+        events += numEvents;
+        return S_OK;
+    }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+/**
+ * Formats and records each message in the manner of the engine's `emit`.
+ */
+class JournalingSink : public MessageSink
+{
+public:
+    explicit JournalingSink(CaptureJournal& journal) : m_journal(journal) {}
+
+    size_t bytes = 0;
+
+    HRESULT emit(MessageType type, const char* pData, size_t cbData)
+    {
+        char attributes[MessageBuffer::SEQUENCE_ATTRIBUTE_SIZE];
+        uint64_t ullSequence = 0;
+        HRESULT hr = m_record.format(type, pData, cbData);
+        if (SUCCEEDED(hr))
+        {
+            hr = m_journal.append(m_record.data(), m_record.size(), CaptureJournal::now(), &ullSequence);
+        }
+        bytes += MessageBuffer::formatSequence(ullSequence, attributes) + cbData;
+        return hr;
+    }
+
+private:
+    CaptureJournal& m_journal;
+    MessageBuffer m_record;
+};
+
+class PollingVocalizer : public Vocalizer
+{
+public:
+    size_t bytes = 0;
+
+    HRESULT vocalize(const char*, size_t cbText, SpeakSite& site)
+    {
+        bytes += cbText;
+        site.getActions();
+        return S_OK;
+    }
+};
+
+/**
+ * The engine's previous `emit`, `vocalize` and fragment loop.
+ */
+static size_t s_legacyBytes = 0;
+
+static HRESULT legacyEmit(MessageType type, std::string data, CaptureJournal& journal)
+{
+    std::string typeString;
+    if (type == MessageType::LIFECYCLE)
+    {
+        typeString = "lifecycle";
+    }
+    else if (type == MessageType::SPEECH)
+    {
+        typeString = "speech";
+    }
+    else
+    {
+        typeString = "internalError";
+    }
+
+    std::string record(typeString + ":" + data);
+    uint64_t ullSequence = 0;
+    journal.append(record.data(), record.size(), CaptureJournal::now(), &ullSequence);
+    std::string attributes = " seq=" + std::to_string(ullSequence);
+    std::string message(typeString + attributes + ":" + data);
+    s_legacyBytes += message.size();
+    return S_OK;
+}
+
+static HRESULT legacyVocalize(std::string text, SpeakSite& site)
+{
+    std::wstring wideText(text.begin(), text.end());
+    s_legacyBytes += wideText.size();
+    site.getActions();
+    return S_OK;
+}
+
+static void speakWithStrings(const std::vector<SpeakFragment>& fragments, SpeakSite& site,
+    CaptureJournal& journal)
+{
+    for (const SpeakFragment& fragment : fragments)
+    {
+        if (fragment.eAction == FragmentAction::Bookmark)
+        {
+            continue;
+        }
+        std::string part = toUtf8(fragment.pTextStart, fragment.ulTextLen);
+        legacyEmit(MessageType::SPEECH, part, journal);
+        legacyVocalize(part, site);
+    }
+}
+
+static std::string journalPath()
+{
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/bench-allocations.journal";
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int iterations = options.quick ? 200 : 20000;
+
+    // A say-all chunk: sentences of varying length (including non-ASCII
+    // text) separated by synchronization bookmarks.
+    std::vector<std::u16string> text;
+    std::vector<SpeakFragment> fragments;
+    const char16_t* sentences[] = {
+        u"Heading level 2, Navigation landmark",
+        u"link",
+        u"Café menu, list with 12 items",
+        u"The quick brown fox jumps over the lazy dog, again and again, until the page ends.",
+    };
+    size_t textFragments = 0;
+    for (int i = 0; i < 64; i += 1)
+    {
+        text.push_back(std::u16string(u"") + (char16_t)(u'0' + i % 10));
+        fragments.push_back(SpeakFragment{FragmentAction::Bookmark, nullptr, 0, 0});
+        text.push_back(sentences[i % 4]);
+        fragments.push_back(SpeakFragment{FragmentAction::Speak, nullptr, 0, 0});
+        textFragments += 1;
+    }
+    for (size_t i = 0; i < fragments.size(); i += 1)
+    {
+        fragments[i].pTextStart = text[i].data();
+        fragments[i].ulTextLen = (uint32_t)text[i].size();
+    }
+
+    std::string path = journalPath();
+    remove(path.c_str());
+    CaptureJournal journal;
+    bench::check(SUCCEEDED(journal.open(path.c_str(), 1 << 20, 8192)), "journal opens");
+
+    PollingSite site;
+    double units = (double)textFragments;
+
+    printf("\n%zu text fragments, %zu bookmarks per Speak\n", textFragments, fragments.size() - textFragments);
+
+    speakWithStrings(fragments, site, journal);
+    uint64_t before = s_allocations;
+    bench::measure("  per-fragment strings, per fragment", iterations, units, [&] {
+        speakWithStrings(fragments, site, journal);
+    });
+    double legacyAllocations = (double)(s_allocations - before) / iterations / units;
+
+    JournalingSink sink(journal);
+    PollingVocalizer vocalizer;
+    SpeakPipeline pipeline(sink, vocalizer);
+
+    // The first call sizes the arena and the message buffer.
+    bench::check(SUCCEEDED(pipeline.speak(fragments.data(), fragments.size(), site)), "speak succeeds");
+    before = s_allocations;
+    bench::measure("  arena, per fragment", iterations, units, [&] {
+        pipeline.speak(fragments.data(), fragments.size(), site);
+    });
+    double arenaAllocations = (double)(s_allocations - before) / iterations / units;
+
+    printf("  allocations per fragment: %.2f with strings, %.2f with the arena\n",
+        legacyAllocations, arenaAllocations);
+
+    bench::check(arenaAllocations == 0, "speaking does not allocate once warmed up");
+    size_t cbText = 0;
+    for (const SpeakFragment& fragment : fragments)
+    {
+        if (fragment.eAction == FragmentAction::Speak)
+        {
+            cbText += toUtf8(fragment.pTextStart, fragment.ulTextLen).size();
+        }
+    }
+    bench::check(vocalizer.bytes == cbText * (iterations + 1), "every fragment is vocalized");
+    bench::check(s_legacyBytes > 0, "the previous strategy produces messages");
+
+    journal.close();
+    remove(path.c_str());
+
+    return 0;
+}
@@ -0,0 +1,333 @@
+/**
+ * Measures the cost which the audio tap adds to each write of audio to the
+ * output site, with no tap, with the tap disabled (its state whenever no
+ * client is capturing audio) and with the tap enabled and drained by a
+ * concurrent reader.
+ *
+ * Several threads then write to one tap while another drains it, to verify
+ * that every record is either received intact and in order or counted as
+ * dropped.
+ */
+#include "bench.h"
+#include "AudioTap.h"
+#include "SpeakPipeline.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t WRITES_PER_SPEAK = 64;
+
+class NullSink : public MessageSink
+{
+public:
+    HRESULT emit(MessageType, const char*, size_t) { return S_OK; }
+};
+
+/**
+ * Writes a fixed amount of audio in chunks of the size which the pipeline
+ * uses for rendered audio.
+ */
+class ToneVocalizer : public Vocalizer
+{
+public:
+    ToneVocalizer() : m_chunk(SpeakPipeline::AUDIO_WRITE_SIZE)
+    {
+        for (size_t i = 0; i < m_chunk.size(); i += 1)
+        {
+            m_chunk[i] = (uint8_t)(i * 7);
+        }
+    }
+
+    HRESULT vocalize(const char*, size_t, SpeakSite& site)
+    {
+        for (size_t i = 0; i < WRITES_PER_SPEAK; i += 1)
+        {
+            size_t cbWritten = 0;
+            HRESULT hr = site.write(m_chunk.data(), m_chunk.size(), &cbWritten);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+private:
+    std::vector<uint8_t> m_chunk;
+};
+
+class NullSite : public SpeakSite
+{
+public:
+    uint64_t ullBytes = 0;
+
+    uint32_t getActions() { return 0; }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 0;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t) { return S_OK; }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        ullBytes += cbBuffer;
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+static std::string tapPath(const char* name)
+{
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/bench-audiotap-" + name + ".tap";
+}
+
+/**
+ * Drains the tap on a separate thread, as the driver does, until stopped.
+ */
+class Drainer
+{
+public:
+    explicit Drainer(AudioTap& tap) : m_tap(tap), m_fStop(false), m_ullBytes(0)
+    {
+        m_thread = std::thread([this] {
+            AudioTap::Record record;
+            while (!m_fStop)
+            {
+                while (m_tap.read(&record))
+                {
+                    m_ullBytes += record.samples.size();
+                }
+                std::this_thread::yield();
+            }
+            while (m_tap.read(&record))
+            {
+                m_ullBytes += record.samples.size();
+            }
+        });
+    }
+
+    uint64_t stop()
+    {
+        m_fStop = true;
+        m_thread.join();
+        return m_ullBytes;
+    }
+
+private:
+    AudioTap&         m_tap;
+    std::atomic<bool> m_fStop;
+    uint64_t          m_ullBytes;
+    std::thread       m_thread;
+};
+
+/**
+ * @returns {double} nanoseconds per write, the least of several runs
+ */
+static double measureWrites(const char* label, SpeakPipeline& pipeline, int iterations)
+{
+    const char16_t text[] = u"tone";
+    SpeakFragment fragment = { FragmentAction::Speak, text, 4, 0 };
+    NullSite site;
+    double best = 0;
+
+    pipeline.speak(&fragment, 1, site);
+    for (int run = 0; run < 5; run += 1)
+    {
+        double start = bench::nowNanoseconds();
+        for (int i = 0; i < iterations; i += 1)
+        {
+            pipeline.speak(&fragment, 1, site);
+        }
+        double perWrite = (bench::nowNanoseconds() - start) / iterations / WRITES_PER_SPEAK;
+        best = run == 0 || perWrite < best ? perWrite : best;
+    }
+    bench::check(site.ullBytes == (uint64_t)(5 * iterations + 1) * WRITES_PER_SPEAK * SpeakPipeline::AUDIO_WRITE_SIZE,
+        "every write reaches the output site");
+
+    printf("  %-46s %12.1f ns\n", label, best);
+    return best;
+}
+
+static void checkRecords()
+{
+    std::string path = tapPath("records");
+    remove(path.c_str());
+    AudioTap tap;
+    bench::check(SUCCEEDED(tap.open(path.c_str(), 4096, 11025, 16, 1)), "the tap opens");
+
+    uint8_t samples[3000];
+    for (size_t i = 0; i < sizeof(samples); i += 1)
+    {
+        samples[i] = (uint8_t)i;
+    }
+    AudioTap::Record record;
+
+    bench::check(tap.write(1, 0, samples, 10) == S_FALSE, "a disabled tap is not written");
+    bench::check(!tap.read(&record), "a disabled tap is empty");
+
+    tap.setEnabled(true);
+    bench::check(tap.write(2, 0, samples, sizeof(samples)) == S_OK, "audio which fits is written");
+    bench::check(tap.write(2, sizeof(samples), samples, sizeof(samples)) == S_FALSE,
+        "audio which does not fit is dropped");
+    size_t cbRead = 0;
+    while (tap.read(&record))
+    {
+        cbRead += record.samples.size();
+    }
+    bench::check(cbRead + tap.droppedBytes() == 2 * sizeof(samples), "dropped audio is counted");
+
+    // Large writes are divided between records of at most a quarter of the
+    // capacity, and records never straddle the end of the ring.
+    size_t cbReceived = 0;
+    for (int pass = 0; pass < 8; pass += 1)
+    {
+        bench::check(tap.write(3, 900 * pass, samples, 900) == S_OK, "audio which fits is written");
+        size_t cbPass = 0;
+        while (tap.read(&record))
+        {
+            bench::check(record.ullUtteranceId == 3, "records carry the utterance id");
+            bench::check(record.ullStreamOffset == 900 * pass + cbPass, "records carry the stream offset");
+            bench::check(memcmp(record.samples.data(), samples + cbPass, record.samples.size()) == 0,
+                "records carry the samples");
+            cbPass += record.samples.size();
+        }
+        bench::check(cbPass == 900, "every record is read");
+        cbReceived += cbPass;
+    }
+    bench::check(cbReceived == 8 * 900, "the ring wraps");
+
+    AudioTap reopened;
+    bench::check(SUCCEEDED(reopened.open(path.c_str(), 4096, 11025, 16, 1)) && reopened.isEnabled(),
+        "an existing tap is reused");
+    bench::check(SUCCEEDED(reopened.open(path.c_str(), 4096, 22050, 16, 1)) && !reopened.isEnabled(),
+        "a tap in another format is reinitialized");
+
+    tap.close();
+    reopened.close();
+    remove(path.c_str());
+}
+
+/**
+ * @param {int} numWriters - threads writing concurrently
+ */
+static void checkConcurrentWriters(int numWriters, int recordsPerWriter)
+{
+    std::string path = tapPath("concurrent");
+    remove(path.c_str());
+    AudioTap tap;
+    bench::check(SUCCEEDED(tap.open(path.c_str(), 64 * 1024, 11025, 16, 1)), "the tap opens");
+    tap.setEnabled(true);
+
+    std::atomic<int> finished{0};
+    std::vector<uint64_t> nextOffsets(numWriters, 0);
+    uint64_t ullReceived = 0;
+    bool fIntact = true;
+    bool fOrdered = true;
+
+    std::thread reader([&] {
+        AudioTap::Record record;
+        for (;;)
+        {
+            bool fDone = finished == numWriters;
+            while (tap.read(&record))
+            {
+                size_t writer = (size_t)record.ullUtteranceId;
+                fOrdered = fOrdered && writer < nextOffsets.size() && record.ullStreamOffset >= nextOffsets[writer];
+                nextOffsets[writer] = record.ullStreamOffset + record.samples.size();
+                for (size_t i = 0; i < record.samples.size(); i += 1)
+                {
+                    fIntact = fIntact && record.samples[i] == (uint8_t)(writer * 31 + record.ullStreamOffset + i);
+                }
+                ullReceived += record.samples.size();
+            }
+            if (fDone)
+            {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    });
+
+    uint64_t ullWritten = 0;
+    std::vector<std::thread> writers;
+    for (int w = 0; w < numWriters; w += 1)
+    {
+        ullWritten += (uint64_t)recordsPerWriter * 1000;
+        writers.emplace_back([&tap, &finished, w, recordsPerWriter] {
+            std::vector<uint8_t> samples(1000);
+            for (int r = 0; r < recordsPerWriter; r += 1)
+            {
+                uint64_t ullOffset = (uint64_t)r * samples.size();
+                for (size_t i = 0; i < samples.size(); i += 1)
+                {
+                    samples[i] = (uint8_t)(w * 31 + ullOffset + i);
+                }
+                tap.write(w, ullOffset, samples.data(), samples.size());
+            }
+            finished += 1;
+        });
+    }
+    for (std::thread& writer : writers)
+    {
+        writer.join();
+    }
+    reader.join();
+
+    printf("  %d writers: %llu bytes received, %llu dropped\n", numWriters, (unsigned long long)ullReceived,
+        (unsigned long long)tap.droppedBytes());
+    bench::check(fIntact, "concurrently written records are intact");
+    bench::check(fOrdered, "each writer's records are received in order");
+    bench::check(ullReceived + tap.droppedBytes() == ullWritten, "every byte is received or counted as dropped");
+    bench::check(ullReceived > 0, "records are received");
+
+    tap.close();
+    remove(path.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int iterations = options.quick ? 200 : 5000;
+
+    checkRecords();
+
+    printf("\nCost per %zu-byte write to the output site\n", SpeakPipeline::AUDIO_WRITE_SIZE);
+    NullSink sink;
+    ToneVocalizer vocalizer;
+    SpeakPipeline pipeline(sink, vocalizer);
+    double none = measureWrites("no tap", pipeline, iterations);
+
+    std::string path = tapPath("overhead");
+    remove(path.c_str());
+    AudioTap tap;
+    bench::check(SUCCEEDED(tap.open(path.c_str(), 4 * 1024 * 1024, 11025, 16, 1)), "the tap opens");
+    pipeline.setAudioTap(&tap);
+    double disabled = measureWrites("tap disabled", pipeline, iterations);
+
+    tap.setEnabled(true);
+    Drainer drainer(tap);
+    double enabled = measureWrites("tap enabled, drained concurrently", pipeline, iterations);
+    uint64_t ullDrained = drainer.stop();
+    printf("  %llu bytes mirrored, %llu dropped\n", (unsigned long long)ullDrained,
+        (unsigned long long)tap.droppedBytes());
+    printf("  disabled tap adds %.1f ns per write; enabled tap adds %.1f ns\n", disabled - none, enabled - none);
+
+    bench::check(ullDrained + tap.droppedBytes() ==
+        (uint64_t)(5 * iterations + 1) * WRITES_PER_SPEAK * SpeakPipeline::AUDIO_WRITE_SIZE,
+        "every write is mirrored or counted as dropped");
+    // A disabled tap costs a load and a branch; the allowance absorbs timing
+    // noise.
+    bench::check(disabled - none < 50, "a disabled tap adds negligible cost");
+    tap.close();
+    remove(path.c_str());
+
+    printf("\nConcurrent writers\n");
+    checkConcurrentWriters(4, options.quick ? 500 : 20000);
+
+    return 0;
+}
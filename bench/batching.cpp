@@ -0,0 +1,163 @@
+/**
+ * Measures the batching of messages which `DriverClient` sends in quick
+ * succession, and the latency which it adds.
+ *
+ * Say-all is modelled as a series of Speak calls, each of which emits the
+ * beginning of an utterance, several runs of speech and the end of the
+ * utterance. The end of each utterance is a boundary (as it is in the engine)
+ * unless stated otherwise, in which case batches span Speak calls. Isolated
+ * announcements, separated by pauses, must not be held at all.
+ *
+ * A thread stands in for the engine's flush timer, writing held messages once
+ * their deadline passes.
+ */
+#include "bench.h"
+#include "counting_server.h"
+#include "DriverClient.h"
+#include <string>
+#include <thread>
+
+static uint64_t nowMicroseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Flusher
+{
+public:
+    explicit Flusher(DriverClient& client) : m_client(client), m_thread([this] { run(); }) {}
+
+    ~Flusher()
+    {
+        m_stopping = true;
+        m_thread.join();
+    }
+
+private:
+    void run()
+    {
+        while (!m_stopping)
+        {
+            uint64_t ullDeadline = m_client.flushDeadline();
+            uint64_t ullNow = nowMicroseconds();
+            if (ullDeadline && ullDeadline <= ullNow)
+            {
+                m_client.flush();
+                continue;
+            }
+            uint64_t ullWait = ullDeadline ? ullDeadline - ullNow : 100;
+            std::this_thread::sleep_for(std::chrono::microseconds(ullWait < 100 ? ullWait : 100));
+        }
+    }
+
+    DriverClient& m_client;
+    std::atomic<bool> m_stopping{false};
+    std::thread m_thread;
+};
+
+static const int SPEECH_PER_CALL = 8;
+
+static void sayAll(DriverClient& client, int calls, bool fBoundaries)
+{
+    std::string text = "row 3, column 2, Quarterly revenue, 4,120,000";
+    for (int i = 0; i < calls; i += 1)
+    {
+        client.send("speakBegin", NULL, "1", 1);
+        for (int j = 0; j < SPEECH_PER_CALL; j += 1)
+        {
+            client.send("speech", "seq=1", text.data(), text.size());
+        }
+        client.send("speakEnd", NULL, "1", 1, fBoundaries);
+    }
+}
+
+/**
+ * Run `workload` with a new client which batches messages.
+ *
+ * @returns {DriverClientStatistics} the client's statistics afterwards
+ */
+template <typename Workload>
+static DriverClientStatistics withBatching(const std::string& path, Workload workload)
+{
+    DriverClientBatching batching;
+    batching.cbMaxBatch = 64 * 1024;
+    batching.ulMinWindowUs = 250;
+    batching.ulMaxWindowUs = 1000;
+    batching.ulLatencyCapUs = 4000;
+
+    DriverClient client(path.c_str());
+    client.setBatching(batching);
+    Flusher flusher(client);
+    workload(client);
+    return client.statistics();
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int calls = options.quick ? 2000 : 20000;
+    int announcements = options.quick ? 5 : 20;
+    int messagesPerCall = SPEECH_PER_CALL + 2;
+    const char* directory = getenv("TMPDIR");
+    std::string path = std::string(directory ? directory : "/tmp") + "/bench-batching.socket";
+    CountingServer server(path);
+    uint64_t expected = 0;
+
+    server.start();
+
+    printf("\nsay-all: %d Speak calls of %d messages\n", calls, messagesPerCall);
+
+    DriverClient unbatched(path.c_str());
+    bench::measure("  unbatched, per message", 1, calls * messagesPerCall, [&] {
+        sayAll(unbatched, calls, true);
+    });
+    expected += calls * messagesPerCall;
+    bench::check(server.await(expected), "every unbatched message is received");
+    DriverClientStatistics plain = unbatched.statistics();
+
+    DriverClientStatistics batched = withBatching(path, [&](DriverClient& client) {
+        bench::measure("  batched, per message", 1, calls * messagesPerCall, [&] {
+            sayAll(client, calls, true);
+        });
+        expected += calls * messagesPerCall;
+        bench::check(server.await(expected), "every batched message is received");
+    });
+
+    DriverClientStatistics spanning = withBatching(path, [&](DriverClient& client) {
+        bench::measure("  batched across Speak calls, per message", 1, calls * messagesPerCall, [&] {
+            sayAll(client, calls, false);
+        });
+        expected += calls * messagesPerCall;
+        bench::check(server.await(expected), "every message batched across calls is received");
+    });
+
+    // Announcements follow pauses much longer than the batching window.
+    DriverClientStatistics interactive = withBatching(path, [&](DriverClient& client) {
+        std::string text = "Heading level 2, Navigation landmark";
+        for (int i = 0; i < announcements; i += 1)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            bench::check(client.send("speech", NULL, text.data(), text.size()) == AT_DRIVER_CLIENT_OK,
+                "an announcement which follows a pause is written at once");
+        }
+        expected += announcements;
+        bench::check(server.await(expected), "every announcement is received");
+    });
+
+    printf("  writes per message: unbatched %.3f, batched %.3f, across Speak calls %.3f\n",
+        (double)plain.ullWrites / plain.ullMessages,
+        (double)batched.ullWrites / batched.ullMessages,
+        (double)spanning.ullWrites / spanning.ullMessages);
+    printf("  batched:              %s\n", batched.describe().c_str());
+    printf("  across Speak calls:   %s\n", spanning.describe().c_str());
+    printf("  announcements:        %s\n", interactive.describe().c_str());
+
+    bench::check(batched.ullWrites < plain.ullWrites, "say-all is written in fewer writes when batched");
+    bench::check(spanning.ullWrites <= batched.ullWrites, "batches spanning Speak calls are no smaller");
+    bench::check(interactive.ullHeld == 0, "announcements are not delayed");
+
+    server.stop();
+
+    return 0;
+}
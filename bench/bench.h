@@ -0,0 +1,61 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Helpers shared by the benchmarks in this directory.
+ */
+namespace bench
+{
+    struct Options
+    {
+        bool quick = false;
+    };
+
+    inline Options parseOptions(int argc, char* argv[])
+    {
+        Options options;
+        for (int i = 1; i < argc; i += 1)
+        {
+            if (strcmp(argv[i], "--quick") == 0)
+            {
+                options.quick = true;
+            }
+        }
+        return options;
+    }
+
+    inline double nowNanoseconds()
+    {
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Invoke `operation` the given number of times and report the mean
+     * duration of each invocation divided by `unitsPerOperation`.
+     */
+    template <typename Operation>
+    double measure(const char* label, int iterations, double unitsPerOperation, Operation operation)
+    {
+        double start = nowNanoseconds();
+        for (int i = 0; i < iterations; i += 1)
+        {
+            operation();
+        }
+        double perUnit = (nowNanoseconds() - start) / iterations / unitsPerOperation;
+        printf("%-48s %12.1f ns\n", label, perUnit);
+        return perUnit;
+    }
+
+    inline void check(bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            fprintf(stderr, "check failed: %s\n", description);
+            exit(1);
+        }
+    }
+}
@@ -0,0 +1,234 @@
+/**
+ * Measures the cost of delivering bookmark events for documents which contain
+ * thousands of bookmarks (as produced by ARIA-AT's synchronization markup).
+ *
+ * The "per-bookmark" figures reproduce the engine's original strategy: one
+ * event interest query, one heap allocation and one `AddEvents` call for each
+ * bookmark. The "batched" figures use `SpeakPipeline`, which additionally
+ * reports each bookmark to the driver.
+ */
+#include "bench.h"
+#include "SpeakPipeline.h"
+#include "Utf8.h"
+#include <string>
+#include <vector>
+
+class CountingSite : public SpeakSite
+{
+public:
+    size_t interestQueries = 0;
+    size_t addEventsCalls = 0;
+    size_t events = 0;
+
+    uint32_t getActions() { return 0; }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        interestQueries += 1;
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents)
+    {
+        addEventsCalls += 1;
+        events += numEvents;
+        // Touch the strings as SAPI would when copying them.
+        for (size_t i = 0; i < numEvents; i += 1)
+        {
+            lastCharacter = pEvents[i].pText[0];
+        }
+        return S_OK;
+    }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+
+    char16_t lastCharacter = 0;
+};
+
+class NullSink : public MessageSink
+{
+public:
+    HRESULT emit(MessageType, const char*, size_t) { return S_OK; }
+};
+
+/**
+ * Records the speech and bookmark messages destined for the driver, one per
+ * line.
+ */
+class RecordingSink : public MessageSink
+{
+public:
+    std::string messages;
+    std::vector<std::string> begun;
+    std::vector<std::string> ended;
+
+    HRESULT emit(MessageType type, const char* pData, size_t cbData)
+    {
+        if (type == MessageType::SPEAK_BEGIN || type == MessageType::SPEAK_END)
+        {
+            (type == MessageType::SPEAK_BEGIN ? begun : ended).push_back(std::string(pData, cbData));
+        }
+        if (type == MessageType::SPEECH || type == MessageType::BOOKMARK)
+        {
+            bench::check(begun.size() == ended.size() + 1, "output is emitted within an utterance");
+            messages += type == MessageType::SPEECH ? "speech:" : "bookmark:";
+            messages.append(pData, cbData);
+            messages += "\n";
+        }
+        return S_OK;
+    }
+};
+
+class NullVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char*, size_t, SpeakSite&) { return S_OK; }
+};
+
+struct Document
+{
+    std::vector<std::u16string> text;
+    std::vector<SpeakFragment> fragments;
+    size_t bookmarks = 0;
+};
+
+/**
+ * @param {size_t} bookmarks - number of bookmark fragments
+ * @param {size_t} bookmarksPerSentence - consecutive bookmarks between
+ *                                        sentences of text
+ */
+static Document makeDocument(size_t bookmarks, size_t bookmarksPerSentence)
+{
+    Document document;
+    document.text.reserve(bookmarks * 2);
+
+    for (size_t i = 0; i < bookmarks; i += 1)
+    {
+        document.text.push_back(std::u16string(u"") + (char16_t)(u'0' + i % 10) + u"42");
+        document.fragments.push_back(SpeakFragment{FragmentAction::Bookmark, nullptr, 0, 0});
+
+        if ((i + 1) % bookmarksPerSentence == 0)
+        {
+            document.text.push_back(u"Heading level 2, Navigation landmark");
+            document.fragments.push_back(SpeakFragment{FragmentAction::Speak, nullptr, 0, 0});
+        }
+    }
+
+    for (size_t i = 0; i < document.fragments.size(); i += 1)
+    {
+        document.fragments[i].pTextStart = document.text[i].data();
+        document.fragments[i].ulTextLen = (uint32_t)document.text[i].size();
+    }
+    document.bookmarks = bookmarks;
+
+    return document;
+}
+
+/**
+ * The strategy used by the engine prior to the introduction of
+ * `SpeakPipeline`.
+ */
+static void speakPerBookmark(const Document& document, SpeakSite& site, MessageSink& sink,
+    Vocalizer& vocalizer)
+{
+    for (const SpeakFragment& fragment : document.fragments)
+    {
+        if (fragment.eAction != FragmentAction::Bookmark)
+        {
+            std::string part = toUtf8(fragment.pTextStart, fragment.ulTextLen);
+            sink.emit(MessageType::SPEECH, part.data(), part.size());
+            vocalizer.vocalize(part.data(), part.size(), site);
+            continue;
+        }
+
+        uint64_t interest;
+        site.getEventInterest(&interest);
+        if (interest & (1ull << SPEAK_EVENT_BOOKMARK))
+        {
+            std::string part = toUtf8(fragment.pTextStart, fragment.ulTextLen);
+            char16_t* copy = (char16_t*)calloc(fragment.ulTextLen + 1, sizeof(char16_t));
+            memcpy(copy, fragment.pTextStart, fragment.ulTextLen * sizeof(char16_t));
+            SpeakEvent event = {SPEAK_EVENT_BOOKMARK, 0, (uintptr_t)atol(part.c_str()), copy};
+            site.addEvents(&event, 1);
+            free(copy);
+        }
+    }
+}
+
+static void run(const char* name, size_t bookmarks, size_t bookmarksPerSentence, int iterations)
+{
+    Document document = makeDocument(bookmarks, bookmarksPerSentence);
+    NullSink sink;
+    NullVocalizer vocalizer;
+    SpeakPipeline pipeline(sink, vocalizer);
+    CountingSite legacySite, batchedSite;
+    std::string label;
+
+    printf("\n%s (%zu bookmarks, %zu fragments)\n", name, bookmarks, document.fragments.size());
+
+    label = "  per-bookmark, per bookmark";
+    bench::measure(label.c_str(), iterations, (double)bookmarks, [&] {
+        speakPerBookmark(document, legacySite, sink, vocalizer);
+    });
+    label = "  batched, per bookmark";
+    bench::measure(label.c_str(), iterations, (double)bookmarks, [&] {
+        pipeline.speak(document.fragments.data(), document.fragments.size(), batchedSite);
+    });
+
+    printf("  interest queries per Speak: %zu -> %zu\n",
+        legacySite.interestQueries / iterations, batchedSite.interestQueries / iterations);
+    printf("  AddEvents calls per Speak:  %zu -> %zu\n",
+        legacySite.addEventsCalls / iterations, batchedSite.addEventsCalls / iterations);
+
+    bench::check(batchedSite.events == legacySite.events, "both strategies deliver every bookmark");
+    bench::check(batchedSite.interestQueries == (size_t)iterations, "interest is queried once per Speak");
+}
+
+/**
+ * Bookmarks are reported to the driver in order with the surrounding speech,
+ * whether or not the output site is interested in them, and each call to
+ * `speak` is bracketed by the beginning and end of an utterance.
+ */
+static void checkDriverMessages()
+{
+    std::u16string first = u"First sentence.";
+    std::u16string mark = u"marker-1";
+    std::u16string second = u"Second sentence.";
+    std::vector<SpeakFragment> fragments = {
+        SpeakFragment{FragmentAction::Speak, first.data(), (uint32_t)first.size(), 0},
+        SpeakFragment{FragmentAction::Bookmark, mark.data(), (uint32_t)mark.size(), 0},
+        SpeakFragment{FragmentAction::Speak, second.data(), (uint32_t)second.size(), 0},
+    };
+
+    RecordingSink sink;
+    NullVocalizer vocalizer;
+    SpeakPipeline pipeline(sink, vocalizer);
+    CountingSite site;
+    bench::check(SUCCEEDED(pipeline.speak(fragments.data(), fragments.size(), site)), "speak succeeds");
+    bench::check(sink.messages == "speech:First sentence.\nbookmark:marker-1\nspeech:Second sentence.\n",
+        "bookmarks are reported to the driver in order");
+
+    bench::check(SUCCEEDED(pipeline.speak(fragments.data(), 1, site)), "speak succeeds");
+    bench::check(sink.begun.size() == 2 && sink.begun == sink.ended, "every utterance which begins ends");
+    bench::check(sink.begun[0] != sink.begun[1], "utterance ids are unique");
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int iterations = options.quick ? 2 : 200;
+    size_t bookmarks = options.quick ? 500 : 5000;
+
+    run("bookmark per sentence", bookmarks, 1, iterations);
+    run("bookmarks in runs of 16", bookmarks, 16, iterations);
+    run("bookmarks only", bookmarks, bookmarks, iterations);
+
+    checkDriverMessages();
+
+    return 0;
+}
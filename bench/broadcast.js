@@ -0,0 +1,203 @@
+/**
+ * Measures the rate at which the server delivers captured output to 1 to 100
+ * subscribers over loopback WebSocket connections, with each message sent in
+ * its own frame and with bursts of output batched.
+ *
+ * The voice emits speech in bursts (for instance, when a screen reader reads
+ * a table row), so output is published in bursts of several messages. Every
+ * subscriber must receive every message.
+ *
+ * A further run stops one subscriber from reading and reports the data which
+ * the server holds for it, with and without watermarks.
+ *
+ * Usage: node bench/broadcast.js [--quick]
+ */
+'use strict';
+
+const { WebSocket, WebSocketServer } = require('ws');
+
+const { OutputBroadcaster } = require('../lib/output-broadcaster');
+
+const quick = process.argv.includes('--quick');
+const SUBSCRIBERS = quick ? [1, 10] : [1, 10, 25, 50, 100];
+const MESSAGES = quick ? 2000 : 20000;
+const BURST = 20;
+const TEXT = 'row 3, column 2, Quarterly revenue, 4,120,000';
+// Enough to fill the kernel's socket buffers for a subscriber which stops
+// reading.
+const STALLED_MESSAGES = 400000;
+
+const check = (condition, description) => {
+  if (!condition) {
+    console.error(`check failed: ${description}`);
+    process.exit(1);
+  }
+};
+
+const delay = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+/**
+ * @param {WebSocket} client
+ * @param {function(number): void} onMessages - receives the number of
+ *                                              messages of output in each
+ *                                              frame
+ */
+const countOutput = (client, onMessages) => {
+  client.on('message', data => {
+    const { method, params } = JSON.parse(data);
+    if (method === 'interaction.capturedOutput') {
+      onMessages(params.batch ? params.batch.length : 1);
+    } else if (method === 'interaction.capturedOutputDropped') {
+      onMessages(params.count);
+    }
+  });
+};
+
+const startServer = async () => {
+  const server = new WebSocketServer({ port: 0, clientTracking: true });
+  server.on('connection', websocket => (websocket.sessionId = 'bench'));
+  await new Promise(resolve => server.once('listening', resolve));
+  return server;
+};
+
+/**
+ * @param {WebSocketServer} server
+ * @param {number} count
+ *
+ * @returns {Promise<WebSocket[]>}
+ */
+const connect = async (server, count) => {
+  const url = `ws://127.0.0.1:${server.address().port}`;
+  const clients = await Promise.all(
+    Array.from({ length: count }, async () => {
+      const client = new WebSocket(url);
+      await new Promise((resolve, reject) => {
+        client.once('open', resolve);
+        client.once('error', reject);
+      });
+      return client;
+    }),
+  );
+  while (server.clients.size < count) {
+    await delay(1);
+  }
+  return clients;
+};
+
+/**
+ * @returns {Promise<{rate: number, frames: number}>} messages delivered per
+ *                                                    second (summed over
+ *                                                    subscribers) and frames
+ *                                                    received per subscriber
+ */
+const measure = async (subscribers, batchWindow) => {
+  const server = await startServer();
+  const broadcaster = new OutputBroadcaster(() => server.clients, {
+    batchWindow,
+    highWatermark: Infinity,
+    lowWatermark: 0,
+  });
+  const clients = await connect(server, subscribers);
+
+  let remaining = subscribers * MESSAGES;
+  let frames = 0;
+  const done = new Promise(resolve => {
+    for (const client of clients) {
+      countOutput(client, count => {
+        frames += 1;
+        remaining -= count;
+        if (remaining === 0) {
+          resolve();
+        }
+      });
+    }
+  });
+
+  const start = process.hrtime.bigint();
+  for (let sent = 0; sent < MESSAGES; sent += BURST) {
+    for (let i = 0; i < BURST; i += 1) {
+      broadcaster.output(TEXT);
+    }
+    // Yield between bursts, as the server does between messages from the
+    // voice.
+    await new Promise(resolve => setImmediate(resolve));
+  }
+  broadcaster.flush();
+  await done;
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+
+  broadcaster.close();
+  clients.forEach(client => client.terminate());
+  await new Promise(resolve => server.close(resolve));
+  check(remaining === 0, 'every subscriber receives every message');
+  return { rate: (subscribers * MESSAGES) / seconds, frames: frames / subscribers };
+};
+
+/**
+ * @returns {Promise<number>} the greatest number of bytes awaiting
+ *                            transmission to a subscriber which stopped
+ *                            reading
+ */
+const measureStalledSubscriber = async options => {
+  const server = await startServer();
+  const broadcaster = new OutputBroadcaster(() => server.clients, { batchWindow: 0, ...options });
+  // Sends to the stalled subscriber fail when it is terminated.
+  broadcaster.on('error', () => {});
+  const [stalled, healthy] = await connect(server, 2);
+  stalled._socket.pause();
+  let received = 0;
+  countOutput(healthy, count => (received += count));
+
+  const [serverSide] = [...server.clients].filter(
+    websocket => websocket._socket.remotePort === stalled._socket.localPort,
+  );
+  let peak = 0;
+  for (let sent = 0; sent < STALLED_MESSAGES; sent += BURST) {
+    for (let i = 0; i < BURST; i += 1) {
+      broadcaster.output(TEXT);
+    }
+    peak = Math.max(peak, serverSide.bufferedAmount);
+    await new Promise(resolve => setImmediate(resolve));
+  }
+  while (received < STALLED_MESSAGES) {
+    await delay(1);
+  }
+
+  broadcaster.close();
+  stalled.terminate();
+  healthy.terminate();
+  await new Promise(resolve => server.close(resolve));
+  return peak;
+};
+
+const main = async () => {
+  console.log(`Delivering ${MESSAGES} messages in bursts of ${BURST}`);
+  console.log('  subscribers   unbatched msg/s   batched msg/s   frames/subscriber');
+  for (const subscribers of SUBSCRIBERS) {
+    const unbatched = await measure(subscribers, 0);
+    const batched = await measure(subscribers, 5);
+    console.log(
+      `  ${String(subscribers).padStart(11)}   ${unbatched.rate.toFixed(0).padStart(15)}` +
+        `   ${batched.rate.toFixed(0).padStart(13)}   ${batched.frames.toFixed(0).padStart(17)}`,
+    );
+    check(batched.frames < unbatched.frames, 'bursts are batched');
+  }
+
+  console.log('\nData held for a subscriber which stops reading');
+  const unbounded = await measureStalledSubscriber({ highWatermark: Infinity, lowWatermark: 0 });
+  console.log(`  no watermark                  ${(unbounded / 1024).toFixed(0).padStart(8)} KB`);
+  const highWatermark = 64 * 1024;
+  const bounded = await measureStalledSubscriber({
+    highWatermark,
+    lowWatermark: 16 * 1024,
+    laggingClientPolicy: 'drop',
+  });
+  console.log(`  64 KB high watermark (drop)   ${(bounded / 1024).toFixed(0).padStart(8)} KB`);
+  // The frame which crosses the watermark is the last one buffered.
+  check(bounded <= highWatermark + 1024, 'a lagging subscriber is not sent more output');
+};
+
+main().catch(error => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,212 @@
+#pragma once
+#include "bench.h"
+#include <atomic>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Stands in for the driver: accepts any number of connections and counts the
+ * messages received. A connection which closes without having terminated any
+ * message is counted as one message, as the driver does. The data received on
+ * each connection may also be recorded, and data may be sent on every
+ * connection, as the driver sends settings to the voice.
+ */
+class CountingServer
+{
+public:
+    explicit CountingServer(const std::string& path) : m_path(path) {}
+
+    ~CountingServer()
+    {
+        stop();
+    }
+
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+
+    /** Record the data received on connections accepted from now on. */
+    void record()
+    {
+        m_recording = true;
+    }
+
+    /** @returns the data received on each recorded connection, in order */
+    std::vector<std::string> recorded()
+    {
+        std::lock_guard<std::mutex> lock(m_recordedMutex);
+        return m_recorded;
+    }
+
+    /** Send `data` on every open connection. */
+    void broadcast(const std::string& data)
+    {
+        std::lock_guard<std::mutex> lock(m_outgoingMutex);
+        m_outgoing.append(data);
+    }
+
+    void start()
+    {
+        unlink(m_path.c_str());
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, m_path.c_str(), sizeof(address.sun_path) - 1);
+        m_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        bench::check(bind(m_listener, (const sockaddr*)&address, sizeof(address)) == 0, "server binds");
+        bench::check(listen(m_listener, 128) == 0, "server listens");
+        m_stopping = false;
+        m_thread = std::thread([this] { run(); });
+    }
+
+    void stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_stopping = true;
+            m_thread.join();
+            close(m_listener);
+            unlink(m_path.c_str());
+        }
+    }
+
+    /** Wait until the given number of messages has been received. */
+    bool await(uint64_t count)
+    {
+        for (int i = 0; i < 5000 && messages < count; i += 1)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return messages == count;
+    }
+
+private:
+    struct Connection
+    {
+        int fd;
+        bool framed;
+        size_t unterminated;
+        // Index into `m_recorded`, if the connection is recorded.
+        size_t recording;
+    };
+
+    void run()
+    {
+        std::vector<Connection> connections;
+        std::vector<pollfd> fds;
+        char buffer[65536];
+
+        while (!m_stopping)
+        {
+            fds.assign(1, pollfd{m_listener, POLLIN, 0});
+            for (const Connection& connection : connections)
+            {
+                fds.push_back(pollfd{connection.fd, POLLIN, 0});
+            }
+            std::string outgoing;
+            {
+                std::lock_guard<std::mutex> lock(m_outgoingMutex);
+                outgoing.swap(m_outgoing);
+            }
+            for (const Connection& connection : connections)
+            {
+                for (size_t cbSent = 0; cbSent < outgoing.size();)
+                {
+                    ssize_t cbChunk =
+                        send(connection.fd, outgoing.data() + cbSent, outgoing.size() - cbSent, MSG_NOSIGNAL);
+                    if (cbChunk <= 0)
+                    {
+                        break;
+                    }
+                    cbSent += (size_t)cbChunk;
+                }
+            }
+
+            if (poll(fds.data(), fds.size(), 10) <= 0)
+            {
+                continue;
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                size_t recording = SIZE_MAX;
+                if (m_recording)
+                {
+                    std::lock_guard<std::mutex> lock(m_recordedMutex);
+                    recording = m_recorded.size();
+                    m_recorded.emplace_back();
+                }
+                connections.push_back(Connection{accept(m_listener, NULL, NULL), false, 0, recording});
+            }
+
+            for (size_t i = 1; i < fds.size(); i += 1)
+            {
+                if (!(fds[i].revents & (POLLIN | POLLHUP)))
+                {
+                    continue;
+                }
+                Connection& connection = connections[i - 1];
+                ssize_t cbRead = read(connection.fd, buffer, sizeof(buffer));
+                if (cbRead <= 0)
+                {
+                    if (!connection.framed && connection.unterminated)
+                    {
+                        messages += 1;
+                    }
+                    close(connection.fd);
+                    connection.fd = -1;
+                    continue;
+                }
+                bytes += cbRead;
+                if (connection.recording != SIZE_MAX)
+                {
+                    std::lock_guard<std::mutex> lock(m_recordedMutex);
+                    m_recorded[connection.recording].append(buffer, cbRead);
+                }
+                const char* pEnd = buffer + cbRead;
+                const char* pTerminator;
+                for (const char* p = buffer; p < pEnd; p = pTerminator + 1)
+                {
+                    pTerminator = (const char*)memchr(p, '\0', pEnd - p);
+                    if (!pTerminator)
+                    {
+                        connection.unterminated += pEnd - p;
+                        break;
+                    }
+                    messages += 1;
+                    connection.framed = true;
+                    connection.unterminated = 0;
+                }
+            }
+
+            size_t kept = 0;
+            for (const Connection& connection : connections)
+            {
+                if (connection.fd >= 0)
+                {
+                    connections[kept++] = connection;
+                }
+            }
+            connections.resize(kept);
+        }
+
+        for (const Connection& connection : connections)
+        {
+            close(connection.fd);
+        }
+    }
+
+    std::string m_path;
+    int m_listener = -1;
+    std::atomic<bool> m_stopping{false};
+    std::thread m_thread;
+    std::atomic<bool> m_recording{false};
+    std::mutex m_recordedMutex;
+    std::vector<std::string> m_recorded;
+    std::mutex m_outgoingMutex;
+    std::string m_outgoing;
+};
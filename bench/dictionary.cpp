@@ -0,0 +1,191 @@
+/**
+ * Measures the bytes which `DriverClient` writes for screen reader transcripts,
+ * with and without the dictionary through which repeated speech is sent by
+ * reference, and the cost of coding it.
+ *
+ * Each transcript (a text file holding one speech message per line) is sent
+ * several times over, as a session which runs the same tests repeatedly
+ * would send it. The data received is decoded as the driver decodes it, with
+ * a dictionary per connection, and compared with the messages sent.
+ *
+ * Usage: bench-dictionary [--quick] <transcript>...
+ */
+#include "bench.h"
+#include "counting_server.h"
+#include "DriverClient.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const uint32_t DICTIONARY_ENTRIES = 1024;
+
+static DriverClientDictionary dictionaryOf(uint32_t ulEntries)
+{
+    DriverClientDictionary dictionary;
+    dictionary.ulEntries = ulEntries;
+    dictionary.cbMinEntry = 8;
+    dictionary.cbMaxEntry = 256;
+    return dictionary;
+}
+
+/**
+ * Decode the data received on one connection as the driver does.
+ *
+ * @returns {bool} whether every reference named a defined entry
+ */
+static bool decode(const std::string& received, std::vector<std::string>* pMessages)
+{
+    std::vector<std::string> dictionary(DICTIONARY_ENTRIES);
+    std::vector<bool> defined(DICTIONARY_ENTRIES);
+    for (size_t start = 0; start < received.size();)
+    {
+        size_t end = received.find('\0', start);
+        size_t separator = received.find(':', start);
+        std::string header = received.substr(start, separator - start);
+        std::string data = received.substr(separator + 1, end - separator - 1);
+        size_t attribute;
+        if ((attribute = header.find(" ref=")) != std::string::npos)
+        {
+            size_t entry = strtoul(header.c_str() + attribute + 5, NULL, 10);
+            if (entry >= DICTIONARY_ENTRIES || !defined[entry])
+            {
+                return false;
+            }
+            data = dictionary[entry];
+        }
+        else if ((attribute = header.find(" def=")) != std::string::npos)
+        {
+            size_t entry = strtoul(header.c_str() + attribute + 5, NULL, 10);
+            if (entry >= DICTIONARY_ENTRIES)
+            {
+                return false;
+            }
+            dictionary[entry] = data;
+            defined[entry] = true;
+        }
+        pMessages->push_back(data);
+        start = end + 1;
+    }
+    return true;
+}
+
+/**
+ * Send every message, disconnecting after `disconnectAfter` of them if
+ * given, and wait for the server to receive them.
+ */
+static DriverClientStatistics sendAll(CountingServer& server, const char* pPath,
+    const std::vector<std::string>& messages, const DriverClientDictionary* pDictionary,
+    size_t disconnectAfter = SIZE_MAX)
+{
+    uint64_t expected = server.messages + messages.size();
+    DriverClient client(pPath);
+    if (pDictionary)
+    {
+        client.setDictionary(*pDictionary);
+    }
+    char attributes[64];
+    for (size_t i = 0; i < messages.size(); i += 1)
+    {
+        if (i == disconnectAfter)
+        {
+            client.disconnect();
+        }
+        snprintf(attributes, sizeof(attributes), "seq=%zu t=%llu", 1000 + i, 5081221000ULL + i * 1000);
+        client.send("speech", attributes, messages[i].data(), messages[i].size());
+    }
+    bench::check(server.await(expected), "every message is received");
+    return client.statistics();
+}
+
+/** @returns {bool} whether the recorded connections decode to `messages` */
+static bool decodesTo(const std::vector<std::string>& received, const std::vector<std::string>& messages)
+{
+    std::vector<std::string> decoded;
+    for (const std::string& connection : received)
+    {
+        if (!decode(connection, &decoded))
+        {
+            return false;
+        }
+    }
+    return decoded == messages;
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int repeats = options.quick ? 4 : 100;
+
+    std::vector<std::string> transcript;
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (argv[i][0] == '-')
+        {
+            continue;
+        }
+        std::ifstream file(argv[i]);
+        bench::check(file.good(), "the transcript can be read");
+        for (std::string line; std::getline(file, line);)
+        {
+            if (!line.empty())
+            {
+                transcript.push_back(line);
+            }
+        }
+    }
+    bench::check(!transcript.empty(), "usage: bench-dictionary [--quick] <transcript>...");
+
+    std::vector<std::string> messages;
+    for (int i = 0; i < repeats; i += 1)
+    {
+        messages.insert(messages.end(), transcript.begin(), transcript.end());
+    }
+
+    const char* directory = getenv("TMPDIR");
+    std::string path = std::string(directory ? directory : "/tmp") + "/bench-dictionary.socket";
+    CountingServer server(path);
+    server.start();
+
+    printf("\n%zu messages (%zu per transcript, repeated %d times)\n", messages.size(), transcript.size(),
+        repeats);
+
+    DriverClientStatistics plain;
+    bench::measure("  uncoded, per message", 1, messages.size(), [&] {
+        plain = sendAll(server, path.c_str(), messages, NULL);
+    });
+
+    DriverClientDictionary dictionary = dictionaryOf(DICTIONARY_ENTRIES);
+    DriverClientStatistics coded;
+    server.record();
+    bench::measure("  coded, per message", 1, messages.size(), [&] {
+        coded = sendAll(server, path.c_str(), messages, &dictionary);
+    });
+    bench::check(decodesTo(server.recorded(), messages), "coded messages decode to those sent");
+
+    printf("  bytes per message: uncoded %.1f, coded %.1f (%.0f%%), references %.0f%%\n",
+        (double)plain.ullBytesWritten / messages.size(), (double)coded.ullBytesWritten / messages.size(),
+        100.0 * coded.ullBytesWritten / plain.ullBytesWritten, 100.0 * coded.ullReferences / messages.size());
+    bench::check(coded.ullBytesWritten < plain.ullBytesWritten, "coded messages are smaller");
+
+    // A new connection begins with an empty dictionary on both sides.
+    CountingServer reconnecting(path + "-2");
+    reconnecting.start();
+    reconnecting.record();
+    sendAll(reconnecting, (path + "-2").c_str(), messages, &dictionary, messages.size() / 2);
+    std::vector<std::string> connections = reconnecting.recorded();
+    bench::check(connections.size() == 2, "the client reconnects");
+    bench::check(decodesTo(connections, messages), "messages coded across connections decode to those sent");
+
+    // Entries are replaced once every entry is in use.
+    CountingServer evicting(path + "-3");
+    evicting.start();
+    evicting.record();
+    DriverClientDictionary small = dictionaryOf(8);
+    DriverClientStatistics evicted = sendAll(evicting, (path + "-3").c_str(), messages, &small);
+    bench::check(decodesTo(evicting.recorded(), messages),
+        "messages coded with a small dictionary decode to those sent");
+    printf("  with %u entries:   coded %.1f bytes per message\n", small.ulEntries,
+        (double)evicted.ullBytesWritten / messages.size());
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * Measures the cost of delivering messages to the driver over a Unix domain
+ * socket.
+ *
+ * The "connection per message" figures reproduce the strategy which the
+ * engine and the macOS service used previously: connect, write one message
+ * and close. The remaining figures use `DriverClient`, from one thread and
+ * from several threads at once (where concurrent messages are coalesced into
+ * shared writes).
+ */
+#include "bench.h"
+#include "counting_server.h"
+#include "DriverClient.h"
+#include <atomic>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static void sendWithConnection(const std::string& path, const std::string& message)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (const sockaddr*)&address, sizeof(address)) == 0)
+    {
+        ssize_t cbWritten = write(fd, message.data(), message.size());
+        (void)cbWritten;
+    }
+    close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int messages = options.quick ? 2000 : 100000;
+    const int threads = 4;
+    const char* directory = getenv("TMPDIR");
+    std::string path = std::string(directory ? directory : "/tmp") + "/bench-driver-client.socket";
+    std::string text = "Heading level 2, Navigation landmark";
+    CountingServer server(path);
+    uint64_t expected = 0;
+
+    server.start();
+
+    printf("\n%d messages\n", messages);
+    bench::measure("  connection per message, per message", 1, messages, [&] {
+        for (int i = 0; i < messages; i += 1)
+        {
+            sendWithConnection(path, "speech:" + text);
+        }
+    });
+    expected += messages;
+    bench::check(server.await(expected), "every message is received");
+
+    DriverClient client(path.c_str());
+    bench::measure("  persistent connection, per message", 1, messages, [&] {
+        for (int i = 0; i < messages; i += 1)
+        {
+            client.send("speech", NULL, text.data(), text.size());
+        }
+    });
+    expected += messages;
+    bench::check(server.await(expected), "every message is received");
+
+    DriverClientStatistics before = client.statistics();
+    std::atomic<int> unavailable(0);
+    bench::measure("  persistent connection, 4 threads, per message", 1, messages, [&] {
+        std::vector<std::thread> senders;
+        for (int t = 0; t < threads; t += 1)
+        {
+            senders.emplace_back([&] {
+                for (int i = 0; i < messages / threads; i += 1)
+                {
+                    if (client.send("speech", "seq=1", text.data(), text.size()) == AT_DRIVER_CLIENT_QUEUED)
+                    {
+                        unavailable += 1;
+                    }
+                }
+            });
+        }
+        for (std::thread& sender : senders)
+        {
+            sender.join();
+        }
+        client.flush();
+    });
+
+    // Messages which do not fit in the client's buffer are dropped rather
+    // than blocking the sender.
+    DriverClientStatistics after = client.statistics();
+    expected += messages / threads * threads - (after.ullDropped - before.ullDropped);
+    bench::check(server.await(expected), "every concurrent message which was accepted is received");
+    printf("  writes per message with 4 threads: %.3f (%llu dropped)\n",
+        (double)(after.ullWrites - before.ullWrites) / (after.ullMessages - before.ullMessages),
+        (unsigned long long)(after.ullDropped - before.ullDropped));
+    bench::check(after.ullConnects == 1, "the connection is reused");
+    // A message written by another thread is coalesced, not queued.
+    bench::check(unavailable == 0, "contention is not reported as the driver being unavailable");
+
+    // Messages sent while the driver is unavailable are delivered once it
+    // returns.
+    server.stop();
+    int queued = 0;
+    for (int i = 0; i < 10; i += 1)
+    {
+        queued += client.send("speech", NULL, text.data(), text.size()) == AT_DRIVER_CLIENT_QUEUED;
+    }
+    bench::check(queued > 0, "messages are queued while the driver is unavailable");
+
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(DriverClient::MAXIMUM_BACKOFF_MS / 50));
+    for (int i = 0; i < 400 && client.flush() != AT_DRIVER_CLIENT_OK; i += 1)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    expected += 10;
+    bench::check(server.await(expected), "queued messages are delivered after reconnecting");
+    bench::check(client.statistics().ullConnects == 2, "the client reconnects");
+
+    // The C interface produces the same framing.
+    ATDriverClient* cClient = at_driver_client_create(path.c_str());
+    bench::check(at_driver_client_send(cClient, "lifecycle", "hello", 5) == AT_DRIVER_CLIENT_OK,
+        "the C interface delivers messages");
+    at_driver_client_destroy(cClient);
+    expected += 1;
+    bench::check(server.await(expected), "C interface messages are received");
+
+    server.stop();
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+/**
+ * Measures the aggregate rate at which a coordinator merges the captured
+ * output of 1 to 8 drivers and delivers it to a client (see `at-driver
+ * coordinate`), with each driver in its own process on this host.
+ *
+ * Each driver captures its messages in bursts, as quickly as its connection
+ * to the coordinator accepts them. A run completes once the client has
+ * received every message of every driver; each driver's messages must arrive
+ * in order, tagged with the driver's name, and the merged stream must be
+ * ordered by time.
+ *
+ * Messages which the coordinator releases after a later message of another
+ * driver are counted as late. They arise when a driver's messages take longer
+ * than the merge window to reach the coordinator, as when several busy
+ * drivers share fewer cores than there are drivers.
+ *
+ * Usage: node bench/federation.js [--quick]
+ */
+'use strict';
+
+const { fork } = require('child_process');
+const { WebSocket } = require('ws');
+
+const { createCoordinator } = require('../lib/federation-coordinator');
+const { FederationUplink } = require('../lib/federation-uplink');
+
+const quick = process.argv.includes('--quick');
+const HOSTS = quick ? [1, 2] : [1, 2, 4, 8];
+const MESSAGES = quick ? 5000 : 50000;
+const BURST = 20;
+const TEXT = 'row 3, column 2, Quarterly revenue, 4,120,000';
+// Bytes awaiting transmission beyond which a driver waits for its
+// connection to drain, rather than discarding output.
+const MAX_BUFFERED = 64 * 1024;
+
+const check = (condition, description) => {
+  if (!condition) {
+    console.error(`check failed: ${description}`);
+    process.exit(1);
+  }
+};
+
+/**
+ * @param {number} port - the coordinator's federation port
+ * @param {string} name
+ * @param {number} count
+ */
+const runHost = (port, name, count) => {
+  const uplink = new FederationUplink({ host: '127.0.0.1', port }, { name, accept: () => {} });
+  process.on('message', () => {
+    let sent = 0;
+    const burst = () => {
+      while (sent < count) {
+        if (uplink.bufferedAmount > MAX_BUFFERED) {
+          uplink.once('drain', burst);
+          return;
+        }
+        for (const end = Math.min(sent + BURST, count); sent < end; sent += 1) {
+          uplink.output(`${sent} ${TEXT}`);
+        }
+        // Each burst is captured in its own turn of the event loop, as
+        // speech arrives from the voice.
+        setImmediate(burst);
+        return;
+      }
+    };
+    burst();
+  });
+  process.on('disconnect', () => process.exit(0));
+};
+
+/**
+ * @param {number} hosts
+ *
+ * @returns {Promise<{rate: number, cpuPerMessage: number, late: number}>}
+ *          messages delivered per second across all drivers, the
+ *          coordinator's CPU time per message in microseconds (including
+ *          that of the client, which shares its process) and the number of
+ *          messages released out of order
+ */
+const measure = async hosts => {
+  const coordinator = await createCoordinator(0, { federationPort: 0 });
+  const federationPort = coordinator.federation.address().port;
+  const names = Array.from({ length: hosts }, (_, index) => `host-${index + 1}`);
+
+  const client = new WebSocket(`ws://localhost:${coordinator.address().port}/session`);
+  await new Promise(resolve => client.once('open', resolve));
+  client.send(JSON.stringify({ id: 1, method: 'session.new', params: {} }));
+  await new Promise(resolve => client.once('message', resolve));
+
+  let joined = 0;
+  const allJoined = new Promise(resolve =>
+    coordinator.on('hostConnected', () => ++joined === hosts && resolve(undefined)),
+  );
+  const children = names.map(name =>
+    fork(__filename, ['--host', String(federationPort), name, String(MESSAGES)]),
+  );
+  await allJoined;
+
+  /** @type {Map<string, number>} */
+  const received = new Map(names.map(name => [name, 0]));
+  let total = 0;
+  let lastTime = -Infinity;
+  let ordered = true;
+  let inSequence = true;
+  const finished = new Promise(resolve => {
+    client.on('message', data => {
+      const { method, params } = JSON.parse(data);
+      if (method !== 'interaction.capturedOutput') {
+        return;
+      }
+      ordered = ordered && params.time >= lastTime;
+      lastTime = params.time;
+      for (const text of params.batch || [params.data]) {
+        const expected = received.get(params.host);
+        inSequence = inSequence && text === `${expected} ${TEXT}`;
+        received.set(params.host, expected + 1);
+      }
+      total += params.batch ? params.batch.length : 1;
+      if (total === hosts * MESSAGES) {
+        resolve(undefined);
+      }
+    });
+  });
+
+  const cpuBefore = process.cpuUsage();
+  const begin = process.hrtime.bigint();
+  children.forEach(child => child.send('go'));
+  await finished;
+  const seconds = Number(process.hrtime.bigint() - begin) / 1e9;
+  const cpu = process.cpuUsage(cpuBefore);
+
+  check(inSequence, `each driver's messages arrive in order (${hosts} drivers)`);
+  check(
+    ordered || coordinator.merged.late > 0,
+    `the merged stream is ordered by time, but for late messages (${hosts} drivers)`,
+  );
+  check(
+    names.every(name => received.get(name) === MESSAGES),
+    `every message of every driver is delivered (${hosts} drivers)`,
+  );
+
+  const late = coordinator.merged.late;
+  client.close();
+  await new Promise(resolve => client.once('close', resolve));
+  children.forEach(child => child.kill());
+  await new Promise(resolve => coordinator.close(resolve));
+  return {
+    rate: (hosts * MESSAGES) / seconds,
+    cpuPerMessage: (cpu.user + cpu.system) / (hosts * MESSAGES),
+    late,
+  };
+};
+
+const main = async () => {
+  console.log(`Merging ${MESSAGES} messages from each driver (bursts of ${BURST})`);
+  console.log('  drivers   total msg/s   msg/s per driver   coordinator us/msg   late');
+  for (const hosts of HOSTS) {
+    const { rate, cpuPerMessage, late } = await measure(hosts);
+    console.log(
+      `  ${String(hosts).padStart(7)}   ${rate.toFixed(0).padStart(11)}` +
+        `   ${(rate / hosts).toFixed(0).padStart(16)}` +
+        `   ${cpuPerMessage.toFixed(2).padStart(18)}   ${String(late).padStart(4)}`,
+    );
+  }
+};
+
+if (process.argv[2] === '--host') {
+  runHost(Number(process.argv[3]), process.argv[4], Number(process.argv[5]));
+} else {
+  main().catch(error => {
+    console.error(error);
+    process.exit(1);
+  });
+}
@@ -0,0 +1,98 @@
+/**
+ * Measures the cost of recording captured output in the history and of
+ * retrieving it from a cursor, as the history grows, compared with an array
+ * of numbered messages from which the oldest are shifted and in which a
+ * cursor is found by searching.
+ *
+ * Usage: node bench/history.js [--quick]
+ */
+'use strict';
+
+const { performance } = require('perf_hooks');
+
+const { OutputHistory } = require('../lib/output-history');
+
+const quick = process.argv.includes('--quick');
+const SIZES = quick ? [1000, 20000] : [1000, 10000, 100000];
+const APPENDS = quick ? 100000 : 500000;
+const SEEKS = quick ? 2000 : 20000;
+const RANGE = 32;
+const TEXT = 'row 3, column 2, Quarterly revenue, 4,120,000';
+// The bytes which the history accounts to each message.
+const MESSAGE_SIZE = 48 + 2 * TEXT.length;
+
+const check = (condition, description) => {
+  if (!condition) {
+    console.error(`check failed: ${description}`);
+    process.exit(1);
+  }
+};
+
+class ShiftedArray {
+  constructor(capacity) {
+    this.capacity = capacity;
+    /** @type {{seq: number, data: string}[]} */
+    this.messages = [];
+    this.next = 0;
+  }
+
+  append(data) {
+    this.messages.push({ seq: this.next, data });
+    this.next += 1;
+    if (this.messages.length > this.capacity) {
+      this.messages.shift();
+    }
+  }
+
+  since(cursor, limit) {
+    const start = this.messages.findIndex(({ seq }) => seq >= cursor);
+    return { output: start === -1 ? [] : this.messages.slice(start, start + limit) };
+  }
+}
+
+/** @returns {number} nanoseconds per call */
+const time = (count, body) => {
+  const start = performance.now();
+  for (let i = 0; i < count; i += 1) {
+    body(i);
+  }
+  return ((performance.now() - start) * 1e6) / count;
+};
+
+const measure = (size, create) => {
+  const history = create(size);
+  const append = time(APPENDS, () => history.append(TEXT));
+  // Cursors are spread over the retained output, as clients resuming after
+  // different delays would request them.
+  const first = APPENDS - size;
+  let returned = 0;
+  const seek = time(SEEKS, i => {
+    const cursor = first + ((i * 7919) % size);
+    returned += history.since(cursor, RANGE).output.length;
+  });
+  check(returned > 0, 'output is returned');
+  return { history, append, seek };
+};
+
+console.log(`\n${APPENDS} messages appended, ${RANGE} retrieved from each of ${SEEKS} cursors:`);
+console.log(
+  `  ${'retained'.padStart(8)} ${'append (ns)'.padStart(24)} ${'retrieve (ns)'.padStart(24)}`,
+);
+console.log(
+  `  ${''.padStart(8)} ${'ring'.padStart(12)}${'array'.padStart(12)}` +
+    `${'ring'.padStart(12)}${'array'.padStart(12)}`,
+);
+let last;
+for (const size of SIZES) {
+  const ring = measure(size, () => new OutputHistory({ maxBytes: size * MESSAGE_SIZE }));
+  const array = measure(size, () => new ShiftedArray(size));
+  check(ring.history.length === size, `${size}: the ring retains ${size} messages`);
+  check(ring.history.bytes <= size * MESSAGE_SIZE, `${size}: the ring stays within its size`);
+  console.log(
+    `  ${String(size).padStart(8)} ${ring.append.toFixed(0).padStart(12)}` +
+      `${array.append.toFixed(0).padStart(12)}${ring.seek.toFixed(0).padStart(12)}` +
+      `${array.seek.toFixed(0).padStart(12)}`,
+  );
+  last = { ring, array };
+}
+check(last.ring.seek < last.array.seek, 'the ring locates cursors faster when it is large');
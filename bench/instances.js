@@ -0,0 +1,166 @@
+/**
+ * Measures the aggregate rate at which the driver accepts captured output
+ * from several instances of the voice, as when several screen reader
+ * sessions share one host (see `serve --instances`).
+ *
+ * Each instance is simulated by a process which writes speech messages to its
+ * own socket as quickly as the driver accepts them. The driver either serves
+ * every instance from one process or runs one process per instance. A run
+ * completes only once every message from every instance has been received.
+ *
+ * Usage: node bench/instances.js [--quick]
+ */
+'use strict';
+
+const { fork } = require('child_process');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+
+const { CapturedOutput } = require('../lib/captured-output');
+const createVoiceServer = require('../lib/create-voice-server');
+const { instancePath } = require('../lib/voice-instances');
+
+const quick = process.argv.includes('--quick');
+const INSTANCES = quick ? [1, 2] : [1, 2, 4, 8];
+const MESSAGES = quick ? 20000 : 200000;
+const TEXT = 'row 3, column 2, Quarterly revenue, 4,120,000';
+
+const socketPath = instance =>
+  instancePath(path.join(os.tmpdir(), `bench-instances-${process.pid}.sock`), instance);
+
+/**
+ * Accept messages for one instance, doing the work the driver does for each
+ * (parsing it and tracking captured output).
+ *
+ * @returns {Promise<{finished: Promise<void>}>} an eventual value which is
+ *          fulfilled once the server is listening, with a promise which is
+ *          fulfilled once every message has been received
+ */
+const serveInstance = async (address, count) => {
+  const server = await createVoiceServer(address);
+  const output = new CapturedOutput();
+  let received = 0;
+  const finished = new Promise(resolve => {
+    server.on('message', message => {
+      output.deliver(message);
+      received += 1;
+      if (received === count) {
+        clearTimeout(output.settleTimer);
+        server.close();
+        resolve();
+      }
+    });
+  });
+  return { finished };
+};
+
+/**
+ * @param {string} address
+ * @param {number} count
+ */
+const runWriter = (address, count) => {
+  const socket = net.connect(address, () => process.send('ready'));
+  const message = Buffer.from(`speech:${TEXT}\0`);
+  const chunk = Buffer.concat(Array.from({ length: 100 }, () => message));
+  process.on('message', () => {
+    let remaining = count;
+    const write = () => {
+      while (remaining > 0) {
+        const messages = Math.min(100, remaining);
+        remaining -= messages;
+        const data = messages === 100 ? chunk : chunk.subarray(0, messages * message.length);
+        if (!socket.write(data)) {
+          socket.once('drain', write);
+          return;
+        }
+      }
+      socket.end();
+    };
+    write();
+  });
+  socket.on('close', () => process.exit(0));
+};
+
+/**
+ * @param {string[]} args
+ * @param {function(any): void} [onMessage] - receives messages other than
+ *                                            "ready"
+ *
+ * @returns {Promise<import('child_process').ChildProcess>} an eventual value
+ *          which is fulfilled once the child reports that it is ready
+ */
+const start = (args, onMessage = () => {}) =>
+  new Promise((resolve, reject) => {
+    const child = fork(__filename, args);
+    child.on('message', message => (message === 'ready' ? resolve(child) : onMessage(message)));
+    child.on('error', reject);
+  });
+
+/**
+ * @param {number} instances
+ * @param {boolean} separateProcesses - whether each instance is served by its
+ *                                      own driver process
+ *
+ * @returns {Promise<number>} messages accepted per second across all
+ *                            instances
+ */
+const measure = async (instances, separateProcesses) => {
+  const numbers = Array.from({ length: instances }, (_, index) => index + 1);
+  /** @type {Promise<void>[]} */
+  let finished;
+  /** @type {import('child_process').ChildProcess[]} */
+  let drivers = [];
+  if (separateProcesses) {
+    const done = [];
+    drivers = await Promise.all(
+      numbers.map(instance =>
+        start(['--driver', socketPath(instance), String(MESSAGES)], () => done[instance - 1]()),
+      ),
+    );
+    finished = numbers.map(instance => new Promise(resolve => (done[instance - 1] = resolve)));
+  } else {
+    const servers = await Promise.all(
+      numbers.map(instance => serveInstance(socketPath(instance), MESSAGES)),
+    );
+    finished = servers.map(server => server.finished);
+  }
+  const writers = await Promise.all(
+    numbers.map(instance => start(['--writer', socketPath(instance), String(MESSAGES)])),
+  );
+
+  const begin = process.hrtime.bigint();
+  writers.forEach(writer => writer.send('go'));
+  await Promise.all(finished);
+  const seconds = Number(process.hrtime.bigint() - begin) / 1e9;
+
+  drivers.forEach(driver => driver.kill());
+  return (instances * MESSAGES) / seconds;
+};
+
+const main = async () => {
+  console.log(`Accepting ${MESSAGES} messages from each instance`);
+  console.log('  instances   one driver msg/s   driver per instance msg/s');
+  for (const instances of INSTANCES) {
+    const shared = await measure(instances, false);
+    const separate = await measure(instances, true);
+    console.log(
+      `  ${String(instances).padStart(9)}   ${shared.toFixed(0).padStart(16)}` +
+        `   ${separate.toFixed(0).padStart(25)}`,
+    );
+  }
+};
+
+if (process.argv[2] === '--writer') {
+  runWriter(process.argv[3], Number(process.argv[4]));
+} else if (process.argv[2] === '--driver') {
+  serveInstance(process.argv[3], Number(process.argv[4])).then(({ finished }) => {
+    process.send('ready');
+    finished.then(() => process.send('done'));
+  });
+} else {
+  main().catch(error => {
+    console.error(error);
+    process.exit(1);
+  });
+}
@@ -0,0 +1,106 @@
+/**
+ * Measures the cost which the capture journal adds to each emitted message,
+ * and the cost of the queries which the driver performs against it: reading
+ * the records since its last acknowledgement, and locating the records in a
+ * time interval.
+ */
+#include "bench.h"
+#include "CaptureJournal.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static std::string journalPath()
+{
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/bench-capture.journal";
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int messages = options.quick ? 20000 : 1000000;
+    uint64_t cbDataCapacity = 1 << 20;
+    uint32_t ulIndexCapacity = 8192;
+    std::string path = journalPath();
+    CaptureJournal journal;
+
+    remove(path.c_str());
+    bench::check(SUCCEEDED(journal.open(path.c_str(), cbDataCapacity, ulIndexCapacity)), "journal opens");
+
+    std::vector<std::string> payloads = {
+        "speech:Heading level 2, Navigation landmark",
+        "speech:link",
+        "lifecycle:Voice initialization succeeded",
+        "speech:" + std::string(400, 'x'),
+    };
+
+    uint64_t ullTimestamp = 1000000;
+    uint64_t ullSequence = 0;
+    printf("\nappend (%d messages, %llu byte ring, %u records)\n", messages,
+        (unsigned long long)cbDataCapacity, ulIndexCapacity);
+    bench::measure("  per message", 1, (double)messages, [&] {
+        for (int i = 0; i < messages; i += 1)
+        {
+            const std::string& payload = payloads[i % payloads.size()];
+            ullTimestamp += 10;
+            journal.append(payload.data(), payload.size(), ullTimestamp, &ullSequence);
+        }
+    });
+
+    bench::check(ullSequence == (uint64_t)messages, "every append is assigned a sequence number");
+    bench::check(journal.nextSequence() == ullSequence + 1, "appends are published");
+    bench::check(journal.nextSequence() - journal.firstSequence() <= ulIndexCapacity,
+        "records are evicted once the index is full");
+
+    uint64_t ullFirst = journal.firstSequence();
+    uint64_t ullRetained = journal.nextSequence() - ullFirst;
+    std::string data;
+    uint64_t ullReadTimestamp = 0;
+    size_t cbRead = 0;
+    printf("\nread (%llu retained records)\n", (unsigned long long)ullRetained);
+    bench::measure("  per record", 10, (double)ullRetained, [&] {
+        for (uint64_t seq = ullFirst; seq < journal.nextSequence(); seq += 1)
+        {
+            if (journal.read(seq, &data, &ullReadTimestamp))
+            {
+                cbRead += data.size();
+            }
+        }
+    });
+
+    bench::check(journal.read(ullSequence, &data, &ullReadTimestamp), "the newest record is readable");
+    bench::check(data == payloads[(messages - 1) % payloads.size()], "records are read intact");
+    bench::check(ullReadTimestamp == ullTimestamp, "timestamps are recorded");
+    bench::check(!journal.read(ullFirst - 1, &data, nullptr), "evicted records are not readable");
+
+    int queries = options.quick ? 1000 : 100000;
+    uint64_t ullFound = 0;
+    printf("\nfind by timestamp (%d queries)\n", queries);
+    bench::measure("  per query", 1, (double)queries, [&] {
+        for (int i = 0; i < queries; i += 1)
+        {
+            ullFound += journal.findByTimestamp(ullTimestamp - (uint64_t)(i % ullRetained) * 10);
+        }
+    });
+
+    bench::check(journal.findByTimestamp(ullTimestamp) == ullSequence, "exact timestamps are found");
+    bench::check(journal.findByTimestamp(ullTimestamp + 1) == journal.nextSequence(),
+        "later timestamps find no record");
+    bench::check(journal.findByTimestamp(0) == ullFirst, "earlier timestamps find the oldest record");
+
+    // A second writer (e.g. another engine instance) continues the sequence.
+    journal.close();
+    CaptureJournal reopened;
+    bench::check(SUCCEEDED(reopened.open(path.c_str(), cbDataCapacity, ulIndexCapacity)), "journal reopens");
+    bench::check(reopened.nextSequence() == ullSequence + 1, "reopened journals retain their records");
+    reopened.append("speech:x", 8, 1, &ullSequence);
+    bench::check(reopened.read(ullSequence, &data, &ullReadTimestamp) && ullReadTimestamp == ullTimestamp,
+        "timestamps never decrease");
+    reopened.close();
+
+    remove(path.c_str());
+    printf("\n(%zu bytes read, %llu)\n", cbRead, (unsigned long long)ullFound);
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * Measures the throughput of the key injection helper's sequencing and the
+ * accuracy with which it observes the delays between chords, using the
+ * recording backend in place of the platform's.
+ *
+ * Accuracy is reported as the lateness of each chord's first key (how long
+ * after its delay elapsed it was pressed), alongside that of simply sleeping
+ * for the delay, as a driver which schedules presses with timers does.
+ */
+#include "bench.h"
+#include "KeyInjector.h"
+#include <algorithm>
+#include <thread>
+
+/** Fails to press the key with the given code. */
+class FailingBackend : public RecordingKeyBackend
+{
+public:
+    explicit FailingBackend(uint32_t ulFailing) : m_ulFailing(ulFailing) {}
+
+    bool key(uint32_t ulCode, bool fDown) override
+    {
+        return (fDown && ulCode == m_ulFailing) ? false : RecordingKeyBackend::key(ulCode, fDown);
+    }
+
+private:
+    uint32_t m_ulFailing;
+};
+
+static void checkProtocol()
+{
+    std::string id;
+    std::vector<KeyChord> chords;
+    bench::check(KeySequence::parse("7 0:16+9 2500:9", &id, &chords), "a sequence is parsed");
+    bench::check(id == "7" && chords.size() == 2, "each chord is parsed");
+    bench::check(chords[0].codes == std::vector<uint32_t>({16, 9}) && chords[0].ulDelayUs == 0,
+        "a chord's keys are parsed in order");
+    bench::check(chords[1].codes == std::vector<uint32_t>({9}) && chords[1].ulDelayUs == 2500,
+        "a chord's delay is parsed");
+
+    const char* malformed[] = {"", "7", "7 ", "7 9", "7 0:", "7 0:9+", "7 0:9  0:9", "7 x:9",
+        "7 0:1+2+3+4+5+6+7+8+9", "7 60000001:9", "7 0:4294967296"};
+    for (const char* pLine : malformed)
+    {
+        bench::check(!KeySequence::parse(pLine, &id, &chords), "a malformed sequence is rejected");
+    }
+    KeySequence::parse("8 0:", &id, &chords);
+    bench::check(KeySequence::formatError(id, "malformed request") == "8 error malformed request\n",
+        "the id of a malformed request is reported");
+    bench::check(KeySequence::formatCompleted("9", {10, 20}) == "9 ok 10 20\n", "a response is formatted");
+}
+
+static void checkFailure()
+{
+    FailingBackend backend(3);
+    KeyInjector injector(backend);
+    KeyChord chord;
+    chord.codes = {1, 2, 3};
+    std::vector<uint64_t> completedAt;
+    bench::check(!injector.run({chord, chord}, KeyInjector::nowMicroseconds(), &completedAt),
+        "a chord which cannot be injected fails");
+    bench::check(completedAt.empty(), "the sequence is abandoned");
+    const std::vector<KeyEvent>& events = backend.events();
+    bench::check(events.size() == 4 && !events[2].fDown && events[2].ulCode == 2 && events[3].ulCode == 1,
+        "keys which were pressed are released");
+}
+
+struct Lateness
+{
+    double mean;
+    uint64_t ullMax;
+};
+
+static Lateness summarize(const std::vector<uint64_t>& lateness)
+{
+    uint64_t ullTotal = 0;
+    for (uint64_t ullLateness : lateness)
+    {
+        ullTotal += ullLateness;
+    }
+    return {(double)ullTotal / lateness.size(), *std::max_element(lateness.begin(), lateness.end())};
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int chordCount = options.quick ? 10000 : 1000000;
+    int timedCount = options.quick ? 10 : 200;
+
+    checkProtocol();
+    checkFailure();
+
+    RecordingKeyBackend backend;
+    KeyInjector injector(backend);
+    std::vector<uint64_t> completedAt;
+
+    // e.g. Insert+Down, as when a screen reader is asked to read continuously
+    KeyChord chord;
+    chord.codes = {45, 40};
+    std::vector<KeyChord> sequence(chordCount, chord);
+    printf("\nsequencing %d chords without delay\n", chordCount);
+    bench::measure("  per chord", 1, chordCount, [&] {
+        injector.run(sequence, KeyInjector::nowMicroseconds(), &completedAt);
+    });
+    const std::vector<KeyEvent>& events = backend.events();
+    bench::check(completedAt.size() == sequence.size() && events.size() == 4 * sequence.size(),
+        "every key is pressed and released");
+    bench::check(events[0].ulCode == 45 && events[1].ulCode == 40 && events[2].ulCode == 40 &&
+        events[3].ulCode == 45 && events[0].fDown && events[1].fDown && !events[2].fDown && !events[3].fDown,
+        "keys are pressed in order and released in reverse order");
+    bench::check(std::is_sorted(completedAt.begin(), completedAt.end()), "completion times are ordered");
+
+    printf("\nlateness of %d chords after each delay\n", timedCount);
+    printf("  delay     injector mean   injector max   sleep mean   sleep max\n");
+    for (uint32_t ulDelayUs : {500u, 1000u, 5000u})
+    {
+        backend.clear();
+        chord.ulDelayUs = ulDelayUs;
+        sequence.assign(timedCount, chord);
+        uint64_t ullStart = KeyInjector::nowMicroseconds();
+        bench::check(injector.run(sequence, ullStart, &completedAt), "a timed sequence is pressed");
+
+        std::vector<uint64_t> injected;
+        for (int i = 0; i < timedCount; i += 1)
+        {
+            uint64_t ullDue = (i == 0 ? ullStart : completedAt[i - 1]) + ulDelayUs;
+            uint64_t ullPressed = backend.events()[4 * i].ullAt;
+            bench::check(ullPressed >= ullDue, "no chord is pressed before its delay has elapsed");
+            injected.push_back(ullPressed - ullDue);
+        }
+
+        std::vector<uint64_t> slept;
+        for (int i = 0; i < timedCount; i += 1)
+        {
+            uint64_t ullDue = KeyInjector::nowMicroseconds() + ulDelayUs;
+            std::this_thread::sleep_for(std::chrono::microseconds(ulDelayUs));
+            slept.push_back(KeyInjector::nowMicroseconds() - ullDue);
+        }
+
+        Lateness fromInjector = summarize(injected);
+        Lateness fromSleep = summarize(slept);
+        printf("  %5uus  %12.1fus %12lluus %10.1fus %9lluus\n", ulDelayUs,
+            fromInjector.mean, (unsigned long long)fromInjector.ullMax,
+            fromSleep.mean, (unsigned long long)fromSleep.ullMax);
+    }
+
+    return 0;
+}
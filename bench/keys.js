@@ -0,0 +1,124 @@
+/**
+ * Measures the rate at which keys are pressed through the key injection
+ * helper, and the precision with which it observes the delays within a
+ * sequence, using the helper's recording backend (which presses no keys).
+ *
+ * Presses are made by starting the helper for each press (as the driver
+ * starts `osascript` for each press on macOS, although `osascript` is
+ * considerably slower to start), by sending each press to a resident helper,
+ * and by sending many presses as one sequence. Delays are observed by the
+ * helper or, as the driver does without it, with timers.
+ *
+ * Usage: node bench/keys.js [--quick] <path to at-driver-keys>
+ */
+'use strict';
+
+const { execFile } = require('child_process');
+
+const { KeyInjector, pressKeySequenceCommand } = require('../lib/key-injector');
+
+const quick = process.argv.includes('--quick');
+const helper = process.argv.slice(2).find(arg => arg !== '--quick');
+const PRESSES = quick ? 20 : 500;
+const TIMED_CHORDS = quick ? 10 : 100;
+const DELAYS = [1, 5];
+// Insert+Down, as when a screen reader is asked to read continuously
+const CHORD = { codes: [45, 40] };
+
+/**
+ * @param {number} count
+ * @param {function(): Promise<void>} operation
+ *
+ * @returns {Promise<number>} operations per second
+ */
+const rate = async (count, operation) => {
+  const begin = process.hrtime.bigint();
+  for (let i = 0; i < count; i += 1) {
+    await operation();
+  }
+  return count / (Number(process.hrtime.bigint() - begin) / 1e9);
+};
+
+/**
+ * @param {number[]} completedAt - microseconds
+ * @param {number} delay - milliseconds
+ *
+ * @returns {{mean: number, min: number, max: number}} microseconds by which
+ *          the interval between chords exceeded the delay (timers may fire
+ *          slightly early, so this may be negative)
+ */
+const lateness = (completedAt, delay) => {
+  const excess = completedAt
+    .slice(1)
+    .map((time, index) => time - completedAt[index] - delay * 1000);
+  return {
+    mean: excess.reduce((sum, value) => sum + value, 0) / excess.length,
+    min: Math.min(...excess),
+    max: Math.max(...excess),
+  };
+};
+
+const main = async () => {
+  if (!helper) {
+    throw new Error('usage: node bench/keys.js [--quick] <path to at-driver-keys>');
+  }
+  const injector = new KeyInjector({ helper, args: ['--backend', 'recording'] });
+
+  const spawned = await rate(PRESSES, async () => {
+    const stdout = await new Promise((resolve, reject) =>
+      execFile(helper, ['--backend', 'recording', '--once', '0:45+40'], (error, stdout) =>
+        error ? reject(error) : resolve(stdout),
+      ),
+    );
+    if (!stdout.startsWith('0 ok')) {
+      throw new Error(`unexpected response: ${stdout}`);
+    }
+  });
+  await injector.press([CHORD]);
+  const resident = await rate(PRESSES, async () => {
+    await injector.press([CHORD]);
+  });
+  const sequence = Array.from({ length: PRESSES }, () => CHORD);
+  const batched = (await rate(10, () => injector.press(sequence).then(() => {}))) * PRESSES;
+
+  console.log(`Pressing ${PRESSES} chords`);
+  console.log(`  process per press   ${spawned.toFixed(0).padStart(10)} presses/s`);
+  console.log(`  resident helper     ${resident.toFixed(0).padStart(10)} presses/s`);
+  console.log(`  one sequence        ${batched.toFixed(0).padStart(10)} presses/s`);
+
+  console.log(`Lateness of ${TIMED_CHORDS} chords after each delay`);
+  console.log('  delay   helper mean   helper max   timers mean   timers max');
+  const withTimers = pressKeySequenceCommand(keys => keys.map(Number), async () => ({}));
+  for (const delay of DELAYS) {
+    const chords = Array.from({ length: TIMED_CHORDS }, () => ({ ...CHORD, delay }));
+    const fromHelper = lateness(await injector.press(chords), delay);
+    if (fromHelper.min < 0) {
+      throw new Error('a chord was pressed before its delay elapsed');
+    }
+    const { completedAt } = await withTimers(
+      null,
+      { chords: chords.map(() => ({ keys: ['45', '40'], delay })) },
+      /** @type {any} */ ({ keyInjector: null }),
+    );
+    const fromTimers = lateness(completedAt, delay);
+    const column = (value, width) => `${value.toFixed(0).padStart(width)}us`;
+    const columns = [
+      `${delay}ms`.padStart(5),
+      column(fromHelper.mean, 9),
+      column(fromHelper.max, 8),
+      column(fromTimers.mean, 9),
+      column(fromTimers.max, 8),
+    ];
+    console.log(`  ${columns.join('   ')}`);
+  }
+
+  injector.close();
+  if (!(resident > spawned)) {
+    throw new Error('a resident helper is no faster than a process per press');
+  }
+};
+
+main().catch(error => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,163 @@
+/**
+ * Compares waiting for speech by matching it on the client, which must
+ * receive every `interaction.capturedOutput` event, with waiting for it by
+ * `interaction.waitForOutput`, and measures the cost of evaluating the
+ * pending predicates as the number of concurrent waits grows.
+ *
+ * Each simulated test step awaits one utterance of a recorded transcript. On
+ * the client, that costs every event up to and including the utterance; on
+ * the server, it costs one command and its response. The server's matcher is
+ * compared with evaluating each wait's predicate against each utterance in
+ * turn.
+ *
+ * Usage: node bench/output-matching.js [--quick]
+ */
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const { performance } = require('perf_hooks');
+
+const { OutputMatcher } = require('../lib/output-matcher');
+
+const quick = process.argv.includes('--quick');
+const WAITS = quick ? [1, 64, 1024] : [1, 16, 256, 1024, 4096];
+const PASSES = quick ? 4 : 40;
+// Utterances spoken by the screen reader between the steps' awaited ones.
+const STEP_LENGTH = 8;
+
+const check = (condition, description) => {
+  if (!condition) {
+    console.error(`check failed: ${description}`);
+    process.exit(1);
+  }
+};
+
+const transcript = fs
+  .readFileSync(path.join(__dirname, 'transcripts', 'sample.txt'), 'utf8')
+  .split('\n')
+  .filter(line => line.length > 0);
+
+const capturedOutput = data =>
+  JSON.stringify({ method: 'interaction.capturedOutput', params: { data } });
+
+const compareTraffic = () => {
+  let clientBytes = 0;
+  let clientMessages = 0;
+  let serverBytes = 0;
+  let steps = 0;
+  for (let i = STEP_LENGTH - 1; i < transcript.length; i += STEP_LENGTH) {
+    const awaited = transcript[i];
+    for (let j = i - STEP_LENGTH + 1; j <= i; j += 1) {
+      clientBytes += capturedOutput(transcript[j]).length;
+      clientMessages += 1;
+    }
+    const params = { contains: awaited };
+    serverBytes += JSON.stringify({ id: steps, method: 'interaction.waitForOutput', params }).length;
+    serverBytes += JSON.stringify({ id: steps, result: { output: [awaited] } }).length;
+    steps += 1;
+  }
+
+  console.log(`\n${steps} steps of ${STEP_LENGTH} utterances, per step:`);
+  console.log(
+    `  matched by the client   ${(clientBytes / steps).toFixed(0).padStart(6)} bytes, ` +
+      `${(clientMessages / steps).toFixed(1)} messages received`,
+  );
+  console.log(
+    `  interaction.waitForOutput ${(serverBytes / steps).toFixed(0).padStart(4)} bytes, ` +
+      '1 command, 1 response',
+  );
+  check(serverBytes < clientBytes, 'waiting on the server sends fewer bytes');
+};
+
+/**
+ * A predicate for each wait, drawn from the transcript's text so that some
+ * of them are satisfied.
+ */
+const predicatesFor = count => {
+  const predicates = [];
+  for (let i = 0; i < count; i += 1) {
+    const utterance = transcript[(i * 7919) % transcript.length];
+    const words = utterance.split(' ');
+    const word = words[i % words.length];
+    // Most waits are for text which is never spoken, as when many clients
+    // await the responses to actions which they have not yet performed.
+    predicates.push(i % 4 === 0 ? word : `${word} ${i}`);
+  }
+  return predicates;
+};
+
+/**
+ * Evaluate the utterances of the transcript against the pending waits, which
+ * are awaited again once satisfied (as a suite awaits the same text in many
+ * steps), so that their number stays constant.
+ *
+ * @param {{
+ *   arm: function(string, function(): void): void,
+ *   match: function(string): void
+ * }} evaluator
+ *
+ * @returns {{elapsed: number, matched: number}} microseconds per utterance and
+ *          the number of times that a wait was satisfied
+ */
+const run = (predicates, { arm, match }) => {
+  let matched = 0;
+  const onMatch = contains => {
+    matched += 1;
+    arm(contains, () => onMatch(contains));
+  };
+  for (const contains of predicates) {
+    arm(contains, () => onMatch(contains));
+  }
+  // Warm up, building the matcher's automaton.
+  transcript.forEach(match);
+  matched = 0;
+
+  const start = performance.now();
+  for (let pass = 0; pass < PASSES; pass += 1) {
+    transcript.forEach(match);
+  }
+  const elapsed = ((performance.now() - start) * 1000) / (PASSES * transcript.length);
+  return { elapsed, matched };
+};
+
+const withMatcher = () => {
+  const matcher = new OutputMatcher();
+  return {
+    arm: (contains, onMatch) => matcher.add({ contains }, onMatch),
+    match: utterance => matcher.match(utterance),
+  };
+};
+
+const inTurn = () => {
+  /** @type {{contains: string, onMatch: function(): void}[]} */
+  let pending = [];
+  return {
+    arm: (contains, onMatch) => pending.push({ contains, onMatch }),
+    match: utterance => {
+      const satisfied = pending.filter(({ contains }) => utterance.includes(contains));
+      if (satisfied.length > 0) {
+        pending = pending.filter(wait => !satisfied.includes(wait));
+        satisfied.forEach(({ onMatch }) => onMatch());
+      }
+    },
+  };
+};
+
+compareTraffic();
+
+console.log(`\n${transcript.length} utterances, microseconds per utterance:`);
+console.log(`  ${'waits'.padStart(6)} ${'in turn'.padStart(10)} ${'matcher'.padStart(10)}`);
+let last;
+for (const count of WAITS) {
+  const predicates = predicatesFor(count);
+  const naive = run(predicates, inTurn());
+  const matched = run(predicates, withMatcher());
+  check(matched.matched === naive.matched, `${count} waits: both satisfy the same waits`);
+  console.log(
+    `  ${String(count).padStart(6)} ${naive.elapsed.toFixed(2).padStart(10)} ` +
+      `${matched.elapsed.toFixed(2).padStart(10)}`,
+  );
+  last = { naive, matched };
+}
+check(last.matched.elapsed < last.naive.elapsed, 'the matcher is faster with many waits');
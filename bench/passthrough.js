@@ -0,0 +1,172 @@
+/**
+ * Measures the driver's CPU time per message of speech under burst load, with
+ * speech sent by the voice as it was spoken and as a payload which the voice
+ * has already escaped (see `serve --normalize-speech`).
+ *
+ * Speech as it was spoken is decoded, wrapped in an event and serialized
+ * again before it is broadcast. A payload is spliced into the event as it was
+ * received, and decoded only where it holds escape sequences. Both are
+ * measured from the bytes received from the voice to the frames handed to
+ * the clients' sockets, with each message broadcast in its own frame and
+ * with bursts batched. The speech is the same in both, so the frames sent
+ * must be identical.
+ *
+ * Usage: node bench/passthrough.js [--quick]
+ */
+'use strict';
+
+const { execFileSync } = require('child_process');
+const fs = require('fs');
+const path = require('path');
+
+const { parseMessage } = require('../lib/create-voice-server');
+const { OutputBroadcaster, escapeOutput } = require('../lib/output-broadcaster');
+
+const quick = process.argv.includes('--quick');
+const MESSAGES = quick ? 20000 : 400000;
+const PASSES = quick ? 1 : 5;
+// Bytes which the driver reads from the voice's connection at once.
+const READ_SIZE = 64 * 1024;
+
+const check = (condition, description) => {
+  if (!condition) {
+    console.error(`check failed: ${description}`);
+    process.exit(1);
+  }
+};
+
+const transcript = fs
+  .readFileSync(path.join(__dirname, 'transcripts', 'sample.txt'), 'utf8')
+  .split('\n')
+  .filter(line => line.length > 0);
+// Passages read from a document, which hold characters that are escaped.
+const passages = [
+  'The report, titled "Revenue and Outlook", describes growth in each region.',
+  'Figures are given in thousands; see C:\\Reports\\2024 for the workbook.',
+  'Café revenue rose 12% — the highest since records began.',
+];
+const speech = [...transcript, ...passages];
+
+/**
+ * @param {boolean} escaped - whether the voice sends payloads
+ *
+ * @returns {Buffer[]} the data received from the voice, in reads
+ */
+const receivedData = escaped => {
+  const frames = [];
+  for (let i = 0; i < MESSAGES; i += 1) {
+    const text = speech[i % speech.length];
+    const attributes = `seq=${i + 1} t=${5000000 + i * 40}`;
+    frames.push(
+      escaped
+        ? `speech ${attributes} esc=1:${escapeOutput(text)}\0`
+        : `speech ${attributes}:${text}\0`,
+    );
+  }
+  const data = Buffer.from(frames.join(''), 'utf8');
+  const reads = [];
+  for (let offset = 0; offset < data.length; offset += READ_SIZE) {
+    reads.push(data.subarray(offset, offset + READ_SIZE));
+  }
+  return reads;
+};
+
+/**
+ * Process the data received from the voice as the driver does.
+ *
+ * @param {Buffer[]} reads
+ * @param {number} batchWindow
+ * @param {boolean} retain - whether to retain the frames broadcast, which
+ *                           a socket would not
+ *
+ * @returns {{microseconds: number, frames: string[]}} CPU time consumed, and
+ *          the frames broadcast if retained
+ */
+const relay = (reads, batchWindow, retain) => {
+  /** @type {string[]} */
+  const frames = [];
+  const client = {
+    sessionId: 'bench',
+    bufferedAmount: 0,
+    send: data => {
+      if (retain) {
+        frames.push(data);
+      }
+    },
+  };
+  const broadcaster = new OutputBroadcaster(() => [client], { batchWindow });
+
+  const start = process.cpuUsage();
+  let pending = Buffer.alloc(0);
+  const dictionary = [];
+  let cursor = 0;
+  for (const read of reads) {
+    pending = pending.length ? Buffer.concat([pending, read]) : read;
+    let start = 0;
+    let terminator;
+    while ((terminator = pending.indexOf(0, start)) !== -1) {
+      const message = parseMessage(pending.toString('utf8', start, terminator), dictionary);
+      cursor += 1;
+      broadcaster.output(message.data, null, cursor, message.escaped);
+      start = terminator + 1;
+    }
+    pending = pending.subarray(start);
+  }
+  broadcaster.flush();
+  const usage = process.cpuUsage(start);
+  broadcaster.close();
+  return { microseconds: usage.user + usage.system, frames };
+};
+
+/**
+ * Measure one form of speech in a process of its own, so that neither is
+ * measured with code which the other has optimized for different input.
+ *
+ * @param {boolean} escaped
+ * @param {number} batchWindow
+ *
+ * @returns {number} the least CPU time consumed by a pass, in microseconds
+ */
+const measureInChild = (escaped, batchWindow) => {
+  const args = [__filename, '--child', String(escaped), String(batchWindow)];
+  if (quick) {
+    args.push('--quick');
+  }
+  return Number(execFileSync(process.execPath, args, { encoding: 'utf8' }));
+};
+
+const measure = batchWindow => {
+  const rawFrames = relay(receivedData(false), batchWindow, true).frames;
+  const escapedFrames = relay(receivedData(true), batchWindow, true).frames;
+  check(rawFrames.length === escapedFrames.length, 'the same number of frames is broadcast');
+  check(
+    rawFrames.every((frame, i) => frame === escapedFrames[i]),
+    'payloads are broadcast exactly as speech is serialized',
+  );
+
+  const rawMicroseconds = measureInChild(false, batchWindow);
+  const escapedMicroseconds = measureInChild(true, batchWindow);
+  const label = batchWindow > 0 ? 'batched' : 'one frame per message';
+  const perMessage = microseconds => ((microseconds * 1000) / MESSAGES).toFixed(0).padStart(8);
+  console.log(`${label.padEnd(24)} speech ${perMessage(rawMicroseconds)} ns/message`);
+  console.log(`${''.padEnd(24)} payload ${perMessage(escapedMicroseconds)} ns/message`);
+  console.log(
+    `${''.padEnd(24)} saving ${(100 * (1 - escapedMicroseconds / rawMicroseconds)).toFixed(1)}%`,
+  );
+};
+
+const childIndex = process.argv.indexOf('--child');
+if (childIndex !== -1) {
+  const escaped = process.argv[childIndex + 1] === 'true';
+  const batchWindow = Number(process.argv[childIndex + 2]);
+  const reads = receivedData(escaped);
+  let microseconds = Infinity;
+  for (let pass = 0; pass < PASSES; pass += 1) {
+    microseconds = Math.min(microseconds, relay(reads, batchWindow, false).microseconds);
+  }
+  process.stdout.write(String(microseconds));
+} else {
+  console.log(`Driver CPU time per message of speech (${MESSAGES} messages in bursts):`);
+  measure(0);
+  measure(5);
+}
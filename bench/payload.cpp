@@ -0,0 +1,190 @@
+/**
+ * Measures the cost of formatting speech as a payload which the driver can
+ * broadcast without decoding it (see `formatSpeechPayload`), with and
+ * without vectorized scanning, for speech of the lengths which screen readers
+ * produce: short announcements as the user navigates, and long passages as
+ * a document is read.
+ *
+ * Both implementations are compared with a straightforward reference (which
+ * normalizes whitespace and then escapes the result) on generated text which
+ * holds every class of byte, including multi-byte UTF-8 sequences.
+ */
+#include "bench.h"
+#include "SpeechPayload.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Normalize and escape speech as the driver did before payloads existed. */
+static std::string referencePayload(const std::string& text)
+{
+    std::string normalized;
+    bool fSpace = false;
+    for (char c : text)
+    {
+        bool fWhitespace = c == ' ' || (c >= '\t' && c <= '\r');
+        if (fWhitespace)
+        {
+            fSpace = true;
+            continue;
+        }
+        if (fSpace && !normalized.empty())
+        {
+            normalized.push_back(' ');
+        }
+        fSpace = false;
+        normalized.push_back(c);
+    }
+
+    std::string escaped;
+    for (char c : normalized)
+    {
+        unsigned char byte = (unsigned char)c;
+        if (c == '"' || c == '\\')
+        {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        else if (c == '\b')
+        {
+            escaped += "\\b";
+        }
+        else if (byte < 0x20)
+        {
+            char sequence[7];
+            snprintf(sequence, sizeof(sequence), "\\u%04x", byte);
+            escaped += sequence;
+        }
+        else
+        {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+template <typename Format>
+static std::string payloadOf(const std::string& text, Format format)
+{
+    std::string payload(maxSpeechPayloadLength(text.size()), '\0');
+    payload.resize(format(text.data(), text.size(), &payload[0]));
+    return payload;
+}
+
+static void checkCases()
+{
+    struct Case
+    {
+        const char* pText;
+        const char* pPayload;
+    };
+    static const Case CASES[] = {
+        {"", ""},
+        {" \t\r\n", ""},
+        {"Quarterly revenue", "Quarterly revenue"},
+        {"  heading \n\n level   2 ", "heading level 2"},
+        {"link, \"Annual report\"", "link, \\\"Annual report\\\""},
+        {"C:\\Users", "C:\\\\Users"},
+        {"bell\x07 back\x08 del\x7f", "bell\\u0007 back\\b del\x7f"},
+        {"caf\xc3\xa9 \xe2\x80\x94 na\xc3\xafve", "caf\xc3\xa9 \xe2\x80\x94 na\xc3\xafve"},
+        {"sixteen bytes...  then a double space", "sixteen bytes... then a double space"},
+        {"0123456789abcde\t\t0123456789abcdef \x01 x", "0123456789abcde 0123456789abcdef \\u0001 x"},
+    };
+    for (const Case& example : CASES)
+    {
+        bench::check(payloadOf(example.pText, formatSpeechPayload) == example.pPayload,
+            "the payload of each example is as expected");
+        bench::check(payloadOf(example.pText, formatSpeechPayloadScalar) == example.pPayload,
+            "the portable payload of each example is as expected");
+    }
+}
+
+static void checkGenerated(int count)
+{
+    // Every class of byte which is treated differently, weighted towards
+    // whitespace so that runs of it occur at every position in a block.
+    static const char* const PIECES[] = {"a", "Z", "0", ",", " ", " ", "  ", "\t", "\n", "\r\n", "\v", "\f", "\"",
+        "\\", "\b", "\x01", "\x1f", "\x7f", "\xc3\xa9", "\xe2\x80\x94", "\xf0\x9f\x98\x80", "quarterly ",
+        "revenue"};
+    static const size_t PIECE_COUNT = sizeof(PIECES) / sizeof(PIECES[0]);
+
+    uint32_t ulState = 12345;
+    bool fMatched = true;
+    for (int i = 0; i < count; i += 1)
+    {
+        std::string text;
+        ulState = ulState * 1103515245 + 12345;
+        size_t pieces = (ulState >> 16) % 80;
+        for (size_t j = 0; j < pieces; j += 1)
+        {
+            ulState = ulState * 1103515245 + 12345;
+            text += PIECES[(ulState >> 16) % PIECE_COUNT];
+        }
+        std::string expected = referencePayload(text);
+        fMatched = fMatched && payloadOf(text, formatSpeechPayload) == expected &&
+            payloadOf(text, formatSpeechPayloadScalar) == expected;
+    }
+    bench::check(fMatched, "both implementations match the reference for generated text");
+}
+
+template <typename Format>
+static double measureFormat(const char* label, const std::vector<std::string>& texts, int iterations,
+    Format format)
+{
+    size_t cbTotal = 0;
+    size_t cbLongest = 0;
+    for (const std::string& text : texts)
+    {
+        cbTotal += text.size();
+        cbLongest = text.size() > cbLongest ? text.size() : cbLongest;
+    }
+    std::vector<char> payload(maxSpeechPayloadLength(cbLongest));
+    volatile size_t cbSink = 0;
+    double nanoseconds = bench::measure(label, iterations, (double)texts.size(), [&] {
+        for (const std::string& text : texts)
+        {
+            cbSink = format(text.data(), text.size(), payload.data());
+        }
+    });
+    printf("%-48s %12.1f MB/s\n", "  throughput", (double)cbTotal / texts.size() / nanoseconds * 1000);
+    return nanoseconds;
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+
+    checkCases();
+    checkGenerated(options.quick ? 2000 : 100000);
+
+    // Announcements made while navigating, as in `transcripts/sample.txt`.
+    std::vector<std::string> announcements = {"Edit", "submenu", "1 of 4", "Sandwich Condiments", "check box",
+        "not checked", "Navigate forwards to a checkbox", "combo box", "has autocomplete", "Choose a Fruit"};
+    // A passage read as the document is read aloud.
+    std::string passage;
+    while (passage.size() < 4096)
+    {
+        passage += "The quarterly report, titled \"Revenue and Outlook\", describes growth in each region.\n"
+            "  Figures are given in thousands;  see the appendix for details.\t";
+    }
+    std::vector<std::string> passages = {passage};
+
+    int iterations = options.quick ? 2000 : 200000;
+    size_t cbAnnouncements = 0;
+    for (const std::string& text : announcements)
+    {
+        cbAnnouncements += text.size();
+    }
+    printf("\nAnnouncements (mean of %zu bytes):\n", cbAnnouncements / announcements.size());
+    measureFormat("format payload (portable)", announcements, iterations, formatSpeechPayloadScalar);
+    measureFormat("format payload", announcements, iterations, formatSpeechPayload);
+
+    printf("\nA passage of %zu bytes:\n", passage.size());
+    int passageIterations = options.quick ? 200 : 20000;
+    double scalar = measureFormat("format payload (portable)", passages, passageIterations,
+        formatSpeechPayloadScalar);
+    double vectorized = measureFormat("format payload", passages, passageIterations, formatSpeechPayload);
+    printf("%-48s %12.2fx\n", "speedup", scalar / vectorized);
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * Measures the silence between consecutive sentences, and the processor time
+ * consumed, when a document is spoken with the audio for up to K upcoming
+ * sentences rendered ahead of playback.
+ *
+ * The renderer spends a fixed amount of processor time on each sentence,
+ * which is more than the time taken to play the sentence back, so playback
+ * without lookahead pauses for the full rendering time between sentences
+ * and a lookahead of one pauses for the difference. With a lookahead of two
+ * or more, sentences are rendered concurrently and the pauses disappear
+ * (given enough processors).
+ *
+ * An abort must take effect promptly, including while the sentence to be
+ * played next is still being rendered.
+ */
+#include "bench.h"
+#include "EngineCounters.h"
+#include "SpeakPipeline.h"
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes of audio played per millisecond.
+static const size_t AUDIO_BYTES_PER_MS = SpeakPipeline::AUDIO_WRITE_SIZE;
+
+class SyntheticRenderer : public Renderer
+{
+public:
+    SyntheticRenderer(uint64_t ullRenderMicroseconds, uint64_t ullPlaybackMicroseconds)
+        : m_ullRenderMicroseconds(ullRenderMicroseconds),
+          m_cbAudio((size_t)(ullPlaybackMicroseconds * AUDIO_BYTES_PER_MS / 1000))
+    {
+    }
+
+    std::atomic<uint32_t> rendered{0};
+    std::atomic<uint32_t> cancelled{0};
+
+    HRESULT render(const char*, size_t, const std::atomic<bool>& fCancelled, std::vector<uint8_t>* pAudio)
+    {
+        // Occupy the processor, as synthesis does.
+        uint64_t ullEnd = monotonicMicroseconds() + m_ullRenderMicroseconds;
+        volatile uint32_t ulWork = 0;
+        while (monotonicMicroseconds() < ullEnd)
+        {
+            if (fCancelled)
+            {
+                cancelled += 1;
+                return E_ABORT;
+            }
+            for (int i = 0; i < 1000; i += 1)
+            {
+                ulWork = ulWork * 31 + i;
+            }
+        }
+
+        pAudio->assign(m_cbAudio, 0);
+        rendered += 1;
+        return S_OK;
+    }
+
+private:
+    uint64_t m_ullRenderMicroseconds;
+    size_t   m_cbAudio;
+};
+
+/**
+ * Plays audio in real time and measures the time during which no audio was
+ * being played.
+ */
+class PlaybackSite : public SpeakSite
+{
+public:
+    uint32_t ulAbortAfterWrites = 0;
+    // Time from which an abort is requested, if not zero.
+    uint64_t ullAbortAt = 0;
+    uint32_t ulWrites = 0;
+    uint64_t ullSilence = 0;
+    uint64_t ullLastWriteEnd = 0;
+
+    uint32_t getActions()
+    {
+        bool fAbort = (ulAbortAfterWrites && ulWrites >= ulAbortAfterWrites) ||
+            (ullAbortAt && monotonicMicroseconds() >= ullAbortAt);
+        return fAbort ? SPEAK_ACTION_ABORT : 0;
+    }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t) { return S_OK; }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        uint64_t ullStart = monotonicMicroseconds();
+        if (ullLastWriteEnd)
+        {
+            ullSilence += ullStart - ullLastWriteEnd;
+        }
+
+        uint64_t ullEnd = ullStart + cbBuffer * 1000 / AUDIO_BYTES_PER_MS;
+        while (monotonicMicroseconds() < ullEnd)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        ullLastWriteEnd = monotonicMicroseconds();
+        ulWrites += 1;
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+class NullSink : public MessageSink
+{
+public:
+    HRESULT emit(MessageType, const char*, size_t) { return S_OK; }
+};
+
+class NullVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char*, size_t, SpeakSite&) { return S_OK; }
+};
+
+static double processorMilliseconds()
+{
+    return (double)std::clock() * 1000 / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    size_t sentences = options.quick ? 12 : 60;
+    uint64_t ullRenderMicroseconds = 6000;
+    uint64_t ullPlaybackMicroseconds = 4000;
+
+    std::vector<std::u16string> text;
+    std::vector<SpeakFragment> fragments;
+    for (size_t i = 0; i < sentences; i += 1)
+    {
+        text.push_back(u"This is one sentence of a document which is being read from top to bottom.");
+        text.push_back(std::u16string(1, (char16_t)(u'0' + i % 10)));
+    }
+    for (size_t i = 0; i < text.size(); i += 1)
+    {
+        fragments.push_back(SpeakFragment{
+            i % 2 ? FragmentAction::Bookmark : FragmentAction::Speak,
+            text[i].data(), (uint32_t)text[i].size(), 0});
+    }
+
+    NullSink sink;
+    NullVocalizer vocalizer;
+    SyntheticRenderer renderer(ullRenderMicroseconds, ullPlaybackMicroseconds);
+
+    printf("\n%zu sentences, %llu us to render and %llu us to play each (%u processors)\n",
+        sentences, (unsigned long long)ullRenderMicroseconds, (unsigned long long)ullPlaybackMicroseconds,
+        std::thread::hardware_concurrency());
+    printf("  %-10s %16s %16s %16s\n", "lookahead", "gap (us)", "total (ms)", "processors used");
+
+    double gapWithoutLookahead = 0;
+    double gapWithLookahead = 0;
+    for (size_t lookahead : {0, 1, 2, 4, 8})
+    {
+        SpeakPipeline pipeline(sink, vocalizer);
+        pipeline.setRenderer(&renderer, lookahead);
+        PlaybackSite site;
+
+        double start = bench::nowNanoseconds();
+        double processorStart = processorMilliseconds();
+        bench::check(SUCCEEDED(pipeline.speak(fragments.data(), fragments.size(), site)), "speak succeeds");
+        double elapsed = (bench::nowNanoseconds() - start) / 1e6;
+        double processor = processorMilliseconds() - processorStart;
+
+        uint32_t expectedWrites = (uint32_t)(sentences *
+            ((ullPlaybackMicroseconds * AUDIO_BYTES_PER_MS / 1000 + SpeakPipeline::AUDIO_WRITE_SIZE - 1) /
+             SpeakPipeline::AUDIO_WRITE_SIZE));
+        bench::check(site.ulWrites == expectedWrites, "every sentence is played");
+
+        double gap = (double)site.ullSilence / (sentences - 1);
+        printf("  %-10zu %16.0f %16.1f %16.2f\n", lookahead, gap, elapsed, processor / elapsed);
+
+        if (lookahead == 0)
+        {
+            gapWithoutLookahead = gap;
+        }
+        if (lookahead == 2)
+        {
+            gapWithLookahead = gap;
+        }
+    }
+    bench::check(gapWithLookahead < gapWithoutLookahead, "rendering ahead shortens the gap between sentences");
+
+    // Audio which has not been played is discarded when the output site
+    // requests an abort, and the pipeline remains usable afterwards.
+    SpeakPipeline pipeline(sink, vocalizer);
+    pipeline.setRenderer(&renderer, 4);
+    PlaybackSite abortingSite;
+    abortingSite.ulAbortAfterWrites = 2;
+    renderer.rendered = 0;
+    renderer.cancelled = 0;
+    double start = bench::nowNanoseconds();
+    bench::check(pipeline.speak(fragments.data(), fragments.size(), abortingSite) == S_OK,
+        "an aborted speak succeeds");
+    printf("  abort: %.1f ms, %u rendered, %u cancelled\n", (bench::nowNanoseconds() - start) / 1e6,
+        renderer.rendered.load(), renderer.cancelled.load());
+    bench::check(abortingSite.ulWrites == 2, "no audio is written after an abort");
+    bench::check(renderer.rendered + renderer.cancelled <= 1 + 4, "rendering stays within the lookahead");
+
+    PlaybackSite site;
+    bench::check(SUCCEEDED(pipeline.speak(fragments.data(), 2, site)), "speaking resumes after an abort");
+    bench::check(site.ulWrites > 0, "audio is played after an abort");
+
+    // The first sentence takes far longer to render than the abort takes to
+    // arrive, so the pipeline is waiting for it when the abort is requested.
+    SyntheticRenderer slowRenderer(2000000, ullPlaybackMicroseconds);
+    SpeakPipeline slowPipeline(sink, vocalizer);
+    slowPipeline.setRenderer(&slowRenderer, 2);
+    PlaybackSite slowSite;
+    slowSite.ullAbortAt = monotonicMicroseconds() + 20000;
+    start = bench::nowNanoseconds();
+    bench::check(slowPipeline.speak(fragments.data(), fragments.size(), slowSite) == S_OK,
+        "a speak aborted during rendering succeeds");
+    double abortMilliseconds = (bench::nowNanoseconds() - start) / 1e6;
+    printf("  abort while rendering: %.1f ms, %u cancelled\n", abortMilliseconds, slowRenderer.cancelled.load());
+    bench::check(slowSite.ulWrites == 0, "nothing is played after an abort during rendering");
+    bench::check(slowRenderer.rendered == 0 && slowRenderer.cancelled > 0, "the renders in progress are cancelled");
+    bench::check(abortMilliseconds < 500, "an abort does not wait for the sentence being rendered");
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+/**
+ * Replays traces of `ISpTTSEngine::Speak` calls (recorded by the engine when
+ * the voice token's "SpeakTraceDirectory" value is set) against the Speak
+ * pipeline and reports the time spent in each call.
+ *
+ *     bench-replay [--realtime] trace...
+ *
+ * By default, calls are replayed back-to-back. With `--realtime`, each call
+ * begins at its recorded offset from the start of the trace. The output
+ * site reports the recorded event interest, and it reports the recorded
+ * `GetActions` values by call index (or, with `--realtime`, by elapsed time).
+ *
+ * When no trace is specified, a synthetic trace is recorded and replayed, and
+ * the round trip is verified.
+ */
+#include "bench.h"
+#include "EngineCounters.h"
+#include "SpeakTrace.h"
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ReplaySite : public SpeakSite
+{
+public:
+    ReplaySite(const TracedSpeak& speak, bool realtime)
+        : m_speak(speak), m_realtime(realtime), m_ullStart(monotonicMicroseconds()), m_ulCalls(0)
+    {
+    }
+
+    size_t events = 0;
+
+    uint32_t getActions()
+    {
+        uint64_t ullElapsed = monotonicMicroseconds() - m_ullStart;
+        uint32_t ulActions = 0;
+        for (const SpeakTraceActions& change : m_speak.actions)
+        {
+            if (m_realtime ? change.ullOffset > ullElapsed : change.ulCall > m_ulCalls)
+            {
+                break;
+            }
+            ulActions = change.ulActions;
+        }
+        m_ulCalls += 1;
+        return ulActions;
+    }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = m_speak.ullEventInterest;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t numEvents)
+    {
+        events += numEvents;
+        return S_OK;
+    }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+
+private:
+    const TracedSpeak& m_speak;
+    bool m_realtime;
+    uint64_t m_ullStart;
+    uint32_t m_ulCalls;
+};
+
+class CountingSink : public MessageSink
+{
+public:
+    size_t messages = 0;
+    size_t bytes = 0;
+
+    HRESULT emit(MessageType, const char*, size_t cbData)
+    {
+        messages += 1;
+        bytes += cbData;
+        return S_OK;
+    }
+};
+
+/**
+ * Consults the output site once per fragment, as the engine's vocalizer does
+ * while it waits for speech to be rendered.
+ */
+class PollingVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char*, size_t, SpeakSite& site)
+    {
+        site.getActions();
+        return S_OK;
+    }
+};
+
+struct ReplayResult
+{
+    size_t speaks = 0;
+    size_t fragments = 0;
+    size_t events = 0;
+    std::vector<double> latencies;
+};
+
+static bool replay(const char* path, bool realtime, CountingSink& sink, ReplayResult* pResult)
+{
+    SpeakTraceReader reader;
+    if (FAILED(reader.open(path)))
+    {
+        fprintf(stderr, "unable to read trace: %s\n", path);
+        return false;
+    }
+
+    PollingVocalizer vocalizer;
+    SpeakPipeline pipeline(sink, vocalizer);
+    TracedSpeak speak;
+    uint64_t ullOrigin = monotonicMicroseconds();
+
+    while (reader.next(&speak))
+    {
+        if (realtime)
+        {
+            uint64_t ullElapsed = monotonicMicroseconds() - ullOrigin;
+            if (speak.ullStart > ullElapsed)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(speak.ullStart - ullElapsed));
+            }
+        }
+
+        ReplaySite site(speak, realtime);
+        double start = bench::nowNanoseconds();
+        pipeline.speak(speak.fragments.data(), speak.fragments.size(), site);
+        pResult->latencies.push_back(bench::nowNanoseconds() - start);
+        pResult->speaks += 1;
+        pResult->fragments += speak.fragments.size();
+        pResult->events += site.events;
+    }
+
+    return true;
+}
+
+/**
+ * Stands in for the output site supplied by SAPI while a synthetic trace is
+ * recorded. Every fifth call is aborted part-way through.
+ */
+class SyntheticSite : public SpeakSite
+{
+public:
+    uint32_t ulAbortAfter = 0;
+    uint32_t ulCalls = 0;
+
+    uint32_t getActions()
+    {
+        ulCalls += 1;
+        return ulAbortAfter && ulCalls > ulAbortAfter ? SPEAK_ACTION_ABORT : 0;
+    }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t) { return S_OK; }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+static std::u16string toUtf16(const std::string& text)
+{
+    return std::u16string(text.begin(), text.end());
+}
+
+/**
+ * Record a trace resembling the output of a screen reader navigating a page
+ * marked up for ARIA-AT (bookmarks surrounding short utterances).
+ */
+static void recordSyntheticTrace(const char* path, int speaks)
+{
+    static const char* const utterances[] = {
+        "Heading level 2, Navigation landmark",
+        "link, Home",
+        "button, Submit, not pressed",
+        "list with 5 items",
+        "edit text, Search, blank",
+    };
+    static const char16_t category[] = u"DATE";
+    SpeakTraceWriter writer;
+    PollingVocalizer vocalizer;
+    CountingSink sink;
+    SpeakPipeline pipeline(sink, vocalizer);
+
+    bench::check(SUCCEEDED(writer.open(path)), "trace is created");
+
+    for (int i = 0; i < speaks; i += 1)
+    {
+        std::vector<std::u16string> text;
+        std::vector<SpeakFragment> fragments;
+        for (int j = 0; j < 3; j += 1)
+        {
+            text.push_back(toUtf16(std::to_string(i * 3 + j)));
+            fragments.push_back(SpeakFragment{FragmentAction::Bookmark, nullptr, 0, 0});
+            text.push_back(toUtf16(utterances[(i + j) % 5]));
+            fragments.push_back(SpeakFragment{FragmentAction::Speak, nullptr, 0, 0});
+        }
+
+        SyntheticSite site;
+        site.ulAbortAfter = i % 5 == 4 ? 2 : 0;
+        TracingSpeakSite tracingSite(site, writer);
+        writer.beginSpeak((uint32_t)i);
+        for (size_t j = 0; j < fragments.size(); j += 1)
+        {
+            fragments[j].pTextStart = text[j].data();
+            fragments[j].ulTextLen = (uint32_t)text[j].size();
+            fragments[j].ulTextSrcOffset = (uint32_t)(j * 10);
+            SpeakTraceState state = {0x409, 0, i % 10, 100, 0, 0, 0, 0, nullptr,
+                j == 1 ? category : nullptr, nullptr, nullptr};
+            writer.addFragment(fragments[j], state);
+        }
+        pipeline.speak(fragments.data(), fragments.size(), tracingSite);
+        bench::check(SUCCEEDED(writer.endSpeak()), "Speak call is recorded");
+    }
+}
+
+static void verifySyntheticTrace(const char* path, int speaks)
+{
+    SpeakTraceReader reader;
+    TracedSpeak speak;
+    int count = 0;
+
+    bench::check(SUCCEEDED(reader.open(path)), "trace is readable");
+    while (reader.next(&speak))
+    {
+        bench::check(speak.ulSpeakFlags == (uint32_t)count, "flags are recorded");
+        bench::check(speak.ullEventInterest == 1ull << SPEAK_EVENT_BOOKMARK, "event interest is recorded");
+        bench::check(speak.fragments.size() == 6, "fragments are recorded");
+        bench::check(std::u16string(speak.fragments[0].pTextStart, speak.fragments[0].ulTextLen) ==
+            toUtf16(std::to_string(count * 3)), "fragment text is recorded");
+        bench::check(speak.fragments[1].eAction == FragmentAction::Speak, "actions are recorded");
+        bench::check(speak.fragments[5].ulTextSrcOffset == 50, "source offsets are recorded");
+        bench::check(speak.states[0].lRateAdj == count % 10, "voice state is recorded");
+        bench::check(speak.states[1].pCategory && speak.states[1].pCategory == std::u16string(u"DATE"),
+            "context strings are recorded");
+        bench::check(!speak.states[0].pCategory && !speak.states[0].pPhoneIds, "null strings are recorded");
+        bench::check(count % 5 == 4 ?
+            speak.actions.size() == 1 && speak.actions[0].ulCall == 2 &&
+                speak.actions[0].ulActions == SPEAK_ACTION_ABORT :
+            speak.actions.empty(), "changes in requested actions are recorded");
+        count += 1;
+    }
+    bench::check(count == speaks, "every Speak call is read");
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    bool realtime = false;
+    std::vector<std::string> paths;
+    std::string syntheticPath;
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (strcmp(argv[i], "--realtime") == 0)
+        {
+            realtime = true;
+        }
+        else if (strcmp(argv[i], "--quick") != 0)
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty())
+    {
+        int speaks = options.quick ? 100 : 20000;
+        const char* directory = getenv("TMPDIR");
+        syntheticPath = std::string(directory ? directory : "/tmp") + "/bench-replay.trace";
+        recordSyntheticTrace(syntheticPath.c_str(), speaks);
+        verifySyntheticTrace(syntheticPath.c_str(), speaks);
+        paths.push_back(syntheticPath);
+    }
+
+    for (const std::string& path : paths)
+    {
+        CountingSink sink;
+        ReplayResult result;
+        double start = bench::nowNanoseconds();
+        if (!replay(path.c_str(), realtime, sink, &result) || result.speaks == 0)
+        {
+            fprintf(stderr, "no Speak calls replayed from %s\n", path.c_str());
+            return 1;
+        }
+        double elapsed = bench::nowNanoseconds() - start;
+
+        std::sort(result.latencies.begin(), result.latencies.end());
+        printf("\n%s%s\n", path.c_str(), realtime ? " (realtime)" : "");
+        printf("  %zu Speak calls, %zu fragments, %zu events, %zu messages (%zu bytes)\n",
+            result.speaks, result.fragments, result.events, sink.messages, sink.bytes);
+        printf("  Speak median %10.1f ns\n", result.latencies[result.latencies.size() / 2]);
+        printf("  Speak p99    %10.1f ns\n", result.latencies[result.latencies.size() * 99 / 100]);
+        printf("  Speak max    %10.1f ns\n", result.latencies.back());
+        printf("  total        %10.1f ms\n", elapsed / 1e6);
+    }
+
+    if (!syntheticPath.empty())
+    {
+        remove(syntheticPath.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,505 @@
+/**
+ * Measures the cost which the driver's control channel adds to every call to
+ * Speak, how soon new settings take effect, and the duration of Speak in
+ * each of the modes which the driver may select.
+ *
+ * At the beginning of each call, the engine polls its connection to the
+ * driver for new settings and copies the settings in effect. Both must cost
+ * no more than a few microseconds, including while another thread publishes
+ * settings. Settings sent by the driver must take effect from the first call
+ * which begins after they arrive, including those of a driver which has
+ * restarted (and so numbers its settings afresh).
+ *
+ * Speak is measured with a site which plays audio in real time, so that
+ * vocalizing takes as long as the audio lasts, time compression shortens it
+ * proportionately and capturing alone takes almost no time.
+ */
+#include "bench.h"
+#include "counting_server.h"
+#include "DriverClient.h"
+#include "EngineCounters.h"
+#include "EngineSettings.h"
+#include "SettingsReceiver.h"
+#include "SpeakPipeline.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes of audio played per millisecond (11kHz, 16-bit mono).
+static const size_t AUDIO_BYTES_PER_MS = 22;
+// Audio produced for each fragment.
+static const size_t AUDIO_PER_FRAGMENT_MS = 40;
+
+static EngineSettings defaultSettings()
+{
+    EngineSettings settings;
+    settings.ulBatchMinWindowUs = 250;
+    settings.ulBatchMaxWindowUs = 1000;
+    settings.ulBatchLatencyCapUs = 4000;
+    return settings;
+}
+
+/**
+ * The settings published as the given generation; each field is derived from
+ * the generation so that a reader can tell whether it copied a whole
+ * snapshot.
+ */
+static EngineSettings settingsFor(uint32_t ulGeneration)
+{
+    EngineSettings settings = defaultSettings();
+    settings.ulGeneration = ulGeneration;
+    settings.fVocalize = ulGeneration % 2 == 0;
+    settings.ulTimeCompression = 100 + ulGeneration % 900;
+    settings.ulBatchMinWindowUs = ulGeneration;
+    settings.ulBatchMaxWindowUs = ulGeneration * 2;
+    return settings;
+}
+
+static bool isConsistent(const EngineSettings& settings)
+{
+    if (!settings.ulGeneration)
+    {
+        return settings.ulBatchMinWindowUs == 250;
+    }
+    EngineSettings expected = settingsFor(settings.ulGeneration);
+    return settings.fVocalize == expected.fVocalize && settings.ulTimeCompression == expected.ulTimeCompression &&
+        settings.ulBatchMinWindowUs == expected.ulBatchMinWindowUs &&
+        settings.ulBatchMaxWindowUs == expected.ulBatchMaxWindowUs;
+}
+
+static void measureSnapshot(int iterations)
+{
+    SettingsSnapshot snapshot(defaultSettings());
+    volatile uint32_t ulSink = 0;
+    bench::measure("load settings", iterations, 1, [&] { ulSink = snapshot.load().ulTimeCompression; });
+
+    // A publisher replaces the settings continuously, far more often than
+    // the driver would.
+    std::atomic<bool> fStopping{false};
+    std::atomic<uint32_t> ulPublished{0};
+    std::thread publisher([&] {
+        for (uint32_t ulGeneration = 1; !fStopping; ulGeneration += 1)
+        {
+            snapshot.publish(settingsFor(ulGeneration));
+            ulPublished = ulGeneration;
+        }
+    });
+    while (!ulPublished)
+    {
+        std::this_thread::yield();
+    }
+    bool fConsistent = true;
+    uint32_t ulLastGeneration = 0;
+    bool fMonotonic = true;
+    bench::measure("load settings while they are published", iterations, 1, [&] {
+        EngineSettings settings = snapshot.load();
+        fConsistent = fConsistent && isConsistent(settings);
+        fMonotonic = fMonotonic && settings.ulGeneration >= ulLastGeneration;
+        ulLastGeneration = settings.ulGeneration;
+    });
+    fStopping = true;
+    publisher.join();
+
+    printf("%-48s %12u\n", "settings published during the measurement", (unsigned)ulPublished);
+    bench::check(fConsistent, "every copy of the settings is a whole snapshot");
+    bench::check(fMonotonic, "settings are never replaced by an earlier generation");
+    bench::check(!snapshot.publish(settingsFor(1)), "settings of an earlier generation are discarded");
+}
+
+static void measureSwitch(const bench::Options& options)
+{
+    std::string path = "/tmp/at-driver-bench-settings-" + std::to_string(getpid());
+    CountingServer server(path);
+    server.start();
+
+    DriverClient client(path.c_str());
+    SettingsSnapshot snapshot(defaultSettings());
+    client.send("lifecycle", NULL, "Voice initialization succeeded", 30);
+    bench::check(server.await(1), "the driver receives the first message");
+
+    std::string received;
+    int iterations = options.quick ? 20000 : 1000000;
+    bool fReceived = false;
+    bench::measure("poll for settings (none sent)", iterations, 1, [&] {
+        received.clear();
+        fReceived = client.receive(&received) || fReceived;
+    });
+    bench::check(!fReceived, "nothing is received before the driver sends settings");
+
+    // Calls to Speak are modelled as polls separated by a millisecond.
+    const int GENERATIONS = options.quick ? 5 : 50;
+    uint64_t ullTotalMicroseconds = 0;
+    uint64_t ullMaxMicroseconds = 0;
+    for (int i = 1; i <= GENERATIONS; i += 1)
+    {
+        std::string data = settingsFor(i).describe();
+        std::string message = "configure gen=" + std::to_string(i) + ":" + data;
+        uint64_t ullSent = monotonicMicroseconds();
+        server.broadcast(std::string(message.c_str(), message.size() + 1));
+
+        bool fApplied = false;
+        for (int call = 0; call < 2000 && !fApplied; call += 1)
+        {
+            received.clear();
+            if (client.receive(&received))
+            {
+                size_t separator = received.find(':');
+                EngineSettings settings = snapshot.defaults();
+                settings.ulGeneration = (uint32_t)i;
+                bench::check(received.compare(0, 14, "configure gen=") == 0, "settings are received whole");
+                bench::check(settings.parse(received.data() + separator + 1, received.size() - separator - 2),
+                    "the settings are valid");
+                fApplied = snapshot.publish(settings);
+            }
+            if (!fApplied)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        bench::check(fApplied, "the settings take effect");
+        bench::check(isConsistent(snapshot.load()), "the settings in effect are those which were sent");
+
+        uint64_t ullElapsed = monotonicMicroseconds() - ullSent;
+        ullTotalMicroseconds += ullElapsed;
+        ullMaxMicroseconds = ullElapsed > ullMaxMicroseconds ? ullElapsed : ullMaxMicroseconds;
+    }
+    // Includes the interval at which the stand-in driver writes (10ms).
+    printf("%-48s %12.1f us (max %llu us)\n", "settings sent until in effect (mean)",
+        (double)ullTotalMicroseconds / GENERATIONS, (unsigned long long)ullMaxMicroseconds);
+
+    client.send("lifecycle", NULL, "Voice destroyed", 15);
+    bench::check(server.await(2), "messages sent after settings are received are delivered");
+}
+
+/** Records the errors emitted. */
+class ErrorSink : public MessageSink
+{
+public:
+    std::vector<std::string> errors;
+
+    HRESULT emit(MessageType type, const char* pData, size_t cbData)
+    {
+        if (type == MessageType::ERR)
+        {
+            errors.emplace_back(pData, cbData);
+        }
+        return S_OK;
+    }
+};
+
+static void sendSettings(CountingServer& server, uint32_t ulGeneration, const EngineSettings& settings)
+{
+    std::string message = "configure gen=" + std::to_string(ulGeneration) + ":" + settings.describe();
+    server.broadcast(std::string(message.c_str(), message.size() + 1));
+}
+
+/** Poll, as calls to Speak do, until the given generation is in effect. */
+static bool awaitGeneration(SettingsReceiver& receiver, uint32_t ulGeneration)
+{
+    for (int i = 0; i < 2000; i += 1)
+    {
+        receiver.receive();
+        if (receiver.load().ulGeneration == ulGeneration)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+/**
+ * A driver which restarts numbers its settings from 1 again, on a new
+ * connection. Its settings must take effect and be acknowledged, and the
+ * defaults must be in effect while no driver is connected.
+ */
+static void checkRestart()
+{
+    std::string path = "/tmp/at-driver-bench-restart-" + std::to_string(getpid());
+    DriverClient client(path.c_str());
+    ErrorSink sink;
+    SettingsReceiver receiver(client, sink, defaultSettings());
+
+    {
+        CountingServer driver(path);
+        driver.start();
+        client.send("lifecycle", NULL, "Voice initialization succeeded", 30);
+        bench::check(driver.await(1), "the first driver receives the first message");
+        sendSettings(driver, 5, settingsFor(5));
+        bench::check(awaitGeneration(receiver, 5), "the first driver's settings take effect");
+    }
+    bench::check(awaitGeneration(receiver, 0), "the defaults are restored when the driver exits");
+    bench::check(isConsistent(receiver.load()), "the settings in effect are the defaults");
+
+    CountingServer driver(path);
+    driver.record();
+    driver.start();
+    client.send("lifecycle", NULL, "Driver restarted", 16);
+    bench::check(driver.await(1), "the restarted driver receives messages");
+    sendSettings(driver, 1, settingsFor(1));
+    bench::check(awaitGeneration(receiver, 1), "the restarted driver's settings take effect");
+    bench::check(isConsistent(receiver.load()), "the settings in effect are those which were sent");
+    bench::check(driver.await(2), "the restarted driver receives an acknowledgement");
+    std::vector<std::string> recorded = driver.recorded();
+    bench::check(recorded.size() == 1 && recorded[0].find("configured gen=1:") != std::string::npos,
+        "the acknowledgement is of the settings sent");
+
+    sendSettings(driver, 1, settingsFor(1));
+    for (int i = 0; i < 2000 && sink.errors.empty(); i += 1)
+    {
+        receiver.receive();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    bench::check(sink.errors.size() == 1 && driver.messages == 2,
+        "settings which are not applied are reported as an error rather than acknowledged");
+}
+
+/**
+ * A driver whose sessions subscribe to few messages narrows those which the
+ * voice emits. Once the driver exits, every message must be emitted again,
+ * and the audio tap left alone, until another driver configures the voice.
+ */
+static void checkNarrowSubscriptionOnDisconnect()
+{
+    std::string path = "/tmp/at-driver-bench-disconnect-" + std::to_string(getpid());
+    DriverClient client(path.c_str());
+    ErrorSink sink;
+    SettingsReceiver receiver(client, sink, defaultSettings());
+
+    EngineSettings narrow = defaultSettings();
+    narrow.fEmitSpeech = false;
+    narrow.fEmitLifecycle = false;
+    narrow.fEmitErrors = false;
+    narrow.fStampTimes = false;
+    narrow.fAudioTap = true;
+    {
+        CountingServer driver(path);
+        driver.start();
+        client.send("lifecycle", NULL, "Voice initialization succeeded", 30);
+        bench::check(driver.await(1), "the driver receives the first message");
+        sendSettings(driver, 1, narrow);
+        bench::check(awaitGeneration(receiver, 1), "the subscription takes effect");
+        EngineSettings settings = receiver.load();
+        bench::check(!settings.fEmitSpeech && settings.fEmitBookmarks && settings.fAudioTap,
+            "only the messages subscribed to are emitted");
+    }
+
+    bench::check(awaitGeneration(receiver, 0), "the subscription is withdrawn when the driver exits");
+    EngineSettings settings = receiver.load();
+    bench::check(settings.fEmitSpeech && settings.fEmitLifecycle && settings.fEmitErrors && settings.fEmitBookmarks &&
+            settings.fStampTimes && !settings.fAudioTap,
+        "every message is emitted while no driver is connected");
+}
+
+/** Plays audio in real time. */
+class PlaybackSite : public SpeakSite
+{
+public:
+    uint64_t cbPlayed = 0;
+
+    uint32_t getActions() { return 0; }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 0;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t) { return S_OK; }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        uint64_t ullEnd = monotonicMicroseconds() + cbBuffer * 1000 / AUDIO_BYTES_PER_MS;
+        while (monotonicMicroseconds() < ullEnd)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        cbPlayed += cbBuffer;
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+class CountingSink : public MessageSink
+{
+public:
+    uint64_t ullSpeech = 0;
+
+    HRESULT emit(MessageType type, const char*, size_t)
+    {
+        ullSpeech += type == MessageType::SPEECH ? 1 : 0;
+        return S_OK;
+    }
+};
+
+/** Records the audio written to it, without delay. */
+class RecordingSite : public SpeakSite
+{
+public:
+    std::vector<uint8_t> audio;
+
+    uint32_t getActions() { return 0; }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 0;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent*, size_t) { return S_OK; }
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten)
+    {
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pBuffer);
+        audio.insert(audio.end(), pBytes, pBytes + cbBuffer);
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+/** Writes `cbAudio` bytes, each the low byte of its offset, per fragment. */
+class ToneVocalizer : public Vocalizer
+{
+public:
+    ToneVocalizer(size_t cbAudio = AUDIO_PER_FRAGMENT_MS * AUDIO_BYTES_PER_MS,
+        size_t cbWrite = SpeakPipeline::AUDIO_WRITE_SIZE)
+        : m_audio(cbAudio), m_cbWrite(cbWrite)
+    {
+        for (size_t i = 0; i < m_audio.size(); i += 1)
+        {
+            m_audio[i] = (uint8_t)i;
+        }
+    }
+
+    HRESULT vocalize(const char*, size_t, SpeakSite& site)
+    {
+        for (size_t offset = 0; offset < m_audio.size(); offset += m_cbWrite)
+        {
+            size_t cbChunk = m_audio.size() - offset < m_cbWrite ? m_audio.size() - offset : m_cbWrite;
+            size_t cbWritten = 0;
+            HRESULT hr = site.write(m_audio.data() + offset, cbChunk, &cbWritten);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+private:
+    std::vector<uint8_t> m_audio;
+    size_t m_cbWrite;
+};
+
+struct ModeResult
+{
+    double microsecondsPerSpeak;
+    uint64_t cbPlayed;
+    uint64_t ullSpeech;
+};
+
+static ModeResult measureMode(const char* label, const EngineSettings& settings, int speaks)
+{
+    static const char16_t TEXT[] = u"Quarterly revenue";
+    SpeakFragment fragments[3];
+    for (SpeakFragment& fragment : fragments)
+    {
+        fragment.eAction = FragmentAction::Speak;
+        fragment.pTextStart = TEXT;
+        fragment.ulTextLen = (uint32_t)(sizeof(TEXT) / sizeof(TEXT[0]) - 1);
+        fragment.ulTextSrcOffset = 0;
+    }
+
+    CountingSink sink;
+    ToneVocalizer vocalizer;
+    SpeakPipeline pipeline(sink, vocalizer);
+    PlaybackSite site;
+    pipeline.setCaptureOnly(!settings.fVocalize);
+    pipeline.setTimeCompression(settings.ulTimeCompression, 2);
+
+    uint64_t ullStart = monotonicMicroseconds();
+    for (int i = 0; i < speaks; i += 1)
+    {
+        pipeline.speak(fragments, 3, site);
+    }
+    ModeResult result = {(double)(monotonicMicroseconds() - ullStart) / speaks, site.cbPlayed, sink.ullSpeech};
+    printf("%-48s %12.1f us\n", label, result.microsecondsPerSpeak);
+    return result;
+}
+
+static void measureModes(const bench::Options& options)
+{
+    int speaks = options.quick ? 4 : 25;
+    EngineSettings settings = defaultSettings();
+    ModeResult vocalize = measureMode("Speak (vocalize)", settings, speaks);
+    settings.ulTimeCompression = 200;
+    ModeResult doubled = measureMode("Speak (time compression 200%)", settings, speaks);
+    settings.ulTimeCompression = 400;
+    ModeResult quadrupled = measureMode("Speak (time compression 400%)", settings, speaks);
+    settings.fVocalize = false;
+    ModeResult captured = measureMode("Speak (capture only)", settings, speaks);
+
+    bench::check(vocalize.ullSpeech == captured.ullSpeech && doubled.ullSpeech == captured.ullSpeech,
+        "every mode reports the same speech");
+    bench::check(doubled.cbPlayed * 2 == vocalize.cbPlayed, "time compression of 200% plays half of the audio");
+    bench::check(quadrupled.cbPlayed * 4 == vocalize.cbPlayed, "time compression of 400% plays a quarter");
+    bench::check(captured.cbPlayed == 0, "capturing alone plays no audio");
+    bench::check(doubled.microsecondsPerSpeak < vocalize.microsecondsPerSpeak * 0.75,
+        "time compression shortens Speak");
+    bench::check(captured.microsecondsPerSpeak < 1000, "capturing alone returns within a millisecond");
+}
+
+/**
+ * Time compression must keep whole blocks however the audio is divided into
+ * writes, and play the bytes which end an utterance short of a block.
+ */
+static void checkUnalignedWrites()
+{
+    static const char16_t TEXT[] = u"Quarterly revenue";
+    static const size_t BLOCK = 4;
+    SpeakFragment fragment;
+    fragment.eAction = FragmentAction::Speak;
+    fragment.pTextStart = TEXT;
+    fragment.ulTextLen = (uint32_t)(sizeof(TEXT) / sizeof(TEXT[0]) - 1);
+    fragment.ulTextSrcOffset = 0;
+
+    // 220 blocks and 2 bytes, written 333 bytes at a time.
+    CountingSink sink;
+    ToneVocalizer vocalizer(882, 333);
+    SpeakPipeline pipeline(sink, vocalizer);
+    RecordingSite site;
+    pipeline.setTimeCompression(200, BLOCK);
+    pipeline.speak(&fragment, 1, site);
+
+    std::vector<uint8_t> expected;
+    for (size_t offset = 0; offset + BLOCK <= 882; offset += 2 * BLOCK)
+    {
+        for (size_t i = offset + BLOCK; i < offset + 2 * BLOCK; i += 1)
+        {
+            expected.push_back((uint8_t)i);
+        }
+    }
+    expected.push_back((uint8_t)880);
+    expected.push_back((uint8_t)881);
+    bench::check(site.audio == expected,
+        "time compression keeps every other block of unaligned writes and plays the partial block at the end");
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+
+    printf("\nReading the settings at the beginning of each call to Speak:\n");
+    measureSnapshot(options.quick ? 100000 : 10000000);
+
+    printf("\nSwitching modes between calls to Speak:\n");
+    measureSwitch(options);
+    checkRestart();
+    checkNarrowSubscriptionOnDisconnect();
+
+    printf("\nDuration of Speak by mode (%zums of audio per fragment, 3 fragments):\n", AUDIO_PER_FRAGMENT_MS);
+    measureModes(options);
+    checkUnalignedWrites();
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Compares the duration of a simulated test suite when each step waits a
+ * fixed period for the screen reader's speech with its duration when each
+ * step uses `waitForSettled`.
+ *
+ * Each step "presses a key", after which a simulated screen reader begins
+ * speaking after a short delay and speaks a few utterances of varying length.
+ * A fixed wait must accommodate the slowest response in the suite; waiting
+ * for output to settle lets each step proceed as soon as its speech ends. Both
+ * strategies must capture all of a step's speech before the next step begins.
+ *
+ * Usage: node bench/settled.js [--quick]
+ */
+'use strict';
+
+const { CapturedOutput } = require('../lib/captured-output');
+
+const quick = process.argv.includes('--quick');
+const STEPS = quick ? 12 : 60;
+// Durations are scaled down in quick mode so that the benchmark can run as a
+// test.
+const SCALE = quick ? 0.1 : 1;
+
+const LATENCY = [20, 120];
+const UTTERANCE = [100, 600];
+const GAP = [0, 80];
+const MAX_UTTERANCES = 3;
+const QUIET_PERIOD = 250;
+// Long enough for the slowest possible response.
+const FIXED_WAIT = LATENCY[1] + MAX_UTTERANCES * UTTERANCE[1] + (MAX_UTTERANCES - 1) * GAP[1] + 100;
+
+const delay = ms => new Promise(resolve => setTimeout(resolve, ms * SCALE));
+
+const check = (condition, description) => {
+  if (!condition) {
+    console.error(`check failed: ${description}`);
+    process.exit(1);
+  }
+};
+
+/**
+ * A deterministic sequence of pseudo-random numbers, so that both strategies
+ * face the same responses.
+ */
+const createRandom = seed => () => {
+  seed = (seed * 1103515245 + 12345) % 2147483648;
+  return seed / 2147483648;
+};
+
+const between = (random, [min, max]) => min + Math.floor(random() * (max - min));
+
+/**
+ * Simulate the screen reader's response to a key press.
+ */
+const respond = async (output, random, step) => {
+  await delay(between(random, LATENCY));
+  const count = 1 + Math.floor(random() * MAX_UTTERANCES);
+  for (let i = 0; i < count; i += 1) {
+    const id = `${step}.${i}`;
+    output.deliver({ type: 'event', name: 'speakBegin', data: id });
+    output.deliver({ type: 'event', name: 'speech', data: `step ${step} utterance ${i}` });
+    await delay(between(random, UTTERANCE));
+    output.deliver({ type: 'event', name: 'speakEnd', data: id });
+    if (i + 1 < count) {
+      await delay(between(random, GAP));
+    }
+  }
+};
+
+const runSuite = async (name, wait) => {
+  const output = new CapturedOutput({ quietPeriod: QUIET_PERIOD * SCALE });
+  const random = createRandom(42);
+
+  const start = Date.now();
+  for (let step = 0; step < STEPS; step += 1) {
+    let finished = false;
+    const response = respond(output, random, step).then(() => (finished = true));
+    await wait(output);
+    check(finished, `${name}: every utterance is captured before moving on`);
+    await response;
+  }
+  const elapsed = (Date.now() - start) / SCALE;
+  console.log(`  ${name.padEnd(28)} ${elapsed.toFixed(0).padStart(10)} ms`);
+  return elapsed;
+};
+
+(async () => {
+  console.log(
+    `\n${STEPS} steps, ${LATENCY[0]}-${LATENCY[1]} ms latency, 1-${MAX_UTTERANCES} utterances of ` +
+      `${UTTERANCE[0]}-${UTTERANCE[1]} ms (times are unscaled)`,
+  );
+  const fixed = await runSuite(`fixed wait (${FIXED_WAIT} ms)`, () => delay(FIXED_WAIT));
+  const settled = await runSuite(`waitForSettled (${QUIET_PERIOD} ms)`, output =>
+    output.waitForSettled(),
+  );
+  console.log(`  ${(fixed / settled).toFixed(2)}x faster`);
+  check(settled < fixed, 'waiting for output to settle shortens the suite');
+})();
@@ -0,0 +1,473 @@
+/**
+ * Drives the engine's portable Speak path through a great many calls, with
+ * aborts and bookmarks, and fails if any resource which it holds trends
+ * upward, as a leak would in a voice which runs inside the screen reader for
+ * days.
+ *
+ * Each message is formatted, recorded in a capture journal and sent to a
+ * stand-in for the driver by a `DriverClient` with batching and a dictionary,
+ * as the engine's `DriverEndpoint` does. Alternate calls are spoken by a
+ * vocalizer which streams the text through a pipe from a writer thread (as
+ * the engine streams it to the Vocalizer subprocess, which is Windows-only
+ * and is replaced here by the calling thread) and by rendering ahead on a
+ * `RenderQueue`. Every fifth call is aborted part of the way through.
+ *
+ * Between calls, the harness samples the allocations counted by the
+ * replacement `operator new` (`AllocationAccounting.cpp`, linked into this
+ * program), the handles and threads counted by `ResourceCounters`, and, where
+ * `/proc` is available, the descriptors, threads and resident memory of the
+ * process. A resource trends upward if its greatest level during the final
+ * third of the run exceeds its greatest level during the middle third (the
+ * first third being a warm-up) by more than the noise allowed for it.
+ *
+ * Usage: bench-soak [--quick] [--speaks <count>] [--leak]
+ *
+ * `--leak` leaks an allocation every 100 calls, which must be detected.
+ */
+#include "bench.h"
+#include "counting_server.h"
+#include "CaptureJournal.h"
+#include "DriverClient.h"
+#include "EngineCounters.h"
+#include "MessageFormat.h"
+#include "ResourceCounters.h"
+#include "SpeakPipeline.h"
+#include "TextStream.h"
+#include <dirent.h>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const size_t SAMPLES = 60;
+static const uint64_t ABORT_INTERVAL = 5;
+static const uint64_t LEAK_INTERVAL = 100;
+
+// Written so that the leaked allocations are not elided.
+static char* volatile s_pLeaked;
+
+/**
+ * Formats, records and sends each message in the manner of the engine's
+ * `DriverEndpoint::emit`.
+ */
+class DriverSink : public MessageSink
+{
+public:
+    DriverSink(const char* pAddress, CaptureJournal& journal) : m_client(pAddress), m_journal(journal)
+    {
+        DriverClientBatching batching;
+        batching.cbMaxBatch = 64 * 1024;
+        batching.ulMinWindowUs = 250;
+        batching.ulMaxWindowUs = 1000;
+        batching.ulLatencyCapUs = 4000;
+        m_client.setBatching(batching);
+
+        DriverClientDictionary dictionary;
+        dictionary.ulEntries = 1024;
+        dictionary.cbMinEntry = 8;
+        dictionary.cbMaxEntry = 256;
+        m_client.setDictionary(dictionary);
+    }
+
+    HRESULT emit(MessageType type, const char* pData, size_t cbData)
+    {
+        char attributes[2 * MessageBuffer::ATTRIBUTE_SIZE];
+        size_t cbAttributes = 0;
+        uint64_t ullSequence = 0;
+        if (SUCCEEDED(m_record.format(type, pData, cbData)) &&
+            SUCCEEDED(m_journal.append(m_record.data(), m_record.size(), CaptureJournal::now(), &ullSequence)))
+        {
+            cbAttributes = MessageBuffer::formatSequence(ullSequence, attributes);
+            attributes[cbAttributes++] = ' ';
+        }
+        MessageBuffer::formatAttribute("t", monotonicMicroseconds(), attributes + cbAttributes);
+
+        bool fBoundary = type != MessageType::SPEECH && type != MessageType::SPEAK_BEGIN;
+        int status = m_client.send(messageTypeName(type), attributes, pData, cbData, fBoundary);
+        bool fAccepted = status == AT_DRIVER_CLIENT_OK || status == AT_DRIVER_CLIENT_HELD ||
+            status == AT_DRIVER_CLIENT_COALESCED;
+        return fAccepted ? S_OK : E_FAIL;
+    }
+
+    /** Write any messages held in a batch, as the engine's flush timer does. */
+    void flush() { m_client.flush(); }
+
+    DriverClientStatistics statistics() { return m_client.statistics(); }
+
+private:
+    DriverClient    m_client;
+    CaptureJournal& m_journal;
+    MessageBuffer   m_record;
+};
+
+/**
+ * Signals an abort once the given number of writes of audio has been made
+ * during a call, and keeps signalling it for the rest of the call, as SAPI
+ * does. Bookmark names are read while they are delivered, as SAPI copies
+ * them.
+ */
+class SoakSite : public SpeakSite
+{
+public:
+    size_t bookmarks = 0;
+    size_t cbBookmarks = 0;
+
+    /** @param {size_t} abortAfter - writes before the abort, or SIZE_MAX */
+    void beginSpeak(size_t abortAfter)
+    {
+        m_abortAfter = abortAfter;
+        m_writes = 0;
+    }
+
+    uint32_t getActions() { return m_writes >= m_abortAfter ? SPEAK_ACTION_ABORT : 0; }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents)
+    {
+        for (size_t i = 0; i < numEvents; i += 1)
+        {
+            for (const char16_t* p = pEvents[i].pText; *p; p += 1)
+            {
+                cbBookmarks += 1;
+            }
+        }
+        bookmarks += numEvents;
+        return S_OK;
+    }
+
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        m_writes += 1;
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+
+private:
+    size_t m_abortAfter = SIZE_MAX;
+    size_t m_writes = 0;
+};
+
+class PipeTextWriter : public TextStreamWriter
+{
+public:
+    explicit PipeTextWriter(int fd) : m_fd(fd) {}
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer)
+    {
+        const char* p = static_cast<const char*>(pBuffer);
+        while (cbBuffer > 0)
+        {
+            ssize_t cbWritten = ::write(m_fd, p, cbBuffer);
+            if (cbWritten <= 0)
+            {
+                return E_FAIL;
+            }
+            p += cbWritten;
+            cbBuffer -= (size_t)cbWritten;
+        }
+        return S_OK;
+    }
+
+private:
+    int m_fd;
+};
+
+static void closeDescriptor(int fd)
+{
+    if (close(fd) == 0)
+    {
+        ResourceCounters::closed(ResourceCounters::HANDLES);
+    }
+}
+
+/**
+ * Streams the text through a pipe from a writer thread, as the engine's
+ * `vocalize` does, and reads it as the Vocalizer subprocess would, writing
+ * audio for each chunk. On abort, the reading end is closed early, as the
+ * subprocess's is when the engine terminates it.
+ */
+class PipeVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char* pText, size_t cbText, SpeakSite& site)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            return E_FAIL;
+        }
+        ResourceCounters::opened(ResourceCounters::HANDLES, 2);
+
+        int fdWrite = fds[1];
+        std::thread writer([fdWrite, pText, cbText]() {
+            PipeTextWriter pipeWriter(fdWrite);
+            streamText(pText, cbText, pipeWriter);
+            closeDescriptor(fdWrite);
+        });
+        ResourceCounters::opened(ResourceCounters::THREADS);
+
+        char chunk[TEXT_CHUNK_SIZE + 1];
+        uint8_t audio[256] = {};
+        while (!(site.getActions() & SPEAK_ACTION_ABORT) && read(fds[0], chunk, sizeof(chunk)) > 0)
+        {
+            size_t cbWritten = 0;
+            site.write(audio, sizeof(audio), &cbWritten);
+        }
+        closeDescriptor(fds[0]);
+
+        writer.join();
+        ResourceCounters::closed(ResourceCounters::THREADS);
+        return S_OK;
+    }
+};
+
+class SyntheticRenderer : public Renderer
+{
+public:
+    HRESULT render(const char*, size_t cbText, const std::atomic<bool>& cancelled,
+        std::vector<uint8_t>* pAudio)
+    {
+        // Enough audio for several writes to the site, so that aborts fall
+        // part of the way through a fragment.
+        for (size_t i = 0; i < 4 && !cancelled; i += 1)
+        {
+            pAudio->insert(pAudio->end(), SpeakPipeline::AUDIO_WRITE_SIZE, (uint8_t)cbText);
+        }
+        return cancelled ? E_ABORT : S_OK;
+    }
+};
+
+/**
+ * Levels of each resource sampled between calls. Levels which cannot be
+ * measured on this host are negative.
+ */
+struct Sample
+{
+    enum
+    {
+        ALLOCATIONS,
+        ALLOCATED_BYTES,
+        HANDLES,
+        THREADS,
+        DESCRIPTORS,
+        OS_THREADS,
+        RESIDENT_BYTES,
+        COUNT
+    };
+
+    int64_t levels[COUNT];
+};
+
+struct ResourceKind
+{
+    const char* name;
+    // Growth which is not counted as a trend.
+    int64_t     llNoise;
+};
+
+static const ResourceKind RESOURCE_KINDS[Sample::COUNT] = {
+    // Buffers which retain their capacity may grow late in a run with no leak.
+    {"allocations", 4},
+    {"allocated bytes", 64 << 10},
+    {"handles", 0},
+    {"threads", 0},
+    {"descriptors (OS)", 0},
+    {"threads (OS)", 0},
+    // The allocator's free lists and the C library's cache of thread stacks
+    // may grow and shrink with no leak.
+    {"resident bytes (OS)", 4 << 20},
+};
+
+static int64_t countDescriptors()
+{
+    DIR* directory = opendir("/proc/self/fd");
+    if (!directory)
+    {
+        return -1;
+    }
+    int64_t count = 0;
+    while (struct dirent* entry = readdir(directory))
+    {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(directory);
+    // The directory itself is open while it is read.
+    return count - 1;
+}
+
+/** @returns {int64_t} the value of the given field of `/proc/self/status` */
+static int64_t statusField(const char* pName)
+{
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file)
+    {
+        return -1;
+    }
+    char line[256];
+    int64_t value = -1;
+    size_t cbName = strlen(pName);
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, pName, cbName) == 0 && line[cbName] == ':')
+        {
+            value = strtoll(line + cbName + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+static Sample sample()
+{
+    ResourceSnapshot resources = ResourceCounters::snapshot();
+    int64_t llResidentKilobytes = statusField("VmRSS");
+
+    Sample sample;
+    sample.levels[Sample::ALLOCATIONS] = resources.llAllocations;
+    sample.levels[Sample::ALLOCATED_BYTES] = resources.llAllocatedBytes;
+    sample.levels[Sample::HANDLES] = resources.llHandles;
+    sample.levels[Sample::THREADS] = resources.llThreads;
+    sample.levels[Sample::DESCRIPTORS] = countDescriptors();
+    sample.levels[Sample::OS_THREADS] = statusField("Threads");
+    sample.levels[Sample::RESIDENT_BYTES] = llResidentKilobytes < 0 ? -1 : llResidentKilobytes * 1024;
+    return sample;
+}
+
+static int64_t greatest(const std::vector<Sample>& samples, size_t begin, size_t end, size_t resource)
+{
+    int64_t llGreatest = samples[begin].levels[resource];
+    for (size_t i = begin + 1; i < end; i += 1)
+    {
+        llGreatest = samples[i].levels[resource] > llGreatest ? samples[i].levels[resource] : llGreatest;
+    }
+    return llGreatest;
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    uint64_t ullSpeaks = options.quick ? 20000 : 2000000;
+    bool fLeak = false;
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (strcmp(argv[i], "--speaks") == 0 && i + 1 < argc)
+        {
+            ullSpeaks = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--leak") == 0)
+        {
+            fLeak = true;
+        }
+    }
+    bench::check(ullSpeaks >= SAMPLES, "at least as many calls as samples are made");
+
+    // The vocalizer's writer may write to a pipe whose reader has gone, as the
+    // engine's does when the subprocess is terminated.
+    signal(SIGPIPE, SIG_IGN);
+
+    const char* directory = getenv("TMPDIR");
+    std::string base = std::string(directory ? directory : "/tmp") + "/bench-soak";
+    CountingServer server(base + ".socket");
+    server.start();
+    remove((base + ".journal").c_str());
+    CaptureJournal journal;
+    bench::check(SUCCEEDED(journal.open((base + ".journal").c_str(), 1 << 20, 8192)), "journal opens");
+
+    // Say-all: sentences separated by numbered bookmarks. The names vary from
+    // call to call so that the arena's contents do.
+    const char16_t* sentences[] = {
+        u"Heading level 2, Navigation landmark",
+        u"link, Café menu",
+        u"list with 12 items",
+        u"The quick brown fox jumps over the lazy dog, again and again, until the page ends.",
+    };
+    std::vector<std::u16string> names;
+    for (int i = 0; i < 64; i += 1)
+    {
+        names.push_back(u"mark-" + std::u16string(1, (char16_t)(u'0' + i % 10)) +
+            std::u16string(i / 10 + 1, u'x'));
+    }
+
+    DriverSink sink((base + ".socket").c_str(), journal);
+    PipeVocalizer vocalizer;
+    SyntheticRenderer renderer;
+    SpeakPipeline vocalizing(sink, vocalizer);
+    SpeakPipeline rendering(sink, vocalizer);
+    rendering.setRenderer(&renderer, 2);
+    SoakSite site;
+
+    std::vector<SpeakFragment> fragments;
+    std::vector<Sample> samples;
+    uint64_t ullAborted = 0;
+    uint64_t ullInterval = ullSpeaks / SAMPLES;
+    double start = bench::nowNanoseconds();
+    for (uint64_t ullSpeak = 0; ullSpeak < ullSpeaks; ullSpeak += 1)
+    {
+        fragments.clear();
+        for (size_t i = 0; i < 4; i += 1)
+        {
+            const std::u16string& name = names[(ullSpeak + i) % names.size()];
+            fragments.push_back(SpeakFragment{FragmentAction::Bookmark, name.data(), (uint32_t)name.size(), 0});
+            const char16_t* sentence = sentences[(ullSpeak + i) % 4];
+            fragments.push_back(SpeakFragment{FragmentAction::Speak, sentence,
+                (uint32_t)std::char_traits<char16_t>::length(sentence), 0});
+        }
+
+        // Aborts arrive at different points in the call, including before it
+        // has written any audio.
+        bool fAbort = ullSpeak % ABORT_INTERVAL == 0;
+        site.beginSpeak(fAbort ? ullSpeak / ABORT_INTERVAL % 6 : SIZE_MAX);
+        ullAborted += fAbort;
+        SpeakPipeline& pipeline = ullSpeak % 2 ? rendering : vocalizing;
+        bench::check(SUCCEEDED(pipeline.speak(fragments.data(), fragments.size(), site)), "speak succeeds");
+        sink.flush();
+
+        if (fLeak && ullSpeak % LEAK_INTERVAL == 0)
+        {
+            s_pLeaked = new char[64];
+        }
+        if ((ullSpeak + 1) % ullInterval == 0 && samples.size() < SAMPLES)
+        {
+            samples.push_back(sample());
+        }
+    }
+    double elapsed = bench::nowNanoseconds() - start;
+
+    DriverClientStatistics statistics = sink.statistics();
+    printf("\n%llu calls to Speak (%llu aborted), %zu bookmarks delivered\n", (unsigned long long)ullSpeaks,
+        (unsigned long long)ullAborted, site.bookmarks);
+    printf("%-48s %12.1f ns\n", "  per Speak", elapsed / ullSpeaks);
+    printf("  %-22s %14s %14s %14s\n", "resource", "after warm-up", "middle third", "final third");
+
+    bool fTrending = false;
+    for (size_t resource = 0; resource < Sample::COUNT; resource += 1)
+    {
+        if (samples[0].levels[resource] < 0)
+        {
+            printf("  %-22s %14s\n", RESOURCE_KINDS[resource].name, "unavailable");
+            continue;
+        }
+        int64_t llWarm = samples[SAMPLES / 3].levels[resource];
+        int64_t llMiddle = greatest(samples, SAMPLES / 3, 2 * SAMPLES / 3, resource);
+        int64_t llFinal = greatest(samples, 2 * SAMPLES / 3, SAMPLES, resource);
+        bool fGrew = llFinal > llMiddle + RESOURCE_KINDS[resource].llNoise;
+        printf("  %-22s %14lld %14lld %14lld%s\n", RESOURCE_KINDS[resource].name, (long long)llWarm,
+            (long long)llMiddle, (long long)llFinal, fGrew ? "  trending upward" : "");
+        fTrending = fTrending || fGrew;
+    }
+
+    // A call which renders ahead stops at an abort.
+    bench::check(site.bookmarks >= (ullSpeaks - ullAborted) * 4, "every bookmark before an abort is delivered");
+    bench::check(server.await(statistics.ullMessages - statistics.ullDropped), "every message is received");
+    bench::check(!fTrending, "no resource trends upward");
+
+    journal.close();
+    remove((base + ".journal").c_str());
+    return 0;
+}
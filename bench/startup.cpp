@@ -0,0 +1,107 @@
+/**
+ * Measures the latency from constructing the engine's Speak pipeline to the
+ * completion of its first `speak` call. Each sample uses a fresh instance so
+ * that one-time costs (e.g. arena growth) are included.
+ *
+ * The platform-specific portion of startup (COM activation, token
+ * initialization) is measured on Windows by `bench-startup-win32` and reported
+ * at runtime by the engine's "startup" lifecycle message.
+ */
+#include "bench.h"
+#include "EngineCounters.h"
+#include "SpeakPipeline.h"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+class NullSite : public SpeakSite
+{
+public:
+    uint32_t getActions() { return 0; }
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+    HRESULT addEvents(const SpeakEvent*, size_t) { return S_OK; }
+    HRESULT write(const void*, size_t cbBuffer, size_t* pcbWritten)
+    {
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+class NullSink : public MessageSink
+{
+public:
+    HRESULT emit(MessageType, const char*, size_t) { return S_OK; }
+};
+
+class NullVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char*, size_t, SpeakSite&) { return S_OK; }
+};
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int samples = options.quick ? 50 : 20000;
+    const char16_t bookmark[] = u"1";
+    const char16_t text[] = u"Bocoup Automation Voice ready";
+    SpeakFragment fragments[] = {
+        {FragmentAction::Bookmark, bookmark, 1, 0},
+        {FragmentAction::Speak, text, (uint32_t)(sizeof(text) / sizeof(text[0]) - 1), 0},
+    };
+    NullSink sink;
+    NullVocalizer vocalizer;
+    NullSite site;
+    std::vector<double> latencies;
+    latencies.reserve(samples);
+
+    for (int i = 0; i < samples; i += 1)
+    {
+        // The engine's counters are constructed first, and stamp the
+        // beginning of construction.
+        double start = bench::nowNanoseconds();
+        EngineCounters counters;
+        std::unique_ptr<SpeakPipeline> pipeline(new SpeakPipeline(sink, vocalizer));
+        counters.ullTokenBegin = monotonicMicroseconds();
+        pipeline->setSink(sink);
+        counters.ullConstructEnd = monotonicMicroseconds();
+        counters.ullFirstSpeak = monotonicMicroseconds();
+        HRESULT hr = pipeline->speak(fragments, 2, site);
+        latencies.push_back(bench::nowNanoseconds() - start);
+
+        bench::check(SUCCEEDED(hr), "first Speak succeeds");
+        bench::check(counters.ullConstructBegin > 0 && counters.ullConstructBegin <= counters.ullTokenBegin &&
+                counters.ullTokenBegin <= counters.ullConstructEnd &&
+                counters.ullConstructEnd <= counters.ullFirstSpeak,
+            "startup phases are stamped in order");
+
+        unsigned long long construct = 0;
+        unsigned long long token = 0;
+        unsigned long long firstSpeak = 0;
+        std::string description = counters.describeStartup();
+        bench::check(sscanf(description.c_str(), "startup construct=%lluus token=%lluus firstSpeak=%lluus",
+                         &construct, &token, &firstSpeak) == 3,
+            "startup profile is described");
+        bench::check(construct == counters.ullConstructEnd - counters.ullConstructBegin &&
+                token == counters.ullConstructEnd - counters.ullTokenBegin &&
+                firstSpeak == counters.ullFirstSpeak - counters.ullConstructBegin,
+            "startup phases are measured from their beginnings");
+        bench::check(token <= construct && construct <= firstSpeak,
+            "initialization from the token is part of construction");
+        bench::check((double)firstSpeak <= (bench::nowNanoseconds() - start) / 1000 + 1,
+            "startup phases are no longer than the time elapsed");
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("construct-to-first-Speak latency (%d samples)\n", samples);
+    printf("  median %10.1f ns\n", latencies[latencies.size() / 2]);
+    printf("  p95    %10.1f ns\n", latencies[latencies.size() * 95 / 100]);
+    printf("  max    %10.1f ns\n", latencies.back());
+
+    return 0;
+}
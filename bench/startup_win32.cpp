@@ -0,0 +1,66 @@
+/**
+ * Measures the latency from instantiating the installed automation voice to
+ * the completion of its first Speak call, as experienced by a screen reader
+ * which switches to the voice. Requires the voice to be installed (see
+ * `at-driver install`).
+ *
+ * The utterance consists only of a bookmark so that no Vocalizer process is
+ * started and the measurement reflects engine startup alone.
+ */
+#include "bench.h"
+#include "..\src\Shared\branding.h"
+#include <windows.h>
+#include <atlbase.h>
+#include <sapi.h>
+#include <sphelper.h>
+#include <algorithm>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int samples = options.quick ? 3 : 100;
+    std::vector<double> latencies;
+
+    if (FAILED(::CoInitialize(NULL)))
+    {
+        fprintf(stderr, "Unable to initialize COM.\n");
+        return 1;
+    }
+
+    for (int i = 0; i < samples; i += 1)
+    {
+        CComPtr<ISpObjectToken> cpToken;
+        CComPtr<ISpVoice> cpVoice;
+
+        HRESULT hr = SpFindBestToken(SPCAT_VOICES, L"Name=" AUTOMATION_VOICE_NAME, L"", &cpToken);
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "The automation voice is not installed.\n");
+            return 1;
+        }
+
+        double start = bench::nowNanoseconds();
+        hr = cpVoice.CoCreateInstance(CLSID_SpVoice);
+        if (SUCCEEDED(hr))
+        {
+            hr = cpVoice->SetVoice(cpToken);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = cpVoice->Speak(L"<bookmark mark=\"1\"/>", SPF_IS_XML, NULL);
+        }
+        latencies.push_back(bench::nowNanoseconds() - start);
+
+        bench::check(SUCCEEDED(hr), "the automation voice speaks");
+    }
+
+    ::CoUninitialize();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("instantiate-to-first-Speak latency (%d samples)\n", samples);
+    printf("  median %10.1f us\n", latencies[latencies.size() / 2] / 1000);
+    printf("  max    %10.1f us\n", latencies.back() / 1000);
+
+    return 0;
+}
@@ -0,0 +1,345 @@
+/**
+ * Measures the throughput and peak heap usage of handing a large document to
+ * the Vocalizer.
+ *
+ * The "environment block" figures reproduce the engine's previous strategy,
+ * in which the text was appended to a copy of the parent's environment as
+ * the variable "WORDS", so the block (and the engine's memory) grew with the
+ * document. The engine's fixed block accommodated only a few thousand
+ * characters. The "stream" figures write the text with `streamText` to a
+ * bounded pipe, from which a reader modelled on the Vocalizer takes one
+ * chunk at a time, so peak memory does not depend on the document's length.
+ * The reader inspects every byte, so streaming is the slower of the two, but
+ * both are several orders of magnitude faster than speech.
+ */
+#include "bench.h"
+#include "TextStream.h"
+#include "Utf8.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Size of the engine's former environment block, in characters.
+static const size_t LEGACY_BLOCK_SIZE = 4096;
+
+// Each allocation is preceded by its size so that the bytes in use can be
+// tracked.
+static const size_t HEADER_SIZE = alignof(std::max_align_t);
+static std::atomic<size_t> s_bytesInUse{0};
+static std::atomic<size_t> s_peakBytesInUse{0};
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    char* p = static_cast<char*>(malloc(size + HEADER_SIZE));
+    if (!p)
+    {
+        return NULL;
+    }
+    *reinterpret_cast<size_t*>(p) = size;
+    size_t bytesInUse = s_bytesInUse += size;
+    size_t peak = s_peakBytesInUse;
+    while (bytesInUse > peak && !s_peakBytesInUse.compare_exchange_weak(peak, bytesInUse))
+    {
+    }
+    return p + HEADER_SIZE;
+}
+
+void* operator new(size_t size)
+{
+    void* p = operator new(size, std::nothrow);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* p) noexcept
+{
+    if (p)
+    {
+        char* pBlock = static_cast<char*>(p) - HEADER_SIZE;
+        s_bytesInUse -= *reinterpret_cast<size_t*>(pBlock);
+        free(pBlock);
+    }
+}
+
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+/**
+ * Begin measuring peak usage from the bytes currently in use.
+ */
+static size_t resetPeak()
+{
+    size_t bytesInUse = s_bytesInUse;
+    s_peakBytesInUse = bytesInUse;
+    return bytesInUse;
+}
+
+/**
+ * An anonymous pipe with a fixed buffer, as created for the Vocalizer's
+ * standard input.
+ */
+class BoundedPipe
+{
+public:
+    explicit BoundedPipe(size_t capacity) : m_buffer(capacity), m_head(0), m_size(0), m_closed(false) {}
+
+    void write(const char* p, size_t cb)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (cb > 0)
+        {
+            m_changed.wait(lock, [&] { return m_size < m_buffer.size(); });
+            // Copy into the free space following the data, which may wrap.
+            size_t tail = (m_head + m_size) % m_buffer.size();
+            size_t cbCopy = std::min(cb, std::min(m_buffer.size() - m_size, m_buffer.size() - tail));
+            memcpy(m_buffer.data() + tail, p, cbCopy);
+            m_size += cbCopy;
+            p += cbCopy;
+            cb -= cbCopy;
+            m_changed.notify_all();
+        }
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_changed.notify_all();
+    }
+
+    /**
+     * @returns {size_t} number of bytes read, or zero once the pipe has been
+     *                   closed and drained
+     */
+    size_t read(char* p, size_t cb)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&] { return m_size > 0 || m_closed; });
+        size_t cbCopy = std::min(cb, std::min(m_size, m_buffer.size() - m_head));
+        memcpy(p, m_buffer.data() + m_head, cbCopy);
+        m_head = (m_head + cbCopy) % m_buffer.size();
+        m_size -= cbCopy;
+        m_changed.notify_all();
+        return cbCopy;
+    }
+
+private:
+    std::vector<char>       m_buffer;
+    size_t                  m_head;
+    size_t                  m_size;
+    bool                    m_closed;
+    std::mutex              m_mutex;
+    std::condition_variable m_changed;
+};
+
+class PipeWriter : public TextStreamWriter
+{
+public:
+    explicit PipeWriter(BoundedPipe& pipe) : m_pipe(pipe) {}
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer)
+    {
+        m_pipe.write(static_cast<const char*>(pBuffer), cbBuffer);
+        return S_OK;
+    }
+
+private:
+    BoundedPipe& m_pipe;
+};
+
+static uint64_t hashBytes(uint64_t hash, const char* p, size_t cb)
+{
+    for (size_t i = 0; i < cb; i += 1)
+    {
+        hash = (hash ^ (uint8_t)p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static const uint64_t HASH_SEED = 14695981039346656037ull;
+
+struct ReceivedText
+{
+    size_t   numChunks = 0;
+    size_t   cbLargestChunk = 0;
+    size_t   cbText = 0;
+    uint64_t ullHash = HASH_SEED;
+    bool     fSplitCodePoint = false;
+};
+
+/**
+ * Read chunks from the pipe as the Vocalizer does: into a buffer of one
+ * chunk, handing each complete chunk to the synthesizer (which is modelled
+ * by hashing it).
+ */
+static void receive(BoundedPipe& pipe, ReceivedText* pReceived)
+{
+    std::vector<char> chunk(TEXT_CHUNK_SIZE);
+    size_t cbChunk = 0;
+    char input[TEXT_CHUNK_SIZE];
+    size_t cbInput = 0;
+    while ((cbInput = pipe.read(input, sizeof(input))) > 0)
+    {
+        for (size_t i = 0; i < cbInput; i += 1)
+        {
+            if (input[i] != '\0')
+            {
+                bench::check(cbChunk < chunk.size(), "chunks do not exceed the maximum size");
+                chunk[cbChunk] = input[i];
+                cbChunk += 1;
+                continue;
+            }
+
+            pReceived->numChunks += 1;
+            pReceived->cbLargestChunk = std::max(pReceived->cbLargestChunk, cbChunk);
+            pReceived->cbText += cbChunk;
+            pReceived->ullHash = hashBytes(pReceived->ullHash, chunk.data(), cbChunk);
+            if (cbChunk > 0 && (chunk[0] & 0xC0) == 0x80)
+            {
+                pReceived->fSplitCodePoint = true;
+            }
+            cbChunk = 0;
+        }
+    }
+    bench::check(cbChunk == 0, "every chunk is terminated");
+}
+
+/**
+ * Build an environment block in the manner of the engine's former
+ * `createEnv`, sized to fit rather than capped.
+ */
+static size_t buildEnvironmentBlock(const std::vector<std::u16string>& environment, const std::u16string& text)
+{
+    std::vector<char16_t> block;
+    for (const std::u16string& variable : environment)
+    {
+        block.insert(block.end(), variable.begin(), variable.end());
+        block.push_back(0);
+    }
+    std::u16string words = u"WORDS=";
+    block.insert(block.end(), words.begin(), words.end());
+    block.insert(block.end(), text.begin(), text.end());
+    block.push_back(0);
+    block.push_back(0);
+    return block.size();
+}
+
+static std::u16string makeDocument(size_t length)
+{
+    const char16_t* sentences[] = {
+        u"The quick brown fox jumps over the lazy dog. ",
+        u"Café menu, list with 12 items; crème brûlée is served daily. ",
+        u"日本語のテキストも読み上げられます。",
+        u"Heading level 2, Navigation landmark, link, visited link. ",
+    };
+    std::u16string document;
+    for (size_t i = 0; document.size() < length; i += 1)
+    {
+        // A long run without whitespace, such as a URL or an encoded value,
+        // must be divided within the word.
+        if (i % 97 == 50)
+        {
+            document += u"https://example.com/";
+            document.append(TEXT_CHUNK_SIZE + 100, u'é');
+            document += u' ';
+        }
+        document += sentences[i % 4];
+    }
+    document.resize(length);
+    return document;
+}
+
+static void checkChunking()
+{
+    const char* text = "one two three";
+    bench::check(nextTextChunk(text, strlen(text), 100) == strlen(text), "short text is a single chunk");
+    bench::check(nextTextChunk(text, strlen(text), 9) == 8, "chunks end after whitespace");
+    bench::check(nextTextChunk(text, strlen(text), 3) == 3, "a long word is divided");
+    const char* accented = "\xC3\xA9\xC3\xA9\xC3\xA9";
+    bench::check(nextTextChunk(accented, 6, 3) == 2, "a long word is divided between code points");
+    bench::check(nextTextChunk("ab\0cd", 5, 4) == 2, "a null character ends a chunk");
+    bench::check(nextTextChunk("", 0, 4) == 0, "empty text has no chunks");
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    std::vector<size_t> lengths = options.quick ?
+        std::vector<size_t>{ 500, 64 * 1024, 1024 * 1024 } :
+        std::vector<size_t>{ 500, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024 };
+    int iterations = options.quick ? 2 : 5;
+
+    checkChunking();
+
+    // A typical parent environment of about 3 KB.
+    std::vector<std::u16string> environment;
+    for (int i = 0; i < 40; i += 1)
+    {
+        environment.push_back(u"VARIABLE_" + std::u16string(1, (char16_t)(u'A' + i % 26)) + u"=" +
+            std::u16string(64, u'x'));
+    }
+
+    printf("\n%-36s %14s %12s %14s\n", "document (UTF-16 units)", "method", "MB/s", "peak heap (KB)");
+    size_t cbStreamPeak = 0;
+    for (size_t length : lengths)
+    {
+        std::u16string document = makeDocument(length);
+        std::string text = toUtf8(document.data(), document.size());
+        double megabytes = (double)text.size() / (1024 * 1024);
+
+        size_t baseline = resetPeak();
+        size_t cbBlock = 0;
+        double start = bench::nowNanoseconds();
+        for (int i = 0; i < iterations; i += 1)
+        {
+            cbBlock = buildEnvironmentBlock(environment, document);
+        }
+        double seconds = (bench::nowNanoseconds() - start) / 1e9 / iterations;
+        printf("%-36zu %14s %12.1f %14.1f%s\n", length, "env block", megabytes / seconds,
+            (double)(s_peakBytesInUse - baseline) / 1024,
+            cbBlock > LEGACY_BLOCK_SIZE ? "  (exceeds former block)" : "");
+
+        ReceivedText received;
+        baseline = resetPeak();
+        start = bench::nowNanoseconds();
+        for (int i = 0; i < iterations; i += 1)
+        {
+            received = ReceivedText();
+            BoundedPipe pipe(TEXT_CHUNK_SIZE + 1);
+            std::thread reader(receive, std::ref(pipe), &received);
+            PipeWriter writer(pipe);
+            bench::check(SUCCEEDED(streamText(text.data(), text.size(), writer)), "the text is streamed");
+            pipe.close();
+            reader.join();
+        }
+        seconds = (bench::nowNanoseconds() - start) / 1e9 / iterations;
+        size_t cbPeak = s_peakBytesInUse - baseline;
+        printf("%-36s %14s %12.1f %14.1f  (%zu chunks)\n", "", "stream", megabytes / seconds,
+            (double)cbPeak / 1024, received.numChunks);
+
+        bench::check(received.cbText == text.size(), "every byte is received");
+        bench::check(received.ullHash == hashBytes(HASH_SEED, text.data(), text.size()),
+            "the text is received intact");
+        bench::check(received.cbLargestChunk <= TEXT_CHUNK_SIZE, "chunks do not exceed the maximum size");
+        bench::check(!received.fSplitCodePoint, "chunks begin on code point boundaries");
+        cbStreamPeak = std::max(cbStreamPeak, cbPeak);
+    }
+
+    // The pipe, the reader's buffer and the thread's bookkeeping are all that
+    // streaming allocates, however long the document.
+    bench::check(cbStreamPeak < 4 * TEXT_CHUNK_SIZE + 64 * 1024, "streaming memory is bounded");
+
+    return 0;
+}
@@ -0,0 +1,319 @@
+/**
+ * Measures the cost of finding a word in a memory-mapped voice data file, and
+ * the throughput with which `VoiceDataVocalizer` speaks text from one.
+ *
+ * For comparison, the lookup is also performed by a linear, case-insensitive
+ * scan of a word list in the manner of the Speech SDK's sample engine, which
+ * the hashed index replaces.
+ *
+ * The sample voice's word list (`src/makevoice/SampleVoice.vce`) is converted
+ * to verify that every one of its recordings survives the conversion intact.
+ */
+#include "bench.h"
+#include "SpeakPipeline.h"
+#include "Utf8.h"
+#include "VoiceData.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const VoiceAudioFormat FORMAT = { 11025, 16, 1 };
+
+class NullSink : public MessageSink
+{
+public:
+    HRESULT emit(MessageType, const char*, size_t) { return S_OK; }
+};
+
+class NullVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char*, size_t, SpeakSite&) { return S_OK; }
+};
+
+/**
+ * Consumes audio and records the positions of bookmarks within it.
+ */
+class CountingSite : public SpeakSite
+{
+public:
+    uint32_t ulAbortAfterWrites = 0;
+    uint32_t ulWrites = 0;
+    uint64_t ullBytes = 0;
+    uint32_t ulChecksum = 0;
+    std::vector<uint64_t> bookmarkOffsets;
+
+    uint32_t getActions()
+    {
+        return ulAbortAfterWrites && ulWrites >= ulAbortAfterWrites ? SPEAK_ACTION_ABORT : 0;
+    }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        *pullEventInterest = 1ull << SPEAK_EVENT_BOOKMARK;
+        return S_OK;
+    }
+
+    HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents)
+    {
+        for (size_t i = 0; i < numEvents; i += 1)
+        {
+            bookmarkOffsets.push_back(pEvents[i].ullAudioStreamOffset);
+        }
+        return S_OK;
+    }
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten)
+    {
+        // Touch the audio, as the output site's copy does.
+        const uint8_t* pBytes = (const uint8_t*)pBuffer;
+        for (size_t i = 0; i < cbBuffer; i += 64)
+        {
+            ulChecksum += pBytes[i];
+        }
+        ulWrites += 1;
+        ullBytes += cbBuffer;
+        *pcbWritten = cbBuffer;
+        return S_OK;
+    }
+};
+
+static std::string tempPath(const char* name)
+{
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/" + name;
+}
+
+static std::u16string toUtf16(const std::string& text)
+{
+    return std::u16string(text.begin(), text.end());
+}
+
+static bool equalsIgnoringCase(const char16_t* a, const char16_t* b, size_t length)
+{
+    for (size_t i = 0; i < length; i += 1)
+    {
+        char16_t ca = a[i] >= u'A' && a[i] <= u'Z' ? a[i] + 32 : a[i];
+        char16_t cb = b[i] >= u'A' && b[i] <= u'Z' ? b[i] + 32 : b[i];
+        if (ca != cb)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The sample engine's strategy: compare the word with every entry in turn.
+ */
+static const VoiceDataEntry* scan(const std::vector<VoiceDataEntry>& words, const char16_t* pText, size_t length)
+{
+    for (const VoiceDataEntry& word : words)
+    {
+        if (word.text.size() == length && equalsIgnoringCase(word.text.data(), pText, length))
+        {
+            return &word;
+        }
+    }
+    return NULL;
+}
+
+static void checkSampleVoice()
+{
+    std::string source(__FILE__);
+    std::string path = source.substr(0, source.find_last_of("/\\") + 1) + "../src/makevoice/SampleVoice.vce";
+    std::ifstream file(path.c_str(), std::ios::binary);
+    bench::check(file.good(), "the sample voice can be read");
+    std::vector<uint8_t> sampleVoice((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::vector<VoiceDataEntry> entries;
+    bench::check(SUCCEEDED(parseSampleVoice(sampleVoice.data(), sampleVoice.size(), &entries)),
+        "the sample voice is parsed");
+    bench::check(entries.size() == 19, "every word of the sample voice is parsed");
+    bench::check(FAILED(parseSampleVoice(sampleVoice.data(), sampleVoice.size() - 1, &entries)),
+        "a truncated sample voice is rejected");
+    parseSampleVoice(sampleVoice.data(), sampleVoice.size(), &entries);
+
+    std::string convertedPath = tempPath("bench-sample.atvd");
+    bench::check(SUCCEEDED(writeVoiceData(convertedPath.c_str(), FORMAT, entries.data(), entries.size())),
+        "the sample voice is converted");
+
+    VoiceData voiceData;
+    bench::check(SUCCEEDED(voiceData.open(convertedPath.c_str())), "the converted sample voice opens");
+    bench::check(voiceData.numWords() == entries.size(), "every word is converted");
+    for (const VoiceDataEntry& entry : entries)
+    {
+        VoiceWord word;
+        std::string utf8 = toUtf8(entry.text.data(), entry.text.size());
+        bench::check(voiceData.lookUp(utf8.data(), utf8.size(), &word), "every word is found");
+        bench::check(word.ulNumAudioBytes == entry.audio.size() &&
+            memcmp(word.pAudio, entry.audio.data(), entry.audio.size()) == 0, "audio is preserved");
+        bench::check(std::u16string(word.pText) == entry.text, "text is preserved");
+    }
+    printf("  sample voice: %u words converted\n", voiceData.numWords());
+
+    voiceData.close();
+    remove(convertedPath.c_str());
+}
+
+static void checkCorruption(const std::string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::vector<char> original((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string corruptPath = tempPath("bench-corrupt.atvd");
+
+    // Truncation, and an entry whose audio extends beyond the file.
+    for (size_t variant = 0; variant < 2; variant += 1)
+    {
+        std::vector<char> corrupt(original);
+        if (variant == 0)
+        {
+            corrupt.resize(corrupt.size() - 4);
+        }
+        else
+        {
+            uint32_t ulNumBuckets;
+            memcpy(&ulNumBuckets, &corrupt[12], 4);
+            uint32_t ulHuge = 0x7FFFFFFF;
+            memcpy(&corrupt[VoiceData::HEADER_SIZE + ulNumBuckets * 4 + 20], &ulHuge, 4);
+        }
+        std::ofstream out(corruptPath.c_str(), std::ios::binary);
+        out.write(corrupt.data(), corrupt.size());
+        out.close();
+
+        VoiceData voiceData;
+        bench::check(FAILED(voiceData.open(corruptPath.c_str())) && !voiceData.isOpen(),
+            "a corrupt voice data file is rejected");
+    }
+
+    remove(corruptPath.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    bench::Options options = bench::parseOptions(argc, argv);
+    int iterations = options.quick ? 20 : 2000;
+    size_t numWords = options.quick ? 500 : 5000;
+
+    // A synthetic vocabulary whose recordings average about a third of a
+    // second.
+    std::vector<VoiceDataEntry> entries(numWords);
+    for (size_t i = 0; i < numWords; i += 1)
+    {
+        entries[i].text = toUtf16("word" + std::to_string(i));
+        entries[i].audio.assign(4000 + (i % 7) * 1000, (uint8_t)i);
+    }
+
+    std::string path = tempPath("bench-voicedata.atvd");
+    bench::check(SUCCEEDED(writeVoiceData(path.c_str(), FORMAT, entries.data(), entries.size())),
+        "voice data is written");
+
+    VoiceData voiceData;
+    bench::check(SUCCEEDED(voiceData.open(path.c_str())), "voice data opens");
+    bench::check(voiceData.numWords() == numWords, "every word is indexed");
+    bench::check(voiceData.format().ulSamplesPerSecond == 11025 && voiceData.format().usBitsPerSample == 16 &&
+        voiceData.format().usChannels == 1, "the audio format is recorded");
+
+    // Queries alternate between words in the vocabulary (in varying case)
+    // and words which are absent.
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < 256; i += 1)
+    {
+        queries.push_back(i % 2 ? "WORD" + std::to_string(i * 7919 % numWords) : "absent" + std::to_string(i));
+    }
+    std::vector<std::u16string> wideQueries;
+    for (const std::string& query : queries)
+    {
+        wideQueries.push_back(toUtf16(query));
+    }
+
+    printf("\nlookup (%zu words, half of the queries absent)\n", numWords);
+    size_t found = 0;
+    bench::measure("  linear scan, per lookup", iterations, (double)wideQueries.size(), [&] {
+        for (const std::u16string& query : wideQueries)
+        {
+            found += scan(entries, query.data(), query.size()) != NULL;
+        }
+    });
+    bench::check(found == wideQueries.size() / 2 * iterations, "the scan finds every present word");
+
+    found = 0;
+    VoiceWord word;
+    bench::measure("  hashed index (UTF-16), per lookup", iterations * 10, (double)wideQueries.size(), [&] {
+        for (const std::u16string& query : wideQueries)
+        {
+            found += voiceData.lookUp(query.data(), query.size(), &word);
+        }
+    });
+    bench::check(found == wideQueries.size() / 2 * iterations * 10, "the index finds every present word");
+
+    found = 0;
+    bench::measure("  hashed index (UTF-8), per lookup", iterations * 10, (double)queries.size(), [&] {
+        for (const std::string& query : queries)
+        {
+            found += voiceData.lookUp(query.data(), query.size(), &word);
+        }
+    });
+    bench::check(found == queries.size() / 2 * iterations * 10, "UTF-8 lookups find every present word");
+
+    bench::check(voiceData.lookUp("Word42", 6, &word) && word.ulNumAudioBytes == entries[42].audio.size() &&
+        word.pAudio[0] == 42, "lookups ignore case");
+    bench::check(!voiceData.lookUp("word4", 4, &word), "lookups match whole words");
+
+    // Speaking a sentence of known words, with the occasional unknown word
+    // and punctuation, through the pipeline.
+    std::string sentence;
+    size_t knownWords = 0;
+    for (size_t i = 0; i < 32; i += 1)
+    {
+        sentence += i % 8 == 7 ? std::string("unknown, ") : "word" + std::to_string(i * 31 % numWords) + " ";
+        knownWords += i % 8 != 7;
+    }
+    std::u16string wideSentence = toUtf16(sentence);
+    std::u16string bookmark = u"1";
+    std::vector<SpeakFragment> fragments = {
+        SpeakFragment{FragmentAction::Speak, wideSentence.data(), (uint32_t)wideSentence.size(), 0},
+        SpeakFragment{FragmentAction::Bookmark, bookmark.data(), (uint32_t)bookmark.size(), 0},
+        SpeakFragment{FragmentAction::Speak, wideSentence.data(), (uint32_t)wideSentence.size(), 0},
+    };
+
+    NullSink sink;
+    NullVocalizer nullVocalizer;
+    VoiceDataVocalizer vocalizer(voiceData);
+    SpeakPipeline pipeline(sink, nullVocalizer);
+    pipeline.setVocalizer(vocalizer);
+
+    CountingSite site;
+    bench::check(SUCCEEDED(pipeline.speak(fragments.data(), fragments.size(), site)), "speak succeeds");
+    size_t cbSilence = (size_t)FORMAT.ulSamplesPerSecond * VoiceDataVocalizer::UNKNOWN_WORD_SILENCE_MS / 1000 * 2;
+    uint64_t ullSentenceBytes = 0;
+    for (size_t i = 0; i < 32; i += 1)
+    {
+        ullSentenceBytes += i % 8 == 7 ? cbSilence : entries[i * 31 % numWords].audio.size();
+    }
+    bench::check(site.ullBytes == ullSentenceBytes * 2, "each word's audio is written in full");
+    bench::check(site.bookmarkOffsets.size() == 1 && site.bookmarkOffsets[0] == ullSentenceBytes,
+        "bookmarks are positioned after the audio which precedes them");
+    bench::check(vocalizer.ullKnownWords == knownWords * 2 && vocalizer.ullUnknownWords == (32 - knownWords) * 2,
+        "known and unknown words are distinguished");
+
+    printf("\nvocalize (%zu words per sentence, %.0f ms of audio)\n", (size_t)32,
+        (double)ullSentenceBytes * 1000 / (FORMAT.ulSamplesPerSecond * 2));
+    double perWord = bench::measure("  per word", iterations * 10, 64, [&] {
+        pipeline.speak(fragments.data(), fragments.size(), site);
+    });
+    printf("  %.0f MB of audio per second\n", (double)ullSentenceBytes * 2 / (perWord * 64) * 1e3);
+
+    CountingSite abortingSite;
+    abortingSite.ulAbortAfterWrites = 3;
+    bench::check(pipeline.speak(fragments.data(), 1, abortingSite) == S_OK, "an aborted speak succeeds");
+    bench::check(abortingSite.ulWrites == 3, "no audio is written after an abort");
+
+    voiceData.close();
+    checkCorruption(path);
+    remove(path.c_str());
+
+    checkSampleVoice();
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+
+const { AudioTap, encodeWav } = require('./audio-tap');
+
+/** @typedef {import('./audio-tap').AudioRecord} AudioRecord */
+/** @typedef {import('./create-voice-server').VoiceMessage} VoiceMessage */
+
+/**
+ * Number of milliseconds between reads of the audio tap while it is enabled.
+ * The tap holds several minutes of audio, so this is chosen for the latency
+ * of streamed samples rather than to avoid dropping them.
+ */
+const DEFAULT_POLL_INTERVAL = 20;
+
+/**
+ * Maximum number of bytes of audio retained for an utterance which is in
+ * progress; samples beyond this are streamed but omitted from the utterance's
+ * recording.
+ */
+const DEFAULT_MAX_UTTERANCE_BYTES = 16 * 1024 * 1024;
+
+/**
+ * Maximum number of utterances in progress whose audio is retained (so that
+ * utterances whose end is never reported do not accumulate).
+ */
+const MAX_PENDING_UTTERANCES = 64;
+
+/**
+ * Captures the audio which the automation voice produces, via its audio tap.
+ * The tap is enabled only while capture has been requested, so that the voice
+ * incurs no cost otherwise.
+ *
+ * Emits "samples" with each `AudioRecord` as it is drained from the tap, and
+ * "utterance" with `{utteranceId, wav}` when an utterance for which audio was
+ * captured ends.
+ */
+class AudioCapture extends EventEmitter {
+  /**
+   * @param {string} path - location of the audio tap
+   * @param {object} [options]
+   * @param {number} [options.pollInterval] - milliseconds
+   * @param {number} [options.maxUtteranceBytes]
+   */
+  constructor(
+    path,
+    { pollInterval = DEFAULT_POLL_INTERVAL, maxUtteranceBytes = DEFAULT_MAX_UTTERANCE_BYTES } = {},
+  ) {
+    super();
+    this.path = path;
+    this.pollInterval = pollInterval;
+    this.maxUtteranceBytes = maxUtteranceBytes;
+    /** @type {AudioTap|null} */
+    this.tap = null;
+    this.references = 0;
+    /** @type {ReturnType<typeof setInterval> | null} */
+    this.pollTimer = null;
+    /** @type {Map<string, {chunks: Buffer[], length: number}>} */
+    this.utterances = new Map();
+  }
+
+  /**
+   * Open the tap if it exists and has not yet been opened. The voice creates
+   * the tap on first use, so it may appear after the driver starts.
+   *
+   * @returns {boolean} whether the tap is available
+   */
+  openTap() {
+    if (!this.tap) {
+      this.tap = AudioTap.open(this.path);
+      if (this.tap) {
+        this.tap.setEnabled(this.references > 0);
+      }
+    }
+    return !!this.tap;
+  }
+
+  /**
+   * Begin capturing audio on behalf of a client. Every call must be balanced
+   * by a call to `release`.
+   */
+  retain() {
+    this.references += 1;
+    if (this.references === 1) {
+      if (this.openTap()) {
+        this.tap.setEnabled(true);
+      }
+      this.pollTimer = setInterval(() => this.poll(), this.pollInterval);
+      this.pollTimer.unref();
+    }
+  }
+
+  release() {
+    this.references -= 1;
+    if (this.references === 0) {
+      clearInterval(this.pollTimer);
+      this.pollTimer = null;
+      if (this.tap) {
+        this.tap.setEnabled(false);
+        // Audio which was written before the tap was disabled is discarded.
+        this.tap.drain();
+      }
+      this.utterances.clear();
+    }
+  }
+
+  close() {
+    clearInterval(this.pollTimer);
+    this.pollTimer = null;
+    if (this.tap) {
+      this.tap.setEnabled(false);
+      this.tap.close();
+      this.tap = null;
+    }
+  }
+
+  poll() {
+    if (!this.openTap()) {
+      return;
+    }
+    for (const record of this.tap.drain()) {
+      this.retainSamples(record);
+      this.emit('samples', record);
+    }
+  }
+
+  /**
+   * @param {AudioRecord} record
+   */
+  retainSamples(record) {
+    let utterance = this.utterances.get(record.utteranceId);
+    if (!utterance) {
+      if (this.utterances.size >= MAX_PENDING_UTTERANCES) {
+        this.utterances.delete(this.utterances.keys().next().value);
+      }
+      utterance = { chunks: [], length: 0 };
+      this.utterances.set(record.utteranceId, utterance);
+    }
+    if (utterance.length + record.samples.length <= this.maxUtteranceBytes) {
+      utterance.chunks.push(record.samples);
+      utterance.length += record.samples.length;
+    }
+  }
+
+  /**
+   * Observe a message from the voice. The voice writes an utterance's audio to
+   * the tap before it reports that the utterance has ended, so the tap is
+   * drained at that point to complete the utterance's recording.
+   *
+   * @param {VoiceMessage} message
+   */
+  deliver(message) {
+    if (message.name !== 'speakEnd' || this.references === 0) {
+      return;
+    }
+    this.poll();
+    const utterance = this.utterances.get(message.data);
+    if (utterance) {
+      this.utterances.delete(message.data);
+      this.emit('utterance', {
+        utteranceId: message.data,
+        wav: encodeWav(this.tap.format, Buffer.concat(utterance.chunks, utterance.length)),
+      });
+    }
+  }
+}
+
+/**
+ * Encode a record as a binary WebSocket frame: the length of a JSON header
+ * (as a little-endian 32-bit integer), the header, and the samples.
+ *
+ * @param {AudioRecord} record
+ * @param {import('./audio-tap').AudioFormat} format
+ *
+ * @returns {Buffer}
+ */
+const encodeAudioFrame = ({ utteranceId, offset, timestamp, samples }, format) => {
+  const header = Buffer.from(JSON.stringify({ utteranceId, offset, timestamp, ...format }), 'utf8');
+  const length = Buffer.alloc(4);
+  length.writeUInt32LE(header.length, 0);
+  return Buffer.concat([length, header, samples]);
+};
+
+module.exports = { AudioCapture, encodeAudioFrame };
@@ -0,0 +1,251 @@
+'use strict';
+
+const fs = require('fs');
+
+const { readUInt64, writeUInt64 } = require('./capture-journal');
+
+/**
+ * Reader for the audio tap maintained by the automation voice. While the tap
+ * is enabled, the voice mirrors the audio which it writes to the Speech API
+ * into this memory-mapped ring. See `src/automationttsengine/AudioTap.h` for a
+ * description of the file format.
+ */
+
+const WINDOWS_AUDIO_TAP_PATH = 'C:\\ProgramData\\Bocoup Automation Voice\\audio.tap';
+
+const MAGIC = 'ATAP';
+const VERSION = 1;
+const HEADER_SIZE = 64;
+const RECORD_HEADER_SIZE = 48;
+const RECORD_ALIGNMENT = 16;
+// A padding record comprises only its commit and length fields.
+const MINIMUM_RECORD_SIZE = 16;
+const PADDING_LENGTH = 0xffffffff;
+
+const OFFSET_VERSION = 4;
+const OFFSET_CAPACITY = 8;
+const OFFSET_RESERVE_OFFSET = 16;
+const OFFSET_READ_OFFSET = 24;
+const OFFSET_DROPPED_BYTES = 32;
+const OFFSET_ENABLED = 40;
+const OFFSET_SAMPLES_PER_SEC = 44;
+const OFFSET_BITS_PER_SAMPLE = 48;
+const OFFSET_CHANNELS = 50;
+
+/**
+ * Number of milliseconds after which a record whose space has been reserved
+ * but which has not been published is assumed to have been abandoned (by a
+ * process which terminated while writing it).
+ */
+const ABANDONED_RECORD_TIMEOUT = 1000;
+
+/** @param {number} size */
+const alignRecord = size => Math.ceil(size / RECORD_ALIGNMENT) * RECORD_ALIGNMENT;
+
+/**
+ * @typedef AudioFormat
+ * @property {number} samplesPerSec
+ * @property {number} bitsPerSample
+ * @property {number} channels
+ */
+
+/**
+ * @typedef AudioRecord
+ * @property {string} utteranceId - as reported by `speakBegin` and `speakEnd`
+ * @property {number} offset - position of the samples within the utterance,
+ *                             in bytes
+ * @property {number} timestamp - microseconds since the Unix epoch
+ * @property {Buffer} samples - PCM
+ */
+
+class AudioTap {
+  /**
+   * @param {number} fd
+   * @param {number} capacity
+   * @param {AudioFormat} format
+   */
+  constructor(fd, capacity, format) {
+    this.fd = fd;
+    this.capacity = capacity;
+    this.format = format;
+    /** @type {number|null} time at which an unpublished record was found */
+    this.stalledSince = null;
+  }
+
+  /**
+   * @param {string} path
+   *
+   * @returns {AudioTap|null} the tap, or `null` if no valid tap exists at the
+   *                          given location
+   */
+  static open(path) {
+    let fd;
+    try {
+      fd = fs.openSync(path, 'r+');
+    } catch (error) {
+      if (error.code === 'ENOENT') {
+        return null;
+      }
+      throw error;
+    }
+
+    const header = Buffer.alloc(HEADER_SIZE);
+    const bytesRead = fs.readSync(fd, header, 0, HEADER_SIZE, 0);
+    if (
+      bytesRead !== HEADER_SIZE ||
+      header.toString('latin1', 0, 4) !== MAGIC ||
+      header.readUInt32LE(OFFSET_VERSION) !== VERSION
+    ) {
+      fs.closeSync(fd);
+      return null;
+    }
+
+    return new AudioTap(fd, readUInt64(header, OFFSET_CAPACITY), {
+      samplesPerSec: header.readUInt32LE(OFFSET_SAMPLES_PER_SEC),
+      bitsPerSample: header.readUInt16LE(OFFSET_BITS_PER_SAMPLE),
+      channels: header.readUInt16LE(OFFSET_CHANNELS),
+    });
+  }
+
+  close() {
+    fs.closeSync(this.fd);
+  }
+
+  /**
+   * @returns {{reserveOffset: number, readOffset: number, droppedBytes: number, enabled: boolean}}
+   */
+  readHeader() {
+    const header = Buffer.alloc(HEADER_SIZE);
+    fs.readSync(this.fd, header, 0, HEADER_SIZE, 0);
+    return {
+      reserveOffset: readUInt64(header, OFFSET_RESERVE_OFFSET),
+      readOffset: readUInt64(header, OFFSET_READ_OFFSET),
+      droppedBytes: readUInt64(header, OFFSET_DROPPED_BYTES),
+      enabled: header.readUInt32LE(OFFSET_ENABLED) !== 0,
+    };
+  }
+
+  /**
+   * Ask the voice to begin (or stop) mirroring its audio.
+   *
+   * @param {boolean} enabled
+   */
+  setEnabled(enabled) {
+    const value = Buffer.alloc(4);
+    value.writeUInt32LE(enabled ? 1 : 0, 0);
+    fs.writeSync(this.fd, value, 0, 4, OFFSET_ENABLED);
+  }
+
+  /**
+   * @param {number} readOffset
+   */
+  release(readOffset) {
+    const value = Buffer.alloc(8);
+    writeUInt64(value, readOffset, 0);
+    fs.writeSync(this.fd, value, 0, 8, OFFSET_READ_OFFSET);
+  }
+
+  /**
+   * Take every published record, releasing their space to the voice. The
+   * published portion of the ring is read with at most two reads (one on
+   * either side of its end).
+   *
+   * @param {number} [now] - the current time, in milliseconds
+   *
+   * @returns {AudioRecord[]}
+   */
+  drain(now = Date.now()) {
+    const { reserveOffset, readOffset: initialReadOffset } = this.readHeader();
+    /** @type {AudioRecord[]} */
+    const records = [];
+    let readOffset = initialReadOffset;
+
+    while (readOffset < reserveOffset) {
+      const position = readOffset % this.capacity;
+      const length = Math.min(reserveOffset - readOffset, this.capacity - position);
+      const region = Buffer.alloc(length);
+      fs.readSync(this.fd, region, 0, length, HEADER_SIZE + position);
+
+      let consumed = 0;
+      while (consumed + MINIMUM_RECORD_SIZE <= length) {
+        if (readUInt64(region, consumed) !== readOffset + consumed + 1) {
+          break;
+        }
+        const size = region.readUInt32LE(consumed + 8);
+        if (size === PADDING_LENGTH) {
+          consumed = length;
+          break;
+        }
+        const end = consumed + RECORD_HEADER_SIZE + size;
+        if (end > length) {
+          break;
+        }
+        records.push({
+          utteranceId: region.readBigUInt64LE(consumed + 16).toString(),
+          offset: readUInt64(region, consumed + 24),
+          timestamp: readUInt64(region, consumed + 32),
+          samples: Buffer.from(region.subarray(consumed + RECORD_HEADER_SIZE, end)),
+        });
+        consumed = Math.min(alignRecord(end), length);
+      }
+
+      readOffset += consumed;
+      if (consumed < length) {
+        break;
+      }
+    }
+
+    if (readOffset < reserveOffset && records.length === 0) {
+      // Writers publish their records promptly, so one which remains
+      // unpublished belongs to a writer which will never finish it.
+      if (this.stalledSince === null) {
+        this.stalledSince = now;
+      } else if (now - this.stalledSince >= ABANDONED_RECORD_TIMEOUT) {
+        readOffset = reserveOffset;
+      }
+    }
+    if (readOffset === reserveOffset || records.length > 0) {
+      this.stalledSince = null;
+    }
+
+    if (readOffset !== initialReadOffset) {
+      this.release(readOffset);
+    }
+    return records;
+  }
+}
+
+/**
+ * Encode PCM samples as a WAV file.
+ *
+ * @param {AudioFormat} format
+ * @param {Buffer} samples
+ *
+ * @returns {Buffer}
+ */
+const encodeWav = ({ samplesPerSec, bitsPerSample, channels }, samples) => {
+  const header = Buffer.alloc(44);
+  const blockAlign = (channels * bitsPerSample) / 8;
+  header.write('RIFF', 0, 'latin1');
+  header.writeUInt32LE(36 + samples.length, 4);
+  header.write('WAVE', 8, 'latin1');
+  header.write('fmt ', 12, 'latin1');
+  header.writeUInt32LE(16, 16);
+  header.writeUInt16LE(1, 20);
+  header.writeUInt16LE(channels, 22);
+  header.writeUInt32LE(samplesPerSec, 24);
+  header.writeUInt32LE(samplesPerSec * blockAlign, 28);
+  header.writeUInt16LE(blockAlign, 32);
+  header.writeUInt16LE(bitsPerSample, 34);
+  header.write('data', 36, 'latin1');
+  header.writeUInt32LE(samples.length, 40);
+  return Buffer.concat([header, samples]);
+};
+
+/**
+ * @returns {string|null} the location at which the automation voice for the
+ *                        current platform maintains its audio tap, if any
+ */
+const defaultAudioTapPath = () => (process.platform === 'win32' ? WINDOWS_AUDIO_TAP_PATH : null);
+
+module.exports = { AudioTap, defaultAudioTapPath, encodeWav };
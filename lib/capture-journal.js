@@ -0,0 +1,280 @@
+'use strict';
+
+const fs = require('fs');
+
+/**
+ * Reader for the capture journal maintained by the automation voice. The
+ * voice records every message it emits in this memory-mapped file before
+ * attempting to deliver it, so messages which are emitted while the driver is
+ * not listening can be recovered. See `src/automationttsengine/CaptureJournal.h`
+ * for a description of the file format.
+ */
+
+const WINDOWS_JOURNAL_PATH = 'C:\\ProgramData\\Bocoup Automation Voice\\capture.journal';
+
+const MAGIC = 'ATDJ';
+const VERSION = 1;
+const HEADER_SIZE = 64;
+const INDEX_ENTRY_SIZE = 24;
+const RECORD_HEADER_SIZE = 24;
+
+const OFFSET_VERSION = 4;
+const OFFSET_DATA_CAPACITY = 8;
+const OFFSET_INDEX_CAPACITY = 16;
+const OFFSET_FIRST_SEQUENCE = 24;
+const OFFSET_NEXT_SEQUENCE = 32;
+const OFFSET_ACKNOWLEDGED_SEQUENCE = 40;
+
+/**
+ * Read an unsigned 64-bit integer. Sequence numbers and timestamps (in
+ * microseconds) remain well within the range of integers which JavaScript
+ * numbers represent exactly.
+ *
+ * @param {Buffer} buffer
+ * @param {number} offset
+ */
+const readUInt64 = (buffer, offset) =>
+  buffer.readUInt32LE(offset) + buffer.readUInt32LE(offset + 4) * 0x100000000;
+
+/**
+ * @param {Buffer} buffer
+ * @param {number} value
+ * @param {number} offset
+ */
+const writeUInt64 = (buffer, value, offset) => {
+  buffer.writeUInt32LE(value % 0x100000000, offset);
+  buffer.writeUInt32LE(Math.floor(value / 0x100000000), offset + 4);
+};
+
+/**
+ * FNV-1a hash of a record's sequence number, timestamp and payload.
+ *
+ * @param {number} sequence
+ * @param {number} timestamp
+ * @param {Buffer} payload
+ */
+const checksum = (sequence, timestamp, payload) => {
+  const prefix = Buffer.alloc(16);
+  writeUInt64(prefix, sequence, 0);
+  writeUInt64(prefix, timestamp, 8);
+  let hash = 2166136261;
+  for (const bytes of [prefix, payload]) {
+    for (let i = 0; i < bytes.length; i += 1) {
+      hash = Math.imul(hash ^ bytes[i], 16777619) >>> 0;
+    }
+  }
+  return hash;
+};
+
+/**
+ * @typedef JournalRecord
+ * @property {number} sequence
+ * @property {number} timestamp - microseconds since the Unix epoch
+ * @property {string} data - the message, e.g. `speech:Hello`
+ */
+
+/**
+ * @typedef JournalHeader
+ * @property {number} dataCapacity
+ * @property {number} indexCapacity
+ * @property {number} firstSequence - the oldest retained record
+ * @property {number} nextSequence - the sequence of the next record to be
+ *                                   written
+ * @property {number} acknowledgedSequence - the newest record delivered by
+ *                                           the driver
+ */
+
+class CaptureJournal {
+  /**
+   * @param {number} fd
+   * @param {JournalHeader} header
+   */
+  constructor(fd, header) {
+    this.fd = fd;
+    this.dataCapacity = header.dataCapacity;
+    this.indexCapacity = header.indexCapacity;
+  }
+
+  /**
+   * @param {string} path
+   *
+   * @returns {CaptureJournal|null} the journal, or `null` if no valid
+   *                                journal exists at the given location
+   */
+  static open(path) {
+    let fd;
+    try {
+      fd = fs.openSync(path, 'r+');
+    } catch (error) {
+      if (error.code === 'ENOENT') {
+        return null;
+      }
+      throw error;
+    }
+
+    const header = Buffer.alloc(HEADER_SIZE);
+    const bytesRead = fs.readSync(fd, header, 0, HEADER_SIZE, 0);
+    if (
+      bytesRead !== HEADER_SIZE ||
+      header.toString('latin1', 0, 4) !== MAGIC ||
+      header.readUInt32LE(OFFSET_VERSION) !== VERSION
+    ) {
+      fs.closeSync(fd);
+      return null;
+    }
+
+    return new CaptureJournal(fd, {
+      dataCapacity: readUInt64(header, OFFSET_DATA_CAPACITY),
+      indexCapacity: readUInt64(header, OFFSET_INDEX_CAPACITY),
+      firstSequence: readUInt64(header, OFFSET_FIRST_SEQUENCE),
+      nextSequence: readUInt64(header, OFFSET_NEXT_SEQUENCE),
+      acknowledgedSequence: readUInt64(header, OFFSET_ACKNOWLEDGED_SEQUENCE),
+    });
+  }
+
+  close() {
+    fs.closeSync(this.fd);
+  }
+
+  /**
+   * @returns {JournalHeader}
+   */
+  readHeader() {
+    const header = Buffer.alloc(HEADER_SIZE);
+    fs.readSync(this.fd, header, 0, HEADER_SIZE, 0);
+    return {
+      dataCapacity: this.dataCapacity,
+      indexCapacity: this.indexCapacity,
+      firstSequence: readUInt64(header, OFFSET_FIRST_SEQUENCE),
+      nextSequence: readUInt64(header, OFFSET_NEXT_SEQUENCE),
+      acknowledgedSequence: readUInt64(header, OFFSET_ACKNOWLEDGED_SEQUENCE),
+    };
+  }
+
+  /**
+   * @param {number} sequence
+   *
+   * @returns {{sequence: number, timestamp: number, offset: number}}
+   */
+  readIndexEntry(sequence) {
+    const entry = Buffer.alloc(INDEX_ENTRY_SIZE);
+    const position = HEADER_SIZE + (sequence % this.indexCapacity) * INDEX_ENTRY_SIZE;
+    fs.readSync(this.fd, entry, 0, INDEX_ENTRY_SIZE, position);
+    return {
+      sequence: readUInt64(entry, 0),
+      timestamp: readUInt64(entry, 8),
+      offset: readUInt64(entry, 16),
+    };
+  }
+
+  /**
+   * @param {number} sequence
+   *
+   * @returns {JournalRecord|null} the record, or `null` if it has been
+   *                               evicted, has not been written, or fails
+   *                               verification
+   */
+  read(sequence) {
+    const { offset } = this.readIndexEntry(sequence);
+    const position =
+      HEADER_SIZE + this.indexCapacity * INDEX_ENTRY_SIZE + (offset % this.dataCapacity);
+    const recordHeader = Buffer.alloc(RECORD_HEADER_SIZE);
+    fs.readSync(this.fd, recordHeader, 0, RECORD_HEADER_SIZE, position);
+
+    const length = recordHeader.readUInt32LE(0);
+    const expectedChecksum = recordHeader.readUInt32LE(4);
+    const timestamp = readUInt64(recordHeader, 16);
+    if (readUInt64(recordHeader, 8) !== sequence || length > this.dataCapacity / 4) {
+      return null;
+    }
+
+    const payload = Buffer.alloc(length);
+    fs.readSync(this.fd, payload, 0, length, position + RECORD_HEADER_SIZE);
+
+    // The record may have been overwritten while it was being read.
+    if (
+      sequence < this.readHeader().firstSequence ||
+      checksum(sequence, timestamp, payload) !== expectedChecksum
+    ) {
+      return null;
+    }
+
+    return { sequence, timestamp, data: payload.toString('utf8') };
+  }
+
+  /**
+   * Read the retained records whose sequence numbers are not less than
+   * `start` and less than `end`.
+   *
+   * @param {number} start
+   * @param {number} [end]
+   *
+   * @returns {JournalRecord[]}
+   */
+  readRange(start, end) {
+    const { firstSequence, nextSequence } = this.readHeader();
+    const records = [];
+    const last = Math.min(end === undefined ? nextSequence : end, nextSequence);
+    for (let sequence = Math.max(start, firstSequence); sequence < last; sequence += 1) {
+      const record = this.read(sequence);
+      if (record) {
+        records.push(record);
+      }
+    }
+    return records;
+  }
+
+  /**
+   * @param {number} timestamp - microseconds since the Unix epoch
+   *
+   * @returns {number} the sequence number of the first retained record whose
+   *                   timestamp is not less than `timestamp`
+   */
+  findByTimestamp(timestamp) {
+    let { firstSequence: low, nextSequence: high } = this.readHeader();
+    while (low < high) {
+      const middle = low + Math.floor((high - low) / 2);
+      if (this.readIndexEntry(middle).timestamp < timestamp) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  /**
+   * Read the records written in the given interval.
+   *
+   * @param {number} since - microseconds since the Unix epoch (inclusive)
+   * @param {number} [until] - microseconds since the Unix epoch (exclusive)
+   *
+   * @returns {JournalRecord[]}
+   */
+  readBetween(since, until) {
+    return this.readRange(
+      this.findByTimestamp(since),
+      until === undefined ? undefined : this.findByTimestamp(until),
+    );
+  }
+
+  /**
+   * Record that the driver has delivered every message up to and including
+   * the given sequence number.
+   *
+   * @param {number} sequence
+   */
+  acknowledge(sequence) {
+    const value = Buffer.alloc(8);
+    writeUInt64(value, sequence, 0);
+    fs.writeSync(this.fd, value, 0, 8, OFFSET_ACKNOWLEDGED_SEQUENCE);
+  }
+}
+
+/**
+ * @returns {string|null} the location at which the automation voice for the
+ *                        current platform maintains its journal, if any
+ */
+const defaultJournalPath = () => (process.platform === 'win32' ? WINDOWS_JOURNAL_PATH : null);
+
+module.exports = { CaptureJournal, checksum, defaultJournalPath, readUInt64, writeUInt64 };
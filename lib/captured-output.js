@@ -0,0 +1,281 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+const { performance } = require('perf_hooks');
+
+const { OutputMatcher } = require('./output-matcher');
+
+/** @typedef {import('./create-voice-server').VoiceMessage} VoiceMessage */
+/** @typedef {import('./output-matcher').OutputPredicate} OutputPredicate */
+
+/**
+ * Number of bookmark names retained so that a client which asks to wait for a
+ * bookmark shortly after it was reached is not made to wait indefinitely.
+ */
+const DEFAULT_BOOKMARK_HISTORY = 1024;
+
+/**
+ * Number of milliseconds without output, and without an utterance in
+ * progress, after which output is considered to have settled.
+ */
+const DEFAULT_QUIET_PERIOD = 300;
+
+/**
+ * Number of milliseconds after which an utterance which has not ended is
+ * disregarded (e.g. because the process which began it was terminated).
+ */
+const DEFAULT_UTTERANCE_TIMEOUT = 30000;
+
+/**
+ * @typedef WaitOptions
+ * @property {number} [timeout] - maximum number of milliseconds to wait
+ * @property {EventEmitter} [cancellation] - an emitter whose "close" event
+ *                                           abandons the wait
+ */
+
+/**
+ * Tracks the output which the driver has delivered to its clients so that
+ * commands may wait for it.
+ *
+ * Emits "settled" once output has settled following any activity.
+ */
+class CapturedOutput extends EventEmitter {
+  /**
+   * @param {object} [options]
+   * @param {number} [options.bookmarkHistory] - number of reached bookmarks to
+   *                                             remember
+   * @param {number} [options.quietPeriod] - default quiet period, in
+   *                                         milliseconds
+   * @param {number} [options.utteranceTimeout] - milliseconds
+   */
+  constructor({
+    bookmarkHistory = DEFAULT_BOOKMARK_HISTORY,
+    quietPeriod = DEFAULT_QUIET_PERIOD,
+    utteranceTimeout = DEFAULT_UTTERANCE_TIMEOUT,
+  } = {}) {
+    super();
+    // Every pending wait adds a listener.
+    this.setMaxListeners(0);
+    this.bookmarkHistory = bookmarkHistory;
+    this.quietPeriod = quietPeriod;
+    this.utteranceTimeout = utteranceTimeout;
+    /** @type {Set<string>} */
+    this.reachedBookmarks = new Set();
+    /** @type {Map<string, number>} utterance id to the time it began */
+    this.utterances = new Map();
+    this.lastActivity = -Infinity;
+    /** @type {ReturnType<typeof setTimeout> | null} */
+    this.settleTimer = null;
+    this.outputMatcher = new OutputMatcher();
+  }
+
+  /**
+   * Record a message which has been delivered to clients. Messages are
+   * delivered in the order in which the voice emitted them, so a bookmark
+   * signifies that all of the speech which preceded it has been delivered.
+   *
+   * @param {VoiceMessage} message
+   */
+  deliver(message) {
+    switch (message.name) {
+      case 'bookmark':
+        // Re-insert so that the set is ordered from least to most recent.
+        this.reachedBookmarks.delete(message.data);
+        this.reachedBookmarks.add(message.data);
+        if (this.reachedBookmarks.size > this.bookmarkHistory) {
+          this.reachedBookmarks.delete(this.reachedBookmarks.values().next().value);
+        }
+        this.emit('bookmark', message.data);
+        break;
+      case 'speakBegin':
+        this.utterances.set(message.data, performance.now());
+        break;
+      case 'speakEnd':
+        this.utterances.delete(message.data);
+        break;
+      case 'speech':
+        this.outputMatcher.match(message.data);
+        break;
+      default:
+        return;
+    }
+
+    this.lastActivity = performance.now();
+    this.emit('activity');
+    this.scheduleSettled();
+  }
+
+  /**
+   * @param {number} since - time (per `performance.now`) from which quiet is
+   *                         measured, if later than the most recent activity
+   * @param {number} quietPeriod - milliseconds
+   *
+   * @returns {number} zero if output has settled; otherwise, the number of
+   *                   milliseconds after which it should be checked again
+   *                   (if there is no further activity)
+   */
+  timeUntilSettled(since, quietPeriod) {
+    const now = performance.now();
+    let untilExpiry = Infinity;
+    for (const [id, began] of this.utterances) {
+      if (now - began >= this.utteranceTimeout) {
+        this.utterances.delete(id);
+      } else {
+        untilExpiry = Math.min(untilExpiry, began + this.utteranceTimeout - now);
+      }
+    }
+    if (this.utterances.size > 0) {
+      return untilExpiry;
+    }
+    return Math.max(0, Math.max(this.lastActivity, since) + quietPeriod - now);
+  }
+
+  scheduleSettled() {
+    clearTimeout(this.settleTimer);
+    this.settleTimer = setTimeout(() => {
+      this.settleTimer = null;
+      if (this.timeUntilSettled(-Infinity, this.quietPeriod) === 0) {
+        this.emit('settled');
+      } else {
+        this.scheduleSettled();
+      }
+    }, this.timeUntilSettled(-Infinity, this.quietPeriod));
+    // The timer alone should not keep the process running.
+    this.settleTimer.unref();
+  }
+
+  /**
+   * Wait for a condition which is re-evaluated when output is delivered.
+   *
+   * @param {string} description - describes the condition in error messages
+   * @param {WaitOptions} options
+   * @param {string} event - the event after which to re-evaluate
+   * @param {function(): number} poll - returns 0 if the condition holds, or
+   *                                    the number of milliseconds after which
+   *                                    it should be re-evaluated (Infinity to
+   *                                    await the next event only)
+   *
+   * @returns {Promise<void>}
+   */
+  waitFor(description, { timeout, cancellation }, event, poll) {
+    return new Promise((resolve, reject) => {
+      /** @type {ReturnType<typeof setTimeout> | null} */
+      let timer = null;
+      /** @type {ReturnType<typeof setTimeout> | null} */
+      let pollTimer = null;
+      const cleanUp = () => {
+        this.removeListener(event, check);
+        if (cancellation) {
+          cancellation.removeListener('close', onClose);
+        }
+        clearTimeout(timer);
+        clearTimeout(pollTimer);
+      };
+      const check = () => {
+        clearTimeout(pollTimer);
+        const remaining = poll();
+        if (remaining === 0) {
+          cleanUp();
+          resolve();
+        } else if (remaining !== Infinity) {
+          pollTimer = setTimeout(check, remaining);
+        }
+      };
+      const onClose = () => {
+        cleanUp();
+        reject(new Error(`connection closed while waiting for ${description}`));
+      };
+
+      this.on(event, check);
+      if (cancellation) {
+        cancellation.once('close', onClose);
+      }
+      if (typeof timeout === 'number') {
+        timer = setTimeout(() => {
+          cleanUp();
+          reject(new Error(`timed out waiting for ${description}`));
+        }, timeout);
+      }
+      check();
+    });
+  }
+
+  /**
+   * @param {string} name
+   * @param {WaitOptions} [options]
+   *
+   * @returns {Promise<void>} an eventual value which is fulfilled when the
+   *                          bookmark has been reached (immediately, if it
+   *                          has already been reached)
+   */
+  waitForBookmark(name, options = {}) {
+    if (this.reachedBookmarks.has(name)) {
+      return Promise.resolve();
+    }
+    return this.waitFor(`bookmark "${name}"`, options, 'bookmark', () =>
+      this.reachedBookmarks.has(name) ? 0 : Infinity,
+    );
+  }
+
+  /**
+   * Wait until no utterance is in progress and there has been no output for
+   * the quiet period. Quiet is measured from the time of the call at the
+   * earliest, so that output which follows an action (such as a key press)
+   * after a short delay is awaited.
+   *
+   * @param {WaitOptions & { quietPeriod?: number }} [options]
+   *
+   * @returns {Promise<void>}
+   */
+  waitForSettled({ quietPeriod = this.quietPeriod, ...options } = {}) {
+    const since = performance.now();
+    return this.waitFor('output to settle', options, 'activity', () =>
+      this.timeUntilSettled(since, quietPeriod),
+    );
+  }
+
+  /**
+   * Wait for speech which satisfies a predicate. Only the speech delivered
+   * after the call is considered, so a client should begin waiting before it
+   * performs the action whose output it awaits.
+   *
+   * @param {OutputPredicate} predicate
+   * @param {WaitOptions} [options]
+   *
+   * @returns {Promise<string[]>} an eventual value which is fulfilled with the
+   *                              utterances which satisfied the predicate
+   */
+  waitForOutput(predicate, { timeout, cancellation } = {}) {
+    return new Promise((resolve, reject) => {
+      /** @type {ReturnType<typeof setTimeout> | null} */
+      let timer = null;
+      const cleanUp = () => {
+        this.outputMatcher.remove(wait);
+        if (cancellation) {
+          cancellation.removeListener('close', onClose);
+        }
+        clearTimeout(timer);
+      };
+      const onClose = () => {
+        cleanUp();
+        reject(new Error('connection closed while waiting for output'));
+      };
+
+      const wait = this.outputMatcher.add(predicate, output => {
+        cleanUp();
+        resolve(output);
+      });
+      if (cancellation) {
+        cancellation.once('close', onClose);
+      }
+      if (typeof timeout === 'number') {
+        timer = setTimeout(() => {
+          cleanUp();
+          reject(new Error('timed out waiting for output'));
+        }, timeout);
+      }
+    });
+  }
+}
+
+module.exports = { CapturedOutput, DEFAULT_QUIET_PERIOD };
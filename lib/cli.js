@@ -3,7 +3,9 @@
 const yargs = require('yargs/yargs');
 const { hideBin } = require('yargs/helpers');
 
+const coordinateCommand = require('./commands/coordinate');
 const installCommand = require('./commands/install');
+const journalCommand = require('./commands/journal');
 const serveCommand = require('./commands/serve');
 const uninstallCommand = require('./commands/uninstall');
 
@@ -15,6 +17,8 @@ module.exports = async process => {
     .command(installCommand)
     .command(uninstallCommand)
     .command(serveCommand)
+    .command(journalCommand)
+    .command(coordinateCommand)
     .demandCommand(1, 1)
     .strict()
     .help()
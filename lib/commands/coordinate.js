@@ -0,0 +1,96 @@
+'use strict';
+
+const { createCoordinator } = require('../federation-coordinator');
+const { nonNegativeInteger } = require('../helpers/options');
+const { LOG_LEVELS, Logger } = require('../logger');
+const { DEFAULT_MERGE_WINDOW } = require('../merged-stream');
+const {
+  DEFAULT_HIGH_WATERMARK,
+  DEFAULT_LOW_WATERMARK,
+  LAGGING_CLIENT_POLICIES,
+} = require('../output-broadcaster');
+
+const DEFAULT_PORT = 4382;
+const DEFAULT_FEDERATION_PORT = 4383;
+
+module.exports = /** @type {import('yargs').CommandModule} */ ({
+  command: 'coordinate',
+  describe:
+    'Run a coordinator which merges the captured output of drivers on several hosts (see ' +
+    '`serve --coordinator`) and relays commands to them',
+  builder(yargs) {
+    return yargs
+      .option('federation-port', {
+        coerce: nonNegativeInteger('federation-port'),
+        default: DEFAULT_FEDERATION_PORT,
+        describe: 'TCP port on which to listen for drivers',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('high-watermark', {
+        coerce: nonNegativeInteger('high-watermark'),
+        default: DEFAULT_HIGH_WATERMARK,
+        describe: 'Number of bytes awaiting transmission beyond which a client is lagging',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('lagging-client-policy', {
+        choices: LAGGING_CLIENT_POLICIES,
+        default: 'queue',
+        describe: 'Treatment of lagging clients (see `serve --lagging-client-policy`)',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('log-level', {
+        choices: LOG_LEVELS,
+        default: 'info',
+        describe: 'Detail with which the coordinator logs',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('low-watermark', {
+        coerce: nonNegativeInteger('low-watermark'),
+        default: DEFAULT_LOW_WATERMARK,
+        describe:
+          'Number of bytes awaiting transmission below which a lagging client has caught up',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('merge-window', {
+        coerce: nonNegativeInteger('merge-window'),
+        default: DEFAULT_MERGE_WINDOW,
+        describe:
+          'Number of milliseconds for which events are held awaiting earlier events from ' +
+          'other drivers, beyond which a quiet driver no longer delays the others',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('port', {
+        coerce: nonNegativeInteger('port'),
+        default: DEFAULT_PORT,
+        describe: 'TCP port on which to listen for WebSocket connections',
+        type: 'string',
+        requiresArg: true,
+      });
+  },
+  async handler(argv) {
+    const log = new Logger(argv.logLevel);
+    const coordinator = await createCoordinator(argv.port, {
+      federationPort: argv.federationPort,
+      mergeWindow: argv.mergeWindow,
+      highWatermark: argv.highWatermark,
+      lowWatermark: argv.lowWatermark,
+      laggingClientPolicy: argv.laggingClientPolicy,
+    });
+    log.info(
+      `listening on port ${argv.port} for clients and ${argv.federationPort} for drivers`,
+    );
+
+    coordinator.on('hostConnected', host => log.info(`driver "${host}" connected`));
+    coordinator.on('hostDisconnected', host => log.warn(`driver "${host}" disconnected`));
+    coordinator.on('error', error => log.error(`error: ${error}`));
+    coordinator.broadcaster.on('lagging', () => {
+      log.warn(`a client is lagging (policy: ${argv.laggingClientPolicy})`);
+    });
+  },
+});
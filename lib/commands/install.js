@@ -1,21 +1,40 @@
 'use strict';
 
 const { loadOsModule } = require('../helpers/load-os-module');
+const { MAX_VOICE_INSTANCES } = require('../voice-instances');
 
 module.exports = /** @type {import('yargs').CommandModule} */ ({
   command: 'install',
   describe: 'Install text to speech extension and other support',
   builder(yargs) {
-    return yargs.option('unattended', {
-      desc: 'Fail if installation requires human intervention',
-      boolean: true,
-    });
+    return yargs
+      .option('instances', {
+        coerce: value => {
+          if (!Number.isInteger(value) || value < 1 || value > MAX_VOICE_INSTANCES) {
+            throw new TypeError(
+              `"instances" option: expected an integer between 1 and ${MAX_VOICE_INSTANCES}`,
+            );
+          }
+          return value;
+        },
+        default: 1,
+        desc: 'Number of instances of the voice to register (see `serve --instances`)',
+        number: true,
+        requiresArg: true,
+      })
+      .option('unattended', {
+        desc: 'Fail if installation requires human intervention',
+        boolean: true,
+      });
   },
-  async handler({ unattended }) {
+  async handler({ instances, unattended }) {
+    if (instances > 1 && process.platform !== 'win32') {
+      throw new Error('multiple instances of the voice are only supported on Windows');
+    }
     const installDelegate = loadOsModule('install', {
       darwin: () => require('../install/macos'),
       win32: () => require('../install/win32'),
     });
-    await installDelegate.install({ unattended });
+    await installDelegate.install({ instances, unattended });
   },
 });
@@ -0,0 +1,70 @@
+'use strict';
+
+const { CaptureJournal, defaultJournalPath } = require('../capture-journal');
+
+/**
+ * @param {string} name
+ *
+ * @returns {function(string): number} a function which interprets an option
+ *                                     value as microseconds since the Unix
+ *                                     epoch
+ */
+const coerceTime = name => string => {
+  const milliseconds = /^[0-9]+$/.test(string) ? Number(string) : Date.parse(string);
+  if (Number.isNaN(milliseconds)) {
+    throw new TypeError(
+      `"${name}" option: expected an ISO 8601 date or a number of milliseconds since the ` +
+        `Unix epoch but received "${string}"`,
+    );
+  }
+  return milliseconds * 1000;
+};
+
+module.exports = /** @type {import('yargs').CommandModule} */ ({
+  command: 'journal',
+  describe: 'Print the messages recorded by the automation voice',
+  builder(yargs) {
+    return yargs
+      .option('path', {
+        default: defaultJournalPath(),
+        demandOption: true,
+        describe: 'Location of the capture journal',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('since', {
+        coerce: coerceTime('since'),
+        describe: 'Print messages recorded at or after this time',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('until', {
+        coerce: coerceTime('until'),
+        describe: 'Print messages recorded before this time',
+        type: 'string',
+        requiresArg: true,
+      });
+  },
+  async handler(argv) {
+    const journal = CaptureJournal.open(argv.path);
+    if (!journal) {
+      throw new Error(`no capture journal found at "${argv.path}"`);
+    }
+
+    try {
+      for (const record of journal.readBetween(argv.since || 0, argv.until)) {
+        const separator = record.data.indexOf(':');
+        console.log(
+          JSON.stringify({
+            sequence: record.sequence,
+            time: new Date(record.timestamp / 1000).toISOString(),
+            name: record.data.slice(0, separator),
+            data: record.data.slice(separator + 1),
+          }),
+        );
+      }
+    } finally {
+      journal.close();
+    }
+  },
+});
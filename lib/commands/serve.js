@@ -1,21 +1,32 @@
 'use strict';
 
 const fs = require('fs/promises');
+const os = require('os');
 
-const createCommandServer = require('../create-command-server');
+const { defaultAudioTapPath } = require('../audio-tap');
+const { defaultJournalPath } = require('../capture-journal');
+const { DEFAULT_QUIET_PERIOD } = require('../captured-output');
+const {
+  DEFAULT_BATCH_WINDOW,
+  DEFAULT_HIGH_WATERMARK,
+  DEFAULT_LOW_WATERMARK,
+  LAGGING_CLIENT_POLICIES,
+} = require('../output-broadcaster');
 const createVoiceServer = require('../create-voice-server');
+const { FederationUplink, parseAddress } = require('../federation-uplink');
+const { nonNegativeInteger } = require('../helpers/options');
+const { JournalReplayer } = require('../journal-replayer');
+const { LOG_LEVELS, Logger } = require('../logger');
+const { DEFAULT_HISTORY_SIZE } = require('../output-history');
+const { EMPTY_SUBSCRIPTION, FULL_SUBSCRIPTION } = require('../subscriptions');
+const { MAX_VOICE_INSTANCES, voiceInstances } = require('../voice-instances');
+const { decodeSettings } = require('../voice-settings');
 
 const WINDOWS_NAMED_PIPE = '\\\\?\\pipe\\my_pipe';
 const MACOS_SYSTEM_DIR = '/tmp/at_driver_generic';
 const MACOS_SOCKET_UNIX_PATH = '/tmp/at_driver_generic/driver.socket';
 const DEFAULT_PORT = 4382;
 
-/**
- * Print logging information to the process's standard error stream, annotated
- * with a timestamp describing the moment that the message was emitted.
- */
-const log = (...args) => console.error(new Date().toISOString(), ...args);
-
 const prepareSocketPath = async () => {
   if (process.platform === 'win32') {
     return WINDOWS_NAMED_PIPE;
@@ -31,54 +42,344 @@ const prepareSocketPath = async () => {
   throw new Error(`unsupported host platform '${process.platform}'`);
 };
 
+/**
+ * @param {Logger} log
+ *
+ * @returns {import('../subscriptions').Subscription} the messages of the voice
+ *          which the server logs, and so requires whatever its sessions
+ *          subscribe to: every message when debugging, lifecycle messages and
+ *          errors by default, and errors alone otherwise
+ */
+const loggedSubscription = log => {
+  if (log.enabled('debug')) {
+    return FULL_SUBSCRIPTION;
+  }
+  return {
+    ...EMPTY_SUBSCRIPTION,
+    types: log.enabled('info') ? ['lifecycle', 'internalError'] : ['internalError'],
+  };
+};
+
+/**
+ * Relay the messages of one instance of the voice to the clients which
+ * connect on its port.
+ *
+ * @param {import('../voice-instances').VoiceInstanceOptions} instance
+ * @param {import('yargs').ArgumentsCamelCase<any>} argv
+ * @param {Logger} log
+ */
+const serveInstance = async ({ instance, port, socketPath, journal, audioTap }, argv, log) => {
+  // The command server depends on the host platform's modules, so it is
+  // loaded only when serving; other commands (such as `coordinate`) run on
+  // any platform.
+  const createCommandServer = require('../create-command-server');
+  const commandServer = await createCommandServer(port, {
+    quietPeriod: argv.quietPeriod,
+    audioTap,
+    batchWindow: argv.batchWindow,
+    highWatermark: argv.highWatermark,
+    lowWatermark: argv.lowWatermark,
+    laggingClientPolicy: argv.laggingClientPolicy,
+    keyInjector: argv.keyInjector,
+    historySize: argv.historySize,
+    normalizeSpeech: argv.normalizeSpeech,
+    subscription: loggedSubscription(log),
+  });
+  // The voice is sent the settings which clients choose (see
+  // `interaction.configureVoice`).
+  const voiceServer = await createVoiceServer(socketPath, {
+    settings: commandServer.voiceSettings,
+  });
+
+  log.info(`listening on port ${port}`);
+
+  commandServer.on('error', error => {
+    log.error(`error: ${error}`);
+  });
+
+  commandServer.broadcaster.on('lagging', () => {
+    log.warn(`a client is lagging (policy: ${argv.laggingClientPolicy})`);
+  });
+
+  commandServer.capturedOutput.on('settled', () => {
+    commandServer.broadcast({ method: 'interaction.outputSettled', params: {} });
+  });
+
+  commandServer.keyPresses.on('report', report => {
+    if (log.enabled('debug')) {
+      log.debug(`key press latency ${JSON.stringify(report)}`);
+    }
+  });
+
+  const deliver = message => {
+    const pressId = commandServer.keyPresses.deliver(message);
+    if (message.name == 'speech') {
+      commandServer.broadcastOutput(message.data, pressId, message.escaped);
+    } else if (message.name == 'bookmark') {
+      commandServer.broadcast(
+        { method: 'interaction.bookmarkReached', params: { name: message.data } },
+        'bookmark',
+      );
+    } else if (message.name == 'lifecycle') {
+      log.info(`voice lifecycle: ${message.data}`);
+      commandServer.broadcast(
+        { method: 'interaction.voiceLifecycle', params: { data: message.data } },
+        'lifecycle',
+      );
+    } else if (message.name == 'internalError') {
+      log.error(`voice error: ${message.data}`);
+      commandServer.broadcast(
+        { method: 'interaction.voiceError', params: { data: message.data } },
+        'internalError',
+      );
+    } else if (message.name == 'configured') {
+      commandServer.broadcast({
+        method: 'interaction.voiceConfigured',
+        params: { generation: message.generation, settings: decodeSettings(message.data) },
+      });
+    }
+    commandServer.capturedOutput.deliver(message);
+    if (commandServer.audioCapture) {
+      commandServer.audioCapture.deliver(message);
+    }
+  };
+
+  if (argv.coordinator) {
+    federate(commandServer, instance, argv, log);
+  }
+
+  const replayer = journal ? new JournalReplayer(journal) : null;
+  if (replayer) {
+    for (const message of replayer.recover()) {
+      if (log.enabled('debug')) {
+        log.debug(`recovered message ${JSON.stringify(message)}`);
+      }
+      deliver(message);
+    }
+  }
+
+  // Messages are stringified for the log only when debugging, since every
+  // message of the voice passes through here.
+  voiceServer.on('message', message => {
+    const debugging = log.enabled('debug');
+    if (debugging) {
+      log.debug(`voice server received message ${JSON.stringify(message)}`);
+    }
+    for (const accepted of replayer ? replayer.accept(message) : [message]) {
+      if (debugging && accepted !== message) {
+        log.debug(`recovered message ${JSON.stringify(accepted)}`);
+      }
+      deliver(accepted);
+    }
+  });
+
+  voiceServer.on('error', error => {
+    log.error(`error: ${error}`);
+  });
+};
+
+/**
+ * Stream the output of one instance of the voice to the coordinator of a
+ * federation, which may also relay commands to it (see `Coordinator`).
+ *
+ * @param {import('../create-command-server').CommandServer} commandServer
+ * @param {number} instance
+ * @param {import('yargs').ArgumentsCamelCase<any>} argv
+ * @param {Logger} log
+ */
+const federate = (commandServer, instance, argv, log) => {
+  const name = argv.instances > 1 ? `${argv.hostName}-${instance}` : argv.hostName;
+  const uplink = new FederationUplink(argv.coordinator, {
+    name,
+    accept: socket => commandServer.accept(socket),
+  });
+  commandServer.on('output', (data, pressId, cursor) => uplink.output(data, pressId, cursor));
+  commandServer.on('broadcast', message => uplink.event(message));
+  commandServer.once('close', () => uplink.close());
+
+  uplink.on('connected', () => {
+    log.info(`connected to coordinator as "${name}"`);
+  });
+  uplink.on('disconnected', () => {
+    log.warn('disconnected from coordinator');
+  });
+  uplink.on('error', error => {
+    if (log.enabled('debug')) {
+      log.debug(`coordinator: ${error}`);
+    }
+  });
+};
+
 module.exports = /** @type {import('yargs').CommandModule} */ ({
   command: 'serve',
   describe: 'Run at-driver server',
   builder(yargs) {
-    return yargs.option('port', {
-      coerce(string) {
-        if (!/^(0|[1-9][0-9]*)$/.test(string)) {
-          throw new TypeError(
-            `"port" option: expected a non-negative integer value but received "${string}"`,
-          );
-        }
-        return Number(string);
-      },
-      default: DEFAULT_PORT,
-      describe: 'TCP port on which to listen for WebSocket connections',
-      // Do not use the `number` type provided by `yargs` because it tolerates
-      // JavaScript numeric literal forms which are likely typos in this
-      // context (e.g. `0xf` or `1e-0`).
-      type: 'string',
-      requiresArg: true,
-    });
+    return yargs
+      .option('audio-tap', {
+        default: defaultAudioTapPath(),
+        describe:
+          'Location of the audio tap maintained by the automation voice, through which clients ' +
+          'may capture the audio it produces (see `interaction.startAudioCapture`)',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('batch-window', {
+        coerce: nonNegativeInteger('batch-window'),
+        default: DEFAULT_BATCH_WINDOW,
+        describe:
+          'Number of milliseconds during which captured output which follows other output is ' +
+          'sent to clients as a single batch (0 disables batching)',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('coordinator', {
+        coerce: string => {
+          try {
+            return parseAddress(string);
+          } catch (error) {
+            throw new TypeError(`"coordinator" option: ${error.message}`);
+          }
+        },
+        describe:
+          'Address ("host:port") of the federation port of a coordinator (see `at-driver ' +
+          'coordinate`), to which captured output is streamed and from which commands are ' +
+          'accepted',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('high-watermark', {
+        coerce: nonNegativeInteger('high-watermark'),
+        default: DEFAULT_HIGH_WATERMARK,
+        describe: 'Number of bytes awaiting transmission beyond which a client is lagging',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('host-name', {
+        default: os.hostname(),
+        describe:
+          'Name by which the coordinator and its clients know this driver (suffixed with "-N" ' +
+          'for instance N when there are several)',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('history-size', {
+        coerce: nonNegativeInteger('history-size'),
+        default: DEFAULT_HISTORY_SIZE,
+        describe:
+          'Number of bytes of captured output to retain for clients which connect late or ' +
+          'reconnect (see `interaction.getOutputSince`)',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('instances', {
+        coerce: string => {
+          const instances = nonNegativeInteger('instances')(string);
+          if (instances < 1 || instances > MAX_VOICE_INSTANCES) {
+            throw new TypeError(
+              `"instances" option: expected a value between 1 and ${MAX_VOICE_INSTANCES}`,
+            );
+          }
+          return instances;
+        },
+        default: 1,
+        describe:
+          'Number of instances of the voice to serve (see `at-driver install --instances`). ' +
+          'Clients of instance N connect to the given port plus N - 1, and the pipe, journal ' +
+          'and audio tap of instances after the first are suffixed with "-N"',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('journal', {
+        default: defaultJournalPath(),
+        describe:
+          'Location of the capture journal maintained by the automation voice, from which ' +
+          'messages emitted while the server was not running are recovered',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('key-injector', {
+        describe:
+          'Location of the key injection helper (`at-driver-keys`), which is started on first ' +
+          'use and then presses every key, rather than the platform default (robotjs on ' +
+          'Windows, a new `osascript` process for each press on macOS)',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('lagging-client-policy', {
+        choices: LAGGING_CLIENT_POLICIES,
+        default: 'queue',
+        describe:
+          'Treatment of lagging clients: hold their messages until they catch up ("queue"), ' +
+          'discard their captured output until they catch up ("drop"), or close their ' +
+          'connections ("disconnect")',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('log-level', {
+        choices: LOG_LEVELS,
+        default: 'info',
+        describe:
+          'Detail with which the server logs: "debug" logs every message of the voice; the ' +
+          'voice does not emit messages which neither the log nor any session requires',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('low-watermark', {
+        coerce: nonNegativeInteger('low-watermark'),
+        default: DEFAULT_LOW_WATERMARK,
+        describe:
+          'Number of bytes awaiting transmission below which a lagging client has caught up',
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('normalize-speech', {
+        default: false,
+        describe:
+          'Have the voice collapse each run of whitespace in speech to a single space and trim ' +
+          'it, and send it escaped so that it is broadcast to clients without being re-encoded',
+        type: 'boolean',
+      })
+      .option('port', {
+        coerce: nonNegativeInteger('port'),
+        default: DEFAULT_PORT,
+        describe: 'TCP port on which to listen for WebSocket connections',
+        // Do not use the `number` type provided by `yargs` because it tolerates
+        // JavaScript numeric literal forms which are likely typos in this
+        // context (e.g. `0xf` or `1e-0`).
+        type: 'string',
+        requiresArg: true,
+      })
+      .option('quiet-period', {
+        coerce: nonNegativeInteger('quiet-period'),
+        default: DEFAULT_QUIET_PERIOD,
+        describe:
+          'Number of milliseconds without speech after which output is considered to have ' +
+          'settled (see `interaction.waitForSettled`)',
+        type: 'string',
+        requiresArg: true,
+      });
   },
   async handler(argv) {
     const socketPath = await prepareSocketPath();
+    if (argv.instances > 1 && process.platform !== 'win32') {
+      throw new Error('multiple instances of the voice are only supported on Windows');
+    }
 
-    const [commandServer, voiceServer] = await Promise.all([
-      createCommandServer(argv.port),
-      createVoiceServer(socketPath),
-    ]);
-
-    log(`listening on port ${argv.port}`);
-
-    commandServer.on('error', error => {
-      log(`error: ${error}`);
-    });
-
-    voiceServer.on('message', message => {
-      log(`voice server received message ${JSON.stringify(message)}`);
-      if (message.name == 'speech') {
-        commandServer.broadcast({
-          method: 'interaction.capturedOutput',
-          params: { data: message.data },
-        });
-      }
-    });
-
-    voiceServer.on('error', error => {
-      log(`error: ${error}`);
+    const instances = voiceInstances(argv.instances, {
+      port: argv.port,
+      socketPath,
+      journal: argv.journal,
+      audioTap: argv.audioTap,
     });
+    const log = new Logger(argv.logLevel);
+    await Promise.all(
+      instances.map(instance =>
+        serveInstance(
+          instance,
+          argv,
+          argv.instances > 1 ? log.child(`[instance ${instance.instance}]`) : log,
+        ),
+      ),
+    );
   },
 });
@@ -1,6 +1,15 @@
 'use strict';
 
 const { WebSocketServer } = require('ws');
+const { AudioCapture } = require('./audio-capture');
+const { CapturedOutput } = require('./captured-output');
+const { KeyInjector } = require('./key-injector');
+const { KeyPressLatency } = require('./key-press-latency');
+const { OutputBroadcaster } = require('./output-broadcaster');
+const { OutputHistory } = require('./output-history');
+const { Subscriptions, parseSubscription } = require('./subscriptions');
+const { VoiceSettings } = require('./voice-settings');
+const captureModule = require('./modules/capture');
 const interactionModule = require('./modules/interaction');
 const sessionModule = require('./modules/session');
 
@@ -9,6 +18,9 @@ const sessionModule = require('./modules/session');
 /**
  * @typedef WebSocketData
  * @property {string} [sessionId]
+ * @property {(function(): void) | null} [stopAudioCapture] - set while the
+ *                                                           client captures
+ *                                                           audio
  */
 
 /**
@@ -16,12 +28,46 @@ const sessionModule = require('./modules/session');
  */
 
 const methodHandlers = {
+  ...captureModule,
   ...interactionModule,
   ...sessionModule,
+  // Each key press is assigned an id which is attached to the output that
+  // follows it (see `KeyPressLatency`).
+  'interaction.pressKeys': async (websocket, params, server) => {
+    const pressKeys = interactionModule['interaction.pressKeys'];
+    const pressId = await server.keyPresses.press(params.keys, () =>
+      pressKeys(websocket, params, server),
+    );
+    return { pressId };
+  },
+  // A client may resume the output it was sent in an earlier session from
+  // the history, and may declare the events to which it subscribes.
+  'session.new': (websocket, params, server) => {
+    const newSession = sessionModule['session.new'];
+    const { outputCursor, subscriptions } = params || {};
+    if (outputCursor !== undefined) {
+      server.outputHistory.validateCursor('outputCursor', outputCursor);
+    }
+    const subscription = parseSubscription(subscriptions);
+    // Output captured before the session begins is sent from the history
+    // alone.
+    server.broadcaster.flush();
+    const result = newSession(websocket, params, server);
+    server.subscriptions.add(websocket, subscription);
+    if (outputCursor !== undefined) {
+      server.replayOutput(websocket, outputCursor);
+    }
+    return result;
+  },
 };
 
-const onConnection = websocket => {
+/**
+ * @param {CommandServer} server
+ * @param {WebSocket} websocket
+ */
+const onConnection = (server, websocket) => {
   const send = value => websocket.send(JSON.stringify(value));
+  websocket.once('close', () => server.subscriptions.remove(websocket));
 
   websocket.on('message', async data => {
     let parsed;
@@ -61,7 +107,7 @@ const onConnection = websocket => {
       if (!handler) {
         return send({ id, error: 'unknown command' });
       }
-      const result = await handler(websocket, params);
+      const result = await handler(websocket, params, server);
       send({ id, result });
     } catch (error) {
       send({ id, error: 'unknown error', message: error.message });
@@ -69,23 +115,107 @@ const onConnection = websocket => {
   });
 };
 
+/**
+ * Emits "output" with the arguments of each call to `broadcastOutput`, and
+ * "broadcast" with each other event, so that they may be relayed elsewhere
+ * (see `FederationUplink`).
+ */
 class CommandServer extends WebSocketServer {
   /**
-   * Broadcast message to all clients.
-   * @param message
+   * @param {import('ws').ServerOptions} options
+   * @param {ConstructorParameters<typeof CapturedOutput>[0]} [outputOptions]
+   * @param {ConstructorParameters<typeof OutputBroadcaster>[1]} [broadcastOptions]
+   * @param {ConstructorParameters<typeof OutputHistory>[0]} [historyOptions]
+   * @param {ConstructorParameters<typeof VoiceSettings>[0]} [settingsOptions]
+   * @param {ConstructorParameters<typeof Subscriptions>[0]} [subscription] -
+   *        the server's own subscription (see `Subscriptions`)
    */
-  broadcast(message) {
-    const packedMessage = JSON.stringify(message);
-    /** @type {Set<WebSocketWithData>} */ (this.clients).forEach(websocket => {
-      if (websocket.sessionId) {
-        websocket.send(packedMessage, error => {
-          if (error) {
-            this.emit('error', `error sending message: ${error}`);
-          }
-        });
+  constructor(
+    options,
+    outputOptions,
+    broadcastOptions,
+    historyOptions,
+    settingsOptions,
+    subscription,
+  ) {
+    super(options);
+    this.capturedOutput = new CapturedOutput(outputOptions);
+    this.outputHistory = new OutputHistory(historyOptions);
+    /** @type {AudioCapture | null} */
+    this.audioCapture = null;
+    /** @type {KeyInjector | null} */
+    this.keyInjector = null;
+    this.keyPresses = new KeyPressLatency();
+    this.voiceSettings = new VoiceSettings(settingsOptions);
+    // The voice emits only the messages to which some session subscribes.
+    this.subscriptions = new Subscriptions(subscription);
+    this.subscriptions.on('change', union => this.voiceSettings.setSubscription(union));
+    this.broadcaster = new OutputBroadcaster(
+      () => /** @type {Set<WebSocketWithData>} */ (this.clients),
+      {
+        ...broadcastOptions,
+        accepts: (websocket, topic) => this.subscriptions.accepts(websocket, topic),
+      },
+    );
+    this.broadcaster.on('error', error => this.emit('error', error));
+    this.broadcaster.on('sent', pressId => this.keyPresses.broadcast(pressId));
+    this.once('close', () => {
+      this.broadcaster.close();
+      if (this.keyInjector) {
+        this.keyInjector.close();
       }
     });
   }
+
+  /**
+   * Broadcast message to all clients, after any captured output which has
+   * yet to be sent.
+   * @param message
+   * @param {string | null} [topic] - if given, the message is sent only to
+   *                                  the clients which subscribe to it (see
+   *                                  `Subscriptions.accepts`)
+   */
+  broadcast(message, topic = null) {
+    this.broadcaster.broadcast(message, topic);
+    this.emit('broadcast', message, topic);
+  }
+
+  /**
+   * Broadcast captured speech to all clients as an
+   * `interaction.capturedOutput` event, batched with other speech which
+   * arrives at about the same time, and record it in the history.
+   *
+   * @param {string} data
+   * @param {number | null} [pressId] - the key press which caused the speech
+   * @param {string} [escaped] - the speech escaped for inclusion in a JSON
+   *                             string, as the voice may send it
+   */
+  broadcastOutput(data, pressId = null, escaped = undefined) {
+    const seq = this.outputHistory.append(data, pressId);
+    this.broadcaster.output(data, pressId, seq + 1, escaped);
+    this.emit('output', data, pressId, seq + 1);
+  }
+
+  /**
+   * Handle the commands of a client.
+   *
+   * @param {WebSocketWithData | import('./federation-uplink').ChannelSocket} websocket -
+   *        a WebSocket, or a client of the coordinator of a federation
+   */
+  accept(websocket) {
+    onConnection(this, /** @type {WebSocket} */ (websocket));
+  }
+
+  /**
+   * Send a client the output recorded in the history from a cursor onwards.
+   *
+   * @param {WebSocketWithData} websocket
+   * @param {number} cursor
+   */
+  replayOutput(websocket, cursor) {
+    const { output, missed, cursor: next } = this.outputHistory.since(cursor);
+    this.broadcaster.replay(websocket, output.map(({ data }) => data), missed, next);
+  }
 }
 
 /**
@@ -94,20 +224,73 @@ class CommandServer extends WebSocketServer {
  *
  * @param {number} port - the port on which the server should listen for new
  *                        connections
+ * @param {object} [options]
+ * @param {number} [options.quietPeriod] - milliseconds without output after
+ *                                         which output is considered settled
+ * @param {string | null} [options.audioTap] - location of the voice's audio
+ *                                             tap, if audio may be captured
+ * @param {number} [options.batchWindow] - milliseconds during which bursts
+ *                                         of captured output are batched
+ * @param {number} [options.highWatermark] - bytes of unsent data beyond
+ *                                           which a client is lagging
+ * @param {number} [options.lowWatermark] - bytes of unsent data below which
+ *                                          a lagging client has caught up
+ * @param {"queue" | "drop" | "disconnect"} [options.laggingClientPolicy]
+ * @param {string | null} [options.keyInjector] - location of the key
+ *                                                injection helper, through
+ *                                                which keys are pressed if
+ *                                                given
+ * @param {number} [options.historySize] - bytes of captured output to retain
+ * @param {boolean} [options.normalizeSpeech] - whether the voice normalizes
+ *                                              the whitespace of speech and
+ *                                              escapes it for broadcasting
+ *                                              (see `VoiceSettings`)
+ * @param {import('./subscriptions').Subscription} [options.subscription] -
+ *        the messages of the voice which the server itself requires, whatever
+ *        its sessions subscribe to
  *
  * @returns {Promise<CommandServer>} an eventual value which is fulfilled when
  *                                   the server has successfully bound to the
  *                                   requested port
  */
-module.exports = async function createWebSocketServer(port) {
-  const server = new CommandServer({
-    clientTracking: true,
-    path: '/session',
-    port,
-  });
+module.exports = async function createWebSocketServer(
+  port,
+  {
+    quietPeriod,
+    audioTap,
+    batchWindow,
+    highWatermark,
+    lowWatermark,
+    laggingClientPolicy,
+    keyInjector,
+    historySize,
+    normalizeSpeech = false,
+    subscription,
+  } = {},
+) {
+  const server = new CommandServer(
+    {
+      clientTracking: true,
+      path: '/session',
+      port,
+    },
+    { quietPeriod },
+    { batchWindow, highWatermark, lowWatermark, laggingClientPolicy },
+    { maxBytes: historySize },
+    { escapeSpeech: normalizeSpeech, audioTap: Boolean(audioTap) },
+    subscription,
+  );
+  if (audioTap) {
+    server.audioCapture = new AudioCapture(audioTap);
+  }
+  if (keyInjector) {
+    server.keyInjector = new KeyInjector({ helper: keyInjector });
+  }
   await new Promise(resolve => server.once('listening', resolve));
 
-  server.on('connection', onConnection);
+  server.on('connection', websocket => server.accept(websocket));
 
   return server;
 };
+
+module.exports.CommandServer = CommandServer;
@@ -4,17 +4,227 @@ const net = require('net');
 
 /** @typedef {import("events").EventEmitter} EventEmitter */
 
-const onConnection = (server, socket) => {
-  let emitted = '';
-  socket.on('data', buffer => (emitted += buffer.toString()));
-  socket.on('end', () => {
-    const match = emitted.match(/^(lifecycle|speech|internalError):(.*)$/);
-    const [name, data] = match
-      ? [match[1], match[2]]
-      : ['internalError', `unrecognized message: "${emitted}"`];
+/**
+ * @typedef VoiceMessage
+ * @property {'event'} type
+ * @property {string} name
+ * @property {string} data
+ * @property {number} [sequence] - the message's position in the capture
+ *                                 journal, if the voice recorded it
+ * @property {number} [emittedAt] - the time at which the voice emitted the
+ *                                  message, in microseconds on the host's
+ *                                  monotonic clock (see
+ *                                  `monotonicMicroseconds`)
+ * @property {number} [speakEntryAt] - for the beginning of an utterance, the
+ *                                     time at which the screen reader asked
+ *                                     the voice to speak it, on the same
+ *                                     clock
+ * @property {number} [generation] - for the acknowledgement of settings sent
+ *                                   to the voice (a `configured` message),
+ *                                   the generation of those settings (see
+ *                                   `VoiceSettings`)
+ * @property {string} [escaped] - for speech which the voice sent as a
+ *                                payload (see `VoiceSettings`), the data
+ *                                escaped for inclusion in a JSON string, as
+ *                                it was received
+ */
+
+/**
+ * Bounds of the dictionary through which the voice sends repeated speech by
+ * reference (see `DriverClientDictionary` in `src/Shared/DriverClient.h`).
+ * They match those of the voice, and definitions which exceed them are
+ * ignored so that a connection's dictionary cannot grow without limit.
+ */
+const MAX_DICTIONARY_ENTRIES = 1024;
+const MAX_DICTIONARY_ENTRY_LENGTH = 256;
+
+// Characters which a JSON string holds only as part of an escape sequence.
+const UNESCAPED_PATTERN = /["\\\u0000-\u001f]/;
+
+const MESSAGE_NAMES = new Set([
+  'lifecycle',
+  'speech',
+  'bookmark',
+  'speakBegin',
+  'speakEnd',
+  'internalError',
+  'configured',
+]);
+
+/** @returns {boolean} whether `key` is a non-empty run of lowercase letters */
+const isAttributeKey = key => {
+  for (let i = 0; i < key.length; i += 1) {
+    const code = key.charCodeAt(i);
+    if (code < 0x61 || code > 0x7a) {
+      return false;
+    }
+  }
+  return key.length > 0;
+};
+
+/**
+ * @param {string} emitted
+ *
+ * @returns {VoiceMessage}
+ */
+const unrecognized = emitted => ({
+  type: 'event',
+  name: 'internalError',
+  data: `unrecognized message: "${emitted}"`,
+});
+
+/**
+ * Interpret a message written by the automation voice. Messages take the form
+ * `<name>[ <attribute>=<value>]*:<data>`, e.g. `speech seq=12 t=5081221:Hello`.
+ * Neither names nor attributes contain a colon, so the first ends the header.
+ * The header is scanned rather than matched with a regular expression because
+ * every message of speech passes through here.
+ *
+ * Speech may also define an entry of the connection's dictionary
+ * (`speech def=3:Quarterly revenue`) or, in place of its data, refer to one
+ * (`speech ref=3:`), in which case the message's data is the string held by
+ * the dictionary, as it was defined.
+ *
+ * Speech marked `esc=1` was escaped by the voice for inclusion in a JSON
+ * string. It is retained as `escaped`, so that it can be broadcast as it is,
+ * and decoded as `data`.
+ *
+ * @param {string} emitted
+ * @param {string[]} [dictionary] - the dictionary of the connection on which
+ *                                  the message was received
+ *
+ * @returns {VoiceMessage}
+ */
+const parseMessage = (emitted, dictionary = []) => {
+  const separator = emitted.indexOf(':');
+  if (separator === -1) {
+    return unrecognized(emitted);
+  }
+  let end = emitted.indexOf(' ');
+  if (end === -1 || end > separator) {
+    end = separator;
+  }
+  const name = emitted.slice(0, end);
+  if (!MESSAGE_NAMES.has(name)) {
+    return unrecognized(emitted);
+  }
+
+  /** @type {VoiceMessage} */
+  const message = { type: 'event', name, data: emitted.slice(separator + 1) };
+  let definition = -1;
+  let reference = -1;
+  let escaped = false;
+  while (end < separator) {
+    const start = end + 1;
+    end = emitted.indexOf(' ', start);
+    if (end === -1 || end > separator) {
+      end = separator;
+    }
+    const equals = emitted.indexOf('=', start);
+    if (equals === -1 || equals >= end) {
+      return unrecognized(emitted);
+    }
+    const key = emitted.slice(start, equals);
+    if (!isAttributeKey(key)) {
+      return unrecognized(emitted);
+    }
+    const value = emitted.slice(equals + 1, end);
+    if (key === 'seq') {
+      message.sequence = Number(value);
+    } else if (key === 't') {
+      message.emittedAt = Number(value);
+    } else if (key === 'entry') {
+      message.speakEntryAt = Number(value);
+    } else if (key === 'def') {
+      definition = Number(value);
+    } else if (key === 'ref') {
+      reference = Number(value);
+    } else if (key === 'gen') {
+      message.generation = Number(value);
+    } else if (key === 'esc') {
+      escaped = value === '1';
+    }
+  }
+
+  if (reference !== -1) {
+    const text = dictionary[reference];
+    if (text === undefined) {
+      return { type: 'event', name: 'internalError', data: `unknown reference: "${emitted}"` };
+    }
+    message.data = text;
+  } else if (
+    definition >= 0 &&
+    definition < MAX_DICTIONARY_ENTRIES &&
+    message.data.length <= MAX_DICTIONARY_ENTRY_LENGTH
+  ) {
+    dictionary[definition] = message.data;
+  }
+
+  if (escaped) {
+    message.escaped = message.data;
+    // Most speech holds nothing which is escaped. Anything which could not
+    // appear in a JSON string is decoded, so that a malformed payload is
+    // never broadcast.
+    if (UNESCAPED_PATTERN.test(message.escaped)) {
+      try {
+        message.data = JSON.parse(`"${message.escaped}"`);
+      } catch (error) {
+        return { type: 'event', name: 'internalError', data: `malformed payload: "${emitted}"` };
+      }
+    }
+  }
+  return message;
+};
+
+/**
+ * Clients may either write a single message and close the connection, or hold
+ * the connection open and terminate each message with a null byte. Each
+ * connection has its own dictionary (see `parseMessage`). The voice's settings
+ * are sent on every connection, both when it is established and whenever
+ * they change, so that they reach each process in which the voice is loaded.
+ *
+ * @param {net.Server} server
+ * @param {import('./voice-settings').VoiceSettings | undefined} settings
+ * @param {net.Socket} socket
+ */
+const onConnection = (server, settings, socket) => {
+  const configuration = settings && settings.encode();
+  if (configuration) {
+    socket.write(configuration);
+  }
 
-    server.emit('message', { type: 'event', name, data });
+  let pending = Buffer.alloc(0);
+  let framed = false;
+  /** @type {string[]} */
+  const dictionary = [];
+  socket.on('data', buffer => {
+    pending = pending.length ? Buffer.concat([pending, buffer]) : buffer;
+    // The remainder is sliced once per read rather than once per message.
+    let start = 0;
+    let terminator;
+    while ((terminator = pending.indexOf(0, start)) !== -1) {
+      framed = true;
+      server.emit('message', parseMessage(pending.toString('utf8', start, terminator), dictionary));
+      start = terminator + 1;
+    }
+    pending = pending.subarray(start);
+  });
+  socket.on('end', () => {
+    if (!framed) {
+      server.emit('message', parseMessage(pending.toString()));
+    } else if (pending.length) {
+      // The connection was lost while a message was being written. The
+      // client sends the message again in full.
+      server.emit('message', {
+        type: 'event',
+        name: 'internalError',
+        data: `incomplete message discarded: "${pending.toString()}"`,
+      });
+    }
   });
+  // Errors (e.g. a client which terminates abruptly) affect only the
+  // connection on which they occur.
+  socket.on('error', () => {});
 };
 
 /**
@@ -24,12 +234,15 @@ const onConnection = (server, socket) => {
  *
  * @param {string} handle - the address at which the server should listen for
  *                          connections
+ * @param {object} [options]
+ * @param {import('./voice-settings').VoiceSettings} [options.settings] - the
+ *        settings which the voice is sent (see `onConnection`)
  *
  * @returns {Promise<EventEmitter>} an eventual value which is fulfilled when
  *                                  the server has established a connection
  *                                  with the SAPI voice
  */
-module.exports = function createVoiceServer(handle) {
+module.exports = function createVoiceServer(handle, { settings } = {}) {
   return new Promise((resolve, reject) => {
     const server = net.createServer();
     const options = {
@@ -44,6 +257,21 @@ module.exports = function createVoiceServer(handle) {
     server.listen(options, () => resolve(server));
     server.on('error', reject);
 
-    server.on('connection', onConnection.bind(null, server));
+    /** @type {Set<net.Socket>} */
+    const sockets = new Set();
+    server.on('connection', socket => {
+      sockets.add(socket);
+      socket.on('close', () => sockets.delete(socket));
+      onConnection(server, settings, socket);
+    });
+    if (settings) {
+      const onChange = configuration => sockets.forEach(socket => socket.write(configuration));
+      settings.on('change', onChange);
+      server.on('close', () => settings.removeListener('change', onChange));
+    }
   });
 };
+
+module.exports.parseMessage = parseMessage;
+module.exports.MAX_DICTIONARY_ENTRIES = MAX_DICTIONARY_ENTRIES;
+module.exports.MAX_DICTIONARY_ENTRY_LENGTH = MAX_DICTIONARY_ENTRY_LENGTH;
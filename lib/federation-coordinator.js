@@ -0,0 +1,521 @@
+'use strict';
+
+const net = require('net');
+const { v4: uuid } = require('uuid');
+const { WebSocketServer } = require('ws');
+
+const { FRAME_TYPES, FrameReader, encodeFrame, now } = require('./federation-link');
+const { MergedStream } = require('./merged-stream');
+const { OutputBroadcaster } = require('./output-broadcaster');
+
+/** @typedef {import('./create-command-server').WebSocketWithData} WebSocketWithData */
+/** @typedef {import('./federation-link').FederatedItem} FederatedItem */
+
+/** Milliseconds between estimates of each driver's clock. */
+const DEFAULT_PING_INTERVAL = 5000;
+
+const MAX_HOST_NAME_LENGTH = 64;
+
+/**
+ * @typedef {WebSocketWithData & {channel?: number}} FederatedWebSocket
+ */
+
+/**
+ * The coordinator's end of a driver's connection (see `FederationUplink`).
+ */
+class HostLink {
+  /**
+   * @param {net.Socket} socket
+   */
+  constructor(socket) {
+    this.socket = socket;
+    /** @type {string | null} */
+    this.name = null;
+    // The driver's clock less the coordinator's, in milliseconds, and the
+    // round trip of the ping from which it was estimated.
+    this.offset = 0;
+    /** @type {number | null} */
+    this.roundTrip = null;
+    this.connectedAt = now();
+    // The channels on which commands have been relayed, and the ids of those
+    // which await responses.
+    /** @type {Set<number>} */
+    this.channels = new Set();
+    /** @type {Map<number, Set<number>>} */
+    this.pending = new Map();
+  }
+
+  /**
+   * @param {number} type
+   * @param {number} channel
+   * @param {string | Buffer} [body]
+   */
+  send(type, channel, body) {
+    this.socket.write(encodeFrame(type, channel, body));
+  }
+
+  describe() {
+    return {
+      host: this.name,
+      offset: this.offset,
+      roundTrip: this.roundTrip,
+      connectedAt: this.connectedAt,
+    };
+  }
+}
+
+/**
+ * @param {FederatedWebSocket} websocket
+ * @param {unknown} value
+ */
+const send = (websocket, value) => websocket.send(JSON.stringify(value));
+
+const methodHandlers = {
+  /**
+   * @param {FederatedWebSocket} websocket
+   */
+  'session.new': websocket => {
+    websocket.sessionId = uuid();
+    return { sessionId: websocket.sessionId, capabilities: {} };
+  },
+  /**
+   * @param {FederatedWebSocket} websocket
+   * @param {unknown} params
+   * @param {Coordinator} coordinator
+   */
+  'federation.hosts': (websocket, params, coordinator) => ({
+    hosts: [...coordinator.hosts.values()].map(link => link.describe()),
+  }),
+};
+
+/**
+ * @param {Coordinator} coordinator
+ * @param {FederatedWebSocket} websocket
+ */
+const onConnection = (coordinator, websocket) => {
+  coordinator.lastChannel += 1;
+  websocket.channel = coordinator.lastChannel;
+  coordinator.channels.set(websocket.channel, websocket);
+  websocket.once('close', () => coordinator.closeChannel(websocket));
+
+  websocket.on('message', data => {
+    let parsed;
+    try {
+      parsed = JSON.parse(data);
+    } catch ({}) {
+      send(websocket, {
+        id: null,
+        error: 'unknown error',
+        message: `Unable to parse message: "${data}".`,
+      });
+      return;
+    }
+
+    if (typeof parsed !== 'object' || parsed === null || Array.isArray(parsed)) {
+      send(websocket, {
+        id: null,
+        error: 'unknown error',
+        message: `Malformed message: "${data}".`,
+      });
+      return;
+    }
+
+    const { id, method, params, host } = parsed;
+    if (!method) {
+      send(websocket, {
+        id: null,
+        error: 'unknown command',
+        message: `Unrecognized message type (no method): "${data}".`,
+      });
+      return;
+    }
+    if (typeof id !== 'number') {
+      send(websocket, {
+        id: null,
+        error: 'unknown error',
+        message: `Command missing required "id": "${data}".`,
+      });
+      return;
+    }
+
+    if (host !== undefined) {
+      coordinator.relay(websocket, host, { id, method, params });
+      return;
+    }
+    const handler = methodHandlers[method];
+    if (!handler) {
+      send(websocket, { id, error: 'unknown command' });
+      return;
+    }
+    try {
+      send(websocket, { id, result: handler(websocket, params, coordinator) });
+    } catch (error) {
+      send(websocket, { id, error: 'unknown error', message: error.message });
+    }
+  });
+};
+
+/**
+ * Presents the output of many drivers, each on its own host, as one stream,
+ * and relays commands to the driver which should perform them.
+ *
+ * Drivers connect on the federation port (see `serve --coordinator`); clients
+ * connect over WebSocket as they would to a driver. Every event which a
+ * driver broadcasts reaches the coordinator's clients with a `host` property
+ * naming the driver and a `time` property giving the moment at which the
+ * driver captured it, in milliseconds on the coordinator's clock. Events are
+ * sent in order of that time across drivers (see `MergedStream`) and in the
+ * order in which each driver captured them. A command with a `host` property
+ * is performed by the named driver, as though the client had sent it to the
+ * driver directly; other commands are performed by the coordinator.
+ *
+ * Emits "hostConnected" and "hostDisconnected" with the driver's name, and
+ * "error".
+ */
+class Coordinator extends WebSocketServer {
+  /**
+   * @param {import('ws').ServerOptions} options
+   * @param {object} [federationOptions]
+   * @param {number} [federationOptions.mergeWindow] - milliseconds (see
+   *                                                   `MergedStream`)
+   * @param {number} [federationOptions.pingInterval] - milliseconds
+   * @param {ConstructorParameters<typeof OutputBroadcaster>[1]} [broadcastOptions]
+   */
+  constructor(
+    options,
+    { mergeWindow, pingInterval = DEFAULT_PING_INTERVAL } = {},
+    broadcastOptions = {},
+  ) {
+    super(options);
+    /** @type {Map<string, HostLink>} */
+    this.hosts = new Map();
+    /** @type {Map<number, FederatedWebSocket>} */
+    this.channels = new Map();
+    this.lastChannel = 0;
+    this.merged = new MergedStream({ window: mergeWindow });
+    this.merged.on('release', released => this.publish(released));
+    // Events are composed by the coordinator, so they are not batched again.
+    this.broadcaster = new OutputBroadcaster(
+      () => /** @type {Set<WebSocketWithData>} */ (this.clients),
+      { ...broadcastOptions, batchWindow: 0 },
+    );
+    this.broadcaster.on('error', error => this.emit('error', error));
+    this.federation = net.createServer(socket => this.onHost(socket));
+    this.pingTimer = setInterval(() => this.ping(), pingInterval);
+    this.pingTimer.unref();
+    this.once('close', () => {
+      clearInterval(this.pingTimer);
+      this.merged.close();
+      this.broadcaster.close();
+      this.federation.close();
+      for (const link of this.hosts.values()) {
+        link.socket.destroy();
+      }
+    });
+  }
+
+  /**
+   * @param {net.Socket} socket
+   */
+  onHost(socket) {
+    socket.setNoDelay(true);
+    const link = new HostLink(socket);
+    const reader = new FrameReader();
+    socket.on('data', chunk => {
+      try {
+        for (const frame of reader.push(chunk)) {
+          this.receive(link, frame);
+        }
+      } catch (error) {
+        this.emit('error', `malformed data from ${link.name || 'a driver'}: ${error.message}`);
+        socket.destroy();
+      }
+    });
+    socket.on('error', error => this.emit('error', `error from ${link.name}: ${error}`));
+    socket.on('close', () => this.removeHost(link));
+  }
+
+  /**
+   * @param {HostLink} link
+   * @param {import('./federation-link').Frame} frame
+   */
+  receive(link, { type, channel, body }) {
+    if (link.name === null) {
+      if (type !== FRAME_TYPES.HELLO) {
+        throw new Error('expected a greeting');
+      }
+      this.addHost(link, JSON.parse(body.toString()));
+      return;
+    }
+
+    if (type === FRAME_TYPES.ITEMS) {
+      /** @type {FederatedItem[]} */
+      const items = JSON.parse(body.toString());
+      for (const item of items) {
+        this.merged.push(link.name, item.t - link.offset, item);
+      }
+    } else if (type === FRAME_TYPES.TEXT) {
+      const text = body.toString();
+      this.settle(link, channel, text);
+      const websocket = this.channels.get(channel);
+      if (websocket) {
+        websocket.send(text);
+      }
+    } else if (type === FRAME_TYPES.BINARY) {
+      const websocket = this.channels.get(channel);
+      if (websocket) {
+        websocket.send(body);
+      }
+    } else if (type === FRAME_TYPES.PONG) {
+      const { t, time } = JSON.parse(body.toString());
+      const received = now();
+      const roundTrip = received - t;
+      // Pings delayed by congestion would skew the estimate.
+      if (link.roundTrip === null || roundTrip <= link.roundTrip * 2) {
+        link.offset = time - (t + received) / 2;
+        link.roundTrip = roundTrip;
+      }
+    }
+  }
+
+  /**
+   * @param {HostLink} link
+   * @param {{host: unknown, time: unknown}} hello
+   */
+  addHost(link, { host, time }) {
+    if (typeof host !== 'string' || host.length === 0 || host.length > MAX_HOST_NAME_LENGTH) {
+      throw new Error(`invalid host name: ${JSON.stringify(host)}`);
+    }
+    // A driver which reconnects replaces its previous connection, which may
+    // not yet have been found to be lost.
+    const previous = this.hosts.get(host);
+    if (previous) {
+      previous.socket.destroy();
+      this.removeHost(previous);
+    }
+    link.name = host;
+    // Until the first ping returns, the driver's greeting is the estimate.
+    link.offset = typeof time === 'number' ? time - now() : 0;
+    this.hosts.set(host, link);
+    this.merged.addSource(host);
+    link.send(FRAME_TYPES.PING, 0, JSON.stringify({ t: now() }));
+    this.broadcaster.broadcast({ method: 'federation.hostConnected', params: { host } });
+    this.emit('hostConnected', host);
+  }
+
+  /**
+   * @param {HostLink} link
+   */
+  removeHost(link) {
+    if (link.name === null || this.hosts.get(link.name) !== link) {
+      return;
+    }
+    const host = link.name;
+    this.hosts.delete(host);
+    this.merged.removeSource(host);
+    for (const [channel, ids] of link.pending) {
+      const websocket = this.channels.get(channel);
+      for (const id of ids) {
+        if (websocket) {
+          send(websocket, { id, error: 'unknown error', message: `host "${host}" disconnected` });
+        }
+      }
+    }
+    link.pending.clear();
+    this.broadcaster.broadcast({ method: 'federation.hostDisconnected', params: { host } });
+    this.emit('hostDisconnected', host);
+  }
+
+  /**
+   * Relay a command to the driver which should perform it.
+   *
+   * @param {FederatedWebSocket} websocket
+   * @param {unknown} host
+   * @param {{id: number, method: string, params: unknown}} command
+   */
+  relay(websocket, host, command) {
+    const link = typeof host === 'string' ? this.hosts.get(host) : undefined;
+    if (!link) {
+      send(websocket, {
+        id: command.id,
+        error: 'unknown error',
+        message: `unknown host ${JSON.stringify(host)}`,
+      });
+      return;
+    }
+    const channel = /** @type {number} */ (websocket.channel);
+    let ids = link.pending.get(channel);
+    if (!ids) {
+      ids = new Set();
+      link.pending.set(channel, ids);
+    }
+    ids.add(command.id);
+    link.channels.add(channel);
+    link.send(FRAME_TYPES.TEXT, channel, JSON.stringify(command));
+  }
+
+  /**
+   * Note the response to a relayed command, if the message is one.
+   *
+   * @param {HostLink} link
+   * @param {number} channel
+   * @param {string} text
+   */
+  settle(link, channel, text) {
+    const ids = link.pending.get(channel);
+    // Responses are serialized with their id first (see `onConnection` in
+    // `create-command-server.js`); events for the channel are not.
+    if (!ids || !text.startsWith('{"id":')) {
+      return;
+    }
+    ids.delete(JSON.parse(text).id);
+    if (ids.size === 0) {
+      link.pending.delete(channel);
+    }
+  }
+
+  /**
+   * @param {FederatedWebSocket} websocket
+   */
+  closeChannel(websocket) {
+    const channel = /** @type {number} */ (websocket.channel);
+    this.channels.delete(channel);
+    // Drivers release whatever the client held (such as audio capture).
+    for (const link of this.hosts.values()) {
+      if (link.channels.delete(channel)) {
+        link.pending.delete(channel);
+        link.send(FRAME_TYPES.CLOSE, channel);
+      }
+    }
+  }
+
+  ping() {
+    for (const link of this.hosts.values()) {
+      link.send(FRAME_TYPES.PING, 0, JSON.stringify({ t: now() }));
+    }
+  }
+
+  /**
+   * Send clients the items released by the merged stream. Consecutive speech
+   * from one driver, caused by the same key press, is sent as one batch (see
+   * "Batched `interaction.capturedOutput` events" in the README).
+   *
+   * @param {import('./merged-stream').MergedItem[]} released
+   */
+  publish(released) {
+    /** @type {import('./merged-stream').MergedItem[]} */
+    let batch = [];
+    const flush = () => {
+      if (batch.length > 0) {
+        this.broadcaster.broadcast(encodeOutput(batch));
+        batch = [];
+      }
+    };
+    for (const merged of released) {
+      /** @type {FederatedItem} */
+      const item = merged.item;
+      if (item.data !== undefined) {
+        const first = batch[0];
+        if (first && (first.source !== merged.source || first.item.pressId !== item.pressId)) {
+          flush();
+        }
+        batch.push(merged);
+        continue;
+      }
+      flush();
+      const host = merged.source;
+      const time = roundTime(merged.time);
+      if (item.event) {
+        const { method, params } = item.event;
+        this.broadcaster.broadcast({ method, params: { ...params, host, time } });
+      } else if (item.dropped) {
+        this.broadcaster.broadcast({
+          method: 'interaction.capturedOutputDropped',
+          params: { count: item.dropped, host, time },
+        });
+      }
+    }
+    flush();
+  }
+}
+
+/**
+ * @param {number} time - milliseconds
+ *
+ * @returns {number} the time to the microsecond
+ */
+const roundTime = time => Math.round(time * 1000) / 1000;
+
+/**
+ * @param {import('./merged-stream').MergedItem[]} batch - speech from one
+ *        driver, caused by the same key press
+ *
+ * @returns {{method: string, params: object}} the
+ *          `interaction.capturedOutput` event for the batch, labelled with
+ *          the driver and the time of its first message
+ */
+const encodeOutput = batch => {
+  const { source, time, item } = batch[0];
+  const last = batch[batch.length - 1].item;
+  /** @type {{[name: string]: unknown}} */
+  const messages = batch.map(merged => merged.item.data);
+  const params =
+    messages.length === 1 ? { data: messages[0] } : { data: messages.join('\n'), batch: messages };
+  if (item.pressId !== undefined) {
+    params.pressId = item.pressId;
+  }
+  if (last.cursor !== undefined) {
+    params.cursor = last.cursor;
+  }
+  params.host = source;
+  params.time = roundTime(time);
+  return { method: 'interaction.capturedOutput', params };
+};
+
+/**
+ * Create a coordinator for drivers on several hosts.
+ *
+ * @param {number} port - the port on which to listen for WebSocket clients
+ * @param {object} options
+ * @param {number} options.federationPort - the port on which to listen for
+ *                                          drivers
+ * @param {number} [options.mergeWindow] - milliseconds for which events are
+ *                                         held awaiting earlier events from
+ *                                         other drivers
+ * @param {number} [options.pingInterval] - milliseconds between estimates of
+ *                                          each driver's clock
+ * @param {number} [options.highWatermark] - bytes of unsent data beyond
+ *                                           which a client is lagging
+ * @param {number} [options.lowWatermark] - bytes of unsent data below which
+ *                                          a lagging client has caught up
+ * @param {"queue" | "drop" | "disconnect"} [options.laggingClientPolicy]
+ *
+ * @returns {Promise<Coordinator>} an eventual value which is fulfilled when
+ *                                 the coordinator is listening on both ports
+ */
+const createCoordinator = async (
+  port,
+  { federationPort, mergeWindow, pingInterval, highWatermark, lowWatermark, laggingClientPolicy },
+) => {
+  const coordinator = new Coordinator(
+    { clientTracking: true, path: '/session', port },
+    { mergeWindow, pingInterval },
+    { highWatermark, lowWatermark, laggingClientPolicy },
+  );
+  await Promise.all([
+    new Promise(resolve => coordinator.once('listening', resolve)),
+    new Promise((resolve, reject) => {
+      coordinator.federation.once('error', reject);
+      coordinator.federation.listen(federationPort, () => {
+        coordinator.federation.removeListener('error', reject);
+        resolve(undefined);
+      });
+    }),
+  ]);
+
+  coordinator.on('connection', websocket => onConnection(coordinator, websocket));
+
+  return coordinator;
+};
+
+module.exports = { Coordinator, createCoordinator, DEFAULT_PING_INTERVAL };
@@ -0,0 +1,151 @@
+'use strict';
+
+/**
+ * The connection between a driver and the coordinator of a federation (see
+ * `FederationUplink` and `Coordinator`). Each driver holds one TCP connection
+ * to the coordinator, over which it streams the output it captures and the
+ * coordinator relays the commands of its clients. The connection carries a
+ * sequence of frames, each of which has a nine-byte header:
+ *
+ * - the length of the frame's body in bytes (32-bit, big-endian)
+ * - the frame's type (8-bit; see `FRAME_TYPES`)
+ * - the frame's channel (32-bit, big-endian): zero for frames concerning the
+ *   driver as a whole, otherwise the coordinator's number for the client
+ *   whose commands and responses the frame carries
+ */
+
+const FRAME_HEADER_SIZE = 9;
+
+/** Bodies larger than this are rejected as malformed. */
+const MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+/**
+ * - `HELLO` (driver to coordinator) - JSON `{host, time}`, naming the driver;
+ *   the first frame which the driver sends
+ * - `ITEMS` (driver to coordinator) - a JSON array of `FederatedItem`s, in
+ *   the order in which they were captured
+ * - `TEXT` (either) - a message for a channel: a command from a client, or a
+ *   response or event for it
+ * - `BINARY` (driver to coordinator) - binary data for a channel, such as
+ *   captured audio
+ * - `CLOSE` (coordinator to driver) - the client of a channel disconnected
+ * - `PING` (coordinator to driver) - JSON `{t}`, the coordinator's time
+ * - `PONG` (driver to coordinator) - JSON `{t, time}`, echoing the ping with
+ *   the driver's time, from which the coordinator estimates the difference
+ *   between the clocks
+ */
+const FRAME_TYPES = Object.freeze({
+  HELLO: 1,
+  ITEMS: 2,
+  TEXT: 3,
+  BINARY: 4,
+  CLOSE: 5,
+  PING: 6,
+  PONG: 7,
+});
+
+/**
+ * @typedef FederatedItem
+ * @property {number} t - when the driver captured the item, in milliseconds
+ *                        on its clock (see `now`)
+ * @property {string} [data] - captured speech
+ * @property {number} [pressId] - the key press which caused the speech
+ * @property {number} [cursor] - the driver's history cursor which follows the
+ *                               speech (see `OutputHistory`)
+ * @property {{method: string, params: object}} [event] - an event other than
+ *                                                        captured output
+ * @property {number} [dropped] - the number of items which the driver could
+ *                                not send since it last sent one
+ */
+
+/**
+ * @typedef Frame
+ * @property {number} type
+ * @property {number} channel
+ * @property {Buffer} body
+ */
+
+/**
+ * @returns {number} the current time in milliseconds, with sub-millisecond
+ *                   precision, which advances monotonically within a process
+ */
+const now = () => performance.timeOrigin + performance.now();
+
+/**
+ * @param {number} type
+ * @param {number} channel
+ * @param {string | Buffer} [body]
+ *
+ * @returns {Buffer}
+ */
+const encodeFrame = (type, channel, body = '') => {
+  const size = typeof body === 'string' ? Buffer.byteLength(body) : body.length;
+  const frame = Buffer.allocUnsafe(FRAME_HEADER_SIZE + size);
+  frame.writeUInt32BE(size, 0);
+  frame.writeUInt8(type, 4);
+  frame.writeUInt32BE(channel, 5);
+  if (typeof body === 'string') {
+    frame.write(body, FRAME_HEADER_SIZE);
+  } else {
+    body.copy(frame, FRAME_HEADER_SIZE);
+  }
+  return frame;
+};
+
+/**
+ * Divides the data read from a connection into frames. Chunks are held until
+ * a frame is complete, so that a large frame is copied once.
+ */
+class FrameReader {
+  constructor() {
+    /** @type {Buffer[]} */
+    this.chunks = [];
+    this.buffered = 0;
+    // The size of the frame (header included) which the buffered data
+    // begins, once its header has been read.
+    this.needed = FRAME_HEADER_SIZE;
+  }
+
+  /**
+   * @param {Buffer} chunk
+   *
+   * @returns {Frame[]} the frames which the chunk completes
+   */
+  push(chunk) {
+    this.chunks.push(chunk);
+    this.buffered += chunk.length;
+    /** @type {Frame[]} */
+    const frames = [];
+    if (this.buffered < this.needed) {
+      return frames;
+    }
+
+    let data = this.chunks.length === 1 ? this.chunks[0] : Buffer.concat(this.chunks);
+    let offset = 0;
+    while (data.length - offset >= FRAME_HEADER_SIZE) {
+      const size = data.readUInt32BE(offset);
+      if (size > MAX_FRAME_SIZE) {
+        throw new Error(`frame of ${size} bytes exceeds the limit of ${MAX_FRAME_SIZE}`);
+      }
+      const end = offset + FRAME_HEADER_SIZE + size;
+      if (end > data.length) {
+        this.needed = end - offset;
+        break;
+      }
+      frames.push({
+        type: data.readUInt8(offset + 4),
+        channel: data.readUInt32BE(offset + 5),
+        body: data.subarray(offset + FRAME_HEADER_SIZE, end),
+      });
+      offset = end;
+      this.needed = FRAME_HEADER_SIZE;
+    }
+
+    data = data.subarray(offset);
+    this.chunks = data.length > 0 ? [data] : [];
+    this.buffered = data.length;
+    return frames;
+  }
+}
+
+module.exports = { FRAME_TYPES, FrameReader, MAX_FRAME_SIZE, encodeFrame, now };
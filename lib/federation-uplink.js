@@ -0,0 +1,266 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+const net = require('net');
+
+const { FRAME_TYPES, FrameReader, encodeFrame, now } = require('./federation-link');
+
+/**
+ * Number of bytes awaiting transmission to the coordinator beyond which
+ * captured output is discarded (and counted) rather than buffered.
+ */
+const DEFAULT_MAX_BUFFERED = 16 * 1024 * 1024;
+
+/** Milliseconds between attempts to reach the coordinator. */
+const DEFAULT_RETRY_DELAY = 1000;
+
+/**
+ * @param {string} value - "<host>:<port>", e.g. "coordinator.local:4383"
+ *
+ * @returns {{host: string, port: number}}
+ */
+const parseAddress = value => {
+  const separator = value.lastIndexOf(':');
+  const host = value.slice(0, separator);
+  const port = Number(value.slice(separator + 1));
+  if (separator <= 0 || !Number.isInteger(port) || port <= 0 || port > 65535) {
+    throw new TypeError(`expected an address of the form "host:port" but received "${value}"`);
+  }
+  return { host, port };
+};
+
+/**
+ * Stands in for the WebSocket of one of the coordinator's clients, so that
+ * the driver handles the commands which the coordinator relays as it handles
+ * those of its own clients. It emits "message" for each command and "close"
+ * when the client disconnects (or the coordinator is lost).
+ */
+class ChannelSocket extends EventEmitter {
+  /**
+   * @param {FederationUplink} uplink
+   * @param {number} channel
+   */
+  constructor(uplink, channel) {
+    super();
+    this.uplink = uplink;
+    this.channel = channel;
+    /** @type {string | undefined} */
+    this.sessionId = undefined;
+  }
+
+  get bufferedAmount() {
+    return this.uplink.bufferedAmount;
+  }
+
+  /**
+   * @param {string | Buffer} data
+   * @param {function(Error=): void} [callback]
+   */
+  send(data, callback) {
+    const type = typeof data === 'string' ? FRAME_TYPES.TEXT : FRAME_TYPES.BINARY;
+    this.uplink.write(encodeFrame(type, this.channel, data));
+    if (callback) {
+      process.nextTick(callback);
+    }
+  }
+
+  close() {}
+}
+
+/**
+ * A driver's connection to the coordinator of a federation. Output and
+ * events which the driver captures are stamped with the time at which they
+ * were captured and sent in batches: everything captured during one turn of
+ * the event loop is sent in one frame. Commands which the coordinator relays
+ * are handed to `accept` as they would arrive from a WebSocket.
+ *
+ * The connection is re-established whenever it is lost. Output captured
+ * while it is down, or while the coordinator does not keep up, is discarded
+ * and counted; it remains in the driver's history (see
+ * `interaction.getOutputSince`).
+ *
+ * Emits "connected", "disconnected" and "error".
+ */
+class FederationUplink extends EventEmitter {
+  /**
+   * @param {{host: string, port: number}} address - the coordinator's
+   * @param {object} options
+   * @param {string} options.name - identifies the driver to the coordinator
+   *                                and its clients
+   * @param {function(ChannelSocket): void} options.accept - begins handling
+   *        the commands of one of the coordinator's clients
+   * @param {number} [options.maxBuffered] - bytes
+   * @param {number} [options.retryDelay] - milliseconds
+   */
+  constructor(
+    address,
+    { name, accept, maxBuffered = DEFAULT_MAX_BUFFERED, retryDelay = DEFAULT_RETRY_DELAY },
+  ) {
+    super();
+    this.address = address;
+    this.name = name;
+    this.accept = accept;
+    this.maxBuffered = maxBuffered;
+    this.retryDelay = retryDelay;
+    /** @type {net.Socket | null} */
+    this.socket = null;
+    this.connected = false;
+    this.closed = false;
+    /** @type {import('./federation-link').FederatedItem[]} */
+    this.items = [];
+    this.dropped = 0;
+    this.flushScheduled = false;
+    /** @type {Map<number, ChannelSocket>} */
+    this.channels = new Map();
+    /** @type {ReturnType<typeof setTimeout> | null} */
+    this.retryTimer = null;
+    this.connect();
+  }
+
+  connect() {
+    const socket = net.connect(this.address);
+    socket.setNoDelay(true);
+    this.socket = socket;
+    const reader = new FrameReader();
+    socket.on('connect', () => {
+      this.connected = true;
+      socket.write(
+        encodeFrame(FRAME_TYPES.HELLO, 0, JSON.stringify({ host: this.name, time: now() })),
+      );
+      this.emit('connected');
+    });
+    socket.on('data', chunk => {
+      try {
+        for (const frame of reader.push(chunk)) {
+          this.receive(frame);
+        }
+      } catch (error) {
+        this.emit('error', error);
+        socket.destroy();
+      }
+    });
+    socket.on('drain', () => this.emit('drain'));
+    socket.on('error', error => this.emit('error', error));
+    socket.on('close', () => {
+      const wasConnected = this.connected;
+      this.connected = false;
+      this.socket = null;
+      for (const channel of this.channels.values()) {
+        channel.emit('close');
+      }
+      this.channels.clear();
+      if (wasConnected) {
+        this.emit('disconnected');
+      }
+      if (!this.closed) {
+        this.retryTimer = setTimeout(() => this.connect(), this.retryDelay);
+      }
+    });
+  }
+
+  /**
+   * @param {import('./federation-link').Frame} frame
+   */
+  receive({ type, channel, body }) {
+    if (type === FRAME_TYPES.PING) {
+      const { t } = JSON.parse(body.toString());
+      this.write(encodeFrame(FRAME_TYPES.PONG, 0, JSON.stringify({ t, time: now() })));
+    } else if (type === FRAME_TYPES.TEXT) {
+      let socket = this.channels.get(channel);
+      if (!socket) {
+        socket = new ChannelSocket(this, channel);
+        this.channels.set(channel, socket);
+        this.accept(socket);
+      }
+      socket.emit('message', body.toString());
+    } else if (type === FRAME_TYPES.CLOSE) {
+      const socket = this.channels.get(channel);
+      if (socket) {
+        this.channels.delete(channel);
+        socket.emit('close');
+      }
+    }
+  }
+
+  /** Bytes awaiting transmission to the coordinator. */
+  get bufferedAmount() {
+    return this.socket ? this.socket.writableLength : 0;
+  }
+
+  /**
+   * @param {Buffer} frame
+   */
+  write(frame) {
+    if (this.connected && this.socket) {
+      this.socket.write(frame);
+    }
+  }
+
+  /**
+   * @param {string} data
+   * @param {number | null} [pressId]
+   * @param {number | null} [cursor]
+   */
+  output(data, pressId = null, cursor = null) {
+    /** @type {import('./federation-link').FederatedItem} */
+    const item = { t: now(), data };
+    if (pressId !== null) {
+      item.pressId = pressId;
+    }
+    if (cursor !== null) {
+      item.cursor = cursor;
+    }
+    this.enqueue(item);
+  }
+
+  /**
+   * @param {{method: string, params: object}} message
+   */
+  event(message) {
+    this.enqueue({ t: now(), event: message });
+  }
+
+  /**
+   * @param {import('./federation-link').FederatedItem} item
+   */
+  enqueue(item) {
+    if (!this.connected || this.bufferedAmount > this.maxBuffered) {
+      this.dropped += 1;
+      return;
+    }
+    this.items.push(item);
+    if (!this.flushScheduled) {
+      this.flushScheduled = true;
+      setImmediate(() => this.flush());
+    }
+  }
+
+  flush() {
+    this.flushScheduled = false;
+    if (this.items.length === 0) {
+      return;
+    }
+    if (!this.connected) {
+      this.dropped += this.items.length;
+      this.items = [];
+      return;
+    }
+    if (this.dropped > 0) {
+      this.items.unshift({ t: this.items[0].t, dropped: this.dropped });
+      this.dropped = 0;
+    }
+    this.write(encodeFrame(FRAME_TYPES.ITEMS, 0, JSON.stringify(this.items)));
+    this.items = [];
+  }
+
+  close() {
+    this.closed = true;
+    clearTimeout(this.retryTimer);
+    if (this.socket) {
+      this.flush();
+      this.socket.end();
+    }
+  }
+}
+
+module.exports = { FederationUplink, ChannelSocket, parseAddress, DEFAULT_MAX_BUFFERED };
@@ -0,0 +1,17 @@
+'use strict';
+
+/**
+ * @param {string} name
+ *
+ * @returns {function(string): number}
+ */
+const nonNegativeInteger = name => string => {
+  if (!/^(0|[1-9][0-9]*)$/.test(string)) {
+    throw new TypeError(
+      `"${name}" option: expected a non-negative integer value but received "${string}"`,
+    );
+  }
+  return Number(string);
+};
+
+module.exports = { nonNegativeInteger };
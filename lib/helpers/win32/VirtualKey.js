@@ -0,0 +1,86 @@
+'use strict';
+
+/**
+ * Map of the key names used by robotjs to Windows virtual-key codes, for
+ * pressing keys through the key injection helper.
+ * @enum {number}
+ * - https://learn.microsoft.com/en-us/windows/win32/inputdev/virtual-key-codes
+ */
+const VirtualKey = {
+  backspace: 0x08,
+  tab: 0x09,
+  enter: 0x0d,
+  shift: 0x10,
+  control: 0x11,
+  alt: 0x12,
+  pause: 0x13,
+  escape: 0x1b,
+  space: 0x20,
+  pageup: 0x21,
+  pagedown: 0x22,
+  end: 0x23,
+  home: 0x24,
+  left: 0x25,
+  up: 0x26,
+  right: 0x27,
+  down: 0x28,
+  insert: 0x2d,
+  delete: 0x2e,
+  command: 0x5b,
+  numpad_0: 0x60,
+  numpad_1: 0x61,
+  numpad_2: 0x62,
+  numpad_3: 0x63,
+  numpad_4: 0x64,
+  numpad_5: 0x65,
+  numpad_6: 0x66,
+  numpad_7: 0x67,
+  numpad_8: 0x68,
+  numpad_9: 0x69,
+  f1: 0x70,
+  f2: 0x71,
+  f3: 0x72,
+  f4: 0x73,
+  f5: 0x74,
+  f6: 0x75,
+  f7: 0x76,
+  f8: 0x77,
+  f9: 0x78,
+  f10: 0x79,
+  f11: 0x7a,
+  f12: 0x7b,
+  // The keys of the US layout which produce punctuation.
+  ';': 0xba,
+  '=': 0xbb,
+  ',': 0xbc,
+  '-': 0xbd,
+  '.': 0xbe,
+  '/': 0xbf,
+  '`': 0xc0,
+  '[': 0xdb,
+  '\\': 0xdc,
+  ']': 0xdd,
+  "'": 0xde,
+};
+
+/**
+ * @param {string} key - a robotjs key name or a single character
+ *
+ * @returns {number} the virtual-key code of the key
+ * @throws if the key has no virtual-key code
+ */
+const virtualKeyCode = key => {
+  if (key in VirtualKey) {
+    return VirtualKey[key];
+  }
+  // Letters and digits share the codes of their ASCII upper case forms.
+  if (/^[a-zA-Z0-9]$/.test(key)) {
+    return key.toUpperCase().charCodeAt(0);
+  }
+  throw new Error(`no virtual-key code for "${key}"`);
+};
+
+module.exports = {
+  VirtualKey,
+  virtualKeyCode,
+};
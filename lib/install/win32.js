@@ -8,8 +8,13 @@ const exec = promisify(_exec);
 
 const MAKE_VOICE_EXE = 'MakeVoice.exe';
 
-exports.install = async function () {
-  await exec(`${MAKE_VOICE_EXE}`, await getExecOptions());
+/**
+ * @param {object} [options]
+ * @param {number} [options.instances] - number of instances of the voice to
+ *                                       register
+ */
+exports.install = async function ({ instances = 1 } = {}) {
+  await exec(`${MAKE_VOICE_EXE} /instances:${instances}`, await getExecOptions());
 };
 
 exports.uninstall = async function () {
@@ -0,0 +1,131 @@
+'use strict';
+
+const { CaptureJournal } = require('./capture-journal');
+const { parseMessage } = require('./create-voice-server');
+
+/** @typedef {import('./create-voice-server').VoiceMessage} VoiceMessage */
+
+/**
+ * Reconciles the messages which the driver receives from the automation voice
+ * with those recorded in the voice's capture journal. Messages which the
+ * voice emitted while the driver was not listening (or which were otherwise
+ * lost) are recovered from the journal, and messages which have already been
+ * recovered are not delivered twice. Progress is recorded in the journal so
+ * that a subsequent instance of the driver resumes where this one stopped.
+ */
+class JournalReplayer {
+  /**
+   * @param {string} path - location of the capture journal
+   */
+  constructor(path) {
+    this.path = path;
+    /** @type {CaptureJournal|null} */
+    this.journal = null;
+    this.acknowledgedSequence = 0;
+    this.acknowledgementPending = false;
+  }
+
+  /**
+   * Open the journal if it exists and has not yet been opened. The voice
+   * creates the journal on first use, so it may appear after the driver
+   * starts.
+   *
+   * @returns {boolean} whether the journal is available
+   */
+  openJournal() {
+    if (!this.journal) {
+      this.journal = CaptureJournal.open(this.path);
+      if (this.journal) {
+        this.acknowledgedSequence = this.journal.readHeader().acknowledgedSequence;
+      }
+    }
+    return !!this.journal;
+  }
+
+  /**
+   * @returns {VoiceMessage[]} the messages recorded since the most recent
+   *                           acknowledgement, in the order they were emitted
+   */
+  recover() {
+    if (!this.openJournal()) {
+      return [];
+    }
+    return this.replay(this.journal.readHeader().nextSequence);
+  }
+
+  /**
+   * Determine which messages should be delivered in response to a message
+   * received from the voice.
+   *
+   * @param {VoiceMessage} message
+   *
+   * @returns {VoiceMessage[]} the messages to deliver, in order
+   */
+  accept(message) {
+    if (message.sequence === undefined || !this.openJournal()) {
+      return [message];
+    }
+    if (message.sequence <= this.acknowledgedSequence) {
+      if (this.journal.readHeader().nextSequence > this.acknowledgedSequence) {
+        return [];
+      }
+      // The voice re-creates the journal (restarting its sequence) if the
+      // existing file is invalid or was created with different capacities.
+      this.acknowledgementPending = false;
+      this.close();
+      this.openJournal();
+    }
+
+    const recovered = this.replay(message.sequence);
+    this.acknowledge(message.sequence);
+    return [...recovered, message];
+  }
+
+  close() {
+    if (this.journal) {
+      this.flushAcknowledgement();
+      this.journal.close();
+      this.journal = null;
+    }
+  }
+
+  /**
+   * @param {number} end - sequence number following the last message to
+   *                       recover
+   *
+   * @returns {VoiceMessage[]}
+   */
+  replay(end) {
+    const messages = this.journal.readRange(this.acknowledgedSequence + 1, end).map(record => ({
+      ...parseMessage(record.data),
+      sequence: record.sequence,
+    }));
+    if (end - 1 > this.acknowledgedSequence) {
+      this.acknowledge(end - 1);
+    }
+    return messages;
+  }
+
+  /**
+   * Acknowledgements are written to the journal at most once per turn of the
+   * event loop, so bursts of messages incur a single write.
+   *
+   * @param {number} sequence
+   */
+  acknowledge(sequence) {
+    this.acknowledgedSequence = sequence;
+    if (!this.acknowledgementPending) {
+      this.acknowledgementPending = true;
+      setImmediate(() => this.flushAcknowledgement());
+    }
+  }
+
+  flushAcknowledgement() {
+    if (this.acknowledgementPending && this.journal) {
+      this.journal.acknowledge(this.acknowledgedSequence);
+    }
+    this.acknowledgementPending = false;
+  }
+}
+
+module.exports = { JournalReplayer };
@@ -0,0 +1,233 @@
+/// <reference path="./modules/types.js" />
+
+'use strict';
+
+const { spawn } = require('child_process');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+
+const { monotonicMicroseconds } = require('./key-press-latency');
+
+/** Milliseconds within which the helper must report that it is listening. */
+const STARTUP_TIMEOUT = 5000;
+
+/**
+ * @typedef KeyChord
+ * @property {number[]} codes - platform key codes, pressed in order and
+ *                              released in reverse order
+ * @property {number} [delay] - milliseconds to wait after the previous
+ *                              chord (or, for the first chord, after the
+ *                              request) before pressing this one
+ */
+
+let helperCount = 0;
+
+/**
+ * @returns {string} a location for a helper's socket which is unique to this
+ *                   process and to the helper (each instance of the voice
+ *                   served by the process may have its own)
+ */
+const defaultHelperAddress = () => {
+  const name = `at-driver-keys-${process.pid}-${++helperCount}`;
+  return process.platform === 'win32'
+    ? `\\\\?\\pipe\\${name}`
+    : path.join(os.tmpdir(), `${name}.sock`);
+};
+
+/**
+ * Presses keys through the key injection helper (`at-driver-keys`, built from
+ * `src/KeyInjector`), a process which is started on first use and then kept
+ * running, so that key presses do not each incur the cost of starting a
+ * process. Requests are sent over a single connection and answered in order;
+ * the protocol is described in `src/KeyInjector/KeyInjector.h`.
+ *
+ * If the helper exits, outstanding requests are rejected and the next request
+ * starts it again.
+ */
+class KeyInjector {
+  /**
+   * @param {object} options
+   * @param {string} options.helper - location of the helper executable
+   * @param {string[]} [options.args] - arguments which precede the address
+   *                                    (e.g. `['--backend', 'recording']`)
+   * @param {string} [options.address] - location of the helper's socket
+   */
+  constructor({ helper, args = [], address = defaultHelperAddress() }) {
+    this.helper = helper;
+    this.args = args;
+    this.address = address;
+    /** @type {Promise<net.Socket> | null} */
+    this.connection = null;
+    /** @type {import('child_process').ChildProcess | null} */
+    this.child = null;
+    /** @type {Map<number, {resolve: function(number[]): void, reject: function(Error): void}>} */
+    this.pending = new Map();
+    this.nextRequestId = 1;
+    this.received = '';
+  }
+
+  /**
+   * Press each chord in turn.
+   *
+   * @param {KeyChord[]} chords
+   *
+   * @returns {Promise<number[]>} the time at which each chord's keys had
+   *                              been released, in microseconds on the
+   *                              monotonic clock (see `monotonicMicroseconds`)
+   */
+  async press(chords) {
+    if (chords.length === 0) {
+      return [];
+    }
+    const request = chords
+      .map(({ codes, delay = 0 }) => {
+        if (codes.length === 0 || !codes.every(code => Number.isInteger(code) && code >= 0)) {
+          throw new Error(`invalid key codes: ${JSON.stringify(codes)}`);
+        }
+        return `${Math.round(delay * 1000)}:${codes.join('+')}`;
+      })
+      .join(' ');
+    const socket = await this.connect();
+    const id = this.nextRequestId++;
+    return new Promise((resolve, reject) => {
+      this.pending.set(id, { resolve, reject });
+      socket.write(`${id} ${request}\n`);
+    });
+  }
+
+  /** Stop the helper, rejecting any outstanding requests. */
+  close() {
+    if (this.child) {
+      this.child.kill();
+    }
+    this.disconnected(new Error('key injector closed'));
+  }
+
+  /**
+   * @returns {Promise<net.Socket>} an eventual value which is fulfilled with
+   *                                the connection to the helper, starting it
+   *                                if it is not running
+   */
+  connect() {
+    if (!this.connection) {
+      this.connection = this.start();
+      this.connection.catch(error => this.disconnected(error));
+    }
+    return this.connection;
+  }
+
+  /** @returns {Promise<net.Socket>} */
+  async start() {
+    const child = spawn(this.helper, [...this.args, this.address], {
+      stdio: ['ignore', 'pipe', 'inherit'],
+    });
+    this.child = child;
+    child.on('exit', () => {
+      if (this.child === child) {
+        this.child = null;
+        this.disconnected(new Error('key injection helper exited'));
+      }
+    });
+
+    await new Promise((resolve, reject) => {
+      const timer = setTimeout(() => {
+        child.kill();
+        reject(new Error('key injection helper did not start'));
+      }, STARTUP_TIMEOUT);
+      let output = '';
+      child.stdout.on('data', data => {
+        output += data;
+        if (output.includes('ready\n')) {
+          clearTimeout(timer);
+          resolve(undefined);
+        }
+      });
+      child.on('error', error => {
+        clearTimeout(timer);
+        reject(error);
+      });
+      child.on('exit', () => {
+        clearTimeout(timer);
+        reject(new Error('key injection helper exited'));
+      });
+    });
+
+    return new Promise((resolve, reject) => {
+      const socket = net.connect(this.address, () => resolve(socket));
+      socket.setEncoding('utf8');
+      socket.on('data', data => this.receive(data));
+      socket.on('error', reject);
+      socket.on('close', () => this.disconnected(new Error('key injection helper disconnected')));
+    });
+  }
+
+  /** @param {string} data */
+  receive(data) {
+    const lines = (this.received + data).split('\n');
+    this.received = lines.pop();
+    for (const line of lines) {
+      const [id, status, ...rest] = line.split(' ');
+      const request = this.pending.get(Number(id));
+      if (!request) {
+        continue;
+      }
+      this.pending.delete(Number(id));
+      if (status === 'ok') {
+        request.resolve(rest.map(Number));
+      } else {
+        request.reject(new Error(`unable to press keys: ${rest.join(' ')}`));
+      }
+    }
+  }
+
+  /** @param {Error} error */
+  disconnected(error) {
+    this.connection = null;
+    this.received = '';
+    const pending = [...this.pending.values()];
+    this.pending.clear();
+    pending.forEach(request => request.reject(error));
+  }
+}
+
+/**
+ * Create the `interaction.pressKeySequence` command for a platform.
+ *
+ * Sequences are pressed by the key injection helper where the server has one
+ * (see `serve --key-injector`). Otherwise each chord is pressed with the
+ * platform's `interaction.pressKeys` command after waiting for its delay with
+ * a timer, which is considerably less precise.
+ *
+ * @param {function(string[]): number[]} toCodes - maps WebDriver key values
+ *                                                 to the platform's key codes
+ * @param {ATDriverModules.InteractionPressKeys} pressKeys
+ *
+ * @returns {ATDriverModules.InteractionPressKeySequence}
+ */
+const pressKeySequenceCommand = (toCodes, pressKeys) => async (websocket, params, server) => {
+  const { chords } = params;
+  if (!Array.isArray(chords) || chords.length === 0) {
+    throw new Error('"chords" must be a non-empty array');
+  }
+  if (server.keyInjector) {
+    const encoded = chords.map(({ keys, delay = 0 }) => ({ codes: toCodes(keys), delay }));
+    return { completedAt: await server.keyInjector.press(encoded) };
+  }
+
+  const completedAt = [];
+  for (const { keys, delay = 0 } of chords) {
+    if (delay > 0) {
+      await new Promise(resolve => setTimeout(resolve, delay));
+    }
+    await pressKeys(websocket, { keys }, server);
+    completedAt.push(monotonicMicroseconds());
+  }
+  return { completedAt };
+};
+
+module.exports = {
+  KeyInjector,
+  defaultHelperAddress,
+  pressKeySequenceCommand,
+};
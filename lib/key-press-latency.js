@@ -0,0 +1,215 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+
+/** @typedef {import('./create-voice-server').VoiceMessage} VoiceMessage */
+
+/** Number of key presses whose reports are retained. */
+const DEFAULT_PRESS_HISTORY = 256;
+
+/**
+ * Number of milliseconds after a key press beyond which output is no longer
+ * attributed to it.
+ */
+const DEFAULT_ATTRIBUTION_WINDOW = 5000;
+
+/**
+ * @returns {number} microseconds on the host's monotonic clock, which the
+ *                   voice also uses to stamp its messages
+ */
+const monotonicMicroseconds = () => Number(process.hrtime.bigint() / 1000n);
+
+/**
+ * @typedef KeyPress
+ * @property {number} pressId
+ * @property {string[]} keys
+ * @property {number} pressedAt - when the command was received
+ * @property {number | null} injectedAt - when the keys had been injected
+ * @property {number | null} speakEntryAt - when the voice was first asked to
+ *                                          speak after the press
+ * @property {number | null} emittedAt - when the voice emitted the first
+ *                                       speech after the press
+ * @property {number | null} receivedAt - when the driver received it
+ * @property {number | null} broadcastAt - when it was sent to clients
+ */
+
+/**
+ * @typedef KeyPressReport
+ * @property {number} pressId
+ * @property {string[]} keys
+ * @property {number | null} injected - milliseconds after the press at which
+ *                                      each stage was reached, or null if it
+ *                                      has not been
+ * @property {number | null} speakEntry
+ * @property {number | null} emitted
+ * @property {number | null} received
+ * @property {number | null} broadcast
+ */
+
+/**
+ * Correlates key presses with the output which follows them, so that the
+ * time which the screen reader (and the driver) takes to respond to each
+ * press can be measured.
+ *
+ * Each press is assigned an id, and each message from the voice is
+ * attributed to the most recent press which preceded it, as judged by the
+ * time at which the voice emitted the message. A press's report records when
+ * the keys were injected, when the voice was first asked to speak, when it
+ * emitted the first speech and when that speech was received and broadcast.
+ *
+ * Emits "report" with a press's report once its first speech is broadcast.
+ */
+class KeyPressLatency extends EventEmitter {
+  /**
+   * @param {object} [options]
+   * @param {number} [options.history] - number of presses to remember
+   * @param {number} [options.attributionWindow] - milliseconds
+   * @param {function(): number} [options.now] - the clock, in microseconds
+   */
+  constructor({
+    history = DEFAULT_PRESS_HISTORY,
+    attributionWindow = DEFAULT_ATTRIBUTION_WINDOW,
+    now = monotonicMicroseconds,
+  } = {}) {
+    super();
+    this.history = history;
+    this.attributionWindow = attributionWindow;
+    this.now = now;
+    /** @type {KeyPress[]} ordered from least to most recent */
+    this.presses = [];
+    this.nextPressId = 1;
+  }
+
+  /**
+   * Press keys, recording the time at which the press was requested and the
+   * time at which the keys had been injected.
+   *
+   * @param {string[]} keys
+   * @param {function(string[]): (void | Promise<void>)} inject - the input
+   *                                                            backend
+   *
+   * @returns {Promise<number>} the press's id
+   */
+  async press(keys, inject) {
+    /** @type {KeyPress} */
+    const press = {
+      pressId: this.nextPressId++,
+      keys,
+      pressedAt: this.now(),
+      injectedAt: null,
+      speakEntryAt: null,
+      emittedAt: null,
+      receivedAt: null,
+      broadcastAt: null,
+    };
+    this.presses.push(press);
+    if (this.presses.length > this.history) {
+      this.presses.shift();
+    }
+    await inject(keys);
+    press.injectedAt = this.now();
+    return press.pressId;
+  }
+
+  /**
+   * Attribute a message from the voice to the press which caused it.
+   *
+   * @param {VoiceMessage} message
+   *
+   * @returns {number | null} the id of the press, if any
+   */
+  deliver(message) {
+    if (message.name !== 'speakBegin' && message.name !== 'speech') {
+      return null;
+    }
+    const receivedAt = this.now();
+    const emittedAt = message.emittedAt === undefined ? receivedAt : message.emittedAt;
+    const causedAt =
+      message.name === 'speakBegin' && message.speakEntryAt !== undefined
+        ? message.speakEntryAt
+        : emittedAt;
+
+    const press = this.pressBefore(causedAt);
+    if (!press) {
+      return null;
+    }
+    if (message.name === 'speakBegin') {
+      if (press.speakEntryAt === null) {
+        press.speakEntryAt = causedAt;
+      }
+    } else if (press.emittedAt === null) {
+      press.emittedAt = emittedAt;
+      press.receivedAt = receivedAt;
+    }
+    return press.pressId;
+  }
+
+  /**
+   * Record that speech attributed to a press has been sent to clients.
+   *
+   * @param {number} pressId
+   */
+  broadcast(pressId) {
+    const press = this.presses.find(press => press.pressId === pressId);
+    if (!press || press.broadcastAt !== null) {
+      return;
+    }
+    press.broadcastAt = this.now();
+    this.emit('report', this.describe(press));
+  }
+
+  /**
+   * @param {number} pressId
+   *
+   * @returns {KeyPressReport | null}
+   */
+  report(pressId) {
+    const press = this.presses.find(press => press.pressId === pressId);
+    return press ? this.describe(press) : null;
+  }
+
+  /** @returns {KeyPressReport[]} reports of the remembered presses */
+  reports() {
+    return this.presses.map(press => this.describe(press));
+  }
+
+  /**
+   * @param {number} time - microseconds
+   *
+   * @returns {KeyPress | undefined} the most recent press at or before the
+   *                                 given time, if it was recent enough
+   */
+  pressBefore(time) {
+    for (let index = this.presses.length - 1; index >= 0; index -= 1) {
+      const press = this.presses[index];
+      if (press.pressedAt <= time) {
+        return time - press.pressedAt <= this.attributionWindow * 1000 ? press : undefined;
+      }
+    }
+    return undefined;
+  }
+
+  /**
+   * @param {KeyPress} press
+   *
+   * @returns {KeyPressReport}
+   */
+  describe(press) {
+    const since = time => (time === null ? null : (time - press.pressedAt) / 1000);
+    return {
+      pressId: press.pressId,
+      keys: press.keys,
+      injected: since(press.injectedAt),
+      speakEntry: since(press.speakEntryAt),
+      emitted: since(press.emittedAt),
+      received: since(press.receivedAt),
+      broadcast: since(press.broadcastAt),
+    };
+  }
+}
+
+module.exports = {
+  KeyPressLatency,
+  DEFAULT_ATTRIBUTION_WINDOW,
+  monotonicMicroseconds,
+};
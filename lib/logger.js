@@ -0,0 +1,85 @@
+'use strict';
+
+/**
+ * Levels of detail at which the server logs, from least to most. Each level
+ * includes those before it.
+ */
+const LOG_LEVELS = ['error', 'warn', 'info', 'debug'];
+
+/**
+ * Writes messages to the process's standard error stream, annotated with a
+ * timestamp describing the moment that the message was emitted, if their
+ * level is enabled. Messages which are costly to compose (for instance, those
+ * logged for every message of the voice) should be guarded by `enabled`, so
+ * that they are not composed unless they are written.
+ */
+class Logger {
+  /**
+   * @param {'error' | 'warn' | 'info' | 'debug'} level
+   * @param {object} [options]
+   * @param {string | null} [options.prefix] - written before each message
+   * @param {function(...unknown): void} [options.write]
+   */
+  constructor(level, { prefix = null, write = (...args) => console.error(...args) } = {}) {
+    if (!LOG_LEVELS.includes(level)) {
+      throw new TypeError(`unrecognized log level: "${level}"`);
+    }
+    this.level = level;
+    this.prefix = prefix;
+    this.write = write;
+    this.threshold = LOG_LEVELS.indexOf(level);
+  }
+
+  /**
+   * @param {'error' | 'warn' | 'info' | 'debug'} level
+   *
+   * @returns {boolean} whether messages of the given level are written
+   */
+  enabled(level) {
+    return LOG_LEVELS.indexOf(level) <= this.threshold;
+  }
+
+  /**
+   * @param {string} prefix
+   *
+   * @returns {Logger} a logger of the same level which writes the given
+   *                   prefix before each message
+   */
+  child(prefix) {
+    return new Logger(/** @type {any} */ (this.level), { prefix, write: this.write });
+  }
+
+  /**
+   * @param {'error' | 'warn' | 'info' | 'debug'} level
+   * @param {unknown[]} args
+   */
+  log(level, ...args) {
+    if (!this.enabled(level)) {
+      return;
+    }
+    const timestamp = new Date().toISOString();
+    if (this.prefix) {
+      this.write(timestamp, this.prefix, ...args);
+    } else {
+      this.write(timestamp, ...args);
+    }
+  }
+
+  error(...args) {
+    this.log('error', ...args);
+  }
+
+  warn(...args) {
+    this.log('warn', ...args);
+  }
+
+  info(...args) {
+    this.log('info', ...args);
+  }
+
+  debug(...args) {
+    this.log('debug', ...args);
+  }
+}
+
+module.exports = { Logger, LOG_LEVELS };
@@ -0,0 +1,194 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+
+const { now } = require('./federation-link');
+
+/**
+ * Milliseconds for which an item is held, awaiting any earlier item from
+ * another source, before it is released regardless.
+ */
+const DEFAULT_MERGE_WINDOW = 20;
+
+/**
+ * @typedef MergedItem
+ * @property {string} source
+ * @property {number} time - milliseconds on the merging clock
+ * @property {number} arrived - time on the merging clock at which the item
+ *                              was pushed
+ * @property {any} item
+ */
+
+/**
+ * @typedef Source
+ * @property {MergedItem[]} queue
+ * @property {number} head - index of the first unreleased item in `queue`
+ * @property {number} lastTime - time of the last item pushed
+ * @property {boolean} active - whether more items may arrive
+ */
+
+/**
+ * Merges the items of several sources, each of which arrives in order, into
+ * one sequence ordered by time.
+ *
+ * An item is released as soon as every active source has an item pending
+ * (no earlier item can then arrive), or once it has been held for the merge
+ * window, so that a quiet source delays the others by no more than the
+ * window. (The window is measured from the item's arrival rather than its
+ * time, so that items which spend long in transit are not released at once
+ * while those of other sources are still in transit too.) The items of each
+ * source keep their order: an item stamped earlier than its predecessor (as
+ * when the estimate of a source's clock changes) is treated as simultaneous
+ * with it. An item which arrives after a later item
+ * of another source has been released is released immediately and counted
+ * as late.
+ *
+ * Emits "release" with the items released together, in order.
+ */
+class MergedStream extends EventEmitter {
+  /**
+   * @param {object} [options]
+   * @param {number} [options.window] - milliseconds
+   * @param {function(): number} [options.clock] - the merging clock
+   */
+  constructor({ window = DEFAULT_MERGE_WINDOW, clock = now } = {}) {
+    super();
+    this.window = window;
+    this.clock = clock;
+    /** @type {Map<string, Source>} */
+    this.sources = new Map();
+    // Active sources with no pending items, which alone can delay release.
+    this.idleSources = 0;
+    this.lastReleased = -Infinity;
+    this.late = 0;
+    this.drainScheduled = false;
+    /** @type {ReturnType<typeof setTimeout> | null} */
+    this.timer = null;
+  }
+
+  /**
+   * @param {string} name
+   */
+  addSource(name) {
+    const existing = this.sources.get(name);
+    if (existing && existing.active) {
+      return;
+    }
+    if (existing) {
+      existing.active = true;
+      if (existing.head === existing.queue.length) {
+        this.idleSources += 1;
+      }
+      return;
+    }
+    this.sources.set(name, { queue: [], head: 0, lastTime: -Infinity, active: true });
+    this.idleSources += 1;
+  }
+
+  /**
+   * Stop awaiting a source's items. Those already pushed are released in
+   * order.
+   *
+   * @param {string} name
+   */
+  removeSource(name) {
+    const source = this.sources.get(name);
+    if (!source || !source.active) {
+      return;
+    }
+    source.active = false;
+    if (source.head === source.queue.length) {
+      this.idleSources -= 1;
+      this.sources.delete(name);
+    }
+    this.scheduleDrain();
+  }
+
+  /**
+   * @param {string} name - an active source
+   * @param {number} time - milliseconds on the merging clock
+   * @param {any} item
+   */
+  push(name, time, item) {
+    const source = /** @type {Source} */ (this.sources.get(name));
+    if (source.head === source.queue.length && source.active) {
+      this.idleSources -= 1;
+    }
+    source.lastTime = Math.max(time, source.lastTime);
+    source.queue.push({ source: name, time: source.lastTime, arrived: this.clock(), item });
+    this.scheduleDrain();
+  }
+
+  scheduleDrain() {
+    if (!this.drainScheduled) {
+      this.drainScheduled = true;
+      setImmediate(() => this.drain());
+    }
+  }
+
+  /**
+   * Release every item which can be released.
+   */
+  drain() {
+    this.drainScheduled = false;
+    clearTimeout(this.timer);
+    this.timer = null;
+    /** @type {MergedItem[]} */
+    const released = [];
+    const threshold = this.clock() - this.window;
+    for (;;) {
+      /** @type {Source | null} */
+      let earliest = null;
+      for (const source of this.sources.values()) {
+        if (
+          source.head < source.queue.length &&
+          (!earliest || source.queue[source.head].time < earliest.queue[earliest.head].time)
+        ) {
+          earliest = source;
+        }
+      }
+      if (!earliest) {
+        break;
+      }
+      const next = earliest.queue[earliest.head];
+      if (this.idleSources > 0 && next.arrived > threshold) {
+        this.timer = setTimeout(() => this.drain(), next.arrived - threshold);
+        break;
+      }
+
+      earliest.head += 1;
+      if (next.time < this.lastReleased) {
+        this.late += 1;
+      } else {
+        this.lastReleased = next.time;
+      }
+      released.push(next);
+      if (earliest.head === earliest.queue.length) {
+        earliest.queue = [];
+        earliest.head = 0;
+        if (earliest.active) {
+          this.idleSources += 1;
+        } else {
+          this.sources.delete(next.source);
+        }
+      }
+    }
+    // A source which is never drained completely sheds its released items.
+    for (const source of this.sources.values()) {
+      if (source.head > 1024 && source.head * 2 > source.queue.length) {
+        source.queue = source.queue.slice(source.head);
+        source.head = 0;
+      }
+    }
+    if (released.length > 0) {
+      this.emit('release', released);
+    }
+  }
+
+  close() {
+    clearTimeout(this.timer);
+    this.timer = null;
+  }
+}
+
+module.exports = { MergedStream, DEFAULT_MERGE_WINDOW };
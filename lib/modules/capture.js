@@ -0,0 +1,156 @@
+/// <reference path="./types.js" />
+
+'use strict';
+
+const { encodeAudioFrame } = require('../audio-capture');
+
+/**
+ * Commands concerning the output captured from the automation voice. Unlike
+ * the other modules, these do not depend on the host platform.
+ */
+
+/**
+ * @param {string} name
+ * @param {unknown} value
+ */
+const validateDuration = (name, value) => {
+  if (value !== undefined && !(typeof value === 'number' && value >= 0)) {
+    throw new Error(`"${name}" must be a non-negative number`);
+  }
+};
+
+const waitForBookmark = /** @type {ATDriverModules.InteractionWaitForBookmark} */ (
+  async (websocket, { name, timeout }, server) => {
+    if (typeof name !== 'string') {
+      throw new Error('"name" must be a string');
+    }
+    validateDuration('timeout', timeout);
+    server.subscriptions.demand('bookmarks', 'interaction.waitForBookmark');
+
+    await server.capturedOutput.waitForBookmark(name, { timeout, cancellation: websocket });
+    return {};
+  }
+);
+
+const waitForSettled = /** @type {ATDriverModules.InteractionWaitForSettled} */ (
+  async (websocket, { quietPeriod, timeout } = {}, server) => {
+    validateDuration('quietPeriod', quietPeriod);
+    validateDuration('timeout', timeout);
+
+    await server.capturedOutput.waitForSettled({ quietPeriod, timeout, cancellation: websocket });
+    return {};
+  }
+);
+
+const waitForOutput = /** @type {ATDriverModules.InteractionWaitForOutput} */ (
+  async (websocket, { contains, matches, flags, sequence, timeout } = {}, server) => {
+    validateDuration('timeout', timeout);
+    server.subscriptions.demand('speech', 'interaction.waitForOutput');
+
+    const output = await server.capturedOutput.waitForOutput(
+      { contains, matches, flags, sequence },
+      { timeout, cancellation: websocket },
+    );
+    return { output };
+  }
+);
+
+const getOutputSince = /** @type {ATDriverModules.InteractionGetOutputSince} */ (
+  (websocket, { cursor, limit } = {}, server) => {
+    server.outputHistory.validateCursor('cursor', cursor);
+    if (limit !== undefined && !(Number.isInteger(limit) && limit > 0)) {
+      throw new Error('"limit" must be a positive integer');
+    }
+    return server.outputHistory.since(cursor, limit);
+  }
+);
+
+const keyPressLatency = /** @type {ATDriverModules.InteractionKeyPressLatency} */ (
+  (websocket, { pressId } = {}, server) => {
+    if (pressId === undefined) {
+      return { reports: server.keyPresses.reports() };
+    }
+    const report = server.keyPresses.report(pressId);
+    if (!report) {
+      throw new Error(`no record of key press ${pressId}`);
+    }
+    return { reports: [report] };
+  }
+);
+
+const configureVoice = /** @type {ATDriverModules.InteractionConfigureVoice} */ (
+  (websocket, params = {}, server) => {
+    if (typeof params !== 'object' || params === null || Array.isArray(params)) {
+      throw new Error('parameters must be an object');
+    }
+    return server.voiceSettings.update(params);
+  }
+);
+
+const AUDIO_FORMATS = ['frames', 'wav'];
+
+/**
+ * @param {ATDriverModules.WebSocket} websocket
+ */
+const stopCapturingAudio = websocket => {
+  if (websocket.stopAudioCapture) {
+    websocket.stopAudioCapture();
+  }
+};
+
+const startAudioCapture = /** @type {ATDriverModules.InteractionStartAudioCapture} */ (
+  (websocket, { format = 'wav' } = {}, server) => {
+    if (!AUDIO_FORMATS.includes(format)) {
+      throw new Error('"format" must be "frames" or "wav"');
+    }
+    const { audioCapture } = server;
+    if (!audioCapture) {
+      throw new Error('audio capture is not available');
+    }
+    server.subscriptions.demand('audio', 'interaction.startAudioCapture');
+    stopCapturingAudio(websocket);
+
+    const onSamples = record => {
+      websocket.send(encodeAudioFrame(record, audioCapture.tap.format));
+    };
+    const onUtterance = ({ utteranceId, wav }) => {
+      websocket.send(
+        JSON.stringify({
+          method: 'interaction.audioCaptured',
+          params: { utteranceId, audio: wav.toString('base64') },
+        }),
+      );
+    };
+    const [event, listener] =
+      format === 'frames' ? ['samples', onSamples] : ['utterance', onUtterance];
+
+    audioCapture.on(event, listener);
+    audioCapture.retain();
+    websocket.stopAudioCapture = () => {
+      audioCapture.removeListener(event, listener);
+      audioCapture.release();
+      websocket.removeListener('close', websocket.stopAudioCapture);
+      websocket.stopAudioCapture = null;
+    };
+    websocket.once('close', websocket.stopAudioCapture);
+    return {};
+  }
+);
+
+const stopAudioCapture = /** @type {ATDriverModules.InteractionStopAudioCapture} */ (
+  websocket => {
+    stopCapturingAudio(websocket);
+    return {};
+  }
+);
+
+module.exports = /** @type {ATDriverModules.Capture} */ ({
+  'interaction.configureVoice': configureVoice,
+  'interaction.getOutputSince': getOutputSince,
+  'interaction.keyPressLatency': keyPressLatency,
+  'interaction.startAudioCapture': startAudioCapture,
+  'interaction.stopAudioCapture': stopAudioCapture,
+  'interaction.waitForBookmark': waitForBookmark,
+  'interaction.waitForOutput': waitForOutput,
+  'interaction.waitForSettled': waitForSettled,
+});
@@ -2,11 +2,29 @@
 
 'use strict';
 
-const { runScript, renderScript } = require('../../helpers/macos/applescript');
+const { KeyCode, runScript, renderScript } = require('../../helpers/macos/applescript');
 const { parseCodePoints } = require('../../helpers/macos/parseCodePoints');
+const { validateCommand } = require('../../helpers/macos/validateCommand');
+const { pressKeySequenceCommand } = require('../../key-injector');
+
+/**
+ * @param {string[]} keys - WebDriver key values
+ *
+ * @returns {number[]} the key codes to press, modifiers first (in the order
+ *                     in which the Applescript presses them)
+ */
+const keyCodes = keys => {
+  const command = parseCodePoints(keys);
+  validateCommand(command);
+  return [...command.modifiers, ...command.keyCodes].map(name => KeyCode[name]);
+};
 
 const pressKeys = /** @type {ATDriverModules.InteractionPressKeys} */ (
-  async function (websocket, { keys }) {
+  async function (websocket, { keys }, server) {
+    if (server && server.keyInjector) {
+      await server.keyInjector.press([{ codes: keyCodes(keys) }]);
+      return {};
+    }
     await runScript(renderScript(parseCodePoints(keys)));
     return {};
   }
@@ -14,4 +32,5 @@ const pressKeys = /** @type {ATDriverModules.InteractionPressKeys} */ (
 
 module.exports = /** @type {ATDriverModules.Interaction} */ ({
   'interaction.pressKeys': pressKeys,
+  'interaction.pressKeySequence': pressKeySequenceCommand(keyCodes, pressKeys),
 });
@@ -1,13 +1,15 @@
 /** @typedef {any} ATDriverModules.WebSocket */
 
+/** @typedef {import('../create-command-server').CommandServer} ATDriverModules.Server */
+
 /**
- * @typedef {function(ATDriverModules.WebSocket, Params): Promise<Response>} ATDriverModules.AsyncCommand
+ * @typedef {function(ATDriverModules.WebSocket, Params, ATDriverModules.Server): Promise<Response>} ATDriverModules.AsyncCommand
  * @template Params
  * @template Response
  */
 
 /**
- * @typedef {function(ATDriverModules.WebSocket, Params): Response} ATDriverModules.SyncCommand
+ * @typedef {function(ATDriverModules.WebSocket, Params, ATDriverModules.Server): Response} ATDriverModules.SyncCommand
  * @template Params
  * @template Response
  */
@@ -28,15 +30,160 @@
  */
 
 /**
- * @typedef {ATDriverModules.Command<ATDriverModules.InteractionPressKeysParameters, {}>} ATDriverModules.InteractionPressKeys
+ * @typedef ATDriverModules.InteractionPressKeysResponse
+ * @property {number} [pressId] - identifies the press in the
+ *                                `interaction.capturedOutput` events which
+ *                                follow it
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionPressKeysParameters, ATDriverModules.InteractionPressKeysResponse>} ATDriverModules.InteractionPressKeys
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionPressKeySequenceChord
+ * @property {ATDriverModules.InteractionPressKeysKeyCombination} keys
+ * @property {number} [delay] - milliseconds after the previous chord
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionPressKeySequenceParameters
+ * @property {ATDriverModules.InteractionPressKeySequenceChord[]} chords
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionPressKeySequenceResponse
+ * @property {number[]} completedAt - when each chord's keys had been
+ *                                    released, in microseconds on the host's
+ *                                    monotonic clock
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionPressKeySequenceParameters, ATDriverModules.InteractionPressKeySequenceResponse>} ATDriverModules.InteractionPressKeySequence
  */
 
 /**
  * @typedef {{
- *   "interaction.pressKeys": ATDriverModules.InteractionPressKeys
+ *   "interaction.pressKeys": ATDriverModules.InteractionPressKeys,
+ *   "interaction.pressKeySequence": ATDriverModules.InteractionPressKeySequence
  * }} ATDriverModules.Interaction
  */
 
+/**
+ * @typedef ATDriverModules.InteractionWaitForBookmarkParameters
+ * @property {string} name
+ * @property {number} [timeout] - milliseconds
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionWaitForBookmarkParameters, {}>} ATDriverModules.InteractionWaitForBookmark
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionWaitForSettledParameters
+ * @property {number} [quietPeriod] - milliseconds
+ * @property {number} [timeout] - milliseconds
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionWaitForSettledParameters, {}>} ATDriverModules.InteractionWaitForSettled
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionWaitForOutputParameters
+ * @property {string} [contains] - text which an utterance must include
+ * @property {string} [matches] - a regular expression which an utterance must
+ *                                match
+ * @property {string} [flags] - flags of the `matches` regular expression
+ * @property {string[]} [sequence] - text which successive utterances must
+ *                                   include, in order
+ * @property {number} [timeout] - milliseconds
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionWaitForOutputResponse
+ * @property {string[]} output - the utterances which satisfied the predicate
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionWaitForOutputParameters, ATDriverModules.InteractionWaitForOutputResponse>} ATDriverModules.InteractionWaitForOutput
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionGetOutputSinceParameters
+ * @property {number} cursor - sequence number of the first message to return
+ * @property {number} [limit] - maximum number of messages to return
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionGetOutputSinceParameters, import('../output-history').HistoryRange>} ATDriverModules.InteractionGetOutputSince
+ */
+
+/**
+ * @typedef {{
+ *   [K in keyof import('../voice-settings').Settings]?:
+ *     import('../voice-settings').Settings[K] | null
+ * }} ATDriverModules.InteractionConfigureVoiceParameters - settings to change;
+ *    null restores a setting's default
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionConfigureVoiceResponse
+ * @property {import('../voice-settings').Settings} settings - every setting,
+ *                                                              as changed
+ * @property {number} generation - reported by the voice when it acknowledges
+ *                                 the settings (see
+ *                                 `interaction.voiceConfigured`)
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionConfigureVoiceParameters, ATDriverModules.InteractionConfigureVoiceResponse>} ATDriverModules.InteractionConfigureVoice
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionKeyPressLatencyParameters
+ * @property {number} [pressId] - the press to report; all remembered presses
+ *                                are reported if omitted
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionKeyPressLatencyResponse
+ * @property {import('../key-press-latency').KeyPressReport[]} reports
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionKeyPressLatencyParameters, ATDriverModules.InteractionKeyPressLatencyResponse>} ATDriverModules.InteractionKeyPressLatency
+ */
+
+/**
+ * @typedef ATDriverModules.InteractionStartAudioCaptureParameters
+ * @property {"frames" | "wav"} [format] - "frames" streams samples as binary
+ *                                          frames as they are produced; "wav"
+ *                                          sends each utterance's audio when
+ *                                          it ends
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.InteractionStartAudioCaptureParameters, {}>} ATDriverModules.InteractionStartAudioCapture
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<{}, {}>} ATDriverModules.InteractionStopAudioCapture
+ */
+
+/**
+ * @typedef {{
+ *   "interaction.configureVoice": ATDriverModules.InteractionConfigureVoice,
+ *   "interaction.getOutputSince": ATDriverModules.InteractionGetOutputSince,
+ *   "interaction.keyPressLatency": ATDriverModules.InteractionKeyPressLatency,
+ *   "interaction.startAudioCapture": ATDriverModules.InteractionStartAudioCapture,
+ *   "interaction.stopAudioCapture": ATDriverModules.InteractionStopAudioCapture,
+ *   "interaction.waitForBookmark": ATDriverModules.InteractionWaitForBookmark,
+ *   "interaction.waitForOutput": ATDriverModules.InteractionWaitForOutput,
+ *   "interaction.waitForSettled": ATDriverModules.InteractionWaitForSettled
+ * }} ATDriverModules.Capture
+ */
+
 /**
  * @typedef ATDriverModules.SessionNewSessionResponse
  * @property {string} sessionId
@@ -47,7 +194,17 @@
  */
 
 /**
- * @typedef {ATDriverModules.Command<{}, ATDriverModules.SessionNewSessionResponse>} ATDriverModules.SessionNewSession
+ * @typedef ATDriverModules.SessionNewSessionParameters
+ * @property {object} [capabilities]
+ * @property {number} [outputCursor] - resume captured output from this
+ *                                     history cursor
+ * @property {Partial<import('../subscriptions').Subscription>} [subscriptions] -
+ *           the events which the session receives, and so which the voice
+ *           emits
+ */
+
+/**
+ * @typedef {ATDriverModules.Command<ATDriverModules.SessionNewSessionParameters, ATDriverModules.SessionNewSessionResponse>} ATDriverModules.SessionNewSession
  */
 
 /**
@@ -3,6 +3,9 @@
 'use strict';
 const robotjs = require('robotjs');
 
+const { virtualKeyCode } = require('../../helpers/win32/VirtualKey');
+const { pressKeySequenceCommand } = require('../../key-injector');
+
 // Commented out keys have no mapping in robotjs
 const keyboardActionsMap = {
   // '\ue000': 'unidentified'
@@ -69,15 +72,35 @@ const keyboardActionsMap = {
 
 const keycodeMatch = /[\ue000-\ue05d]/;
 
+/**
+ * @param {string[]} keys - WebDriver key values
+ *
+ * @returns {string[]} the corresponding robotjs key names
+ */
+const robotjsKeyNames = keys =>
+  keys.map(key => {
+    if (keyboardActionsMap[key]) return keyboardActionsMap[key];
+    if (keycodeMatch.test(key))
+      throw new Error(`unknown key (\\u${key.charCodeAt(0).toString(16)})`);
+
+    return key;
+  });
+
+/**
+ * @param {string[]} keys - WebDriver key values
+ *
+ * @returns {number[]} the corresponding virtual-key codes
+ */
+const virtualKeyCodes = keys => robotjsKeyNames(keys).map(virtualKeyCode);
+
 const pressKeys = /** @type {ATDriverModules.InteractionPressKeys} */ (
-  (websocket, { keys }) => {
-    const robotjsKeys = keys.map(key => {
-      if (keyboardActionsMap[key]) return keyboardActionsMap[key];
-      if (keycodeMatch.test(key))
-        throw new Error(`unknown key (\\u${key.charCodeAt(0).toString(16)})`);
+  async (websocket, { keys }, server) => {
+    if (server && server.keyInjector) {
+      await server.keyInjector.press([{ codes: virtualKeyCodes(keys) }]);
+      return {};
+    }
 
-      return key;
-    });
+    const robotjsKeys = robotjsKeyNames(keys);
 
     // keys = ['insert', 'tab'] means to press insert and tab together
     // push all keys down in order then release them in reverse order
@@ -94,4 +117,5 @@ const pressKeys = /** @type {ATDriverModules.InteractionPressKeys} */ (
 
 module.exports = /** @type {ATDriverModules.Interaction} */ ({
   'interaction.pressKeys': pressKeys,
+  'interaction.pressKeySequence': pressKeySequenceCommand(virtualKeyCodes, pressKeys),
 });
@@ -0,0 +1,419 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+
+/** @typedef {import('./create-command-server').WebSocketWithData} WebSocketWithData */
+
+/**
+ * Number of milliseconds during which captured output which follows other
+ * output is collected into a single batch. Output which arrives while the
+ * server is idle is sent immediately.
+ */
+const DEFAULT_BATCH_WINDOW = 5;
+
+/** Maximum number of messages in one batch. */
+const DEFAULT_MAX_BATCH_SIZE = 256;
+
+/**
+ * Number of bytes awaiting transmission to a client beyond which the client
+ * is considered to be lagging.
+ */
+const DEFAULT_HIGH_WATERMARK = 1024 * 1024;
+
+/**
+ * Number of bytes awaiting transmission to a lagging client below which it
+ * is considered to have caught up.
+ */
+const DEFAULT_LOW_WATERMARK = 256 * 1024;
+
+/**
+ * Maximum number of messages held for a lagging client under the "queue"
+ * policy; the oldest captured output is discarded beyond this.
+ */
+const DEFAULT_MAX_QUEUED_MESSAGES = 10000;
+
+/**
+ * Treatment of a client whose unsent data exceeds the high watermark:
+ *
+ * - "queue" holds its messages in the server (up to a limit) and sends them
+ *   as one batch once it has caught up
+ * - "drop" discards the captured output sent while it lags and reports the
+ *   number of messages discarded once it has caught up
+ * - "disconnect" closes its connection
+ */
+const LAGGING_CLIENT_POLICIES = ['queue', 'drop', 'disconnect'];
+
+/**
+ * @typedef OutputBatch
+ * @property {string[]} messages - each escaped for inclusion in a JSON string
+ *                                 (see `escapeOutput`)
+ * @property {number | null} cursor - the history cursor which follows the
+ *                                    batch's last message, if known
+ */
+
+/**
+ * @typedef ClientState
+ * @property {boolean} lagging
+ * @property {Array<string | OutputBatch>} queue - serialized events and
+ *                                                 batches of captured output
+ * @property {number} queuedMessages - number of messages in `queue`, counting
+ *                                     each message of captured output
+ * @property {number} dropped - number of messages of captured output
+ *                              discarded since the client began to lag
+ */
+
+/**
+ * @param {string} data
+ *
+ * @returns {string} `data` as it appears between the quotation marks of a
+ *                   JSON string
+ */
+const escapeOutput = data => JSON.stringify(data).slice(1, -1);
+
+/**
+ * The event is assembled from escaped messages rather than serialized, so
+ * that speech which the voice escaped (see `VoiceMessage.escaped`) is
+ * broadcast as it was received. The result is identical to serializing the
+ * event with `JSON.stringify`.
+ *
+ * @param {string[]} batch - messages escaped for inclusion in a JSON string
+ * @param {number | null} [pressId] - the key press which caused the output
+ * @param {number | null} [cursor] - the history cursor which follows the
+ *                                   batch's last message
+ *
+ * @returns {string} the `interaction.capturedOutput` event for a batch of
+ *                   output. A batch of one message is a standard AT Driver
+ *                   event; larger batches also list the individual messages.
+ */
+const encodeBatch = (batch, pressId = null, cursor = null) => {
+  let params =
+    batch.length === 1
+      ? `{"data":"${batch[0]}"`
+      : `{"data":"${batch.join('\\n')}","batch":["${batch.join('","')}"]`;
+  if (pressId !== null) {
+    params += `,"pressId":${pressId}`;
+  }
+  if (cursor !== null) {
+    params += `,"cursor":${cursor}`;
+  }
+  return `{"method":"interaction.capturedOutput","params":${params}}}`;
+};
+
+/**
+ * Delivers events to every client with a session, collecting bursts of
+ * captured output into batches and preventing clients which do not keep up
+ * from accumulating unbounded send buffers.
+ *
+ * Emits "lagging" and "recovered" with the client concerned, and "sent" with
+ * the id of the key press which caused each batch of output that is sent.
+ */
+class OutputBroadcaster extends EventEmitter {
+  /**
+   * @param {function(): Iterable<WebSocketWithData>} getClients
+   * @param {object} [options]
+   * @param {number} [options.batchWindow] - milliseconds
+   * @param {number} [options.maxBatchSize]
+   * @param {number} [options.highWatermark] - bytes
+   * @param {number} [options.lowWatermark] - bytes
+   * @param {"queue" | "drop" | "disconnect"} [options.laggingClientPolicy]
+   * @param {number} [options.maxQueuedMessages]
+   * @param {function(WebSocketWithData, string): boolean} [options.accepts] -
+   *        whether a client accepts events of a topic: "keyPress" or
+   *        "unprompted" for captured output, or the topic given to
+   *        `broadcast` (see `Subscriptions`)
+   */
+  constructor(
+    getClients,
+    {
+      batchWindow = DEFAULT_BATCH_WINDOW,
+      maxBatchSize = DEFAULT_MAX_BATCH_SIZE,
+      highWatermark = DEFAULT_HIGH_WATERMARK,
+      lowWatermark = DEFAULT_LOW_WATERMARK,
+      laggingClientPolicy = 'queue',
+      maxQueuedMessages = DEFAULT_MAX_QUEUED_MESSAGES,
+      accepts = () => true,
+    } = {},
+  ) {
+    super();
+    if (!LAGGING_CLIENT_POLICIES.includes(laggingClientPolicy)) {
+      throw new TypeError(`unrecognized lagging client policy: "${laggingClientPolicy}"`);
+    }
+    if (lowWatermark > highWatermark) {
+      throw new TypeError('the low watermark must not exceed the high watermark');
+    }
+    this.getClients = getClients;
+    this.batchWindow = batchWindow;
+    this.maxBatchSize = maxBatchSize;
+    this.highWatermark = highWatermark;
+    this.lowWatermark = lowWatermark;
+    this.laggingClientPolicy = laggingClientPolicy;
+    this.maxQueuedMessages = maxQueuedMessages;
+    this.accepts = accepts;
+    // Escaped messages (see `escapeOutput`).
+    /** @type {string[]} */
+    this.batch = [];
+    /** @type {number | null} */
+    this.batchPressId = null;
+    /** @type {number | null} */
+    this.batchCursor = null;
+    /** @type {ReturnType<typeof setTimeout> | null} */
+    this.batchTimer = null;
+    /** @type {WeakMap<WebSocketWithData, ClientState>} */
+    this.clientStates = new WeakMap();
+  }
+
+  /**
+   * Send captured output. Output which follows a batch within the batch
+   * window is held until the window closes, so that a burst of output costs
+   * one frame per client rather than one per message. Output caused by
+   * different key presses is not batched together.
+   *
+   * @param {string} data
+   * @param {number | null} [pressId] - the key press which caused the output
+   * @param {number | null} [cursor] - the history cursor which follows the
+   *                                   output
+   * @param {string} [escaped] - `data` escaped for inclusion in a JSON
+   *                             string, if it has been already
+   */
+  output(data, pressId = null, cursor = null, escaped = escapeOutput(data)) {
+    if (this.batch.length > 0 && pressId !== this.batchPressId) {
+      this.flush();
+    }
+    this.batch.push(escaped);
+    this.batchPressId = pressId;
+    this.batchCursor = cursor;
+    if (this.batchTimer) {
+      if (this.batch.length >= this.maxBatchSize) {
+        this.flush();
+      }
+      return;
+    }
+    this.flush();
+  }
+
+  /**
+   * Send an event other than captured output, after any output which
+   * preceded it.
+   *
+   * @param {object} message
+   * @param {string | null} [topic] - if given, the event is sent only to the
+   *                                  clients which accept the topic
+   */
+  broadcast(message, topic = null) {
+    this.flush();
+    this.sendToAll(JSON.stringify(message), null, topic);
+  }
+
+  /**
+   * Send the output collected so far and open a new batch window.
+   */
+  flush() {
+    if (this.batch.length > 0) {
+      const batch = { messages: this.batch, cursor: this.batchCursor };
+      const pressId = this.batchPressId;
+      this.batch = [];
+      const topic = pressId === null ? 'unprompted' : 'keyPress';
+      this.sendToAll(encodeBatch(batch.messages, pressId, batch.cursor), batch, topic);
+      if (pressId !== null) {
+        this.emit('sent', pressId);
+      }
+    }
+    clearTimeout(this.batchTimer);
+    this.batchTimer = null;
+    if (this.batchWindow > 0) {
+      this.batchTimer = setTimeout(() => {
+        this.batchTimer = null;
+        if (this.batch.length > 0) {
+          this.flush();
+        }
+      }, this.batchWindow);
+      // The timer alone should not keep the process running.
+      this.batchTimer.unref();
+    }
+  }
+
+  close() {
+    clearTimeout(this.batchTimer);
+    this.batchTimer = null;
+  }
+
+  /**
+   * Send a client output which it missed before it began its session. Output
+   * yet to be sent should be flushed before the session begins, so that the
+   * client is not sent it twice.
+   *
+   * @param {WebSocketWithData} websocket
+   * @param {string[]} messages
+   * @param {number} missed - number of messages which are no longer available
+   * @param {number} cursor - the history cursor which follows `messages`
+   */
+  replay(websocket, messages, missed, cursor) {
+    if (missed > 0) {
+      this.write(
+        websocket,
+        JSON.stringify({ method: 'interaction.capturedOutputDropped', params: { count: missed } }),
+      );
+    }
+    if (messages.length > 0) {
+      const batch = { messages: messages.map(escapeOutput), cursor };
+      this.sendTo(websocket, encodeBatch(batch.messages, null, cursor), batch);
+    }
+  }
+
+  /**
+   * @param {string} packed - the serialized message
+   * @param {OutputBatch | null} batch - the captured output which `packed`
+   *                                     holds, if any
+   * @param {string | null} topic
+   */
+  sendToAll(packed, batch, topic) {
+    for (const websocket of this.getClients()) {
+      if (websocket.sessionId && (topic === null || this.accepts(websocket, topic))) {
+        this.sendTo(websocket, packed, batch);
+      }
+    }
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   *
+   * @returns {ClientState}
+   */
+  stateOf(websocket) {
+    let state = this.clientStates.get(websocket);
+    if (!state) {
+      state = { lagging: false, queue: [], queuedMessages: 0, dropped: 0 };
+      this.clientStates.set(websocket, state);
+    }
+    return state;
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   * @param {string} packed
+   * @param {OutputBatch | null} batch
+   */
+  sendTo(websocket, packed, batch) {
+    const state = this.stateOf(websocket);
+    if (state.lagging) {
+      if (this.laggingClientPolicy === 'queue') {
+        this.enqueue(state, batch || packed);
+        return;
+      } else if (batch && this.laggingClientPolicy === 'drop') {
+        state.dropped += batch.messages.length;
+        return;
+      }
+    }
+
+    this.write(websocket, packed);
+    if (!state.lagging && websocket.bufferedAmount > this.highWatermark) {
+      state.lagging = true;
+      this.emit('lagging', websocket);
+      if (this.laggingClientPolicy === 'disconnect') {
+        websocket.close(1008, 'client did not keep up with captured output');
+      }
+    }
+  }
+
+  /**
+   * @param {ClientState} state
+   * @param {string | OutputBatch} item
+   */
+  enqueue(state, item) {
+    if (typeof item === 'string') {
+      state.queue.push(item);
+      state.queuedMessages += 1;
+    } else {
+      // Batches are copied because other clients share them.
+      state.queue.push({ messages: item.messages.slice(), cursor: item.cursor });
+      state.queuedMessages += item.messages.length;
+    }
+    while (state.queuedMessages > this.maxQueuedMessages) {
+      const index = state.queue.findIndex(queued => typeof queued !== 'string');
+      if (index === -1) {
+        break;
+      }
+      const oldest = /** @type {OutputBatch} */ (state.queue[index]).messages;
+      const excess = Math.min(oldest.length, state.queuedMessages - this.maxQueuedMessages);
+      oldest.splice(0, excess);
+      state.queuedMessages -= excess;
+      state.dropped += excess;
+      if (oldest.length === 0) {
+        state.queue.splice(index, 1);
+      }
+    }
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   * @param {string} packed
+   */
+  write(websocket, packed) {
+    websocket.send(packed, error => {
+      if (error) {
+        this.emit('error', `error sending message: ${error}`);
+        return;
+      }
+      const state = this.stateOf(websocket);
+      if (state.lagging && websocket.bufferedAmount <= this.lowWatermark) {
+        this.recover(websocket, state);
+      }
+    });
+  }
+
+  /**
+   * Deliver whatever was withheld from a client while it lagged.
+   *
+   * @param {WebSocketWithData} websocket
+   * @param {ClientState} state
+   */
+  recover(websocket, state) {
+    state.lagging = false;
+    if (state.dropped > 0) {
+      this.write(
+        websocket,
+        JSON.stringify({
+          method: 'interaction.capturedOutputDropped',
+          params: { count: state.dropped },
+        }),
+      );
+      state.dropped = 0;
+    }
+
+    // Consecutive batches are merged so that the backlog is sent in as few
+    // frames as possible.
+    const queue = state.queue;
+    state.queue = [];
+    state.queuedMessages = 0;
+    /** @type {string[]} */
+    let pending = [];
+    /** @type {number | null} */
+    let pendingCursor = null;
+    for (const item of queue) {
+      if (typeof item !== 'string') {
+        pending.push(...item.messages);
+        pendingCursor = item.cursor;
+        continue;
+      }
+      if (pending.length > 0) {
+        this.write(websocket, encodeBatch(pending, null, pendingCursor));
+        pending = [];
+      }
+      this.write(websocket, item);
+    }
+    if (pending.length > 0) {
+      this.write(websocket, encodeBatch(pending, null, pendingCursor));
+    }
+    this.emit('recovered', websocket);
+  }
+}
+
+module.exports = {
+  OutputBroadcaster,
+  encodeBatch,
+  escapeOutput,
+  DEFAULT_BATCH_WINDOW,
+  DEFAULT_HIGH_WATERMARK,
+  DEFAULT_LOW_WATERMARK,
+  LAGGING_CLIENT_POLICIES,
+};
@@ -0,0 +1,157 @@
+'use strict';
+
+/**
+ * Number of bytes of captured output retained so that clients which connect
+ * late, reconnect, or fall behind may retrieve what they missed.
+ */
+const DEFAULT_HISTORY_SIZE = 4 * 1024 * 1024;
+
+/**
+ * Approximate number of bytes which the history holds for each message in
+ * addition to its text.
+ */
+const ENTRY_OVERHEAD = 48;
+
+/**
+ * @typedef HistoryEntry
+ * @property {number} seq - the message's sequence number
+ * @property {string} data
+ * @property {number} [pressId] - the key press which caused the output
+ */
+
+/**
+ * @typedef HistoryRange
+ * @property {HistoryEntry[]} output
+ * @property {number} cursor - the cursor from which to retrieve the output
+ *                             which follows
+ * @property {number} missed - number of messages after the requested cursor
+ *                             which were discarded before it was requested
+ */
+
+/**
+ * @param {string} data
+ *
+ * @returns {number} the bytes which the history accounts to a message
+ */
+const sizeOf = data => ENTRY_OVERHEAD + 2 * data.length;
+
+/**
+ * A bounded record of captured output, in which each message is numbered in
+ * the order in which it was captured. A cursor names the message with which
+ * retrieval begins: the sequence number of the next message to be captured
+ * retrieves only output which follows.
+ *
+ * Messages are held in a ring which grows (by doubling) until the history
+ * reaches its size, after which the oldest are discarded to make room.
+ * Sequence numbers are consecutive, so a cursor is located by arithmetic
+ * rather than by searching.
+ */
+class OutputHistory {
+  /**
+   * @param {object} [options]
+   * @param {number} [options.maxBytes] - bytes of output to retain (0 retains
+   *                                      none)
+   */
+  constructor({ maxBytes = DEFAULT_HISTORY_SIZE } = {}) {
+    this.maxBytes = maxBytes;
+    /** @type {string[]} */
+    this.data = new Array(16);
+    /** @type {Array<number | null>} */
+    this.pressIds = new Array(16);
+    /** index in the ring of the oldest message */
+    this.head = 0;
+    this.length = 0;
+    this.bytes = 0;
+    /** sequence number of the oldest message retained */
+    this.first = 0;
+  }
+
+  /** @returns {number} the sequence number of the next message */
+  get cursor() {
+    return this.first + this.length;
+  }
+
+  /**
+   * @param {string} name - the parameter which gave the cursor
+   * @param {unknown} cursor
+   */
+  validateCursor(name, cursor) {
+    if (!Number.isInteger(cursor) || /** @type {number} */ (cursor) < 0) {
+      throw new Error(`"${name}" must be a non-negative integer`);
+    }
+    // The server may have restarted since the client received the cursor.
+    if (/** @type {number} */ (cursor) > this.cursor) {
+      throw new Error(`"${name}" is beyond the most recent output (${this.cursor})`);
+    }
+  }
+
+  /**
+   * @param {string} data
+   * @param {number | null} [pressId] - the key press which caused the output
+   *
+   * @returns {number} the message's sequence number
+   */
+  append(data, pressId = null) {
+    const seq = this.cursor;
+    const size = sizeOf(data);
+    while (this.length > 0 && this.bytes + size > this.maxBytes) {
+      this.bytes -= sizeOf(this.data[this.head]);
+      this.data[this.head] = undefined;
+      this.head = (this.head + 1) % this.data.length;
+      this.length -= 1;
+      this.first += 1;
+    }
+    if (size > this.maxBytes) {
+      this.first += 1;
+      return seq;
+    }
+
+    if (this.length === this.data.length) {
+      this.grow();
+    }
+    const index = (this.head + this.length) % this.data.length;
+    this.data[index] = data;
+    this.pressIds[index] = pressId;
+    this.length += 1;
+    this.bytes += size;
+    return seq;
+  }
+
+  grow() {
+    const capacity = this.data.length;
+    const data = new Array(capacity * 2);
+    const pressIds = new Array(capacity * 2);
+    for (let i = 0; i < this.length; i += 1) {
+      data[i] = this.data[(this.head + i) % capacity];
+      pressIds[i] = this.pressIds[(this.head + i) % capacity];
+    }
+    this.data = data;
+    this.pressIds = pressIds;
+    this.head = 0;
+  }
+
+  /**
+   * @param {number} cursor - a valid cursor (see `validateCursor`)
+   * @param {number} [limit] - maximum number of messages to return
+   *
+   * @returns {HistoryRange}
+   */
+  since(cursor, limit = Infinity) {
+    const start = Math.max(cursor, this.first);
+    const end = Math.min(this.cursor, start + limit);
+    /** @type {HistoryEntry[]} */
+    const output = [];
+    for (let seq = start; seq < end; seq += 1) {
+      const index = (this.head + seq - this.first) % this.data.length;
+      /** @type {HistoryEntry} */
+      const entry = { seq, data: this.data[index] };
+      if (this.pressIds[index] !== null) {
+        entry.pressId = this.pressIds[index];
+      }
+      output.push(entry);
+    }
+    return { output, cursor: end, missed: start - cursor };
+  }
+}
+
+module.exports = { OutputHistory, DEFAULT_HISTORY_SIZE };
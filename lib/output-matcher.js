@@ -0,0 +1,292 @@
+'use strict';
+
+/**
+ * @typedef OutputPredicate
+ * @property {string} [contains] - satisfied by an utterance which includes
+ *                                 this text
+ * @property {string} [matches] - satisfied by an utterance which matches this
+ *                                regular expression
+ * @property {string} [flags] - flags of the `matches` regular expression
+ * @property {string[]} [sequence] - satisfied by utterances which include each
+ *                                   of these texts, in order
+ */
+
+/**
+ * @typedef Wait
+ * @property {string[]} literals - text for which utterances are searched
+ * @property {RegExp | null} regexp
+ * @property {boolean} isSequence
+ * @property {number} position - index of the literal which a sequence awaits
+ * @property {string[]} output - utterances which have satisfied the wait
+ * @property {function(string[]): void} onMatch
+ */
+
+/** @type {Set<string>} */
+const NOTHING_FOUND = new Set();
+
+// Flags with which `RegExp.prototype.test` is stateful.
+const STATEFUL_FLAGS = /[gy]/;
+
+/**
+ * @param {string} name
+ * @param {unknown} value
+ */
+const validateText = (name, value) => {
+  if (typeof value !== 'string' || value.length === 0) {
+    throw new Error(`"${name}" must be a non-empty string`);
+  }
+};
+
+/**
+ * Finds every occurrence of any of a set of strings in a single pass over the
+ * searched text (Aho-Corasick), so that the cost of examining an utterance
+ * does not grow with the number of clients waiting for output.
+ */
+class PatternAutomaton {
+  /**
+   * @param {Iterable<string>} patterns
+   */
+  constructor(patterns) {
+    /** @type {Map<number, number>[]} each state's transitions, by code unit */
+    this.next = [new Map()];
+    /** @type {number[]} state reached by the longest proper suffix */
+    this.fail = [0];
+    /** @type {(string | null)[]} pattern which ends at each state */
+    this.pattern = [null];
+    /** @type {number[]} nearest suffix state at which a pattern ends, or -1 */
+    this.outputLink = [-1];
+
+    for (const pattern of patterns) {
+      let state = 0;
+      for (let i = 0; i < pattern.length; i += 1) {
+        const character = pattern.charCodeAt(i);
+        let target = this.next[state].get(character);
+        if (target === undefined) {
+          target = this.next.length;
+          this.next.push(new Map());
+          this.fail.push(0);
+          this.pattern.push(null);
+          this.outputLink.push(-1);
+          this.next[state].set(character, target);
+        }
+        state = target;
+      }
+      this.pattern[state] = pattern;
+    }
+
+    // States are visited breadth first, so each state's suffixes are linked
+    // before the state itself.
+    const queue = [...this.next[0].values()];
+    for (let i = 0; i < queue.length; i += 1) {
+      const state = queue[i];
+      for (const [character, target] of this.next[state]) {
+        let suffix = this.fail[state];
+        while (suffix !== 0 && !this.next[suffix].has(character)) {
+          suffix = this.fail[suffix];
+        }
+        const fail = this.next[suffix].get(character);
+        this.fail[target] = fail === undefined ? 0 : fail;
+        this.outputLink[target] =
+          this.pattern[this.fail[target]] !== null
+            ? this.fail[target]
+            : this.outputLink[this.fail[target]];
+        queue.push(target);
+      }
+    }
+  }
+
+  /**
+   * @param {string} text
+   *
+   * @returns {Set<string>} the patterns which occur in the text
+   */
+  search(text) {
+    const found = new Set();
+    let state = 0;
+    for (let i = 0; i < text.length; i += 1) {
+      const character = text.charCodeAt(i);
+      let target;
+      while ((target = this.next[state].get(character)) === undefined && state !== 0) {
+        state = this.fail[state];
+      }
+      state = target === undefined ? 0 : target;
+      let output = this.pattern[state] !== null ? state : this.outputLink[state];
+      while (output !== -1) {
+        found.add(this.pattern[output]);
+        output = this.outputLink[output];
+      }
+    }
+    return found;
+  }
+}
+
+/**
+ * Evaluates the predicates of every pending `interaction.waitForOutput`
+ * command against each utterance as it is captured. The literal text of all
+ * of the predicates is searched for together, and the automaton which does so
+ * is rebuilt only when text which it does not know is awaited.
+ */
+class OutputMatcher {
+  constructor() {
+    /** @type {Set<Wait>} */
+    this.waits = new Set();
+    /** @type {Map<string, Set<Wait>>} literal text to the waits which need it */
+    this.literals = new Map();
+    /** @type {Set<Wait>} waits for a regular expression */
+    this.expressions = new Set();
+    /** @type {Set<string>} literal text known to the automaton */
+    this.indexed = new Set();
+    /** @type {PatternAutomaton | null} */
+    this.automaton = null;
+    this.stale = false;
+  }
+
+  /** @returns {number} the number of pending waits */
+  get size() {
+    return this.waits.size;
+  }
+
+  /**
+   * Begin evaluating a predicate against the utterances which follow.
+   *
+   * @param {OutputPredicate} predicate - exactly one of `contains`, `matches`
+   *                                      and `sequence` must be given
+   * @param {function(string[]): void} onMatch - called with the utterances
+   *                                             which satisfied the predicate
+   *
+   * @returns {Wait}
+   */
+  add({ contains, matches, flags, sequence }, onMatch) {
+    const given = [contains, matches, sequence].filter(value => value !== undefined).length;
+    if (given !== 1) {
+      throw new Error('exactly one of "contains", "matches" and "sequence" must be given');
+    }
+    if (flags !== undefined && matches === undefined) {
+      throw new Error('"flags" may only be given with "matches"');
+    }
+
+    /** @type {Wait} */
+    const wait = {
+      literals: [],
+      regexp: null,
+      isSequence: false,
+      position: 0,
+      output: [],
+      onMatch,
+    };
+    if (contains !== undefined) {
+      validateText('contains', contains);
+      wait.literals = [contains];
+    } else if (matches !== undefined) {
+      validateText('matches', matches);
+      if (flags !== undefined && (typeof flags !== 'string' || STATEFUL_FLAGS.test(flags))) {
+        throw new Error('"flags" must be a string of flags other than "g" and "y"');
+      }
+      try {
+        wait.regexp = new RegExp(matches, flags);
+      } catch (error) {
+        throw new Error(`"matches" is not a valid regular expression: ${error.message}`);
+      }
+    } else {
+      if (!Array.isArray(sequence) || sequence.length === 0) {
+        throw new Error('"sequence" must be a non-empty array of strings');
+      }
+      sequence.forEach((text, index) => validateText(`sequence[${index}]`, text));
+      wait.literals = [...sequence];
+      wait.isSequence = true;
+    }
+
+    this.waits.add(wait);
+    if (wait.regexp) {
+      this.expressions.add(wait);
+    }
+    for (const literal of wait.literals) {
+      let waits = this.literals.get(literal);
+      if (!waits) {
+        waits = new Set();
+        this.literals.set(literal, waits);
+        if (!this.indexed.has(literal)) {
+          this.stale = true;
+        }
+      }
+      waits.add(wait);
+    }
+    return wait;
+  }
+
+  /**
+   * Stop evaluating a wait's predicate.
+   *
+   * @param {Wait} wait
+   */
+  remove(wait) {
+    this.waits.delete(wait);
+    this.expressions.delete(wait);
+    for (const literal of wait.literals) {
+      const waits = this.literals.get(literal);
+      if (waits && waits.delete(wait) && waits.size === 0) {
+        this.literals.delete(literal);
+      }
+    }
+    // Text which is no longer awaited is harmless to search for, but is
+    // discarded once it makes up most of the automaton.
+    if (this.indexed.size > 2 * this.literals.size + 16) {
+      this.stale = true;
+    }
+  }
+
+  /**
+   * Evaluate the pending predicates against an utterance, fulfilling (and
+   * removing) those which it satisfies.
+   *
+   * @param {string} text
+   */
+  match(text) {
+    if (this.waits.size === 0) {
+      return;
+    }
+    if (this.stale) {
+      this.indexed = new Set(this.literals.keys());
+      this.automaton = new PatternAutomaton(this.indexed);
+      this.stale = false;
+    }
+
+    const found = this.literals.size > 0 ? this.automaton.search(text) : NOTHING_FOUND;
+    if (found.size === 0 && this.expressions.size === 0) {
+      return;
+    }
+    /** @type {Set<Wait>} */
+    const candidates = new Set();
+    for (const literal of found) {
+      const waits = this.literals.get(literal);
+      if (waits) {
+        waits.forEach(wait => candidates.add(wait));
+      }
+    }
+    for (const wait of this.expressions) {
+      if (wait.regexp.test(text)) {
+        candidates.add(wait);
+      }
+    }
+
+    /** @type {Wait[]} */
+    const satisfied = [];
+    for (const wait of candidates) {
+      // An utterance advances a sequence by one step at most.
+      if (wait.isSequence && !found.has(wait.literals[wait.position])) {
+        continue;
+      }
+      wait.output.push(text);
+      wait.position += 1;
+      if (!wait.isSequence || wait.position === wait.literals.length) {
+        satisfied.push(wait);
+      }
+    }
+    for (const wait of satisfied) {
+      this.remove(wait);
+      wait.onMatch(wait.output);
+    }
+  }
+}
+
+module.exports = { OutputMatcher, PatternAutomaton };
@@ -0,0 +1,278 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+
+/** @typedef {import('./create-command-server').WebSocketWithData} WebSocketWithData */
+
+/**
+ * @typedef {'speech' | 'lifecycle' | 'internalError'} SubscribedType
+ * @typedef {'keyPress' | 'unprompted'} Origin
+ */
+
+/**
+ * @typedef Subscription
+ * @property {SubscribedType[]} types - the messages of the voice which are
+ *                                      delivered: speech (as
+ *                                      `interaction.capturedOutput`),
+ *                                      lifecycle notifications (as
+ *                                      `interaction.voiceLifecycle`) and
+ *                                      errors (as `interaction.voiceError`)
+ * @property {Origin[]} origins - the speech which is delivered: that caused
+ *                                by a key press (see `KeyPressLatency`) and
+ *                                that which was not
+ * @property {boolean} bookmarks - whether `interaction.bookmarkReached` is
+ *                                 delivered
+ * @property {boolean} timing - whether the voice stamps each message with the
+ *                              time at which it was emitted, from which key
+ *                              press latency is measured
+ * @property {boolean} audio - whether audio may be captured (see
+ *                             `interaction.startAudioCapture`)
+ */
+
+const SUBSCRIBED_TYPES = ['speech', 'lifecycle', 'internalError'];
+const ORIGINS = ['keyPress', 'unprompted'];
+const FLAGS = ['bookmarks', 'timing', 'audio'];
+
+/**
+ * The subscription of a session which does not declare one. It receives
+ * every event which sessions received before subscriptions existed.
+ *
+ * @type {Readonly<Subscription>}
+ */
+const DEFAULT_SUBSCRIPTION = Object.freeze({
+  types: ['speech'],
+  origins: ['keyPress', 'unprompted'],
+  bookmarks: true,
+  timing: true,
+  audio: true,
+});
+
+/** @type {Readonly<Subscription>} */
+const FULL_SUBSCRIPTION = Object.freeze({
+  types: SUBSCRIBED_TYPES,
+  origins: ORIGINS,
+  bookmarks: true,
+  timing: true,
+  audio: true,
+});
+
+/** @type {Readonly<Subscription>} */
+const EMPTY_SUBSCRIPTION = Object.freeze({
+  types: [],
+  origins: [],
+  bookmarks: false,
+  timing: false,
+  audio: false,
+});
+
+/**
+ * @param {string} name
+ * @param {unknown} value
+ * @param {string[]} allowed
+ */
+const validateList = (name, value, allowed) => {
+  if (!Array.isArray(value) || !value.every(item => allowed.includes(item))) {
+    throw new Error(`"${name}" must be a list of ${allowed.map(item => `"${item}"`).join(', ')}`);
+  }
+};
+
+/**
+ * Interpret the `subscriptions` parameter of `session.new`. Properties which
+ * it omits take their values from `DEFAULT_SUBSCRIPTION`.
+ *
+ * @param {unknown} value
+ *
+ * @returns {Subscription}
+ */
+const parseSubscription = value => {
+  if (value === undefined) {
+    return DEFAULT_SUBSCRIPTION;
+  }
+  if (typeof value !== 'object' || value === null || Array.isArray(value)) {
+    throw new Error('"subscriptions" must be an object');
+  }
+  /** @type {Subscription} */
+  const subscription = { ...DEFAULT_SUBSCRIPTION };
+  for (const [name, setting] of Object.entries(value)) {
+    if (name === 'types') {
+      validateList(name, setting, SUBSCRIBED_TYPES);
+      subscription.types = [...new Set(setting)];
+    } else if (name === 'origins') {
+      validateList(name, setting, ORIGINS);
+      subscription.origins = [...new Set(setting)];
+    } else if (FLAGS.includes(name)) {
+      if (typeof setting !== 'boolean') {
+        throw new Error(`"${name}" must be a boolean`);
+      }
+      subscription[name] = setting;
+    } else {
+      throw new Error(`unknown subscription "${name}"`);
+    }
+  }
+  return subscription;
+};
+
+/**
+ * @param {Subscription[]} subscriptions
+ *
+ * @returns {Subscription} a subscription to everything to which any of the
+ *                         given subscriptions subscribes
+ */
+const unionOf = subscriptions => ({
+  types: SUBSCRIBED_TYPES.filter(type => subscriptions.some(({ types }) => types.includes(type))),
+  origins: ORIGINS.filter(origin => subscriptions.some(({ origins }) => origins.includes(origin))),
+  bookmarks: subscriptions.some(({ bookmarks }) => bookmarks),
+  timing: subscriptions.some(({ timing }) => timing),
+  audio: subscriptions.some(({ audio }) => audio),
+});
+
+/**
+ * @param {Subscription} a
+ * @param {Subscription} b
+ */
+const sameSubscription = (a, b) =>
+  a.types.join() === b.types.join() &&
+  a.origins.join() === b.origins.join() &&
+  FLAGS.every(flag => a[flag] === b[flag]);
+
+/**
+ * @param {Subscription} subscription
+ *
+ * @returns {boolean} whether any speech is delivered
+ */
+const includesSpeech = subscription =>
+  subscription.types.includes('speech') && subscription.origins.length > 0;
+
+/**
+ * @param {Subscription} subscription
+ *
+ * @returns {string} the messages which the voice need not emit, and whether
+ *                   it writes to its audio tap (which it does not by
+ *                   default), in the form in which it receives its settings
+ *                   (see `EngineSettings` in
+ *                   `src/automationttsengine/EngineSettings.h`), e.g.
+ *                   "emitLifecycle=0 stampTimes=0 audioTap=1"; empty if the
+ *                   voice's defaults apply
+ */
+const encodeSubscription = subscription =>
+  [
+    ...[
+      ['emitSpeech', includesSpeech(subscription)],
+      ['emitLifecycle', subscription.types.includes('lifecycle')],
+      ['emitErrors', subscription.types.includes('internalError')],
+      ['emitBookmarks', subscription.bookmarks],
+      ['stampTimes', subscription.timing],
+    ]
+      .filter(([, emitted]) => !emitted)
+      .map(([name]) => `${name}=0`),
+    ...(subscription.audio ? ['audioTap=1'] : []),
+  ].join(' ');
+
+/**
+ * The subscriptions of the sessions of one server, and their union, which
+ * determines what the voice emits. While no session has begun, the voice
+ * emits everything, so that clients which do not begin sessions (for
+ * instance, to await output) are unaffected.
+ *
+ * The server itself may subscribe (for instance, to the messages which it
+ * logs); its subscription is included in the union whenever a session has
+ * begun.
+ *
+ * Emits "change" with the union whenever it changes.
+ */
+class Subscriptions extends EventEmitter {
+  /**
+   * @param {Subscription} [own] - the server's own subscription
+   */
+  constructor(own = EMPTY_SUBSCRIPTION) {
+    super();
+    this.own = own;
+    /** @type {Map<WebSocketWithData, Subscription>} */
+    this.sessions = new Map();
+    /** @type {Subscription} */
+    this.union = FULL_SUBSCRIPTION;
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   * @param {Subscription} subscription
+   */
+  add(websocket, subscription) {
+    this.sessions.set(websocket, subscription);
+    this.update();
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   */
+  remove(websocket) {
+    if (this.sessions.delete(websocket)) {
+      this.update();
+    }
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   *
+   * @returns {Subscription}
+   */
+  of(websocket) {
+    return this.sessions.get(websocket) || DEFAULT_SUBSCRIPTION;
+  }
+
+  /**
+   * @param {WebSocketWithData} websocket
+   * @param {string} topic - "keyPress" or "unprompted" for captured output,
+   *                         "bookmark", "lifecycle" or "internalError"
+   *
+   * @returns {boolean} whether events of the given topic are delivered to
+   *                    the client
+   */
+  accepts(websocket, topic) {
+    const subscription = this.of(websocket);
+    switch (topic) {
+      case 'keyPress':
+      case 'unprompted':
+        return subscription.types.includes('speech') && subscription.origins.includes(topic);
+      case 'bookmark':
+        return subscription.bookmarks;
+      case 'lifecycle':
+      case 'internalError':
+        return subscription.types.includes(topic);
+      default:
+        return true;
+    }
+  }
+
+  /**
+   * Reject a command which depends on messages that the voice no longer
+   * emits because no session subscribes to them.
+   *
+   * @param {'speech' | 'bookmarks' | 'audio'} name
+   * @param {string} command
+   */
+  demand(name, command) {
+    const subscribed = name === 'speech' ? includesSpeech(this.union) : this.union[name];
+    if (!subscribed) {
+      throw new Error(`${command} requires a session which subscribes to ${name}`);
+    }
+  }
+
+  update() {
+    const union =
+      this.sessions.size === 0 ? FULL_SUBSCRIPTION : unionOf([this.own, ...this.sessions.values()]);
+    if (!sameSubscription(union, this.union)) {
+      this.union = union;
+      this.emit('change', union);
+    }
+  }
+}
+
+module.exports = {
+  Subscriptions,
+  DEFAULT_SUBSCRIPTION,
+  EMPTY_SUBSCRIPTION,
+  FULL_SUBSCRIPTION,
+  encodeSubscription,
+  parseSubscription,
+};
@@ -0,0 +1,66 @@
+'use strict';
+
+/**
+ * Several instances of the automation voice may be registered on one Windows
+ * host (see `MakeVoice.exe /instances:N`) so that one driver can serve each of
+ * several screen reader sessions. The first instance uses the voice's original
+ * names and locations; each subsequent instance N appends "-N" to the names of
+ * its pipe, capture journal and audio tap. `src/makevoice/MakeVoice.cpp`
+ * derives the same names.
+ */
+
+/** Greatest number of instances of the voice which may be registered. */
+const MAX_VOICE_INSTANCES = 64;
+
+/**
+ * @param {string} location - a location used by the first instance
+ * @param {number} instance - one-based instance number
+ *
+ * @returns {string} the corresponding location used by the given instance
+ */
+const instancePath = (location, instance) => {
+  if (instance === 1) {
+    return location;
+  }
+  const separator = Math.max(location.lastIndexOf('\\'), location.lastIndexOf('/'));
+  let extension = location.lastIndexOf('.');
+  if (extension <= separator) {
+    extension = location.length;
+  }
+  return `${location.slice(0, extension)}-${instance}${location.slice(extension)}`;
+};
+
+/**
+ * @typedef VoiceInstanceOptions
+ * @property {number} instance - one-based instance number
+ * @property {number} port - port on which the instance's clients connect
+ * @property {string} socketPath - address at which the instance's voice
+ *                                 reports
+ * @property {string | null} journal - location of the instance's capture
+ *                                     journal
+ * @property {string | null} audioTap - location of the instance's audio tap
+ */
+
+/**
+ * Derive the locations at which the driver serves each instance of the voice
+ * from those of the first. Clients of instance N connect to the given port
+ * plus N - 1.
+ *
+ * @param {number} count
+ * @param {{port: number, socketPath: string, journal: string | null, audioTap: string | null}} first
+ *
+ * @returns {VoiceInstanceOptions[]}
+ */
+const voiceInstances = (count, { port, socketPath, journal, audioTap }) =>
+  Array.from({ length: count }, (_, index) => {
+    const instance = index + 1;
+    return {
+      instance,
+      port: port + index,
+      socketPath: instancePath(socketPath, instance),
+      journal: journal && instancePath(journal, instance),
+      audioTap: audioTap && instancePath(audioTap, instance),
+    };
+  });
+
+module.exports = { MAX_VOICE_INSTANCES, instancePath, voiceInstances };
@@ -0,0 +1,236 @@
+'use strict';
+
+const { EventEmitter } = require('events');
+
+const { FULL_SUBSCRIPTION, encodeSubscription } = require('./subscriptions');
+
+/**
+ * @typedef Settings
+ * @property {boolean} vocalize - whether the voice renders speech as audio;
+ *                                when false, speech is captured and each
+ *                                utterance ends as soon as it is reported
+ * @property {number} timeCompression - rate at which the voice plays audio,
+ *                                      as a multiple of real time
+ * @property {number} batchMinWindow - microseconds (see
+ *                                     `DriverClientBatching`)
+ * @property {number} batchMaxWindow - microseconds
+ * @property {number} batchLatencyCap - microseconds
+ * @property {boolean} trace - whether the voice records the input to each
+ *                             utterance (in addition to any recording
+ *                             requested when the voice was installed)
+ */
+
+/**
+ * The voice's settings until the driver changes them. They match those of the
+ * voice (see `EngineSettings` in `src/automationttsengine/EngineSettings.h`).
+ *
+ * @type {Readonly<Settings>}
+ */
+const DEFAULT_VOICE_SETTINGS = Object.freeze({
+  vocalize: true,
+  timeCompression: 1,
+  batchMinWindow: 250,
+  batchMaxWindow: 1000,
+  batchLatencyCap: 4000,
+  trace: false,
+});
+
+const MAX_TIME_COMPRESSION = 10;
+const MAX_BATCH_INTERVAL = 1000000;
+
+/**
+ * Each setting's name in the voice's protocol.
+ *
+ * @type {Record<keyof Settings, string>}
+ */
+const WIRE_NAMES = {
+  vocalize: 'vocalize',
+  timeCompression: 'timeCompression',
+  batchMinWindow: 'batchMinWindowUs',
+  batchMaxWindow: 'batchMaxWindowUs',
+  batchLatencyCap: 'batchLatencyCapUs',
+  trace: 'trace',
+};
+
+/**
+ * @param {string} name
+ * @param {unknown} value
+ */
+const validateSetting = (name, value) => {
+  if (name === 'vocalize' || name === 'trace') {
+    if (typeof value !== 'boolean') {
+      throw new Error(`"${name}" must be a boolean`);
+    }
+  } else if (name === 'timeCompression') {
+    if (typeof value !== 'number' || !(value >= 1 && value <= MAX_TIME_COMPRESSION)) {
+      throw new Error(`"timeCompression" must be a number between 1 and ${MAX_TIME_COMPRESSION}`);
+    }
+  } else if (!Number.isInteger(value) || value < 0 || value > MAX_BATCH_INTERVAL) {
+    throw new Error(`"${name}" must be an integer between 0 and ${MAX_BATCH_INTERVAL}`);
+  }
+};
+
+/**
+ * @param {keyof Settings} name
+ * @param {boolean | number} value
+ *
+ * @returns {number}
+ */
+const encodeValue = (name, value) => {
+  if (typeof value === 'boolean') {
+    return Number(value);
+  }
+  // The voice receives the rate as a percentage.
+  return name === 'timeCompression' ? Math.round(value * 100) : value;
+};
+
+/**
+ * @param {Settings} settings
+ *
+ * @returns {string} the settings in the form in which the voice receives
+ *                   them, e.g. "vocalize=0 timeCompression=200 ..."
+ */
+const encodeSettings = settings =>
+  /** @type {(keyof Settings)[]} */ (Object.keys(WIRE_NAMES))
+    .map(name => `${WIRE_NAMES[name]}=${encodeValue(name, settings[name])}`)
+    .join(' ');
+
+/**
+ * @param {string} data - settings as described by the voice
+ *
+ * @returns {Partial<Settings>} those of the settings which are recognized
+ */
+const decodeSettings = data => {
+  /** @type {Partial<Settings>} */
+  const settings = {};
+  for (const pair of data.split(' ')) {
+    const [wireName, value] = pair.split('=');
+    const name = /** @type {(keyof Settings)[]} */ (Object.keys(WIRE_NAMES)).find(
+      key => WIRE_NAMES[key] === wireName,
+    );
+    if (!name || value === undefined) {
+      continue;
+    }
+    if (name === 'vocalize' || name === 'trace') {
+      settings[name] = value === '1';
+    } else if (name === 'timeCompression') {
+      settings[name] = Number(value) / 100;
+    } else {
+      settings[name] = Number(value);
+    }
+  }
+  return settings;
+};
+
+/**
+ * The settings which the driver applies to the voice (see
+ * `interaction.configureVoice`). Each change is numbered (its "generation")
+ * and emitted as a "change" event whose value is the message which conveys
+ * the settings to the voice. The voice applies them from the next utterance
+ * which it begins, and acknowledges them with a `configured` message of the
+ * same generation.
+ */
+class VoiceSettings extends EventEmitter {
+  /**
+   * @param {object} [options]
+   * @param {boolean} [options.escapeSpeech] - whether the voice sends speech
+   *        with its whitespace normalized and escaped for inclusion in a JSON
+   *        string, so that the driver can broadcast it without encoding it
+   *        (see `formatSpeechPayload` in
+   *        `src/automationttsengine/SpeechPayload.h`). It is chosen by the
+   *        driver rather than its clients, so it is sent from the first
+   *        connection.
+   * @param {boolean} [options.audioTap] - whether the driver reads the
+   *        voice's audio tap. The voice writes to its tap only while the
+   *        driver does and some session may capture audio, which, like every
+   *        subscription, is the case until a session begins.
+   */
+  constructor({ escapeSpeech = false, audioTap = false } = {}) {
+    super();
+    /** @type {Settings} */
+    this.settings = { ...DEFAULT_VOICE_SETTINGS };
+    this.escapeSpeech = escapeSpeech;
+    this.audioTap = audioTap;
+    // The messages which the voice need not emit, and whether it writes to
+    // its audio tap (see `Subscriptions`).
+    this.subscribed = this.encodeSubscription(FULL_SUBSCRIPTION);
+    this.generation = escapeSpeech || this.subscribed ? 1 : 0;
+  }
+
+  /**
+   * Change some of the settings. A setting whose value is `null` is restored
+   * to its default.
+   *
+   * @param {{[name: string]: unknown}} changes
+   *
+   * @returns {{settings: Settings, generation: number}} every setting, as
+   *          changed, and the generation which the voice will acknowledge
+   */
+  update(changes) {
+    /** @type {Settings} */
+    const settings = { ...this.settings };
+    for (const [name, value] of Object.entries(changes)) {
+      if (!Object.prototype.hasOwnProperty.call(WIRE_NAMES, name)) {
+        throw new Error(`unknown voice setting "${name}"`);
+      }
+      if (value === null) {
+        settings[name] = DEFAULT_VOICE_SETTINGS[name];
+        continue;
+      }
+      validateSetting(name, value);
+      settings[name] = value;
+    }
+    if (settings.batchMinWindow > settings.batchMaxWindow) {
+      throw new Error('"batchMinWindow" must not exceed "batchMaxWindow"');
+    }
+
+    this.settings = settings;
+    this.generation += 1;
+    this.emit('change', this.encode());
+    return { settings: { ...settings }, generation: this.generation };
+  }
+
+  /**
+   * Tell the voice which messages the driver's sessions subscribe to, so
+   * that it does not emit those to which none subscribes.
+   *
+   * @param {import('./subscriptions').Subscription} subscription
+   */
+  setSubscription(subscription) {
+    const subscribed = this.encodeSubscription(subscription);
+    if (subscribed === this.subscribed) {
+      return;
+    }
+    this.subscribed = subscribed;
+    this.generation += 1;
+    this.emit('change', this.encode());
+  }
+
+  /**
+   * @param {import('./subscriptions').Subscription} subscription
+   */
+  encodeSubscription(subscription) {
+    return encodeSubscription({ ...subscription, audio: subscription.audio && this.audioTap });
+  }
+
+  /**
+   * @returns {string | null} the message which conveys the current settings
+   *                          to the voice (including its terminator), or
+   *                          null if they are the voice's defaults
+   */
+  encode() {
+    if (this.generation === 0) {
+      return null;
+    }
+    let data = encodeSettings(this.settings);
+    if (this.escapeSpeech) {
+      data += ' escapeSpeech=1';
+    }
+    if (this.subscribed) {
+      data += ` ${this.subscribed}`;
+    }
+    return `configure gen=${this.generation}:${data}\0`;
+  }
+}
+
+module.exports = { VoiceSettings, DEFAULT_VOICE_SETTINGS, encodeSettings, decodeSettings };
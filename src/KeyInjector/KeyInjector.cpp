@@ -0,0 +1,162 @@
+#include "KeyInjector.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+//--- Protocol
+
+/**
+ * Parse a decimal number from `text` at `*pOffset`, advancing it past the
+ * digits.
+ *
+ * @returns {bool} whether any digits were found and the value is at most
+ *                 `ullMaximum`
+ */
+static bool parseNumber(const std::string& text, size_t* pOffset, uint64_t ullMaximum, uint64_t* pValue)
+{
+    size_t offset = *pOffset;
+    uint64_t ullValue = 0;
+    while (offset < text.size() && text[offset] >= '0' && text[offset] <= '9')
+    {
+        ullValue = ullValue * 10 + (uint64_t)(text[offset] - '0');
+        if (ullValue > ullMaximum)
+        {
+            return false;
+        }
+        offset += 1;
+    }
+    if (offset == *pOffset)
+    {
+        return false;
+    }
+    *pOffset = offset;
+    *pValue = ullValue;
+    return true;
+}
+
+bool KeySequence::parse(const std::string& line, std::string* pId, std::vector<KeyChord>* pChords)
+{
+    pChords->clear();
+    size_t offset = line.find(' ');
+    *pId = line.substr(0, offset);
+    if (pId->empty() || offset == std::string::npos)
+    {
+        return false;
+    }
+
+    while (offset < line.size())
+    {
+        if (line[offset] != ' ' || pChords->size() == MAX_CHORDS)
+        {
+            return false;
+        }
+        offset += 1;
+
+        KeyChord chord;
+        uint64_t ullValue;
+        if (!parseNumber(line, &offset, MAX_DELAY_US, &ullValue) || offset == line.size() || line[offset] != ':')
+        {
+            return false;
+        }
+        chord.ulDelayUs = (uint32_t)ullValue;
+        do
+        {
+            offset += 1;
+            if (chord.codes.size() == MAX_KEYS_PER_CHORD || !parseNumber(line, &offset, UINT32_MAX, &ullValue))
+            {
+                return false;
+            }
+            chord.codes.push_back((uint32_t)ullValue);
+        } while (offset < line.size() && line[offset] == '+');
+
+        pChords->push_back(std::move(chord));
+    }
+    return !pChords->empty();
+}
+
+std::string KeySequence::formatCompleted(const std::string& id, const std::vector<uint64_t>& completedAt)
+{
+    std::string response = id + " ok";
+    char number[24];
+    for (uint64_t ullCompletedAt : completedAt)
+    {
+        snprintf(number, sizeof(number), " %llu", (unsigned long long)ullCompletedAt);
+        response += number;
+    }
+    return response + "\n";
+}
+
+std::string KeySequence::formatError(const std::string& id, const char* pMessage)
+{
+    return (id.empty() ? std::string("-") : id) + " error " + pMessage + "\n";
+}
+
+//--- Backends
+
+bool RecordingKeyBackend::key(uint32_t ulCode, bool fDown)
+{
+    if (m_ulLatencyUs)
+    {
+        KeyInjector::waitUntil(KeyInjector::nowMicroseconds() + m_ulLatencyUs);
+    }
+    m_events.push_back({ulCode, fDown, KeyInjector::nowMicroseconds()});
+    return true;
+}
+
+//--- Execution
+
+uint64_t KeyInjector::nowMicroseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void KeyInjector::waitUntil(uint64_t ullDeadline)
+{
+    for (uint64_t ullNow = nowMicroseconds(); ullNow < ullDeadline; ullNow = nowMicroseconds())
+    {
+        uint64_t ullRemaining = ullDeadline - ullNow;
+        if (ullRemaining > SPIN_THRESHOLD_US)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(ullRemaining - SPIN_THRESHOLD_US));
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool KeyInjector::run(const std::vector<KeyChord>& chords, uint64_t ullStart, std::vector<uint64_t>* pCompletedAt)
+{
+    pCompletedAt->clear();
+    uint64_t ullPrevious = ullStart;
+    for (const KeyChord& chord : chords)
+    {
+        waitUntil(ullPrevious + chord.ulDelayUs);
+
+        size_t down = 0;
+        bool fInjected = true;
+        while (down < chord.codes.size() && fInjected)
+        {
+            fInjected = m_backend.key(chord.codes[down], true);
+            down += fInjected ? 1 : 0;
+        }
+        // Keys which are left down would modify every subsequent key press on
+        // the host, so they are released even if the chord failed.
+        while (down > 0)
+        {
+            down -= 1;
+            fInjected = m_backend.key(chord.codes[down], false) && fInjected;
+        }
+        if (!fInjected)
+        {
+            return false;
+        }
+
+        ullPrevious = nowMicroseconds();
+        pCompletedAt->push_back(ullPrevious);
+    }
+    return true;
+}
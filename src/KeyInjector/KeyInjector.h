@@ -0,0 +1,145 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A set of keys which are pressed together: each is pressed in order and then
+ * released in reverse order, after waiting `ulDelayUs` microseconds from the
+ * completion of the previous chord (or, for the first chord of a sequence,
+ * from the moment the sequence was received).
+ */
+struct KeyChord
+{
+    std::vector<uint32_t> codes;
+    uint32_t ulDelayUs = 0;
+};
+
+/**
+ * Requests to the key injection helper are single lines of the form
+ *
+ *     <id> <delay>:<code>[+<code>]* [<delay>:<code>[+<code>]*]*
+ *
+ * where each chord's delay is in microseconds and each code is a platform key
+ * code (a virtual-key code on Windows, a key code on macOS) in decimal. The
+ * helper responds to each request, in order, with
+ *
+ *     <id> ok <completed>[ <completed>]*
+ *
+ * listing the time at which each chord's keys had been released, in
+ * microseconds since the epoch of the host's monotonic clock (which the driver
+ * and the voice also use), or with
+ *
+ *     <id> error <message>
+ *
+ * if the request is malformed or the keys could not be injected.
+ */
+namespace KeySequence
+{
+    static const size_t MAX_CHORDS = 1024;
+    static const size_t MAX_KEYS_PER_CHORD = 8;
+    static const uint32_t MAX_DELAY_US = 60 * 1000 * 1000;
+
+    /**
+     * @param {std::string*} pId - receives the request's id, which is also
+     *                             set (where present) when parsing fails
+     *
+     * @returns {bool} whether the request was well-formed
+     */
+    bool parse(const std::string& line, std::string* pId, std::vector<KeyChord>* pChords);
+
+    std::string formatCompleted(const std::string& id, const std::vector<uint64_t>& completedAt);
+    std::string formatError(const std::string& id, const char* pMessage);
+}
+
+/**
+ * Presses and releases individual keys. The platform's backend injects them
+ * into the system's input stream; the recording backend (see
+ * `RecordingKeyBackend`) stands in for it wherever keys must not be pressed.
+ */
+class KeyBackend
+{
+public:
+    virtual ~KeyBackend() {}
+
+    /** @returns {bool} whether the key was injected */
+    virtual bool key(uint32_t ulCode, bool fDown) = 0;
+};
+
+struct KeyEvent
+{
+    uint32_t ulCode;
+    bool     fDown;
+    uint64_t ullAt;
+};
+
+/**
+ * Records each key event and the time at which it was injected, taking
+ * `ulLatencyUs` microseconds to do so in order to model the cost of injecting
+ * a key.
+ */
+class RecordingKeyBackend : public KeyBackend
+{
+public:
+    explicit RecordingKeyBackend(uint32_t ulLatencyUs = 0) : m_ulLatencyUs(ulLatencyUs) {}
+
+    bool key(uint32_t ulCode, bool fDown) override;
+
+    const std::vector<KeyEvent>& events() const { return m_events; }
+    void clear() { m_events.clear(); }
+
+private:
+    uint32_t m_ulLatencyUs;
+    std::vector<KeyEvent> m_events;
+};
+
+/**
+ * @returns {KeyBackend*} a backend which injects keys on this host, or NULL
+ *                        if there is none (e.g. on Linux)
+ */
+KeyBackend* createPlatformKeyBackend();
+
+/**
+ * Executes sequences of chords with precise timing.
+ *
+ * The system's sleep granularity is coarser than the delays which tests
+ * request (a millisecond or more, and 15.6 milliseconds on Windows unless the
+ * timer resolution is raised), so the injector sleeps until shortly before
+ * each chord is due and then yields until it is.
+ */
+class KeyInjector
+{
+public:
+    // Remaining time below which the injector yields rather than sleeps.
+#ifdef _WIN32
+    static const uint32_t SPIN_THRESHOLD_US = 2000;
+#else
+    static const uint32_t SPIN_THRESHOLD_US = 1000;
+#endif
+
+    explicit KeyInjector(KeyBackend& backend) : m_backend(backend) {}
+
+    /**
+     * Press each chord in turn. If a key cannot be injected, any keys of the
+     * chord which are down are released and the sequence is abandoned.
+     *
+     * @param {uint64_t} ullStart - the time from which the first chord's
+     *                              delay is measured
+     * @param {std::vector<uint64_t>*} pCompletedAt - receives the time at
+     *                                                which each chord's keys
+     *                                                had been released
+     *
+     * @returns {bool} whether every chord was pressed
+     */
+    bool run(const std::vector<KeyChord>& chords, uint64_t ullStart, std::vector<uint64_t>* pCompletedAt);
+
+    /** @returns {uint64_t} microseconds on the host's monotonic clock */
+    static uint64_t nowMicroseconds();
+
+    /** Wait until the monotonic clock reaches the given time. */
+    static void waitUntil(uint64_t ullDeadline);
+
+private:
+    KeyBackend& m_backend;
+};
@@ -0,0 +1,106 @@
+#include "KeyInjector.h"
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+/**
+ * Injects virtual-key codes with `SendInput`. Screen readers observe keys
+ * through low-level keyboard hooks, which see the scan code and the extended
+ * flag as well as the virtual-key code, so all three are supplied as a
+ * physical keyboard would supply them (without the extended flag, for instance,
+ * Insert would be reported as the numeric keypad's 0 key).
+ */
+class SendInputKeyBackend : public KeyBackend
+{
+public:
+    bool key(uint32_t ulCode, bool fDown) override
+    {
+        INPUT input = {};
+        input.type = INPUT_KEYBOARD;
+        input.ki.wVk = (WORD)ulCode;
+        input.ki.wScan = (WORD)MapVirtualKeyW(ulCode, MAPVK_VK_TO_VSC);
+        input.ki.dwFlags = (fDown ? 0 : KEYEVENTF_KEYUP) | (isExtended(ulCode) ? KEYEVENTF_EXTENDEDKEY : 0);
+        return SendInput(1, &input, sizeof(input)) == 1;
+    }
+
+private:
+    static bool isExtended(uint32_t ulCode)
+    {
+        switch (ulCode)
+        {
+        case VK_PRIOR: case VK_NEXT: case VK_END: case VK_HOME:
+        case VK_LEFT: case VK_UP: case VK_RIGHT: case VK_DOWN:
+        case VK_INSERT: case VK_DELETE: case VK_LWIN: case VK_RWIN: case VK_APPS:
+        case VK_RCONTROL: case VK_RMENU: case VK_DIVIDE: case VK_NUMLOCK:
+            return true;
+        default:
+            return false;
+        }
+    }
+};
+
+KeyBackend* createPlatformKeyBackend()
+{
+    return new SendInputKeyBackend();
+}
+
+#elif defined(__APPLE__)
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/**
+ * Posts key codes as Quartz events. Modifier keys do not modify subsequent
+ * synthetic events of their own accord, so the flags of the modifiers which
+ * are down are applied to each event. Posting events requires that the helper
+ * (or the process which started it) be granted the Accessibility permission.
+ */
+class QuartzKeyBackend : public KeyBackend
+{
+public:
+    bool key(uint32_t ulCode, bool fDown) override
+    {
+        CGEventFlags flag = modifierFlag(ulCode);
+        m_flags = fDown ? (m_flags | flag) : (m_flags & ~flag);
+
+        CGEventRef event = CGEventCreateKeyboardEvent(NULL, (CGKeyCode)ulCode, fDown);
+        if (!event)
+        {
+            return false;
+        }
+        CGEventSetFlags(event, m_flags);
+        CGEventPost(kCGHIDEventTap, event);
+        CFRelease(event);
+        return true;
+    }
+
+private:
+    static CGEventFlags modifierFlag(uint32_t ulCode)
+    {
+        switch (ulCode)
+        {
+        case 55: case 54: return kCGEventFlagMaskCommand;
+        case 56: case 60: return kCGEventFlagMaskShift;
+        case 58: case 61: return kCGEventFlagMaskAlternate;
+        case 59: case 62: return kCGEventFlagMaskControl;
+        case 63: return kCGEventFlagMaskSecondaryFn;
+        default: return 0;
+        }
+    }
+
+    CGEventFlags m_flags = 0;
+};
+
+KeyBackend* createPlatformKeyBackend()
+{
+    return new QuartzKeyBackend();
+}
+
+#else
+
+KeyBackend* createPlatformKeyBackend()
+{
+    return NULL;
+}
+
+#endif
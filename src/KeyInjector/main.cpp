@@ -0,0 +1,319 @@
+/**
+ * `at-driver-keys`, the key injection helper.
+ *
+ * The driver starts the helper once and sends it every key press over a
+ * single connection, rather than starting a process (such as `osascript`) for
+ * each press. The helper serves one connection and exits when it closes, so
+ * it does not outlive the driver.
+ *
+ * Usage:
+ *
+ *     at-driver-keys [--backend recording] <address>
+ *     at-driver-keys [--backend recording] --once "<chord> [<chord>]*"
+ *
+ * The address is a Unix domain socket path or, on Windows, a named pipe path.
+ * "ready" is written to the standard output stream once the helper is
+ * listening. With `--once`, a single sequence (in the form described in
+ * `KeyInjector.h`, without an id) is pressed and the response is written to
+ * the standard output stream instead. The recording backend presses no keys.
+ */
+#include "KeyInjector.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/** Longest request accepted, beyond which the connection is closed. */
+static const size_t MAX_REQUEST_LENGTH = 64 * 1024;
+
+// Set when the recording backend is in use, whose events are discarded once
+// each request has been answered.
+static RecordingKeyBackend* s_pRecording = NULL;
+
+/**
+ * @returns {std::string} the response to the given request
+ */
+static std::string respond(KeyInjector& injector, const std::string& line)
+{
+    uint64_t ullReceived = KeyInjector::nowMicroseconds();
+    std::string id;
+    std::vector<KeyChord> chords;
+    if (!KeySequence::parse(line, &id, &chords))
+    {
+        return KeySequence::formatError(id, "malformed request");
+    }
+    std::vector<uint64_t> completedAt;
+    bool fInjected = injector.run(chords, ullReceived, &completedAt);
+    if (s_pRecording)
+    {
+        s_pRecording->clear();
+    }
+    if (!fInjected)
+    {
+        return KeySequence::formatError(id, "keys could not be injected");
+    }
+    return KeySequence::formatCompleted(id, completedAt);
+}
+
+/**
+ * A listening socket which accepts a single connection (implemented per
+ * platform).
+ */
+class Connection
+{
+public:
+    ~Connection();
+
+    bool listen(const std::string& address);
+    bool accept();
+
+    /** @returns {int} bytes read, or zero once the connection has closed */
+    int read(char* pBuffer, int cbBuffer);
+    bool write(const std::string& data);
+
+private:
+#ifdef _WIN32
+    HANDLE m_hPipe = INVALID_HANDLE_VALUE;
+#else
+    std::string m_address;
+    int m_fdListener = -1;
+    int m_fdConnection = -1;
+#endif
+};
+
+#ifdef _WIN32
+
+Connection::~Connection()
+{
+    if (m_hPipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hPipe);
+    }
+}
+
+bool Connection::listen(const std::string& address)
+{
+    int cchAddress = MultiByteToWideChar(CP_UTF8, 0, address.c_str(), -1, NULL, 0);
+    std::wstring wideAddress(cchAddress, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, address.c_str(), -1, &wideAddress[0], cchAddress);
+
+    m_hPipe = CreateNamedPipeW(
+        wideAddress.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1,
+        4096,
+        4096,
+        0,
+        NULL
+    );
+    return m_hPipe != INVALID_HANDLE_VALUE;
+}
+
+bool Connection::accept()
+{
+    return ConnectNamedPipe(m_hPipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED;
+}
+
+int Connection::read(char* pBuffer, int cbBuffer)
+{
+    DWORD cbRead = 0;
+    return ReadFile(m_hPipe, pBuffer, (DWORD)cbBuffer, &cbRead, NULL) ? (int)cbRead : 0;
+}
+
+bool Connection::write(const std::string& data)
+{
+    DWORD cbWritten = 0;
+    return WriteFile(m_hPipe, data.data(), (DWORD)data.size(), &cbWritten, NULL) && cbWritten == data.size();
+}
+
+#else
+
+Connection::~Connection()
+{
+    if (m_fdConnection >= 0)
+    {
+        ::close(m_fdConnection);
+    }
+    if (m_fdListener >= 0)
+    {
+        ::close(m_fdListener);
+        unlink(m_address.c_str());
+    }
+}
+
+bool Connection::listen(const std::string& address)
+{
+    sockaddr_un socketAddress = {};
+    if (address.size() >= sizeof(socketAddress.sun_path))
+    {
+        return false;
+    }
+    socketAddress.sun_family = AF_UNIX;
+    memcpy(socketAddress.sun_path, address.c_str(), address.size() + 1);
+
+    m_fdListener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_fdListener < 0)
+    {
+        return false;
+    }
+    unlink(address.c_str());
+    if (bind(m_fdListener, (const sockaddr*)&socketAddress, sizeof(socketAddress)) != 0)
+    {
+        return false;
+    }
+    m_address = address;
+    return ::listen(m_fdListener, 1) == 0;
+}
+
+bool Connection::accept()
+{
+    do
+    {
+        m_fdConnection = ::accept(m_fdListener, NULL, NULL);
+    } while (m_fdConnection < 0 && errno == EINTR);
+    return m_fdConnection >= 0;
+}
+
+int Connection::read(char* pBuffer, int cbBuffer)
+{
+    ssize_t cbRead;
+    do
+    {
+        cbRead = ::read(m_fdConnection, pBuffer, (size_t)cbBuffer);
+    } while (cbRead < 0 && errno == EINTR);
+    return cbRead > 0 ? (int)cbRead : 0;
+}
+
+bool Connection::write(const std::string& data)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    size_t cbWritten = 0;
+    while (cbWritten < data.size())
+    {
+        ssize_t cbChunk = ::send(m_fdConnection, data.data() + cbWritten, data.size() - cbWritten, flags);
+        if (cbChunk < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        cbWritten += (size_t)cbChunk;
+    }
+    return true;
+}
+
+#endif
+
+static int serve(KeyInjector& injector, const std::string& address)
+{
+    Connection connection;
+    if (!connection.listen(address))
+    {
+        fprintf(stderr, "at-driver-keys: unable to listen at %s\n", address.c_str());
+        return 1;
+    }
+    printf("ready\n");
+    fflush(stdout);
+    if (!connection.accept())
+    {
+        return 1;
+    }
+
+    std::string pending;
+    char buffer[4096];
+    for (int cbRead; (cbRead = connection.read(buffer, sizeof(buffer))) > 0;)
+    {
+        pending.append(buffer, cbRead);
+        size_t start = 0;
+        for (size_t end; (end = pending.find('\n', start)) != std::string::npos; start = end + 1)
+        {
+            if (!connection.write(respond(injector, pending.substr(start, end - start))))
+            {
+                return 1;
+            }
+        }
+        pending.erase(0, start);
+        if (pending.size() > MAX_REQUEST_LENGTH)
+        {
+            fprintf(stderr, "at-driver-keys: request exceeds %u bytes\n", (unsigned)MAX_REQUEST_LENGTH);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    bool fRecording = false;
+    const char* pOnce = NULL;
+    const char* pAddress = NULL;
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc && strcmp(argv[i + 1], "recording") == 0)
+        {
+            fRecording = true;
+            i += 1;
+        }
+        else if (strcmp(argv[i], "--once") == 0 && i + 1 < argc)
+        {
+            pOnce = argv[++i];
+        }
+        else if (!pAddress && argv[i][0] != '-')
+        {
+            pAddress = argv[i];
+        }
+        else
+        {
+            pAddress = NULL;
+            pOnce = NULL;
+            break;
+        }
+    }
+    if (!pAddress == !pOnce)
+    {
+        fprintf(stderr, "usage: at-driver-keys [--backend recording] (<address> | --once <sequence>)\n");
+        return 2;
+    }
+
+    if (fRecording)
+    {
+        s_pRecording = new RecordingKeyBackend();
+    }
+    std::unique_ptr<KeyBackend> backend(fRecording ? s_pRecording : createPlatformKeyBackend());
+    if (!backend)
+    {
+        fprintf(stderr, "at-driver-keys: keys cannot be injected on this host (see --backend)\n");
+        return 2;
+    }
+
+#ifdef _WIN32
+    // Raise the timer resolution from 15.6 milliseconds so that the injector
+    // can sleep for most of each delay (see `KeyInjector::waitUntil`).
+    timeBeginPeriod(1);
+#endif
+
+    KeyInjector injector(*backend);
+    if (pOnce)
+    {
+        fputs(respond(injector, std::string("0 ") + pOnce).c_str(), stdout);
+        return 0;
+    }
+    return serve(injector, pAddress);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+
+/**
+ * C interface to `DriverClient`, for use from languages which cannot consume
+ * C++ declarations directly (e.g. the macOS service, which is written in
+ * Swift).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The message was written to the driver.
+#define AT_DRIVER_CLIENT_OK 0
+// The message was buffered and will be written by a subsequent call (for
+// instance, because the driver is not currently reachable).
+#define AT_DRIVER_CLIENT_QUEUED 1
+// The message was discarded because the buffer is full.
+#define AT_DRIVER_CLIENT_DROPPED -1
+// The message was gathered into a batch which is written when the batch ends
+// (only when batching has been enabled).
+#define AT_DRIVER_CLIENT_HELD 2
+// The message was buffered and will be written by the thread which is
+// currently writing to the driver.
+#define AT_DRIVER_CLIENT_COALESCED 3
+
+typedef struct ATDriverClient ATDriverClient;
+
+/**
+ * @param address - UTF-8 encoded location of the driver's socket (a Unix
+ *                  domain socket path or, on Windows, a named pipe path)
+ *
+ * @returns a client, or NULL if memory could not be allocated
+ */
+ATDriverClient* at_driver_client_create(const char* address);
+void at_driver_client_destroy(ATDriverClient* client);
+
+/**
+ * Send the message `<name>:<data>`. `data` need not be null-terminated.
+ *
+ * @returns one of the AT_DRIVER_CLIENT_ status codes
+ */
+int at_driver_client_send(ATDriverClient* client, const char* name, const char* data, size_t length);
+
+/**
+ * Attempt to write any buffered messages.
+ *
+ * @returns AT_DRIVER_CLIENT_OK if no messages remain buffered, or
+ *          AT_DRIVER_CLIENT_COALESCED if another thread is writing them
+ */
+int at_driver_client_flush(ATDriverClient* client);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,715 @@
+#include "DriverClient.h"
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+const size_t DriverClient::DEFAULT_BUFFER_CAPACITY;
+const uint32_t DriverClient::INITIAL_BACKOFF_MS;
+const uint32_t DriverClient::MAXIMUM_BACKOFF_MS;
+const uint32_t DriverClient::BACKPRESSURE_TIMEOUT_MS;
+const uint32_t DriverClient::BATCH_WINDOW_INTERVALS;
+
+static const char REPLACEMENT_CHARACTER[] = "\xEF\xBF\xBD";
+
+static uint64_t nowMilliseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t nowMicroseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * The writer's half of the dictionary described by `DriverClientDictionary`.
+ * Entries are kept in order of use so that the least recently used can be
+ * replaced, and are indexed by their text. The text of each message is
+ * copied into a reusable key for lookup, so that coding a reference does not
+ * allocate. (The voice is built as C++14, which has no `std::string_view`.)
+ */
+class MessageDictionary
+{
+public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    explicit MessageDictionary(const DriverClientDictionary& config) : m_config(config)
+    {
+        m_entries.resize(config.ulEntries);
+        m_index.reserve(config.ulEntries);
+        reset();
+    }
+
+    /** Forget every entry, as the driver does when a connection closes. */
+    void reset()
+    {
+        m_index.clear();
+        m_cUsed = 0;
+        m_ulNewest = NONE;
+        m_ulOldest = NONE;
+    }
+
+    /**
+     * Code each message in `raw`, appending the result to `*pCoded` and the
+     * end of each message in `raw` and in `*pCoded` to `*pFrames`.
+     *
+     * @returns {uint64_t} the number of messages replaced by references
+     */
+    uint64_t code(const std::string& raw, std::string* pCoded, std::vector<std::pair<size_t, size_t>>* pFrames)
+    {
+        uint64_t ullReferences = 0;
+        char attribute[sizeof(" def=4294967295")];
+        for (size_t start = 0; start < raw.size();)
+        {
+            size_t end = raw.find('\0', start);
+            size_t separator = raw.find(':', start);
+            size_t cbData = end - separator - 1;
+
+            if (!isSpeech(raw, start) || cbData < m_config.cbMinEntry || cbData > m_config.cbMaxEntry)
+            {
+                pCoded->append(raw, start, end + 1 - start);
+            }
+            else
+            {
+                pCoded->append(raw, start, separator - start);
+                m_key.assign(raw, separator + 1, cbData);
+                auto found = m_index.find(m_key);
+                if (found != m_index.end())
+                {
+                    use(found->second);
+                    pCoded->append(attribute, snprintf(attribute, sizeof(attribute), " ref=%u", found->second));
+                    pCoded->append(":\0", 2);
+                    ullReferences += 1;
+                }
+                else
+                {
+                    uint32_t ulEntry = define(m_key);
+                    pCoded->append(attribute, snprintf(attribute, sizeof(attribute), " def=%u", ulEntry));
+                    pCoded->append(raw, separator, end + 1 - separator);
+                }
+            }
+
+            pFrames->emplace_back(end + 1, pCoded->size());
+            start = end + 1;
+        }
+        return ullReferences;
+    }
+
+private:
+    struct Entry
+    {
+        std::string text;
+        uint32_t ulNewer = NONE;
+        uint32_t ulOlder = NONE;
+    };
+
+    static bool isSpeech(const std::string& raw, size_t start)
+    {
+        return raw.compare(start, 6, "speech") == 0 && (raw[start + 6] == ' ' || raw[start + 6] == ':');
+    }
+
+    uint32_t define(const std::string& text)
+    {
+        uint32_t ulEntry;
+        if (m_cUsed < m_entries.size())
+        {
+            ulEntry = (uint32_t)m_cUsed++;
+        }
+        else
+        {
+            ulEntry = m_ulOldest;
+            m_index.erase(m_entries[ulEntry].text);
+            unlink(ulEntry);
+        }
+        m_entries[ulEntry].text.assign(text);
+        m_index.emplace(text, ulEntry);
+        linkNewest(ulEntry);
+        return ulEntry;
+    }
+
+    void use(uint32_t ulEntry)
+    {
+        if (ulEntry != m_ulNewest)
+        {
+            unlink(ulEntry);
+            linkNewest(ulEntry);
+        }
+    }
+
+    void unlink(uint32_t ulEntry)
+    {
+        Entry& entry = m_entries[ulEntry];
+        (entry.ulNewer == NONE ? m_ulNewest : m_entries[entry.ulNewer].ulOlder) = entry.ulOlder;
+        (entry.ulOlder == NONE ? m_ulOldest : m_entries[entry.ulOlder].ulNewer) = entry.ulNewer;
+    }
+
+    void linkNewest(uint32_t ulEntry)
+    {
+        Entry& entry = m_entries[ulEntry];
+        entry.ulNewer = NONE;
+        entry.ulOlder = m_ulNewest;
+        (m_ulNewest == NONE ? m_ulOldest : m_entries[m_ulNewest].ulNewer) = ulEntry;
+        m_ulNewest = ulEntry;
+    }
+
+    DriverClientDictionary m_config;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, uint32_t> m_index;
+    std::string m_key;
+    size_t m_cUsed;
+    uint32_t m_ulNewest;
+    uint32_t m_ulOldest;
+};
+
+DriverClient::DriverClient(const char* pAddress, size_t cbBufferCapacity)
+    : m_address(pAddress), m_cbBufferCapacity(cbBufferCapacity), m_fWriting(false), m_ullRetryAt(0),
+      m_ulBackoffMs(INITIAL_BACKOFF_MS), m_ullConnection(0), m_ullLastArrival(0), m_ullIntervalEstimate(0),
+      m_ullWindowUs(0), m_ullBatchOpened(0), m_ullHeldInBatch(0), m_ullHeldArrivals(0)
+#ifdef _WIN32
+    , m_hConnection(INVALID_HANDLE_VALUE)
+#else
+    , m_fdConnection(-1)
+#endif
+{
+}
+
+DriverClient::~DriverClient()
+{
+    closeConnection();
+}
+
+int DriverClient::send(const char* pName, const char* pAttributes, const char* pData, size_t cbData,
+    bool fBoundary)
+{
+    size_t cbName = strlen(pName);
+    size_t cbAttributes = pAttributes ? strlen(pAttributes) : 0;
+    size_t cbFrame = cbName + (cbAttributes ? cbAttributes + 1 : 0) + 1 + cbData + 1;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // While another thread is making progress, the sender waits briefly for
+    // space rather than discarding the message.
+    if (m_pending.size() + cbFrame > m_cbBufferCapacity && m_fWriting)
+    {
+        m_spaceAvailable.wait_for(lock, std::chrono::milliseconds(BACKPRESSURE_TIMEOUT_MS), [&] {
+            return m_pending.size() + cbFrame <= m_cbBufferCapacity;
+        });
+    }
+    if (m_pending.size() + cbFrame > m_cbBufferCapacity)
+    {
+        m_statistics.ullDropped += 1;
+        return AT_DRIVER_CLIENT_DROPPED;
+    }
+
+    try
+    {
+        m_pending.append(pName, cbName);
+        if (cbAttributes)
+        {
+            m_pending.push_back(' ');
+            m_pending.append(pAttributes, cbAttributes);
+        }
+        m_pending.push_back(':');
+
+        const char* pEnd = pData + cbData;
+        for (const char* pRun = pData; pRun < pEnd;)
+        {
+            const char* pNull = (const char*)memchr(pRun, '\0', pEnd - pRun);
+            m_pending.append(pRun, (pNull ? pNull : pEnd) - pRun);
+            if (!pNull)
+            {
+                break;
+            }
+            m_pending.append(REPLACEMENT_CHARACTER);
+            pRun = pNull + 1;
+        }
+        m_pending.push_back('\0');
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_statistics.ullDropped += 1;
+        return AT_DRIVER_CLIENT_DROPPED;
+    }
+
+    m_statistics.ullMessages += 1;
+
+    // The thread which is currently writing delivers this message when its
+    // write completes.
+    if (m_fWriting)
+    {
+        return AT_DRIVER_CLIENT_COALESCED;
+    }
+
+    if (m_batching.cbMaxBatch && hold(nowMicroseconds(), fBoundary))
+    {
+        return AT_DRIVER_CLIENT_HELD;
+    }
+
+    return drain(lock);
+}
+
+void DriverClient::setBatching(const DriverClientBatching& batching)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_batching = batching;
+    m_ullIntervalEstimate = batching.ulMaxWindowUs;
+    m_ullWindowUs = batching.ulMaxWindowUs;
+}
+
+void DriverClient::setDictionary(const DriverClientDictionary& dictionary)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pDictionary.reset(dictionary.ulEntries ? new MessageDictionary(dictionary) : NULL);
+}
+
+uint64_t DriverClient::flushDeadline()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_ullBatchOpened)
+    {
+        return 0;
+    }
+    uint64_t ullWindowEnd = m_ullLastArrival + m_ullWindowUs;
+    uint64_t ullCap = m_ullBatchOpened + m_batching.ulLatencyCapUs;
+    return ullWindowEnd < ullCap ? ullWindowEnd : ullCap;
+}
+
+/**
+ * Decide whether the message just appended should be held rather than
+ * written, and adapt the batching window to the interval since the previous
+ * message.
+ */
+bool DriverClient::hold(uint64_t ullNow, bool fBoundary)
+{
+    uint64_t ullInterval = m_ullLastArrival ? ullNow - m_ullLastArrival : UINT64_MAX;
+    // A message which follows a pause is written at once, along with any
+    // messages held before the pause.
+    bool fBurst = ullInterval <= m_ullWindowUs;
+    m_ullLastArrival = ullNow;
+
+    uint64_t ullSample = ullInterval < m_batching.ulMaxWindowUs ? ullInterval : m_batching.ulMaxWindowUs;
+    m_ullIntervalEstimate = (3 * m_ullIntervalEstimate + ullSample) / 4;
+    m_ullWindowUs = BATCH_WINDOW_INTERVALS * m_ullIntervalEstimate;
+    if (m_ullWindowUs < m_batching.ulMinWindowUs)
+    {
+        m_ullWindowUs = m_batching.ulMinWindowUs;
+    }
+    if (m_ullWindowUs > m_batching.ulMaxWindowUs)
+    {
+        m_ullWindowUs = m_batching.ulMaxWindowUs;
+    }
+
+    if (!fBurst || fBoundary || m_pending.size() >= m_batching.cbMaxBatch ||
+        (m_ullBatchOpened && ullNow - m_ullBatchOpened >= m_batching.ulLatencyCapUs))
+    {
+        return false;
+    }
+
+    if (!m_ullBatchOpened)
+    {
+        m_ullBatchOpened = ullNow;
+    }
+    m_ullHeldInBatch += 1;
+    m_ullHeldArrivals += ullNow;
+    return true;
+}
+
+int DriverClient::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_fWriting)
+    {
+        return AT_DRIVER_CLIENT_COALESCED;
+    }
+
+    return drain(lock);
+}
+
+bool DriverClient::receive(std::string* pMessages, uint64_t* pullConnection)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (pullConnection)
+    {
+        *pullConnection = m_ullConnection;
+    }
+
+    // The connection is claimed as a writer would claim it, so that it is not
+    // closed or replaced while it is read.
+#ifdef _WIN32
+    bool fConnected = m_hConnection != INVALID_HANDLE_VALUE;
+#else
+    bool fConnected = m_fdConnection >= 0;
+#endif
+    if (m_fWriting || !fConnected)
+    {
+        return false;
+    }
+    m_fWriting = true;
+
+    lock.unlock();
+    bool fOpen = read(&m_received);
+    lock.lock();
+
+    size_t lastTerminator = m_received.rfind('\0');
+    bool fReceived = lastTerminator != std::string::npos;
+    if (fReceived)
+    {
+        pMessages->append(m_received, 0, lastTerminator + 1);
+        m_received.erase(0, lastTerminator + 1);
+    }
+    if (!fOpen)
+    {
+        // The remainder of an interrupted message is not resent.
+        m_received.clear();
+        closeConnection();
+        m_ullConnection = 0;
+        m_ullRetryAt = 0;
+    }
+
+    m_fWriting = false;
+    // Messages sent while the connection was claimed were left for this
+    // thread to write.
+    if (!m_pending.empty())
+    {
+        drain(lock);
+    }
+    return fReceived;
+}
+
+void DriverClient::disconnect()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // The connection belongs to the writing thread, if any.
+    if (!m_fWriting)
+    {
+        closeConnection();
+        m_ullConnection = 0;
+    }
+}
+
+DriverClientStatistics DriverClient::statistics()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+int DriverClient::drain(std::unique_lock<std::mutex>& lock)
+{
+    int result = AT_DRIVER_CLIENT_OK;
+    m_fWriting = true;
+
+    // Held messages are no longer held once a write is attempted (if the
+    // driver is unavailable, they remain buffered as any other message would).
+    if (m_ullBatchOpened)
+    {
+        uint64_t ullNow = nowMicroseconds();
+        uint64_t ullLongest = ullNow - m_ullBatchOpened;
+        m_statistics.ullHeld += m_ullHeldInBatch;
+        m_statistics.ullHeldMicroseconds += m_ullHeldInBatch * ullNow - m_ullHeldArrivals;
+        if (ullLongest > m_statistics.ullMaxHeldMicroseconds)
+        {
+            m_statistics.ullMaxHeldMicroseconds = ullLongest;
+        }
+        m_ullBatchOpened = 0;
+        m_ullHeldInBatch = 0;
+        m_ullHeldArrivals = 0;
+    }
+
+    while (!m_pending.empty())
+    {
+#ifdef _WIN32
+        bool fConnected = m_hConnection != INVALID_HANDLE_VALUE;
+#else
+        bool fConnected = m_fdConnection >= 0;
+#endif
+        if (!fConnected)
+        {
+            uint64_t ullNow = nowMilliseconds();
+            if (ullNow < m_ullRetryAt)
+            {
+                result = AT_DRIVER_CLIENT_QUEUED;
+                break;
+            }
+
+            lock.unlock();
+            fConnected = connect();
+            lock.lock();
+
+            if (!fConnected)
+            {
+                m_ullRetryAt = ullNow + m_ulBackoffMs;
+                m_ulBackoffMs = m_ulBackoffMs * 2 > MAXIMUM_BACKOFF_MS ? MAXIMUM_BACKOFF_MS : m_ulBackoffMs * 2;
+                result = AT_DRIVER_CLIENT_QUEUED;
+                break;
+            }
+
+            m_ulBackoffMs = INITIAL_BACKOFF_MS;
+            m_statistics.ullConnects += 1;
+            m_ullConnection = m_statistics.ullConnects;
+            // The driver begins each connection with an empty dictionary.
+            if (m_pDictionary)
+            {
+                m_pDictionary->reset();
+            }
+            m_received.clear();
+        }
+
+        m_writing.swap(m_pending);
+        m_spaceAvailable.notify_all();
+
+        lock.unlock();
+        uint64_t ullReferences = 0;
+        const std::string* pWire = &m_writing;
+        if (m_pDictionary)
+        {
+            m_coded.clear();
+            m_codedFrames.clear();
+            ullReferences = m_pDictionary->code(m_writing, &m_coded, &m_codedFrames);
+            pWire = &m_coded;
+        }
+        size_t cbWritten = 0;
+        bool fWritten = write(pWire->data(), pWire->size(), &cbWritten);
+        lock.lock();
+
+        m_statistics.ullWrites += 1;
+        m_statistics.ullBytesWritten += cbWritten;
+        m_statistics.ullReferences += fWritten ? ullReferences : 0;
+
+        if (!fWritten)
+        {
+            // The driver discards a message which is interrupted by the loss
+            // of its connection, so any message which was not written in its
+            // entirety is sent again in full (and coded afresh, since the
+            // dictionary does not outlive the connection).
+            size_t resendFrom = 0;
+            if (m_pDictionary)
+            {
+                for (size_t i = 0; i < m_codedFrames.size() && m_codedFrames[i].second <= cbWritten; i += 1)
+                {
+                    resendFrom = m_codedFrames[i].first;
+                }
+            }
+            else if (cbWritten > 0)
+            {
+                size_t lastTerminator = m_writing.rfind('\0', cbWritten - 1);
+                resendFrom = lastTerminator == std::string::npos ? 0 : lastTerminator + 1;
+            }
+            m_pending.insert(0, m_writing, resendFrom, std::string::npos);
+
+            closeConnection();
+            m_ullConnection = 0;
+
+            // A connection which was lost after accepting data is
+            // re-established immediately; one which accepted nothing is
+            // subject to the reconnection interval.
+            m_ullRetryAt = cbWritten > 0 ? 0 : nowMilliseconds() + m_ulBackoffMs;
+        }
+
+        m_writing.clear();
+    }
+
+    m_fWriting = false;
+    return result;
+}
+
+#ifdef _WIN32
+
+bool DriverClient::connect()
+{
+    int cchAddress = MultiByteToWideChar(CP_UTF8, 0, m_address.c_str(), -1, NULL, 0);
+    std::wstring wideAddress(cchAddress, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, m_address.c_str(), -1, &wideAddress[0], cchAddress);
+
+    HANDLE hConnection = CreateFileW(
+        wideAddress.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    m_hConnection = hConnection;
+
+    return hConnection != INVALID_HANDLE_VALUE;
+}
+
+bool DriverClient::write(const char* pData, size_t cbData, size_t* pcbWritten)
+{
+    while (*pcbWritten < cbData)
+    {
+        DWORD cbChunk = 0;
+        DWORD cbRequested = (DWORD)(cbData - *pcbWritten > 0x10000000 ? 0x10000000 : cbData - *pcbWritten);
+        if (!WriteFile((HANDLE)m_hConnection, pData + *pcbWritten, cbRequested, &cbChunk, NULL))
+        {
+            return false;
+        }
+        *pcbWritten += cbChunk;
+    }
+    return true;
+}
+
+bool DriverClient::read(std::string* pData)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        DWORD cbAvailable = 0;
+        if (!PeekNamedPipe((HANDLE)m_hConnection, NULL, 0, NULL, &cbAvailable, NULL))
+        {
+            return false;
+        }
+        if (!cbAvailable)
+        {
+            return true;
+        }
+        DWORD cbRead = 0;
+        if (!ReadFile((HANDLE)m_hConnection, buffer,
+            cbAvailable < sizeof(buffer) ? cbAvailable : (DWORD)sizeof(buffer), &cbRead, NULL))
+        {
+            return false;
+        }
+        pData->append(buffer, cbRead);
+    }
+}
+
+void DriverClient::closeConnection()
+{
+    if (m_hConnection != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle((HANDLE)m_hConnection);
+    }
+    m_hConnection = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool DriverClient::connect()
+{
+    sockaddr_un address = {};
+    if (m_address.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, m_address.c_str(), m_address.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+#ifdef SO_NOSIGPIPE
+    int enabled = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+
+    if (::connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    m_fdConnection = fd;
+    return true;
+}
+
+bool DriverClient::write(const char* pData, size_t cbData, size_t* pcbWritten)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    while (*pcbWritten < cbData)
+    {
+        ssize_t cbChunk = ::send(m_fdConnection, pData + *pcbWritten, cbData - *pcbWritten, flags);
+        if (cbChunk < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        *pcbWritten += (size_t)cbChunk;
+    }
+    return true;
+}
+
+bool DriverClient::read(std::string* pData)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        ssize_t cbChunk = ::recv(m_fdConnection, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (cbChunk > 0)
+        {
+            pData->append(buffer, (size_t)cbChunk);
+            continue;
+        }
+        if (cbChunk < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        // The driver closed the connection if nothing could be read.
+        return cbChunk < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+void DriverClient::closeConnection()
+{
+    if (m_fdConnection >= 0)
+    {
+        ::close(m_fdConnection);
+    }
+    m_fdConnection = -1;
+}
+
+#endif
+
+//--- C interface
+
+struct ATDriverClient
+{
+    explicit ATDriverClient(const char* address) : client(address) {}
+    DriverClient client;
+};
+
+extern "C" ATDriverClient* at_driver_client_create(const char* address)
+{
+    return new (std::nothrow) ATDriverClient(address);
+}
+
+extern "C" void at_driver_client_destroy(ATDriverClient* client)
+{
+    delete client;
+}
+
+extern "C" int at_driver_client_send(ATDriverClient* client, const char* name, const char* data, size_t length)
+{
+    return client->client.send(name, NULL, data, length);
+}
+
+extern "C" int at_driver_client_flush(ATDriverClient* client)
+{
+    return client->client.flush();
+}
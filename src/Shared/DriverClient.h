@@ -0,0 +1,245 @@
+#pragma once
+#include "ATDriverClient.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct DriverClientStatistics
+{
+    uint64_t ullMessages = 0;
+    uint64_t ullWrites = 0;
+    uint64_t ullConnects = 0;
+    uint64_t ullDropped = 0;
+
+    //--- Batching (see `DriverClientBatching`)
+    // Messages which were held in a batch rather than written at once.
+    uint64_t ullHeld = 0;
+    // Time for which those messages were held, summed and at most.
+    uint64_t ullHeldMicroseconds = 0;
+    uint64_t ullMaxHeldMicroseconds = 0;
+
+    //--- Dictionary coding (see `DriverClientDictionary`)
+    // Bytes written to the connection, after coding.
+    uint64_t ullBytesWritten = 0;
+    // Messages whose data was replaced by a reference to a dictionary entry.
+    uint64_t ullReferences = 0;
+
+    /**
+     * Describe the delivery of messages, e.g. "delivery messages=1200
+     * writes=85 dropped=0 held=1100 meanHold=310us maxHold=2000us
+     * bytes=41200 references=900".
+     */
+    std::string describe() const
+    {
+        char buffer[224];
+        snprintf(buffer, sizeof(buffer),
+            "delivery messages=%llu writes=%llu dropped=%llu held=%llu meanHold=%lluus maxHold=%lluus"
+            " bytes=%llu references=%llu",
+            (unsigned long long)ullMessages, (unsigned long long)ullWrites,
+            (unsigned long long)ullDropped, (unsigned long long)ullHeld,
+            (unsigned long long)(ullHeld ? ullHeldMicroseconds / ullHeld : 0),
+            (unsigned long long)ullMaxHeldMicroseconds,
+            (unsigned long long)ullBytesWritten, (unsigned long long)ullReferences);
+        return buffer;
+    }
+};
+
+/**
+ * Policy by which consecutive messages are gathered into a single write.
+ *
+ * A message which follows a pause (longer than the current window) is written
+ * at once, so isolated announcements are not delayed. During a burst of
+ * messages, each is held until the burst ends (no message arrives within the
+ * window), the batch reaches `cbMaxBatch` bytes, a boundary message is sent
+ * or the oldest message has been held for `ulLatencyCapUs`. The window is a
+ * multiple of the recent interval between messages, between `ulMinWindowUs`
+ * and `ulMaxWindowUs`.
+ *
+ * The client has no thread of its own, so the sender is responsible for
+ * calling `flush` at `flushDeadline()` when `send` reports that a message was
+ * held.
+ */
+struct DriverClientBatching
+{
+    // Zero disables batching.
+    size_t   cbMaxBatch = 0;
+    uint32_t ulMinWindowUs = 0;
+    uint32_t ulMaxWindowUs = 0;
+    uint32_t ulLatencyCapUs = 0;
+};
+
+/**
+ * Dictionary by which the data of repeated speech is sent only once per
+ * connection.
+ *
+ * The first time speech of between `cbMinEntry` and `cbMaxEntry` bytes is
+ * written on a connection, it is assigned an entry (an id below `ulEntries`)
+ * and sent with a `def=<id>` attribute. Subsequent messages with the same data
+ * are sent with a `ref=<id>` attribute and no data. Once every entry is in
+ * use, a definition replaces the least recently used entry; the driver
+ * replaces whichever entry each definition names, so the two dictionaries
+ * always agree without the driver implementing an eviction policy of its own.
+ * Both dictionaries are discarded when the connection closes.
+ */
+struct DriverClientDictionary
+{
+    // Zero disables the dictionary.
+    uint32_t ulEntries = 0;
+    size_t   cbMinEntry = 0;
+    size_t   cbMaxEntry = 0;
+};
+
+class MessageDictionary;
+
+/**
+ * Delivers messages to the driver over a persistent connection. This is used
+ * by every component which reports to the driver so that they share a single
+ * implementation of the protocol.
+ *
+ * Each message takes the form `<name>[ <attribute>=<value>]*:<data>` and is
+ * terminated by a null byte (any null bytes within the data are replaced with
+ * U+FFFD).
+ *
+ * Messages are appended to a bounded buffer. The calling thread then writes
+ * the buffer's contents to the connection unless another thread is already
+ * doing so, in which case that thread writes the message once its current
+ * write completes. Messages sent concurrently are therefore coalesced into
+ * a single write without the cost of a dedicated writer thread (which could
+ * not be safely stopped while the engine's module is unloading).
+ *
+ * When the buffer is full, the sender waits briefly for a concurrent write to
+ * make space, after which the message is dropped. When the driver cannot be
+ * reached, messages remain buffered and connection attempts are made on
+ * subsequent calls, no more often than an exponentially increasing interval
+ * allows.
+ *
+ * Messages sent in quick succession from one thread may also be gathered into
+ * batches (see `setBatching`).
+ */
+class DriverClient
+{
+public:
+    static const size_t DEFAULT_BUFFER_CAPACITY = 1 << 20;
+    static const uint32_t INITIAL_BACKOFF_MS = 10;
+    static const uint32_t MAXIMUM_BACKOFF_MS = 2000;
+    // Longest time for which `send` waits for space in a full buffer.
+    static const uint32_t BACKPRESSURE_TIMEOUT_MS = 50;
+    // Ratio of the batching window to the recent interval between messages.
+    static const uint32_t BATCH_WINDOW_INTERVALS = 2;
+
+    explicit DriverClient(const char* pAddress, size_t cbBufferCapacity = DEFAULT_BUFFER_CAPACITY);
+    ~DriverClient();
+
+    DriverClient(const DriverClient&) = delete;
+    DriverClient& operator=(const DriverClient&) = delete;
+
+    /**
+     * @param {const char*} pName - message name, e.g. "speech"
+     * @param {const char*} pAttributes - space-separated `key=value` pairs,
+     *                                    or NULL
+     * @param {bool} fBoundary - whether the message ends a batch, because the
+     *                           driver may be waiting for it
+     *
+     * @returns {int} one of the AT_DRIVER_CLIENT_ status codes
+     */
+    int send(const char* pName, const char* pAttributes, const char* pData, size_t cbData,
+        bool fBoundary = false);
+
+    void setBatching(const DriverClientBatching& batching);
+
+    /** Must be called before the first message is sent. */
+    void setDictionary(const DriverClientDictionary& dictionary);
+
+    /**
+     * @returns {uint64_t} the time (in microseconds since the epoch of
+     *                     `std::chrono::steady_clock`) by which the messages
+     *                     being held must be written, or zero if none are
+     *                     held
+     */
+    uint64_t flushDeadline();
+
+    /**
+     * Attempt to write any buffered messages (subject to the reconnection
+     * interval).
+     */
+    int flush();
+
+    /**
+     * Read whatever the driver has sent on the connection without waiting for
+     * more. The driver sends messages in the same form as the client does.
+     * Nothing is read while the connection is absent or another thread is
+     * writing; the caller is expected to poll.
+     *
+     * @param {std::string*} pMessages - receives each complete message, with
+     *                                   its terminator
+     * @param {uint64_t*} pullConnection - if not NULL, receives the number of
+     *                                     the connection on which messages
+     *                                     are received (the first which the
+     *                                     client establishes is 1), or zero
+     *                                     if there is none. A driver which
+     *                                     restarts is reached on a new
+     *                                     connection.
+     *
+     * @returns {bool} whether any message was received
+     */
+    bool receive(std::string* pMessages, uint64_t* pullConnection = NULL);
+
+    /** Close the connection; buffered messages are retained. */
+    void disconnect();
+
+    DriverClientStatistics statistics();
+
+private:
+    int drain(std::unique_lock<std::mutex>& lock);
+    bool hold(uint64_t ullNow, bool fBoundary);
+
+    //--- Transport (implemented per platform)
+    bool connect();
+    bool write(const char* pData, size_t cbData, size_t* pcbWritten);
+    // Appends to `*pData` without waiting; false if the connection was lost.
+    bool read(std::string* pData);
+    void closeConnection();
+
+    std::string m_address;
+    size_t      m_cbBufferCapacity;
+
+    std::mutex  m_mutex;
+    std::condition_variable m_spaceAvailable;
+    std::string m_pending;
+    std::string m_writing;
+    bool        m_fWriting;
+    uint64_t    m_ullRetryAt;
+    uint32_t    m_ulBackoffMs;
+    // Number of the current connection, or zero.
+    uint64_t    m_ullConnection;
+    DriverClientStatistics m_statistics;
+
+    //--- Batching
+    DriverClientBatching m_batching;
+    uint64_t    m_ullLastArrival;
+    uint64_t    m_ullIntervalEstimate;
+    uint64_t    m_ullWindowUs;
+    // Arrival of the oldest message held, or zero.
+    uint64_t    m_ullBatchOpened;
+    uint64_t    m_ullHeldInBatch;
+    uint64_t    m_ullHeldArrivals;
+
+    // Owned by the thread which is writing (`m_fWriting`).
+#ifdef _WIN32
+    void*       m_hConnection;
+#else
+    int         m_fdConnection;
+#endif
+    std::unique_ptr<MessageDictionary> m_pDictionary;
+    std::string m_coded;
+    // The end of each message in `m_writing` and in `m_coded`.
+    std::vector<std::pair<size_t, size_t>> m_codedFrames;
+    // Data received from the driver which does not yet form a message.
+    std::string m_received;
+};
@@ -2,4 +2,5 @@
 #define AUTOMATION_VOICE_ID "BocoupAutomationVoice"
 #define AUTOMATION_VOICE_NAME "Bocoup Automation Voice"
 #define AUTOMATION_VOICE_VENDOR "Bocoup"
-#define AUTOMATION_VOICE_HOME "C:\\Program Files\\Bocoup Automation Voice"
\ No newline at end of file
+#define AUTOMATION_VOICE_HOME "C:\\Program Files\\Bocoup Automation Voice"
+#define AUTOMATION_VOICE_DATA "C:\\ProgramData\\Bocoup Automation Voice"
\ No newline at end of file
@@ -3,27 +3,39 @@
 #include <cstdlib>
 
 using namespace System;
+using namespace System::IO;
+using namespace System::Speech::AudioFormat;
 using namespace System::Speech::Synthesis;
 
+// Maximum number of bytes in a chunk of text, per `TEXT_CHUNK_SIZE` in the
+// engine's TextStream.h.
+static const int TEXT_CHUNK_SIZE = 4096;
+
 /**
- * A process which vocalizes text data supplied as input via the environment
- * variable named "WORDS". Although the process's command-line arguments are
- * the more traditional method for providing input, the use of an environment
- * variable circumvents the character escaping concerns that are typical for
- * Windows processes.
+ * A process which vocalizes text data supplied via its standard input stream.
+ * The text is a sequence of UTF-8 chunks, each terminated by a null
+ * character, which are spoken in turn as they arrive until the stream ends.
+ * Reading a chunk at a time bounds the memory used regardless of the length
+ * of the text, and avoids the character escaping concerns that are typical
+ * for Windows command-line arguments.
  * https://docs.microsoft.com/en-us/archive/blogs/twistylittlepassagesallalike/everyone-quotes-command-line-arguments-the-wrong-way
+ *
+ * For use during installation, text may instead be supplied via the
+ * environment variable named "WORDS", in which case the input stream is not
+ * read.
+ *
+ * When the argument "--stdout" is given, the audio is written to the standard
+ * output stream (in the format which the Automation Voice reports to the
+ * Speech API) instead of being played, so that the voice can deliver it to its
+ * output site. Diagnostic messages are then written to the standard error
+ * stream.
  */
 int main(array<System::String^>^ args)
 {
+    bool render = args->Length > 0 && args[0] == "--stdout";
+    TextWriter^ log = render ? Console::Error : Console::Out;
+
     char* words = getenv("WORDS");
-    if (words == NULL)
-    {
-        Console::WriteLine(
-            "Expected the environment variable WORDS to be set, but it was not set."
-        );
-        return 1;
-    }
-    Console::WriteLine(gcnew System::String(words));
     SpeechSynthesizer speaker;
     speaker.Rate = 1;
     speaker.Volume = 100;
@@ -50,12 +62,57 @@ int main(array<System::String^>^ args)
         }
         if (speaker.Voice->Name == AUTOMATION_VOICE_NAME)
         {
-            Console::WriteLine("Unable to locate an authentic voice.");
+            log->WriteLine("Unable to locate an authentic voice.");
             return 1;
         }
     }
 
-    speaker.Speak(gcnew System::String(words));
+    if (render)
+    {
+        speaker.SetOutputToAudioStream(
+            Console::OpenStandardOutput(),
+            gcnew SpeechAudioFormatInfo(11025, AudioBitsPerSample::Sixteen, AudioChannel::Mono)
+        );
+    }
+
+    if (words != NULL)
+    {
+        log->WriteLine(gcnew System::String(words));
+        speaker.Speak(gcnew System::String(words));
+        return 0;
+    }
+
+    Stream^ input = gcnew BufferedStream(Console::OpenStandardInput(), TEXT_CHUNK_SIZE);
+    array<Byte>^ chunk = gcnew array<Byte>(TEXT_CHUNK_SIZE);
+    int cbChunk = 0;
+    for (;;)
+    {
+        int value = input->ReadByte();
+
+        // A chunk which exceeds the maximum size (which the engine does not
+        // produce) is spoken in parts.
+        if (value == -1 || value == 0 || cbChunk == chunk->Length)
+        {
+            if (cbChunk > 0)
+            {
+                System::String^ text = Text::Encoding::UTF8->GetString(chunk, 0, cbChunk);
+                log->WriteLine(text);
+                speaker.Speak(text);
+                cbChunk = 0;
+            }
+            if (value == -1)
+            {
+                break;
+            }
+            if (value == 0)
+            {
+                continue;
+            }
+        }
+
+        chunk[cbChunk] = (Byte)value;
+        cbChunk += 1;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+/**
+ * Replaces the global `operator new` and `operator delete` so that the
+ * allocations made by the module into which this file is linked (including
+ * those made by the standard library on its behalf) are reported to
+ * `ResourceCounters`. Each block is preceded by a header which records its
+ * size, so that the bytes freed are known to `operator delete`.
+ *
+ * `operator new` throws `std::bad_alloc` when memory is exhausted, on every
+ * platform, since the standard containers which the engine uses rely on it
+ * (the engine previously linked `nothrownew.obj`, with which it returns NULL).
+ * Allocations which can fail without an exception use `new (std::nothrow)`.
+ * Over-aligned allocations are not replaced, and are not counted.
+ */
+#include "ResourceCounters.h"
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// A multiple of the alignment of every fundamental type, so that the block
+// which follows the header is as aligned as `malloc` would align it.
+static const size_t HEADER_SIZE =
+    alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+static void* allocate(size_t cbSize) noexcept
+{
+    char* p = static_cast<char*>(malloc(HEADER_SIZE + cbSize));
+    if (!p)
+    {
+        return NULL;
+    }
+    *reinterpret_cast<size_t*>(p) = cbSize;
+    ResourceCounters::allocated(cbSize);
+    return p + HEADER_SIZE;
+}
+
+static void release(void* pBlock) noexcept
+{
+    if (!pBlock)
+    {
+        return;
+    }
+    char* p = static_cast<char*>(pBlock) - HEADER_SIZE;
+    ResourceCounters::freed(*reinterpret_cast<size_t*>(p));
+    free(p);
+}
+
+void* operator new(size_t cbSize)
+{
+    void* p = allocate(cbSize);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t cbSize)
+{
+    return operator new(cbSize);
+}
+
+void* operator new(size_t cbSize, const std::nothrow_t&) noexcept
+{
+    return allocate(cbSize);
+}
+
+void* operator new[](size_t cbSize, const std::nothrow_t&) noexcept
+{
+    return allocate(cbSize);
+}
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
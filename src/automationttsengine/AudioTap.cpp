@@ -0,0 +1,369 @@
+#include "AudioTap.h"
+#include "CaptureJournal.h"
+#include "FileFormat.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The header's counters are accessed as lock-free atomics so that writers in
+// different processes may update them concurrently.
+static const char TAP_MAGIC[4] = { 'A', 'T', 'A', 'P' };
+
+static const size_t OFFSET_MAGIC = 0;
+static const size_t OFFSET_VERSION = 4;
+static const size_t OFFSET_CAPACITY = 8;
+static const size_t OFFSET_RESERVE_OFFSET = 16;
+static const size_t OFFSET_READ_OFFSET = 24;
+static const size_t OFFSET_DROPPED_BYTES = 32;
+static const size_t OFFSET_ENABLED = 40;
+static const size_t OFFSET_SAMPLES_PER_SEC = 44;
+static const size_t OFFSET_BITS_PER_SAMPLE = 48;
+static const size_t OFFSET_CHANNELS = 50;
+
+static const size_t RECORD_OFFSET_COMMIT = 0;
+static const size_t RECORD_OFFSET_LENGTH = 8;
+static const size_t RECORD_OFFSET_UTTERANCE_ID = 16;
+static const size_t RECORD_OFFSET_STREAM_OFFSET = 24;
+static const size_t RECORD_OFFSET_TIMESTAMP = 32;
+
+static const uint64_t RECORD_ALIGNMENT = 16;
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8 && sizeof(std::atomic<uint32_t>) == 4,
+    "atomics in the shared header have the size of the values they hold");
+
+static uint64_t alignRecord(uint64_t cb)
+{
+    return (cb + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+AudioTap::AudioTap()
+    : m_pView(NULL), m_cbView(0), m_cbCapacity(0), m_pEnabled(NULL)
+#ifdef _WIN32
+    , m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+AudioTap::~AudioTap()
+{
+    close();
+}
+
+HRESULT AudioTap::open(const char* path, uint64_t cbCapacity, uint32_t ulSamplesPerSec, uint16_t usBitsPerSample,
+    uint16_t usChannels)
+{
+    close();
+
+    if (cbCapacity < 4 * (RECORD_HEADER_SIZE + RECORD_ALIGNMENT))
+    {
+        return E_INVALIDARG;
+    }
+
+    cbCapacity = alignRecord(cbCapacity);
+    size_t cbView = HEADER_SIZE + (size_t)cbCapacity;
+    bool fExisting = false;
+
+#ifdef _WIN32
+    int cchPath = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+    std::wstring widePath(cchPath, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], cchPath);
+
+    // Initialization by each process which has loaded the engine is
+    // serialized by a mutex whose name is derived from the tap's location.
+    wchar_t lockName[64];
+    swprintf(lockName, 64, L"Local\\AutomationVoiceAudioTap%08x", pathHash(path));
+    HANDLE hLock = CreateMutexW(NULL, FALSE, lockName);
+    DWORD lockResult = hLock ? WaitForSingleObject(hLock, INFINITE) : WAIT_FAILED;
+    if (lockResult != WAIT_OBJECT_0 && lockResult != WAIT_ABANDONED)
+    {
+        if (hLock)
+        {
+            CloseHandle(hLock);
+        }
+        return E_HANDLE;
+    }
+
+    m_hFile = CreateFileW(
+        widePath.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER size;
+        fExisting = GetFileSizeEx(m_hFile, &size) && (uint64_t)size.QuadPart == cbView;
+
+        m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READWRITE,
+            (DWORD)((uint64_t)cbView >> 32), (DWORD)(cbView & 0xFFFFFFFF), NULL);
+    }
+    if (m_hMapping)
+    {
+        m_pView = (uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, cbView);
+    }
+#else
+    m_fd = ::open(path, O_RDWR | O_CREAT, 0666);
+    if (m_fd < 0)
+    {
+        return E_HANDLE;
+    }
+    if (flock(m_fd, LOCK_EX) != 0)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    struct stat status;
+    fExisting = fstat(m_fd, &status) == 0 && (uint64_t)status.st_size == cbView;
+
+    if (fExisting || ftruncate(m_fd, (off_t)cbView) == 0)
+    {
+        void* pView = mmap(NULL, cbView, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        m_pView = pView == MAP_FAILED ? NULL : (uint8_t*)pView;
+    }
+#endif
+
+    if (m_pView)
+    {
+        m_cbView = cbView;
+        m_cbCapacity = cbCapacity;
+
+        uint32_t ulVersion;
+        uint32_t ulExistingSamplesPerSec;
+        uint16_t usExistingBitsPerSample;
+        uint16_t usExistingChannels;
+        memcpy(&ulVersion, m_pView + OFFSET_VERSION, sizeof(ulVersion));
+        memcpy(&ulExistingSamplesPerSec, m_pView + OFFSET_SAMPLES_PER_SEC, sizeof(ulExistingSamplesPerSec));
+        memcpy(&usExistingBitsPerSample, m_pView + OFFSET_BITS_PER_SAMPLE, sizeof(usExistingBitsPerSample));
+        memcpy(&usExistingChannels, m_pView + OFFSET_CHANNELS, sizeof(usExistingChannels));
+
+        if (!fExisting ||
+            memcmp(m_pView + OFFSET_MAGIC, TAP_MAGIC, sizeof(TAP_MAGIC)) != 0 ||
+            ulVersion != VERSION ||
+            field(OFFSET_CAPACITY).load() != cbCapacity ||
+            ulExistingSamplesPerSec != ulSamplesPerSec ||
+            usExistingBitsPerSample != usBitsPerSample ||
+            usExistingChannels != usChannels)
+        {
+            uint32_t ulNewVersion = VERSION;
+            memset(m_pView, 0, HEADER_SIZE);
+            // Stale records must not appear to be published.
+            memset(m_pView + HEADER_SIZE, 0xFF, (size_t)cbCapacity);
+            field(OFFSET_CAPACITY).store(cbCapacity);
+            memcpy(m_pView + OFFSET_SAMPLES_PER_SEC, &ulSamplesPerSec, sizeof(ulSamplesPerSec));
+            memcpy(m_pView + OFFSET_BITS_PER_SAMPLE, &usBitsPerSample, sizeof(usBitsPerSample));
+            memcpy(m_pView + OFFSET_CHANNELS, &usChannels, sizeof(usChannels));
+            memcpy(m_pView + OFFSET_VERSION, &ulNewVersion, sizeof(ulNewVersion));
+            // The magic value is written last so that a tap whose
+            // initialization was interrupted is recognized as invalid.
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(m_pView + OFFSET_MAGIC, TAP_MAGIC, sizeof(TAP_MAGIC));
+        }
+
+        m_pEnabled = reinterpret_cast<std::atomic<uint32_t>*>(m_pView + OFFSET_ENABLED);
+    }
+
+#ifdef _WIN32
+    ReleaseMutex(hLock);
+    CloseHandle(hLock);
+#else
+    flock(m_fd, LOCK_UN);
+#endif
+
+    if (!m_pView)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+void AudioTap::close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+    }
+    m_hMapping = NULL;
+    m_hFile = INVALID_HANDLE_VALUE;
+#else
+    if (m_pView)
+    {
+        munmap(m_pView, m_cbView);
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+#endif
+    m_pView = NULL;
+    m_cbView = 0;
+    m_pEnabled = NULL;
+}
+
+std::atomic<uint64_t>& AudioTap::field(size_t offset) const
+{
+    return *reinterpret_cast<std::atomic<uint64_t>*>(m_pView + offset);
+}
+
+uint8_t* AudioTap::dataAt(uint64_t ullOffset) const
+{
+    return m_pView + HEADER_SIZE + (size_t)(ullOffset % m_cbCapacity);
+}
+
+HRESULT AudioTap::write(uint64_t ullUtteranceId, uint64_t ullStreamOffset, const void* pSamples, size_t cbSamples)
+{
+    if (!isEnabled())
+    {
+        return S_FALSE;
+    }
+
+    const uint8_t* p = static_cast<const uint8_t*>(pSamples);
+    size_t cbMaximum = (size_t)(m_cbCapacity / 4) - RECORD_HEADER_SIZE;
+    uint64_t ullTimestamp = CaptureJournal::now();
+    HRESULT hr = S_OK;
+
+    while (cbSamples > 0)
+    {
+        size_t cbRecord = cbSamples < cbMaximum ? cbSamples : cbMaximum;
+        if (writeRecord(ullUtteranceId, ullStreamOffset, ullTimestamp, p, cbRecord) != S_OK)
+        {
+            hr = S_FALSE;
+        }
+        p += cbRecord;
+        cbSamples -= cbRecord;
+        ullStreamOffset += cbRecord;
+    }
+
+    return hr;
+}
+
+HRESULT AudioTap::writeRecord(uint64_t ullUtteranceId, uint64_t ullStreamOffset, uint64_t ullTimestamp,
+    const uint8_t* pSamples, size_t cbSamples)
+{
+    std::atomic<uint64_t>& reserveOffset = field(OFFSET_RESERVE_OFFSET);
+    uint64_t cbRecord = alignRecord(RECORD_HEADER_SIZE + cbSamples);
+    uint64_t ullOffset = reserveOffset.load(std::memory_order_acquire);
+    uint64_t cbPadding;
+
+    for (;;)
+    {
+        uint64_t cbRemaining = m_cbCapacity - ullOffset % m_cbCapacity;
+        cbPadding = cbRemaining < cbRecord ? cbRemaining : 0;
+        uint64_t ullRead = field(OFFSET_READ_OFFSET).load(std::memory_order_acquire);
+
+        if (ullOffset + cbPadding + cbRecord - ullRead > m_cbCapacity)
+        {
+            field(OFFSET_DROPPED_BYTES).fetch_add(cbSamples, std::memory_order_relaxed);
+            return S_FALSE;
+        }
+        if (reserveOffset.compare_exchange_weak(ullOffset, ullOffset + cbPadding + cbRecord,
+            std::memory_order_acq_rel))
+        {
+            break;
+        }
+    }
+
+    if (cbPadding)
+    {
+        uint8_t* pPadding = dataAt(ullOffset);
+        uint32_t ulLength = PADDING_LENGTH;
+        memcpy(pPadding + RECORD_OFFSET_LENGTH, &ulLength, sizeof(ulLength));
+        reinterpret_cast<std::atomic<uint64_t>*>(pPadding + RECORD_OFFSET_COMMIT)->store(
+            ullOffset + 1, std::memory_order_release);
+        ullOffset += cbPadding;
+    }
+
+    uint8_t* pRecord = dataAt(ullOffset);
+    uint32_t ulLength = (uint32_t)cbSamples;
+    memcpy(pRecord + RECORD_OFFSET_LENGTH, &ulLength, sizeof(ulLength));
+    memcpy(pRecord + RECORD_OFFSET_UTTERANCE_ID, &ullUtteranceId, sizeof(ullUtteranceId));
+    memcpy(pRecord + RECORD_OFFSET_STREAM_OFFSET, &ullStreamOffset, sizeof(ullStreamOffset));
+    memcpy(pRecord + RECORD_OFFSET_TIMESTAMP, &ullTimestamp, sizeof(ullTimestamp));
+    memcpy(pRecord + RECORD_HEADER_SIZE, pSamples, cbSamples);
+    reinterpret_cast<std::atomic<uint64_t>*>(pRecord + RECORD_OFFSET_COMMIT)->store(
+        ullOffset + 1, std::memory_order_release);
+
+    return S_OK;
+}
+
+void AudioTap::setEnabled(bool fEnabled)
+{
+    if (m_pEnabled)
+    {
+        m_pEnabled->store(fEnabled ? 1 : 0);
+    }
+}
+
+bool AudioTap::read(Record* pRecord)
+{
+    if (!m_pView)
+    {
+        return false;
+    }
+
+    std::atomic<uint64_t>& readOffset = field(OFFSET_READ_OFFSET);
+    uint64_t ullOffset = readOffset.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+        uint8_t* p = dataAt(ullOffset);
+        uint64_t ullCommit = reinterpret_cast<std::atomic<uint64_t>*>(p + RECORD_OFFSET_COMMIT)->load(
+            std::memory_order_acquire);
+        if (ullCommit != ullOffset + 1)
+        {
+            return false;
+        }
+
+        uint32_t ulLength;
+        memcpy(&ulLength, p + RECORD_OFFSET_LENGTH, sizeof(ulLength));
+        if (ulLength == PADDING_LENGTH)
+        {
+            ullOffset += m_cbCapacity - ullOffset % m_cbCapacity;
+            readOffset.store(ullOffset, std::memory_order_release);
+            continue;
+        }
+        if (ulLength > m_cbCapacity / 4)
+        {
+            return false;
+        }
+
+        memcpy(&pRecord->ullUtteranceId, p + RECORD_OFFSET_UTTERANCE_ID, sizeof(pRecord->ullUtteranceId));
+        memcpy(&pRecord->ullStreamOffset, p + RECORD_OFFSET_STREAM_OFFSET, sizeof(pRecord->ullStreamOffset));
+        memcpy(&pRecord->ullTimestamp, p + RECORD_OFFSET_TIMESTAMP, sizeof(pRecord->ullTimestamp));
+        pRecord->samples.assign(p + RECORD_HEADER_SIZE, p + RECORD_HEADER_SIZE + ulLength);
+
+        // The space is released to writers only once the record is copied.
+        readOffset.store(ullOffset + alignRecord(RECORD_HEADER_SIZE + ulLength), std::memory_order_release);
+        return true;
+    }
+}
+
+uint64_t AudioTap::droppedBytes() const
+{
+    return m_pView ? field(OFFSET_DROPPED_BYTES).load(std::memory_order_relaxed) : 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "Portable.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A memory-mapped ring through which the engine mirrors the audio it writes
+ * to its output site, so that the driver can capture the speech which was
+ * actually produced. Every process which has loaded the engine writes to the
+ * same ring, and the driver drains it.
+ *
+ * Writers never wait: space is reserved with a compare-and-swap on the
+ * reservation offset, and audio which does not fit (because the driver has
+ * fallen behind) is dropped and counted. The driver enables the tap only
+ * while a client is capturing audio; otherwise a write costs one load.
+ *
+ * File layout (all integers little-endian):
+ *
+ *     header (64 bytes)
+ *       0  magic "ATAP"          32 droppedBytes
+ *       4  version               40 enabled (4 bytes, written by driver)
+ *       8  capacity              44 samplesPerSec (4 bytes)
+ *       16 reserveOffset         48 bitsPerSample (2 bytes)
+ *       24 readOffset (written   50 channels (2 bytes)
+ *          by driver)            52 reserved
+ *     data (capacity bytes, treated as a ring)
+ *       commit (8), length (4), reserved (4), utteranceId (8),
+ *       streamOffset (8), timestamp (8), reserved (8), samples
+ *
+ * Offsets are logical (monotonically increasing); the physical position is
+ * the offset modulo the capacity. Records are 16-byte aligned and never
+ * straddle the end of the ring: a record whose length is `PADDING_LENGTH`
+ * marks the remainder of the ring as unused. A record is published by
+ * storing its logical offset plus one to `commit` after the rest of it has
+ * been written, so a reader which finds any other value there (including one
+ * left by a previous pass around the ring) has caught up with the writers.
+ * `streamOffset` is the position of the samples within the utterance, in
+ * bytes, and timestamps are microseconds since the Unix epoch.
+ */
+class AudioTap
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 64;
+    static const size_t RECORD_HEADER_SIZE = 48;
+    static const uint32_t PADDING_LENGTH = 0xFFFFFFFF;
+
+    struct Record
+    {
+        uint64_t ullUtteranceId;
+        uint64_t ullStreamOffset;
+        uint64_t ullTimestamp;
+        std::vector<uint8_t> samples;
+    };
+
+    AudioTap();
+    ~AudioTap();
+
+    AudioTap(const AudioTap&) = delete;
+    AudioTap& operator=(const AudioTap&) = delete;
+
+    /**
+     * Open the tap at the given location, creating it if necessary. An
+     * existing tap with a different capacity or format is discarded.
+     *
+     * @param {const char*} path - UTF-8 encoded file system path
+     * @param {uint64_t} cbCapacity - bytes reserved for records
+     */
+    HRESULT open(const char* path, uint64_t cbCapacity, uint32_t ulSamplesPerSec, uint16_t usBitsPerSample,
+        uint16_t usChannels);
+    void close();
+    bool isOpen() const { return m_pView != NULL; }
+
+    bool isEnabled() const
+    {
+        return m_pEnabled && m_pEnabled->load(std::memory_order_relaxed) != 0;
+    }
+
+    /**
+     * Mirror audio into the ring if the tap is enabled. Audio larger than a
+     * quarter of the capacity is divided between several records.
+     *
+     * @returns {HRESULT} S_FALSE if the tap is disabled or some of the audio
+     *                    was dropped for want of space
+     */
+    HRESULT write(uint64_t ullUtteranceId, uint64_t ullStreamOffset, const void* pSamples, size_t cbSamples);
+
+    //--- The driver's side of the ring, for use by tests and benchmarks.
+
+    void setEnabled(bool fEnabled);
+
+    /**
+     * Take the oldest published record.
+     *
+     * @returns {bool} false if there is none
+     */
+    bool read(Record* pRecord);
+
+    uint64_t droppedBytes() const;
+
+private:
+    HRESULT writeRecord(uint64_t ullUtteranceId, uint64_t ullStreamOffset, uint64_t ullTimestamp,
+        const uint8_t* pSamples, size_t cbSamples);
+    std::atomic<uint64_t>& field(size_t offset) const;
+    uint8_t* dataAt(uint64_t ullOffset) const;
+
+    uint8_t*               m_pView;
+    size_t                 m_cbView;
+    uint64_t               m_cbCapacity;
+    std::atomic<uint32_t>* m_pEnabled;
+#ifdef _WIN32
+    HANDLE                 m_hFile;
+    HANDLE                 m_hMapping;
+#else
+    int                    m_fd;
+#endif
+};
@@ -0,0 +1,406 @@
+#include "CaptureJournal.h"
+#include "FileFormat.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char JOURNAL_MAGIC[4] = { 'A', 'T', 'D', 'J' };
+
+static const size_t OFFSET_MAGIC = 0;
+static const size_t OFFSET_VERSION = 4;
+static const size_t OFFSET_DATA_CAPACITY = 8;
+static const size_t OFFSET_INDEX_CAPACITY = 16;
+static const size_t OFFSET_FIRST_SEQUENCE = 24;
+static const size_t OFFSET_NEXT_SEQUENCE = 32;
+static const size_t OFFSET_ACKNOWLEDGED_SEQUENCE = 40;
+static const size_t OFFSET_WRITE_OFFSET = 48;
+
+static uint64_t load64(const uint8_t* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return value;
+}
+
+static void store64(uint8_t* p, uint64_t value)
+{
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(p, &value, sizeof(value));
+}
+
+static uint32_t checksum(uint64_t ullSequence, uint64_t ullTimestamp, const uint8_t* pData, size_t cbData)
+{
+    uint32_t hash = fnv1a(FNV1A_OFFSET_BASIS, &ullSequence, sizeof(ullSequence));
+    hash = fnv1a(hash, &ullTimestamp, sizeof(ullTimestamp));
+    return fnv1a(hash, pData, cbData);
+}
+
+CaptureJournal::CaptureJournal()
+    : m_pView(NULL), m_cbView(0), m_cbDataCapacity(0), m_ulIndexCapacity(0)
+#ifdef _WIN32
+    , m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL), m_hLock(NULL)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+CaptureJournal::~CaptureJournal()
+{
+    close();
+}
+
+uint64_t CaptureJournal::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+HRESULT CaptureJournal::open(const char* path, uint64_t cbDataCapacity, uint32_t ulIndexCapacity)
+{
+    close();
+
+    if (cbDataCapacity < 1024 || ulIndexCapacity == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Records are 8-byte aligned within the data region.
+    cbDataCapacity = (cbDataCapacity + 7) & ~(uint64_t)7;
+    size_t cbView = HEADER_SIZE + (size_t)ulIndexCapacity * INDEX_ENTRY_SIZE + (size_t)cbDataCapacity;
+    bool fExisting = false;
+
+#ifdef _WIN32
+    int cchPath = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+    std::wstring widePath(cchPath, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], cchPath);
+
+    // Appends from every process which has loaded the engine are serialized
+    // by a mutex whose name is derived from the journal's location.
+    wchar_t lockName[64];
+    swprintf(lockName, 64, L"Local\\AutomationVoiceJournal%08x", pathHash(path));
+    m_hLock = CreateMutexW(NULL, FALSE, lockName);
+
+    m_hFile = CreateFileW(
+        widePath.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    if (m_hFile == INVALID_HANDLE_VALUE || m_hLock == NULL)
+    {
+        close();
+        return E_HANDLE;
+    }
+
+    LARGE_INTEGER size;
+    fExisting = GetFileSizeEx(m_hFile, &size) && (uint64_t)size.QuadPart == cbView;
+
+    m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READWRITE,
+        (DWORD)((uint64_t)cbView >> 32), (DWORD)(cbView & 0xFFFFFFFF), NULL);
+    if (m_hMapping == NULL)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    m_pView = (uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, cbView);
+#else
+    m_fd = ::open(path, O_RDWR | O_CREAT, 0666);
+    if (m_fd < 0)
+    {
+        return E_HANDLE;
+    }
+
+    struct stat status;
+    fExisting = fstat(m_fd, &status) == 0 && (uint64_t)status.st_size == cbView;
+
+    if (!fExisting && ftruncate(m_fd, (off_t)cbView) != 0)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    void* pView = mmap(NULL, cbView, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    m_pView = pView == MAP_FAILED ? NULL : (uint8_t*)pView;
+#endif
+
+    if (m_pView == NULL)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    m_cbView = cbView;
+    m_cbDataCapacity = cbDataCapacity;
+    m_ulIndexCapacity = ulIndexCapacity;
+
+    if (!lock())
+    {
+        close();
+        return E_FAIL;
+    }
+
+    uint32_t ulVersion;
+    memcpy(&ulVersion, m_pView + OFFSET_VERSION, sizeof(ulVersion));
+
+    if (!fExisting ||
+        memcmp(m_pView + OFFSET_MAGIC, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        ulVersion != VERSION ||
+        load64(m_pView + OFFSET_DATA_CAPACITY) != cbDataCapacity ||
+        load64(m_pView + OFFSET_INDEX_CAPACITY) != ulIndexCapacity)
+    {
+        uint32_t ulNewVersion = VERSION;
+        memset(m_pView, 0, HEADER_SIZE);
+        store64(m_pView + OFFSET_DATA_CAPACITY, cbDataCapacity);
+        store64(m_pView + OFFSET_INDEX_CAPACITY, ulIndexCapacity);
+        store64(m_pView + OFFSET_FIRST_SEQUENCE, 1);
+        store64(m_pView + OFFSET_NEXT_SEQUENCE, 1);
+        store64(m_pView + OFFSET_ACKNOWLEDGED_SEQUENCE, 0);
+        store64(m_pView + OFFSET_WRITE_OFFSET, 0);
+        memcpy(m_pView + OFFSET_VERSION, &ulNewVersion, sizeof(ulNewVersion));
+        // The magic value is written last so that a journal whose
+        // initialization was interrupted is recognized as invalid.
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(m_pView + OFFSET_MAGIC, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    }
+
+    unlock();
+
+    return S_OK;
+}
+
+void CaptureJournal::close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+    }
+    if (m_hLock)
+    {
+        CloseHandle(m_hLock);
+    }
+    m_hMapping = NULL;
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_hLock = NULL;
+#else
+    if (m_pView)
+    {
+        munmap(m_pView, m_cbView);
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+#endif
+    m_pView = NULL;
+    m_cbView = 0;
+}
+
+bool CaptureJournal::lock()
+{
+    m_mutex.lock();
+#ifdef _WIN32
+    // An abandoned mutex indicates that a writer terminated while appending.
+    // The publication protocol leaves the journal consistent in that case.
+    DWORD result = WaitForSingleObject(m_hLock, INFINITE);
+    if (result != WAIT_OBJECT_0 && result != WAIT_ABANDONED)
+#else
+    if (flock(m_fd, LOCK_EX) != 0)
+#endif
+    {
+        m_mutex.unlock();
+        return false;
+    }
+    return true;
+}
+
+void CaptureJournal::unlock()
+{
+#ifdef _WIN32
+    ReleaseMutex(m_hLock);
+#else
+    flock(m_fd, LOCK_UN);
+#endif
+    m_mutex.unlock();
+}
+
+uint8_t* CaptureJournal::indexEntry(uint64_t ullSequence) const
+{
+    return m_pView + HEADER_SIZE + (size_t)(ullSequence % m_ulIndexCapacity) * INDEX_ENTRY_SIZE;
+}
+
+uint8_t* CaptureJournal::dataAt(uint64_t ullOffset) const
+{
+    return m_pView + HEADER_SIZE + (size_t)m_ulIndexCapacity * INDEX_ENTRY_SIZE +
+        (size_t)(ullOffset % m_cbDataCapacity);
+}
+
+uint64_t CaptureJournal::firstSequence() const
+{
+    return m_pView ? load64(m_pView + OFFSET_FIRST_SEQUENCE) : 0;
+}
+
+uint64_t CaptureJournal::nextSequence() const
+{
+    return m_pView ? load64(m_pView + OFFSET_NEXT_SEQUENCE) : 0;
+}
+
+HRESULT CaptureJournal::append(const char* pData, size_t cbData, uint64_t ullTimestamp, uint64_t* pullSequence)
+{
+    if (!m_pView)
+    {
+        return E_HANDLE;
+    }
+
+    if (cbData > m_cbDataCapacity / 4)
+    {
+        cbData = (size_t)(m_cbDataCapacity / 4);
+    }
+
+    if (!lock())
+    {
+        return E_FAIL;
+    }
+
+    uint64_t ullFirst = load64(m_pView + OFFSET_FIRST_SEQUENCE);
+    uint64_t ullNext = load64(m_pView + OFFSET_NEXT_SEQUENCE);
+    uint64_t ullOffset = load64(m_pView + OFFSET_WRITE_OFFSET);
+    uint64_t cbRecord = (RECORD_HEADER_SIZE + cbData + 7) & ~(uint64_t)7;
+
+    // Timestamps are kept non-decreasing so that the index can be searched
+    // even if the system clock is adjusted.
+    if (ullNext > ullFirst)
+    {
+        uint64_t ullPrevious = load64(indexEntry(ullNext - 1) + 8);
+        if (ullTimestamp < ullPrevious)
+        {
+            ullTimestamp = ullPrevious;
+        }
+    }
+
+    // Records never straddle the end of the ring.
+    uint64_t ullPhysical = ullOffset % m_cbDataCapacity;
+    if (ullPhysical + cbRecord > m_cbDataCapacity)
+    {
+        ullOffset += m_cbDataCapacity - ullPhysical;
+    }
+    uint64_t ullEnd = ullOffset + cbRecord;
+
+    while (ullFirst < ullNext &&
+        (ullEnd - load64(indexEntry(ullFirst) + 16) > m_cbDataCapacity ||
+         ullNext - ullFirst >= m_ulIndexCapacity))
+    {
+        ullFirst += 1;
+    }
+    store64(m_pView + OFFSET_FIRST_SEQUENCE, ullFirst);
+
+    uint8_t* pRecord = dataAt(ullOffset);
+    uint32_t ulLength = (uint32_t)cbData;
+    uint32_t ulChecksum = checksum(ullNext, ullTimestamp, (const uint8_t*)pData, cbData);
+    memcpy(pRecord, &ulLength, 4);
+    memcpy(pRecord + 4, &ulChecksum, 4);
+    memcpy(pRecord + 8, &ullNext, 8);
+    memcpy(pRecord + 16, &ullTimestamp, 8);
+    memcpy(pRecord + RECORD_HEADER_SIZE, pData, cbData);
+
+    uint8_t* pEntry = indexEntry(ullNext);
+    memcpy(pEntry, &ullNext, 8);
+    memcpy(pEntry + 8, &ullTimestamp, 8);
+    memcpy(pEntry + 16, &ullOffset, 8);
+
+    store64(m_pView + OFFSET_WRITE_OFFSET, ullEnd);
+    store64(m_pView + OFFSET_NEXT_SEQUENCE, ullNext + 1);
+
+    unlock();
+
+    if (pullSequence)
+    {
+        *pullSequence = ullNext;
+    }
+
+    return S_OK;
+}
+
+bool CaptureJournal::read(uint64_t ullSequence, std::string* pData, uint64_t* pullTimestamp) const
+{
+    if (!m_pView || ullSequence < firstSequence() || ullSequence >= nextSequence())
+    {
+        return false;
+    }
+
+    const uint8_t* pEntry = indexEntry(ullSequence);
+    uint64_t ullOffset = load64(pEntry + 16);
+    const uint8_t* pRecord = dataAt(ullOffset);
+    uint32_t ulLength, ulChecksum;
+    uint64_t ullRecordSequence, ullTimestamp;
+    memcpy(&ulLength, pRecord, 4);
+    memcpy(&ulChecksum, pRecord + 4, 4);
+    memcpy(&ullRecordSequence, pRecord + 8, 8);
+    memcpy(&ullTimestamp, pRecord + 16, 8);
+
+    if (ullRecordSequence != ullSequence || ulLength > m_cbDataCapacity / 4)
+    {
+        return false;
+    }
+
+    pData->assign((const char*)pRecord + RECORD_HEADER_SIZE, ulLength);
+
+    // The record may have been overwritten while it was being copied.
+    if (ullSequence < firstSequence() ||
+        checksum(ullSequence, ullTimestamp, (const uint8_t*)pData->data(), ulLength) != ulChecksum)
+    {
+        return false;
+    }
+
+    if (pullTimestamp)
+    {
+        *pullTimestamp = ullTimestamp;
+    }
+
+    return true;
+}
+
+uint64_t CaptureJournal::findByTimestamp(uint64_t ullTimestamp) const
+{
+    uint64_t ullLow = firstSequence();
+    uint64_t ullHigh = nextSequence();
+
+    while (ullLow < ullHigh)
+    {
+        uint64_t ullMiddle = ullLow + (ullHigh - ullLow) / 2;
+        if (load64(indexEntry(ullMiddle) + 8) < ullTimestamp)
+        {
+            ullLow = ullMiddle + 1;
+        }
+        else
+        {
+            ullHigh = ullMiddle;
+        }
+    }
+
+    return ullLow;
+}
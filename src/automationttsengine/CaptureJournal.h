@@ -0,0 +1,107 @@
+#pragma once
+#include "Portable.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * A size-capped, memory-mapped record of every message emitted by the engine.
+ * Messages are retained even when the driver is not listening so that the
+ * driver can recover them after it (re)connects, and so that test harnesses
+ * can query the speech which occurred during a given interval.
+ *
+ * File layout (all integers little-endian):
+ *
+ *     header (64 bytes)
+ *       0  magic "ATDJ"          32  nextSequence
+ *       4  version               40  acknowledgedSequence (written by driver)
+ *       8  dataCapacity          48  writeOffset
+ *       16 indexCapacity         56  reserved
+ *       24 firstSequence
+ *     index (indexCapacity entries of 24 bytes, slot = sequence % capacity)
+ *       sequence, timestamp, dataOffset
+ *     data (dataCapacity bytes, treated as a ring)
+ *       length (4), checksum (4), sequence (8), timestamp (8), payload
+ *
+ * Records with sequence numbers in [firstSequence, nextSequence) are valid.
+ * A record is published by advancing `nextSequence` only after its data and
+ * index entry have been written, and old records are retired by advancing
+ * `firstSequence` before their storage is reused, so a writer which crashes
+ * mid-append never leaves a partially-written record visible. Offsets are
+ * logical (monotonically increasing); the physical position is the offset
+ * modulo the data capacity. Timestamps are microseconds since the Unix epoch.
+ */
+class CaptureJournal
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 64;
+    static const size_t INDEX_ENTRY_SIZE = 24;
+    static const size_t RECORD_HEADER_SIZE = 24;
+
+    CaptureJournal();
+    ~CaptureJournal();
+
+    CaptureJournal(const CaptureJournal&) = delete;
+    CaptureJournal& operator=(const CaptureJournal&) = delete;
+
+    /**
+     * Open the journal at the given location, creating it if necessary. An
+     * existing journal with different capacities is discarded.
+     *
+     * @param {const char*} path - UTF-8 encoded file system path
+     * @param {uint64_t} cbDataCapacity - bytes reserved for message data
+     * @param {uint32_t} ulIndexCapacity - maximum number of retained records
+     */
+    HRESULT open(const char* path, uint64_t cbDataCapacity, uint32_t ulIndexCapacity);
+    void close();
+    bool isOpen() const { return m_pView != NULL; }
+
+    /**
+     * Append a message, evicting the oldest records as necessary. Messages
+     * larger than a quarter of the data capacity are truncated so that the
+     * cost of eviction remains bounded.
+     */
+    HRESULT append(const char* pData, size_t cbData, uint64_t ullTimestamp, uint64_t* pullSequence);
+
+    uint64_t firstSequence() const;
+    uint64_t nextSequence() const;
+
+    /**
+     * Copy the record with the given sequence number.
+     *
+     * @returns {bool} false if the record has been evicted, has not been
+     *                 written, or fails verification
+     */
+    bool read(uint64_t ullSequence, std::string* pData, uint64_t* pullTimestamp) const;
+
+    /**
+     * @returns {uint64_t} the sequence number of the first retained record
+     *                     whose timestamp is not less than `ullTimestamp`
+     *                     (`nextSequence()` if there is none)
+     */
+    uint64_t findByTimestamp(uint64_t ullTimestamp) const;
+
+    /** Microseconds since the Unix epoch. */
+    static uint64_t now();
+
+private:
+    uint8_t* indexEntry(uint64_t ullSequence) const;
+    uint8_t* dataAt(uint64_t ullOffset) const;
+    bool lock();
+    void unlock();
+
+    uint8_t*   m_pView;
+    size_t     m_cbView;
+    uint64_t   m_cbDataCapacity;
+    uint64_t   m_ulIndexCapacity;
+    std::mutex m_mutex;
+#ifdef _WIN32
+    HANDLE     m_hFile;
+    HANDLE     m_hMapping;
+    HANDLE     m_hLock;
+#else
+    int        m_fd;
+#endif
+};
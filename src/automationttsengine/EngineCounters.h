@@ -0,0 +1,73 @@
+#pragma once
+#include "ResourceCounters.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * @returns {uint64_t} microseconds elapsed since an arbitrary, fixed point in
+ *                     time; suitable only for measuring intervals
+ */
+inline uint64_t monotonicMicroseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Measurements describing the behavior of a single engine instance. They are
+ * reported to the driver via lifecycle messages.
+ */
+struct EngineCounters
+{
+    //--- Startup (monotonic timestamps; zero until reached)
+    // Construction begins as the counters are constructed, so the engine
+    // constructs them before anything else, and ends once the voice has been
+    // initialized from its token.
+    uint64_t ullConstructBegin = monotonicMicroseconds();
+    uint64_t ullTokenBegin = 0;
+    uint64_t ullConstructEnd = 0;
+    uint64_t ullFirstSpeak = 0;
+
+    //--- Resources
+    uint64_t ullSpeaks = 0;
+    // Largest growth in allocated memory during any one call to Speak.
+    uint64_t cbPeakSpeak = 0;
+
+    /**
+     * Describe the startup path: the duration of construction, the part of
+     * it spent initializing the voice from its token, and the time from the
+     * beginning of construction to the first call to Speak, e.g. "startup
+     * construct=140us token=95us firstSpeak=1210us".
+     */
+    std::string describeStartup() const
+    {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "startup construct=%lluus token=%lluus firstSpeak=%lluus",
+            (unsigned long long)elapsed(ullConstructBegin, ullConstructEnd),
+            (unsigned long long)elapsed(ullTokenBegin, ullConstructEnd),
+            (unsigned long long)elapsed(ullConstructBegin, ullFirstSpeak));
+        return buffer;
+    }
+
+    /**
+     * Describe the resources held by the process on the engine's behalf
+     * (which are shared by every instance of the engine in the process), e.g.
+     * "resources speaks=2000 peakSpeakBytes=18432 allocations=310
+     * bytes=1204112 handles=3 processes=0 threads=2".
+     */
+    std::string describeResources(const ResourceSnapshot& resources) const
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "resources speaks=%llu peakSpeakBytes=%llu ",
+            (unsigned long long)ullSpeaks, (unsigned long long)cbPeakSpeak);
+        return buffer + resources.describe();
+    }
+
+private:
+    static uint64_t elapsed(uint64_t ullBegin, uint64_t ullEnd)
+    {
+        return ullBegin && ullEnd > ullBegin ? ullEnd - ullBegin : 0;
+    }
+};
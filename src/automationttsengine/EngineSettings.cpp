@@ -0,0 +1,219 @@
+#include "EngineSettings.h"
+#include <cstdio>
+#include <cstring>
+
+const uint32_t EngineSettings::MAXIMUM_TIME_COMPRESSION;
+
+/**
+ * @returns {bool} whether `[pStart, pEnd)` is a decimal number no greater
+ *                 than `ulMaximum`
+ */
+static bool parseNumber(const char* pStart, const char* pEnd, uint32_t ulMaximum, uint32_t* pulValue)
+{
+    if (pStart == pEnd)
+    {
+        return false;
+    }
+    uint64_t ullValue = 0;
+    for (const char* p = pStart; p < pEnd; p += 1)
+    {
+        if (*p < '0' || *p > '9')
+        {
+            return false;
+        }
+        ullValue = ullValue * 10 + (uint64_t)(*p - '0');
+        if (ullValue > ulMaximum)
+        {
+            return false;
+        }
+    }
+    *pulValue = (uint32_t)ullValue;
+    return true;
+}
+
+static bool parseFlag(const char* pStart, const char* pEnd, bool* pfValue)
+{
+    uint32_t ulValue = 0;
+    if (!parseNumber(pStart, pEnd, 1, &ulValue))
+    {
+        return false;
+    }
+    *pfValue = ulValue == 1;
+    return true;
+}
+
+static bool keyIs(const char* pKey, size_t cbKey, const char* pName)
+{
+    return cbKey == strlen(pName) && memcmp(pKey, pName, cbKey) == 0;
+}
+
+bool EngineSettings::parse(const char* pData, size_t cbData)
+{
+    EngineSettings parsed = *this;
+    const char* pEnd = pData + cbData;
+
+    for (const char* pPair = pData; pPair < pEnd;)
+    {
+        const char* pPairEnd = (const char*)memchr(pPair, ' ', pEnd - pPair);
+        if (!pPairEnd)
+        {
+            pPairEnd = pEnd;
+        }
+        const char* pEquals = (const char*)memchr(pPair, '=', pPairEnd - pPair);
+        if (pPairEnd > pPair && !pEquals)
+        {
+            return false;
+        }
+
+        bool fValid = true;
+        if (pEquals)
+        {
+            size_t cbKey = pEquals - pPair;
+            const char* pValue = pEquals + 1;
+            if (keyIs(pPair, cbKey, "vocalize"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fVocalize);
+            }
+            else if (keyIs(pPair, cbKey, "timeCompression"))
+            {
+                fValid = parseNumber(pValue, pPairEnd, MAXIMUM_TIME_COMPRESSION, &parsed.ulTimeCompression) &&
+                    parsed.ulTimeCompression >= 100;
+            }
+            else if (keyIs(pPair, cbKey, "batchMinWindowUs"))
+            {
+                fValid = parseNumber(pValue, pPairEnd, UINT32_MAX, &parsed.ulBatchMinWindowUs);
+            }
+            else if (keyIs(pPair, cbKey, "batchMaxWindowUs"))
+            {
+                fValid = parseNumber(pValue, pPairEnd, UINT32_MAX, &parsed.ulBatchMaxWindowUs);
+            }
+            else if (keyIs(pPair, cbKey, "batchLatencyCapUs"))
+            {
+                fValid = parseNumber(pValue, pPairEnd, UINT32_MAX, &parsed.ulBatchLatencyCapUs);
+            }
+            else if (keyIs(pPair, cbKey, "trace"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fTrace);
+            }
+            else if (keyIs(pPair, cbKey, "escapeSpeech"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fEscapeSpeech);
+            }
+            else if (keyIs(pPair, cbKey, "emitSpeech"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fEmitSpeech);
+            }
+            else if (keyIs(pPair, cbKey, "emitLifecycle"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fEmitLifecycle);
+            }
+            else if (keyIs(pPair, cbKey, "emitErrors"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fEmitErrors);
+            }
+            else if (keyIs(pPair, cbKey, "emitBookmarks"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fEmitBookmarks);
+            }
+            else if (keyIs(pPair, cbKey, "stampTimes"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fStampTimes);
+            }
+            else if (keyIs(pPair, cbKey, "audioTap"))
+            {
+                fValid = parseFlag(pValue, pPairEnd, &parsed.fAudioTap);
+            }
+        }
+        if (!fValid)
+        {
+            return false;
+        }
+        pPair = pPairEnd + 1;
+    }
+
+    if (parsed.ulBatchMinWindowUs > parsed.ulBatchMaxWindowUs)
+    {
+        return false;
+    }
+    *this = parsed;
+    return true;
+}
+
+std::string EngineSettings::describe() const
+{
+    char buffer[320];
+    snprintf(buffer, sizeof(buffer),
+        "vocalize=%d timeCompression=%u batchMinWindowUs=%u batchMaxWindowUs=%u batchLatencyCapUs=%u trace=%d "
+        "escapeSpeech=%d emitSpeech=%d emitLifecycle=%d emitErrors=%d emitBookmarks=%d stampTimes=%d audioTap=%d",
+        fVocalize ? 1 : 0, ulTimeCompression, ulBatchMinWindowUs, ulBatchMaxWindowUs, ulBatchLatencyCapUs,
+        fTrace ? 1 : 0, fEscapeSpeech ? 1 : 0, fEmitSpeech ? 1 : 0, fEmitLifecycle ? 1 : 0, fEmitErrors ? 1 : 0,
+        fEmitBookmarks ? 1 : 0, fStampTimes ? 1 : 0, fAudioTap ? 1 : 0);
+    return buffer;
+}
+
+SettingsSnapshot::SettingsSnapshot(const EngineSettings& defaults)
+    : m_defaults(defaults), m_pCurrent(new EngineSettings(defaults)), m_cReaders(0)
+{
+}
+
+SettingsSnapshot::~SettingsSnapshot()
+{
+    delete m_pCurrent.load();
+    for (const EngineSettings* pRetired : m_retired)
+    {
+        delete pRetired;
+    }
+}
+
+EngineSettings SettingsSnapshot::load() const
+{
+    // The registration must be visible to a publisher before the pointer is
+    // read, so both are sequentially consistent.
+    m_cReaders.fetch_add(1);
+    EngineSettings settings = *m_pCurrent.load();
+    m_cReaders.fetch_sub(1, std::memory_order_release);
+    return settings;
+}
+
+uint32_t SettingsSnapshot::generation() const
+{
+    return load().ulGeneration;
+}
+
+bool SettingsSnapshot::publish(const EngineSettings& settings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const EngineSettings* pCurrent = m_pCurrent.load();
+    if (settings.ulGeneration <= pCurrent->ulGeneration)
+    {
+        return false;
+    }
+
+    replace(settings);
+    return true;
+}
+
+void SettingsSnapshot::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    replace(m_defaults);
+}
+
+/** The caller holds `m_mutex`. */
+void SettingsSnapshot::replace(const EngineSettings& settings)
+{
+    const EngineSettings* pPublished = new EngineSettings(settings);
+    m_retired.push_back(m_pCurrent.exchange(pPublished));
+
+    // A reader which registers after this point reads the published
+    // settings, so none can hold a retired snapshot.
+    if (m_cReaders.load() == 0)
+    {
+        for (const EngineSettings* pRetired : m_retired)
+        {
+            delete pRetired;
+        }
+        m_retired.clear();
+    }
+}
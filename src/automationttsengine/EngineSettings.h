@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * The behavior of the engine which the driver may change while the screen
+ * reader is running (see `interaction.configureVoice`). The driver sends the
+ * settings in a `configure` message whose data takes the same form as
+ * `describe`; settings which it omits take their default values.
+ */
+struct EngineSettings
+{
+    // Upper bound of `ulTimeCompression`.
+    static const uint32_t MAXIMUM_TIME_COMPRESSION = 1000;
+
+    // Whether speech is rendered as audio. When it is not, speech is only
+    // captured, and each call to Speak returns as soon as it has been
+    // reported.
+    bool     fVocalize = true;
+    // Rate at which audio is played, as a percentage of real time (at least
+    // 100).
+    uint32_t ulTimeCompression = 100;
+    // The batching policy applied to messages sent to the driver (see
+    // `DriverClientBatching`).
+    uint32_t ulBatchMinWindowUs = 0;
+    uint32_t ulBatchMaxWindowUs = 0;
+    uint32_t ulBatchLatencyCapUs = 0;
+    // Whether the input to Speak is recorded, in addition to any recording
+    // requested by the voice's token.
+    bool     fTrace = false;
+    // Whether speech is sent to the driver as a payload which it can
+    // broadcast as it is (see `formatSpeechPayload`).
+    bool     fEscapeSpeech = false;
+    // The messages which are sent to the driver, and whether they are
+    // stamped with the time at which they were emitted. The driver disables
+    // those to which none of its sessions subscribes; every message is
+    // journaled regardless, so that a later driver can recover it.
+    bool     fEmitSpeech = true;
+    bool     fEmitLifecycle = true;
+    bool     fEmitErrors = true;
+    bool     fEmitBookmarks = true;
+    bool     fStampTimes = true;
+    // Whether audio is written to the audio tap (which is then opened). The
+    // driver enables it while it reads the tap and a session may capture
+    // audio.
+    bool     fAudioTap = false;
+    // Incremented by the driver for each `configure` message; zero for the
+    // defaults.
+    uint32_t ulGeneration = 0;
+
+    /**
+     * Apply space-separated `key=value` pairs, e.g. "vocalize=0
+     * timeCompression=200", to these settings. Unknown keys are ignored so
+     * that a newer driver may configure an older engine.
+     *
+     * @returns {bool} false, leaving the settings unchanged, if a value is
+     *                 malformed or out of range
+     */
+    bool parse(const char* pData, size_t cbData);
+
+    /**
+     * Describe every setting in the form accepted by `parse`, e.g.
+     * "vocalize=1 timeCompression=100 batchMinWindowUs=250
+     * batchMaxWindowUs=1000 batchLatencyCapUs=4000 trace=0 escapeSpeech=0
+     * emitSpeech=1 ...".
+     */
+    std::string describe() const;
+
+    bool sameBatching(const EngineSettings& other) const
+    {
+        return ulBatchMinWindowUs == other.ulBatchMinWindowUs && ulBatchMaxWindowUs == other.ulBatchMaxWindowUs &&
+            ulBatchLatencyCapUs == other.ulBatchLatencyCapUs;
+    }
+};
+
+/**
+ * The settings in effect, which are read at the beginning of every call to
+ * Speak and replaced (rarely) when the driver sends new ones.
+ *
+ * Readers never wait: each published snapshot is immutable, and a reader
+ * copies whichever snapshot is current while registered as reading. A
+ * replaced snapshot is freed by a later publication once no reader is
+ * registered, so a reader which loaded its pointer before the replacement
+ * never observes it freed.
+ */
+class SettingsSnapshot
+{
+public:
+    explicit SettingsSnapshot(const EngineSettings& defaults);
+    ~SettingsSnapshot();
+
+    SettingsSnapshot(const SettingsSnapshot&) = delete;
+    SettingsSnapshot& operator=(const SettingsSnapshot&) = delete;
+
+    /** @returns {EngineSettings} a copy of the settings in effect */
+    EngineSettings load() const;
+
+    /** @returns {uint32_t} the generation of the settings in effect */
+    uint32_t generation() const;
+
+    /**
+     * Replace the settings in effect. Settings may be received on several
+     * threads, so those of an earlier generation than the settings in effect
+     * are discarded.
+     *
+     * @returns {bool} whether the settings were published
+     */
+    bool publish(const EngineSettings& settings);
+
+    /**
+     * Restore the defaults, whatever the generation of the settings in
+     * effect, as when the driver which sent them is no longer connected.
+     */
+    void reset();
+
+    const EngineSettings& defaults() const { return m_defaults; }
+
+private:
+    void replace(const EngineSettings& settings);
+
+    EngineSettings m_defaults;
+    std::atomic<const EngineSettings*> m_pCurrent;
+    mutable std::atomic<uint32_t> m_cReaders;
+
+    // Serializes publication.
+    std::mutex m_mutex;
+    std::vector<const EngineSettings*> m_retired;
+};
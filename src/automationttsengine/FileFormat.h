@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Conventions shared by the files which the engine exchanges with the driver
+ * and with other hosts: the capture journal, the audio tap, speak traces and
+ * voice data.
+ *
+ * The integers in these files are little-endian. Every supported host is
+ * little-endian, so fields are stored natively and read in place.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The engine's files are stored in native byte order, which must be little-endian."
+#endif
+
+static const uint32_t FNV1A_OFFSET_BASIS = 2166136261u;
+
+/**
+ * Continue a 32-bit FNV-1a hash, which begins at `FNV1A_OFFSET_BASIS`, over
+ * the given bytes.
+ */
+inline uint32_t fnv1a(uint32_t hash, const void* pData, size_t cbData)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(pData);
+    for (size_t i = 0; i < cbData; i += 1)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Hash the location of a file, from which the names of the objects that
+ * serialize access to it by several processes are derived.
+ */
+inline uint32_t pathHash(const char* path)
+{
+    return fnv1a(FNV1A_OFFSET_BASIS, path, strlen(path));
+}
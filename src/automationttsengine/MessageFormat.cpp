@@ -0,0 +1,81 @@
+#include "MessageFormat.h"
+#include <new>
+
+struct MessageTypeName
+{
+    const char* pName;
+    size_t      cbName;
+};
+
+#define MESSAGE_TYPE_NAME(name) { name, sizeof(name) - 1 }
+
+// Indexed by MessageType.
+static const MessageTypeName MESSAGE_TYPE_NAMES[] = {
+    MESSAGE_TYPE_NAME("lifecycle"),
+    MESSAGE_TYPE_NAME("speech"),
+    MESSAGE_TYPE_NAME("internalError"),
+    MESSAGE_TYPE_NAME("bookmark"),
+    MESSAGE_TYPE_NAME("speakBegin"),
+    MESSAGE_TYPE_NAME("speakEnd"),
+};
+
+#undef MESSAGE_TYPE_NAME
+
+static const MessageTypeName& lookUp(MessageType type)
+{
+    size_t index = (size_t)type;
+    return MESSAGE_TYPE_NAMES[index < sizeof(MESSAGE_TYPE_NAMES) / sizeof(MESSAGE_TYPE_NAMES[0]) ?
+        index : (size_t)MessageType::ERR];
+}
+
+const char* messageTypeName(MessageType type)
+{
+    return lookUp(type).pName;
+}
+
+HRESULT MessageBuffer::format(MessageType type, const char* pData, size_t cbData)
+{
+    const MessageTypeName& name = lookUp(type);
+
+    try
+    {
+        m_text.clear();
+        m_text.append(name.pName, name.cbName);
+        m_text.push_back(':');
+        m_text.append(pData, cbData);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+size_t MessageBuffer::formatSequence(uint64_t ullSequence, char* pBuffer)
+{
+    return formatAttribute("seq", ullSequence, pBuffer);
+}
+
+size_t MessageBuffer::formatAttribute(const char* pKey, uint64_t ullValue, char* pBuffer)
+{
+    char digits[20];
+    size_t numDigits = 0;
+    do
+    {
+        digits[numDigits] = (char)('0' + ullValue % 10);
+        ullValue /= 10;
+        numDigits += 1;
+    } while (ullValue);
+
+    size_t cbKey = strlen(pKey);
+    memcpy(pBuffer, pKey, cbKey);
+    pBuffer[cbKey] = '=';
+    for (size_t i = 0; i < numDigits; i += 1)
+    {
+        pBuffer[cbKey + 1 + i] = digits[numDigits - 1 - i];
+    }
+    pBuffer[cbKey + 1 + numDigits] = '\0';
+
+    return cbKey + 1 + numDigits;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "SpeakPipeline.h"
+#include <string>
+
+/**
+ * @returns {const char*} the name by which the driver identifies messages of
+ *                        the given type
+ */
+const char* messageTypeName(MessageType type);
+
+/**
+ * Storage for a message in the form `<name>:<data>` (as recorded by the
+ * capture journal). The storage is retained between messages, so formatting
+ * only allocates when a message is longer than any before it.
+ */
+class MessageBuffer
+{
+public:
+    // Space required for the longest `seq=<n>` attribute and its terminator.
+    static const size_t SEQUENCE_ATTRIBUTE_SIZE = sizeof("seq=18446744073709551615");
+    // Space required for the longest numeric attribute whose key has at most
+    // five characters, and its terminator.
+    static const size_t ATTRIBUTE_SIZE = sizeof("entry=18446744073709551615");
+
+    HRESULT format(MessageType type, const char* pData, size_t cbData);
+
+    const char* data() const { return m_text.data(); }
+    size_t size() const { return m_text.size(); }
+
+    /**
+     * Write the null-terminated attribute `seq=<ullSequence>` to `pBuffer`,
+     * which must have space for `SEQUENCE_ATTRIBUTE_SIZE` characters.
+     *
+     * @returns {size_t} length of the attribute
+     */
+    static size_t formatSequence(uint64_t ullSequence, char* pBuffer);
+
+    /**
+     * Write the null-terminated attribute `<pKey>=<ullValue>` to `pBuffer`,
+     * which must have space for `ATTRIBUTE_SIZE` characters. The key must
+     * have at most five characters.
+     *
+     * @returns {size_t} length of the attribute
+     */
+    static size_t formatAttribute(const char* pKey, uint64_t ullValue, char* pBuffer);
+
+private:
+    std::string m_text;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+/**
+ * The engine's Speak pipeline is written without dependencies on the Windows
+ * SDK so that it can be built and benchmarked on other platforms. This header
+ * provides the small subset of Windows definitions that the pipeline relies
+ * upon. On Windows, the definitions come from the system headers.
+ */
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cstdint>
+
+typedef int32_t HRESULT;
+
+#define S_OK            ((HRESULT)0x00000000L)
+#define S_FALSE         ((HRESULT)0x00000001L)
+#define E_ABORT         ((HRESULT)0x80004004L)
+#define E_FAIL          ((HRESULT)0x80004005L)
+#define E_HANDLE        ((HRESULT)0x80070006L)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000EL)
+#define E_INVALIDARG    ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#endif
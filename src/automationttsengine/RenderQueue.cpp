@@ -0,0 +1,165 @@
+#include "RenderQueue.h"
+#include "ResourceCounters.h"
+#include "SpeakPipeline.h"
+#include <chrono>
+
+const uint32_t RenderQueue::ABORT_POLL_INTERVAL_MS;
+
+RenderQueue::RenderQueue(Renderer& renderer, size_t lookahead)
+    : m_renderer(renderer), m_lookahead(lookahead), m_slots(lookahead + 1),
+      m_cancelled(false), m_fStopping(false), m_pTexts(NULL), m_numTexts(0), m_nextToRender(0),
+      m_playing(0), m_numRendering(0)
+{
+    // Rendering is CPU-bound, so there is no benefit in running more workers
+    // than there are processors.
+    size_t numWorkers = lookahead;
+    size_t numProcessors = std::thread::hardware_concurrency();
+    if (numProcessors && numWorkers > numProcessors)
+    {
+        numWorkers = numProcessors;
+    }
+
+    for (size_t i = 0; i < numWorkers; i += 1)
+    {
+        m_workers.emplace_back([this] { work(); });
+        ResourceCounters::opened(ResourceCounters::THREADS);
+    }
+}
+
+RenderQueue::~RenderQueue()
+{
+    finish();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fStopping = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    ResourceCounters::closed(ResourceCounters::THREADS, (int64_t)m_workers.size());
+}
+
+void RenderQueue::start(const RenderText* pTexts, size_t numTexts)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pTexts = pTexts;
+        m_numTexts = numTexts;
+        m_nextToRender = 0;
+        m_playing = 0;
+        m_cancelled = false;
+        for (Slot& slot : m_slots)
+        {
+            slot.state = SlotState::Empty;
+        }
+    }
+    m_workAvailable.notify_all();
+}
+
+HRESULT RenderQueue::take(size_t index, SpeakSite& site, const std::vector<uint8_t>** ppAudio)
+{
+    Slot& slot = m_slots[index % m_slots.size()];
+
+    if (m_workers.empty())
+    {
+        // The item is rendered on this thread, so an abort is only noticed
+        // before rendering begins.
+        if (site.getActions() & SPEAK_ACTION_ABORT)
+        {
+            return S_FALSE;
+        }
+        slot.audio.clear();
+        slot.hr = m_renderer.render(m_pTexts[index].pText, m_pTexts[index].cbText, m_cancelled, &slot.audio);
+        *ppAudio = &slot.audio;
+        return slot.hr;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Rendering may now proceed up to `lookahead` items beyond this one.
+    m_playing = index;
+    m_workAvailable.notify_all();
+
+    // The site is polled (on this thread, as it must be) while the item is
+    // rendered, so that an abort need not wait for the render to finish.
+    while (!m_slotReady.wait_for(lock, std::chrono::milliseconds(ABORT_POLL_INTERVAL_MS),
+        [&] { return slot.state == SlotState::Ready && slot.index == index; }))
+    {
+        lock.unlock();
+        bool fAborted = (site.getActions() & SPEAK_ACTION_ABORT) != 0;
+        lock.lock();
+        if (fAborted)
+        {
+            m_numTexts = m_nextToRender;
+            m_cancelled = true;
+            return S_FALSE;
+        }
+    }
+    *ppAudio = &slot.audio;
+    return slot.hr;
+}
+
+void RenderQueue::release(size_t index)
+{
+    if (m_workers.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots[index % m_slots.size()].state = SlotState::Empty;
+}
+
+void RenderQueue::finish()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Items which have not been claimed are abandoned, and workers are asked
+    // to stop rendering the items which they have claimed.
+    m_numTexts = m_nextToRender;
+    m_cancelled = true;
+    m_slotReady.wait(lock, [&] { return m_numRendering == 0; });
+
+    m_pTexts = NULL;
+    m_numTexts = 0;
+    m_nextToRender = 0;
+}
+
+void RenderQueue::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_workAvailable.wait(lock, [&] {
+            return m_fStopping ||
+                (m_nextToRender < m_numTexts && m_nextToRender <= m_playing + m_lookahead);
+        });
+        if (m_fStopping)
+        {
+            return;
+        }
+
+        size_t index = m_nextToRender;
+        Slot& slot = m_slots[index % m_slots.size()];
+        const RenderText& text = m_pTexts[index];
+        m_nextToRender += 1;
+        m_numRendering += 1;
+        slot.state = SlotState::Rendering;
+        slot.index = index;
+
+        lock.unlock();
+        slot.audio.clear();
+        HRESULT hr = m_renderer.render(text.pText, text.cbText, m_cancelled, &slot.audio);
+        lock.lock();
+
+        slot.hr = hr;
+        slot.state = SlotState::Ready;
+        m_numRendering -= 1;
+        m_slotReady.notify_all();
+    }
+}
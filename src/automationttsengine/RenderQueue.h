@@ -0,0 +1,128 @@
+#pragma once
+#include "Portable.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class SpeakSite;
+
+/**
+ * Synthesizes audio for text without playing it, so that the audio for
+ * upcoming sentences can be prepared while an earlier sentence plays.
+ */
+class Renderer
+{
+public:
+    virtual ~Renderer() {}
+
+    /**
+     * Called from worker threads, concurrently for different text. The
+     * samples are written in the format reported by `GetOutputFormat`.
+     *
+     * @param {const std::atomic<bool>&} cancelled - becomes true when the
+     *                                               audio is no longer needed;
+     *                                               long renders should poll it
+     * @param {std::vector<uint8_t>*} pAudio - empty on entry; its capacity is
+     *                                         retained between renders
+     */
+    virtual HRESULT render(const char* pText, size_t cbText, const std::atomic<bool>& cancelled,
+        std::vector<uint8_t>* pAudio) = 0;
+};
+
+struct RenderText
+{
+    const char* pText;
+    size_t      cbText;
+};
+
+/**
+ * Renders a sequence of text on a pool of worker threads, up to `lookahead`
+ * items beyond the item which is currently being played, and hands the
+ * results back in order.
+ *
+ * With a lookahead of zero, each item is rendered on the calling thread when
+ * it is taken (so rendering and playback alternate, as they do without a
+ * queue).
+ */
+class RenderQueue
+{
+public:
+    // Interval at which `take` polls the output site for an abort while it
+    // waits.
+    static const uint32_t ABORT_POLL_INTERVAL_MS = 5;
+
+    RenderQueue(Renderer& renderer, size_t lookahead);
+    ~RenderQueue();
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    size_t lookahead() const { return m_lookahead; }
+
+    /**
+     * Begin rendering. The text must remain valid until `finish` returns.
+     */
+    void start(const RenderText* pTexts, size_t numTexts);
+
+    /**
+     * Wait for the item at `index` (the item following the previously taken
+     * one) to be rendered. The audio remains valid until `release`.
+     *
+     * If `site` requests an abort while the item is awaited, the items which
+     * have not been taken are abandoned, as by `finish`, without waiting for
+     * those being rendered.
+     *
+     * @returns {HRESULT} S_FALSE if the speak was aborted, or the result of
+     *                    rendering the item
+     */
+    HRESULT take(size_t index, SpeakSite& site, const std::vector<uint8_t>** ppAudio);
+
+    /** Indicate that the most recently taken item has been played. */
+    void release(size_t index);
+
+    /**
+     * Abandon any items which have not been taken and wait for the workers
+     * to stop using the text supplied to `start`.
+     */
+    void finish();
+
+private:
+    enum class SlotState
+    {
+        Empty,
+        Rendering,
+        Ready
+    };
+
+    struct Slot
+    {
+        SlotState            state = SlotState::Empty;
+        size_t               index = 0;
+        HRESULT              hr = S_OK;
+        std::vector<uint8_t> audio;
+    };
+
+    void work();
+
+    Renderer&                m_renderer;
+    size_t                   m_lookahead;
+    std::vector<Slot>        m_slots;
+    std::vector<std::thread> m_workers;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_slotReady;
+    std::atomic<bool>       m_cancelled;
+    bool                    m_fStopping;
+
+    //--- State scoped to a single sequence (see `start`)
+    const RenderText* m_pTexts;
+    size_t            m_numTexts;
+    size_t            m_nextToRender;
+    size_t            m_playing;  // most recently taken item
+    size_t            m_numRendering;
+};
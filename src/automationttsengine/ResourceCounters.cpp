@@ -0,0 +1,72 @@
+#include "ResourceCounters.h"
+#include <atomic>
+#include <cstdio>
+
+// Objects with static storage duration are zero-initialized before any
+// dynamic initialization, so these may be updated by allocations made while
+// other modules are being initialized.
+static std::atomic<int64_t> s_live[ResourceCounters::RESOURCE_COUNT];
+static std::atomic<int64_t> s_allocations;
+static std::atomic<int64_t> s_allocatedBytes;
+static std::atomic<int64_t> s_peakAllocatedBytes;
+
+std::string ResourceSnapshot::describe() const
+{
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "allocations=%lld bytes=%lld handles=%lld processes=%lld threads=%lld",
+        (long long)llAllocations, (long long)llAllocatedBytes, (long long)llHandles,
+        (long long)llProcesses, (long long)llThreads);
+    return buffer;
+}
+
+void ResourceCounters::opened(Resource resource, int64_t count)
+{
+    s_live[resource].fetch_add(count, std::memory_order_relaxed);
+}
+
+void ResourceCounters::closed(Resource resource, int64_t count)
+{
+    s_live[resource].fetch_sub(count, std::memory_order_relaxed);
+}
+
+void ResourceCounters::allocated(size_t cbAllocation)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    int64_t llBytes = s_allocatedBytes.fetch_add((int64_t)cbAllocation, std::memory_order_relaxed) +
+        (int64_t)cbAllocation;
+
+    int64_t llPeak = s_peakAllocatedBytes.load(std::memory_order_relaxed);
+    while (llBytes > llPeak &&
+        !s_peakAllocatedBytes.compare_exchange_weak(llPeak, llBytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+void ResourceCounters::freed(size_t cbAllocation)
+{
+    s_allocations.fetch_sub(1, std::memory_order_relaxed);
+    s_allocatedBytes.fetch_sub((int64_t)cbAllocation, std::memory_order_relaxed);
+}
+
+ResourceSnapshot ResourceCounters::snapshot()
+{
+    ResourceSnapshot snapshot;
+    snapshot.llAllocations = s_allocations.load(std::memory_order_relaxed);
+    snapshot.llAllocatedBytes = s_allocatedBytes.load(std::memory_order_relaxed);
+    snapshot.llHandles = s_live[HANDLES].load(std::memory_order_relaxed);
+    snapshot.llProcesses = s_live[PROCESSES].load(std::memory_order_relaxed);
+    snapshot.llThreads = s_live[THREADS].load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+int64_t ResourceCounters::resetPeak()
+{
+    int64_t llBytes = s_allocatedBytes.load(std::memory_order_relaxed);
+    s_peakAllocatedBytes.store(llBytes, std::memory_order_relaxed);
+    return llBytes;
+}
+
+int64_t ResourceCounters::peakAllocatedBytes()
+{
+    return s_peakAllocatedBytes.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Levels of the resources held by the engine at one moment.
+ */
+struct ResourceSnapshot
+{
+    int64_t llAllocations = 0;
+    int64_t llAllocatedBytes = 0;
+    int64_t llHandles = 0;
+    int64_t llProcesses = 0;
+    int64_t llThreads = 0;
+
+    /**
+     * Describe the levels, e.g. "allocations=310 bytes=1204112 handles=3
+     * processes=0 threads=2".
+     */
+    std::string describe() const;
+};
+
+/**
+ * Process-wide accounting of the resources which the engine holds, so that a
+ * leak in a voice which runs inside the screen reader for days can be
+ * observed before it exhausts the process.
+ *
+ * Allocations are counted by the replacement `operator new` in
+ * `AllocationAccounting.cpp`, where it is linked (it is not part of the
+ * engine's portable library, whose benchmarks replace `operator new` for
+ * their own purposes). Handles, subprocesses and threads are counted where
+ * the engine opens and closes them.
+ */
+class ResourceCounters
+{
+public:
+    enum Resource
+    {
+        HANDLES,
+        PROCESSES,
+        THREADS,
+        RESOURCE_COUNT
+    };
+
+    static void opened(Resource resource, int64_t count = 1);
+    static void closed(Resource resource, int64_t count = 1);
+
+    //--- Called by the replacement `operator new` and `operator delete`
+    static void allocated(size_t cbAllocation);
+    static void freed(size_t cbAllocation);
+
+    static ResourceSnapshot snapshot();
+
+    /**
+     * Begin measuring the peak of the bytes allocated.
+     *
+     * @returns {int64_t} the bytes currently allocated
+     */
+    static int64_t resetPeak();
+
+    /** @returns {int64_t} the most bytes allocated since `resetPeak` */
+    static int64_t peakAllocatedBytes();
+};
+
+/**
+ * Records in `*pcbPeak` the largest growth in allocated memory over any scope
+ * which it has measured, such as a call to `Speak`. Scopes which overlap on
+ * different threads share one peak, so each is attributed the growth of both.
+ */
+class AllocationPeakScope
+{
+public:
+    explicit AllocationPeakScope(uint64_t* pcbPeak)
+        : m_pcbPeak(pcbPeak), m_llBaseline(ResourceCounters::resetPeak())
+    {
+    }
+
+    ~AllocationPeakScope()
+    {
+        int64_t llGrowth = ResourceCounters::peakAllocatedBytes() - m_llBaseline;
+        if (llGrowth > 0 && (uint64_t)llGrowth > *m_pcbPeak)
+        {
+            *m_pcbPeak = (uint64_t)llGrowth;
+        }
+    }
+
+    AllocationPeakScope(const AllocationPeakScope&) = delete;
+    AllocationPeakScope& operator=(const AllocationPeakScope&) = delete;
+
+private:
+    uint64_t* m_pcbPeak;
+    int64_t   m_llBaseline;
+};
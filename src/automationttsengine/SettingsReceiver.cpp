@@ -0,0 +1,77 @@
+#include "SettingsReceiver.h"
+#include <cstdio>
+#include <cstdlib>
+
+SettingsReceiver::SettingsReceiver(DriverClient& client, MessageSink& sink, const EngineSettings& defaults)
+    : m_client(client), m_sink(sink), m_snapshot(defaults), m_ullConnection(0)
+{
+}
+
+bool SettingsReceiver::receive()
+{
+    m_received.clear();
+    uint64_t ullConnection = 0;
+    bool fReceived = m_client.receive(&m_received, &ullConnection);
+
+    bool fChanged = false;
+    if (ullConnection != m_ullConnection)
+    {
+        m_ullConnection = ullConnection;
+        if (m_snapshot.generation())
+        {
+            m_snapshot.reset();
+            fChanged = true;
+        }
+    }
+    if (!fReceived)
+    {
+        return fChanged;
+    }
+
+    static const char PREFIX[] = "configure gen=";
+    for (size_t start = 0; start < m_received.size();)
+    {
+        size_t end = m_received.find('\0', start);
+        size_t separator = m_received.find(':', start);
+        if (separator < end && m_received.compare(start, sizeof(PREFIX) - 1, PREFIX) == 0)
+        {
+            uint32_t ulGeneration = strtoul(m_received.c_str() + start + sizeof(PREFIX) - 1, NULL, 10);
+            fChanged = apply(ulGeneration, m_received.data() + separator + 1, end - separator - 1) || fChanged;
+        }
+        start = end + 1;
+    }
+    return fChanged;
+}
+
+/**
+ * @returns {bool} whether the settings were applied
+ */
+bool SettingsReceiver::apply(uint32_t ulGeneration, const char* pData, size_t cbData)
+{
+    // Settings which the driver omits take their default values, rather than
+    // those previously sent, so each message describes the settings in full.
+    EngineSettings settings = m_snapshot.defaults();
+    settings.ulGeneration = ulGeneration;
+    if (!settings.parse(pData, cbData))
+    {
+        m_sink.emit(MessageType::ERR, "Invalid voice settings.");
+        return false;
+    }
+
+    // A driver does not reuse a generation on one connection, so a client
+    // which awaits the acknowledgement of these settings is told why it will
+    // not arrive.
+    if (!m_snapshot.publish(settings))
+    {
+        m_sink.emit(MessageType::ERR, "Voice settings of an earlier generation were discarded.");
+        return false;
+    }
+
+    // The acknowledgement tells the driver which settings are in effect; it
+    // is not journaled because it is not output.
+    char attributes[sizeof("gen=4294967295")];
+    snprintf(attributes, sizeof(attributes), "gen=%u", ulGeneration);
+    std::string description = settings.describe();
+    m_client.send("configured", attributes, description.data(), description.size(), true);
+    return true;
+}
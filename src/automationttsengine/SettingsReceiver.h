@@ -0,0 +1,56 @@
+#pragma once
+#include "../Shared/DriverClient.h"
+#include "EngineSettings.h"
+#include "SpeakPipeline.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Applies the settings which the driver sends on its connection to the voice,
+ * each in a message of the form `configure gen=<generation>:<settings>`, and
+ * acknowledges each with a `configured` message of the same generation whose
+ * data describes the settings in effect.
+ *
+ * Settings belong to the connection on which they were received. The driver
+ * numbers its settings from 1 each time it starts and sends them on every
+ * connection as it is established, so the defaults are restored whenever the
+ * connection is lost or replaced. Until a driver configures the voice, every
+ * message is therefore emitted.
+ */
+class SettingsReceiver
+{
+public:
+    /**
+     * @param {MessageSink&} sink - told of each message which is rejected
+     */
+    SettingsReceiver(DriverClient& client, MessageSink& sink, const EngineSettings& defaults);
+
+    SettingsReceiver(const SettingsReceiver&) = delete;
+    SettingsReceiver& operator=(const SettingsReceiver&) = delete;
+
+    /**
+     * Apply whatever the driver has sent without waiting for more. Calls must
+     * not overlap, so that settings are applied in the order in which they
+     * were sent; the settings in effect may be loaded at any time.
+     *
+     * @returns {bool} whether the settings in effect changed
+     */
+    bool receive();
+
+    /** @returns {EngineSettings} a copy of the settings in effect */
+    EngineSettings load() const { return m_snapshot.load(); }
+
+    const EngineSettings& defaults() const { return m_snapshot.defaults(); }
+
+private:
+    bool apply(uint32_t ulGeneration, const char* pData, size_t cbData);
+
+    DriverClient&    m_client;
+    MessageSink&     m_sink;
+    SettingsSnapshot m_snapshot;
+    // The connection on which the settings in effect were received, or zero.
+    uint64_t         m_ullConnection;
+    // Reused by each call so that polling does not allocate.
+    std::string      m_received;
+};
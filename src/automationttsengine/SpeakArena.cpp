@@ -0,0 +1,92 @@
+#include "SpeakArena.h"
+#include <cstdint>
+#include <new>
+
+// Offset of the first usable byte within a block. Rounded so that the data
+// which follows the header is suitably aligned for any fundamental type.
+const size_t SpeakArena::BLOCK_HEADER_SIZE =
+    (sizeof(SpeakArena::Block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+SpeakArena::SpeakArena(size_t blockSize)
+    : m_cbBlockSize(blockSize), m_cbReserved(0), m_pFirst(NULL), m_pCurrent(NULL)
+{
+}
+
+SpeakArena::~SpeakArena()
+{
+    Block* block = m_pFirst;
+    while (block)
+    {
+        Block* next = block->pNext;
+        ::operator delete(block);
+        block = next;
+    }
+}
+
+SpeakArena::Block* SpeakArena::newBlock(size_t cbMinimum)
+{
+    size_t cbSize = cbMinimum > m_cbBlockSize ? cbMinimum : m_cbBlockSize;
+    Block* block = static_cast<Block*>(::operator new(BLOCK_HEADER_SIZE + cbSize, std::nothrow));
+    if (!block)
+    {
+        return NULL;
+    }
+    block->pNext = NULL;
+    block->cbSize = cbSize;
+    block->cbUsed = 0;
+    m_cbReserved += cbSize;
+    return block;
+}
+
+void* SpeakArena::allocate(size_t size, size_t alignment)
+{
+    for (;;)
+    {
+        if (m_pCurrent)
+        {
+            uintptr_t base = reinterpret_cast<uintptr_t>(m_pCurrent) + BLOCK_HEADER_SIZE;
+            uintptr_t start = (base + m_pCurrent->cbUsed + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            size_t cbEnd = (start - base) + size;
+
+            if (cbEnd <= m_pCurrent->cbSize)
+            {
+                m_pCurrent->cbUsed = cbEnd;
+                return reinterpret_cast<void*>(start);
+            }
+
+            // Blocks retained from an earlier Speak call are reused in order
+            // before any new memory is requested.
+            if (m_pCurrent->pNext)
+            {
+                m_pCurrent = m_pCurrent->pNext;
+                m_pCurrent->cbUsed = 0;
+                continue;
+            }
+        }
+
+        Block* block = newBlock(size + alignment);
+        if (!block)
+        {
+            return NULL;
+        }
+
+        if (m_pCurrent)
+        {
+            m_pCurrent->pNext = block;
+        }
+        else
+        {
+            m_pFirst = block;
+        }
+        m_pCurrent = block;
+    }
+}
+
+void SpeakArena::reset()
+{
+    m_pCurrent = m_pFirst;
+    if (m_pCurrent)
+    {
+        m_pCurrent->cbUsed = 0;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+/**
+ * A bump allocator whose contents live for the duration of a single call to
+ * `Speak`. Memory is released in bulk by `reset`, and the underlying blocks
+ * are retained so that subsequent calls do not return to the heap once the
+ * arena has grown to fit the workload.
+ */
+class SpeakArena
+{
+public:
+    explicit SpeakArena(size_t blockSize = 4096);
+    ~SpeakArena();
+
+    SpeakArena(const SpeakArena&) = delete;
+    SpeakArena& operator=(const SpeakArena&) = delete;
+
+    /**
+     * @param {size_t} size - number of bytes requested
+     * @param {size_t} alignment - required alignment (a power of two)
+     *
+     * @returns {void*} a pointer which remains valid until the next call to
+     *                  `reset`, or NULL if memory could not be obtained
+     */
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * Copy a string of `length` characters into the arena, appending a null
+     * terminator.
+     */
+    template <typename Char>
+    Char* copyString(const Char* text, size_t length)
+    {
+        Char* copy = static_cast<Char*>(allocate((length + 1) * sizeof(Char), alignof(Char)));
+        if (copy)
+        {
+            memcpy(copy, text, length * sizeof(Char));
+            copy[length] = 0;
+        }
+        return copy;
+    }
+
+    /**
+     * Invalidate every allocation made since the previous reset.
+     */
+    void reset();
+
+    /** Total number of bytes reserved from the heap. */
+    size_t bytesReserved() const { return m_cbReserved; }
+
+private:
+    struct Block
+    {
+        Block* pNext;
+        size_t cbSize;
+        size_t cbUsed;
+    };
+
+    static const size_t BLOCK_HEADER_SIZE;
+
+    Block* newBlock(size_t cbMinimum);
+
+    size_t m_cbBlockSize;
+    size_t m_cbReserved;
+    Block* m_pFirst;
+    Block* m_pCurrent;
+};
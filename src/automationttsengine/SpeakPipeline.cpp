@@ -0,0 +1,487 @@
+#include "SpeakPipeline.h"
+#include "Utf8.h"
+#include <atomic>
+#include <random>
+
+const size_t SpeakPipeline::UTTERANCE_ID_SIZE;
+
+/**
+ * Utterance ids are drawn from a counter whose upper half is chosen at random
+ * when the process starts, so that ids from different processes (which the
+ * driver receives on a single stream) do not collide.
+ */
+static uint64_t seedUtteranceIds()
+{
+    std::random_device random;
+    return (uint64_t)random() << 32;
+}
+
+static std::atomic<uint64_t> s_nextUtteranceId(seedUtteranceIds());
+
+/**
+ * @returns {size_t} number of characters written, excluding the terminator
+ */
+static size_t formatUtteranceId(uint64_t ullId, char* pBuffer)
+{
+    char digits[SpeakPipeline::UTTERANCE_ID_SIZE];
+    size_t numDigits = 0;
+    do
+    {
+        digits[numDigits] = (char)('0' + ullId % 10);
+        numDigits += 1;
+        ullId /= 10;
+    } while (ullId);
+
+    for (size_t i = 0; i < numDigits; i += 1)
+    {
+        pBuffer[i] = digits[numDigits - 1 - i];
+    }
+    pBuffer[numDigits] = '\0';
+    return numDigits;
+}
+
+/**
+ * Interpret the leading integer of a bookmark name in the manner of `_wtol`.
+ * SAPI clients conventionally use numeric bookmarks, and the value is reported
+ * to them via the event's `wParam`.
+ */
+static long parseBookmarkValue(const char16_t* text, size_t length)
+{
+    size_t i = 0;
+    long value = 0;
+    bool negative = false;
+
+    while (i < length && (text[i] == u' ' || text[i] == u'\t'))
+    {
+        i += 1;
+    }
+    if (i < length && (text[i] == u'-' || text[i] == u'+'))
+    {
+        negative = text[i] == u'-';
+        i += 1;
+    }
+    while (i < length && text[i] >= u'0' && text[i] <= u'9')
+    {
+        value = value * 10 + (text[i] - u'0');
+        i += 1;
+    }
+
+    return negative ? -value : value;
+}
+
+/**
+ * Convert a fragment's text to null-terminated UTF-8 in the arena.
+ *
+ * @returns {const char*} the text, or NULL if memory could not be obtained
+ */
+const char* SpeakPipeline::convert(const SpeakFragment& fragment, size_t* pcbText)
+{
+    char* text = static_cast<char*>(m_arena.allocate(maxUtf8Length(fragment.ulTextLen) + 1, 1));
+    if (!text)
+    {
+        return NULL;
+    }
+    *pcbText = toUtf8(fragment.pTextStart, fragment.ulTextLen, text);
+    text[*pcbText] = '\0';
+    return text;
+}
+
+/**
+ * Forwards to the output site, counting the audio written to it so that events
+ * which follow it are positioned correctly, and mirroring the audio into the
+ * audio tap.
+ */
+class OffsetTrackingSite : public SpeakSite
+{
+public:
+    OffsetTrackingSite(SpeakSite& site, SpeakPipeline& pipeline, uint64_t& ullAudioOffset)
+        : m_site(site), m_pipeline(pipeline), m_ullAudioOffset(ullAudioOffset)
+    {
+    }
+
+    uint32_t getActions() { return m_site.getActions(); }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest) { return m_site.getEventInterest(pullEventInterest); }
+
+    HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents) { return m_site.addEvents(pEvents, numEvents); }
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten)
+    {
+        // The writer is told that all of its audio was written, whether or
+        // not time compression discarded some of it.
+        size_t cbRequested = cbBuffer;
+        m_pipeline.compress(&pBuffer, &cbBuffer);
+        HRESULT hr = forward(pBuffer, cbBuffer);
+        if (SUCCEEDED(hr))
+        {
+            *pcbWritten = cbRequested;
+        }
+        return hr;
+    }
+
+    /**
+     * Play the bytes which time compression holds back from the end of the
+     * utterance, as they are too few to form a block.
+     */
+    HRESULT flush()
+    {
+        HRESULT hr = forward(m_pipeline.m_partialBlock.data(), m_pipeline.m_cbPartialBlock);
+        m_pipeline.m_cbPartialBlock = 0;
+        return hr;
+    }
+
+private:
+    HRESULT forward(const void* pBuffer, size_t cbBuffer)
+    {
+        size_t cbWritten = 0;
+        HRESULT hr = cbBuffer ? m_site.write(pBuffer, cbBuffer, &cbWritten) : S_OK;
+        if (SUCCEEDED(hr))
+        {
+            m_pipeline.tap(pBuffer, cbBuffer);
+            m_ullAudioOffset += cbBuffer;
+        }
+        return hr;
+    }
+
+    SpeakSite&     m_site;
+    SpeakPipeline& m_pipeline;
+    uint64_t&      m_ullAudioOffset;
+};
+
+SpeakPipeline::SpeakPipeline(MessageSink& sink, Vocalizer& vocalizer)
+    : m_pSink(&sink), m_pVocalizer(&vocalizer), m_pAudioTap(NULL), m_fCaptureOnly(false), m_ulTimeCompression(100),
+      m_cbBlock(0), m_ullEventInterest(0), m_ullAudioOffset(0), m_ullUtteranceId(0), m_numEvents(0),
+      m_ulCompressionPhase(0), m_cbPartialBlock(0)
+{
+}
+
+void SpeakPipeline::setRenderer(Renderer* pRenderer, size_t lookahead)
+{
+    m_pRenderQueue.reset(pRenderer ? new RenderQueue(*pRenderer, lookahead) : NULL);
+}
+
+HRESULT SpeakPipeline::queueEvent(SpeakSite& site, const SpeakEvent& event)
+{
+    HRESULT hr = S_OK;
+
+    if (m_numEvents == EVENT_BATCH_SIZE)
+    {
+        hr = flushEvents(site);
+    }
+
+    m_events[m_numEvents] = event;
+    m_numEvents += 1;
+
+    return hr;
+}
+
+HRESULT SpeakPipeline::flushEvents(SpeakSite& site)
+{
+    if (m_numEvents == 0)
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = site.addEvents(m_events, m_numEvents);
+    m_numEvents = 0;
+
+    return hr;
+}
+
+/**
+ * The check is made here, rather than by the tap, so that a disabled tap
+ * costs no more than a load and a branch per write.
+ */
+void SpeakPipeline::tap(const void* pBuffer, size_t cbBuffer)
+{
+    if (m_pAudioTap && m_pAudioTap->isEnabled())
+    {
+        m_pAudioTap->write(m_ullUtteranceId, m_ullAudioOffset, pBuffer, cbBuffer);
+    }
+}
+
+/**
+ * Advance time compression by one block.
+ *
+ * @returns {bool} whether the block is kept
+ */
+bool SpeakPipeline::keepBlock()
+{
+    m_ulCompressionPhase += 100;
+    if (m_ulCompressionPhase < m_ulTimeCompression)
+    {
+        return false;
+    }
+    m_ulCompressionPhase -= m_ulTimeCompression;
+    return true;
+}
+
+/**
+ * Replace `*ppBuffer` with the blocks of it which time compression keeps. The
+ * phase carries over between writes, as does a block which spans two writes,
+ * so the rate is exact however the audio is divided into writes.
+ */
+void SpeakPipeline::compress(const void** ppBuffer, size_t* pcbBuffer)
+{
+    if (m_ulTimeCompression <= 100 || !m_cbBlock)
+    {
+        return;
+    }
+
+    const uint8_t* pSource = static_cast<const uint8_t*>(*ppBuffer);
+    size_t cbSource = *pcbBuffer;
+    if (m_compressed.size() < cbSource + m_cbBlock)
+    {
+        m_compressed.resize(cbSource + m_cbBlock);
+    }
+    size_t cbKept = 0;
+
+    if (m_cbPartialBlock)
+    {
+        size_t cbFill = m_cbBlock - m_cbPartialBlock < cbSource ? m_cbBlock - m_cbPartialBlock : cbSource;
+        memcpy(m_partialBlock.data() + m_cbPartialBlock, pSource, cbFill);
+        m_cbPartialBlock += cbFill;
+        pSource += cbFill;
+        cbSource -= cbFill;
+        if (m_cbPartialBlock == m_cbBlock)
+        {
+            if (keepBlock())
+            {
+                memcpy(m_compressed.data(), m_partialBlock.data(), m_cbBlock);
+                cbKept += m_cbBlock;
+            }
+            m_cbPartialBlock = 0;
+        }
+    }
+
+    size_t numBlocks = cbSource / m_cbBlock;
+    for (size_t i = 0; i < numBlocks; i += 1)
+    {
+        if (keepBlock())
+        {
+            memcpy(m_compressed.data() + cbKept, pSource + i * m_cbBlock, m_cbBlock);
+            cbKept += m_cbBlock;
+        }
+    }
+
+    size_t cbRemainder = cbSource - numBlocks * m_cbBlock;
+    if (cbRemainder)
+    {
+        memcpy(m_partialBlock.data(), pSource + numBlocks * m_cbBlock, cbRemainder);
+        m_cbPartialBlock = cbRemainder;
+    }
+
+    *ppBuffer = m_compressed.data();
+    *pcbBuffer = cbKept;
+}
+
+/**
+ * @param {SpeakSite&} site - tracks the audio offset
+ *
+ * @returns {HRESULT} S_FALSE if playback was interrupted by an abort
+ */
+HRESULT SpeakPipeline::play(const std::vector<uint8_t>& audio, SpeakSite& site)
+{
+    for (size_t offset = 0; offset < audio.size();)
+    {
+        if (site.getActions() & SPEAK_ACTION_ABORT)
+        {
+            return S_FALSE;
+        }
+
+        size_t cbChunk = audio.size() - offset < AUDIO_WRITE_SIZE ? audio.size() - offset : AUDIO_WRITE_SIZE;
+        size_t cbWritten = 0;
+        HRESULT hr = site.write(audio.data() + offset, cbChunk, &cbWritten);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        offset += cbChunk;
+    }
+
+    return S_OK;
+}
+
+HRESULT SpeakPipeline::speak(const SpeakFragment* pFragments, size_t numFragments, SpeakSite& site)
+{
+    HRESULT hr = S_OK;
+
+    m_arena.reset();
+    m_numEvents = 0;
+    m_ullAudioOffset = 0;
+    m_ulCompressionPhase = 0;
+    m_cbPartialBlock = 0;
+
+    // The output site's interest is fixed for the duration of the call, so it
+    // is queried once rather than once per event.
+    if (FAILED(site.getEventInterest(&m_ullEventInterest)))
+    {
+        m_pSink->emit(MessageType::ERR, "Unable to query output site for event interest.");
+        m_ullEventInterest = 0;
+    }
+
+    // When rendering ahead, the text of every fragment is converted up front
+    // so that the renderer can begin work on fragments which are yet to be
+    // reached. The text is converted into the arena so that, once the arena
+    // has grown to fit the workload, speaking does not touch the heap.
+    RenderText* pTexts = NULL;
+    size_t numTexts = 0;
+    bool fRender = m_pRenderQueue && !m_fCaptureOnly;
+    if (fRender)
+    {
+        pTexts = static_cast<RenderText*>(m_arena.allocate(numFragments * sizeof(RenderText), alignof(RenderText)));
+        if (!pTexts)
+        {
+            return E_OUTOFMEMORY;
+        }
+        for (size_t i = 0; i < numFragments; i += 1)
+        {
+            if (pFragments[i].eAction != FragmentAction::Bookmark)
+            {
+                pTexts[numTexts].pText = convert(pFragments[i], &pTexts[numTexts].cbText);
+                if (!pTexts[numTexts].pText)
+                {
+                    return E_OUTOFMEMORY;
+                }
+                numTexts += 1;
+            }
+        }
+        m_pRenderQueue->start(pTexts, numTexts);
+    }
+    size_t textIndex = 0;
+    OffsetTrackingSite outputSite(site, *this, m_ullAudioOffset);
+
+    m_ullUtteranceId = s_nextUtteranceId++;
+    char utteranceId[UTTERANCE_ID_SIZE];
+    size_t cbUtteranceId = formatUtteranceId(m_ullUtteranceId, utteranceId);
+    m_pSink->emit(MessageType::SPEAK_BEGIN, utteranceId, cbUtteranceId);
+
+    for (size_t i = 0; i < numFragments; i += 1)
+    {
+        const SpeakFragment& fragment = pFragments[i];
+
+        if (fragment.eAction == FragmentAction::Bookmark)
+        {
+            // The driver is told of every bookmark, in order with the speech
+            // which surrounds it, so that its clients can wait for a marker
+            // rather than for an arbitrary period of time.
+            size_t cbName = 0;
+            const char* name = convert(fragment, &cbName);
+            if (!name)
+            {
+                hr = E_OUTOFMEMORY;
+                break;
+            }
+            if (FAILED(m_pSink->emit(MessageType::BOOKMARK, name, cbName)))
+            {
+                m_pSink->emit(MessageType::ERR, "Emission failed");
+            }
+
+            if (m_ullEventInterest & (1ull << SPEAK_EVENT_BOOKMARK))
+            {
+                SpeakEvent event;
+                event.eEventId = SPEAK_EVENT_BOOKMARK;
+                event.ullAudioStreamOffset = m_ullAudioOffset;
+                event.pText = m_arena.copyString(fragment.pTextStart, fragment.ulTextLen);
+                event.wParam = (uintptr_t)parseBookmarkValue(fragment.pTextStart, fragment.ulTextLen);
+
+                if (!event.pText)
+                {
+                    hr = E_OUTOFMEMORY;
+                    break;
+                }
+
+                if (FAILED(queueEvent(site, event)))
+                {
+                    m_pSink->emit(MessageType::ERR, "Unable to add events to output site.");
+                }
+            }
+            continue;
+        }
+
+        const char* part = NULL;
+        size_t cbPart = 0;
+        if (pTexts)
+        {
+            part = pTexts[textIndex].pText;
+            cbPart = pTexts[textIndex].cbText;
+        }
+        else
+        {
+            part = convert(fragment, &cbPart);
+            if (!part)
+            {
+                hr = E_OUTOFMEMORY;
+                break;
+            }
+        }
+
+        hr = m_pSink->emit(MessageType::SPEECH, part, cbPart);
+
+        if (FAILED(hr))
+        {
+            m_pSink->emit(MessageType::ERR, "Emission failed");
+            break;
+        }
+
+        // Events which precede this fragment must be delivered before any
+        // audio which follows them.
+        if (FAILED(flushEvents(site)))
+        {
+            m_pSink->emit(MessageType::ERR, "Unable to add events to output site.");
+        }
+
+        if (m_fCaptureOnly)
+        {
+            continue;
+        }
+        if (!fRender)
+        {
+            hr = m_pVocalizer->vocalize(part, cbPart, outputSite);
+        }
+        else
+        {
+            const std::vector<uint8_t>* pAudio = NULL;
+            hr = m_pRenderQueue->take(textIndex, outputSite, &pAudio);
+            if (hr == S_OK)
+            {
+                hr = play(*pAudio, outputSite);
+            }
+            m_pRenderQueue->release(textIndex);
+            textIndex += 1;
+
+            // Audio which has not yet been played, or rendered, is discarded
+            // on abort.
+            if (hr == S_FALSE)
+            {
+                hr = S_OK;
+                break;
+            }
+        }
+
+        if (FAILED(hr))
+        {
+            m_pSink->emit(MessageType::ERR, "Vocalization failed");
+        }
+    }
+
+    if (fRender)
+    {
+        m_pRenderQueue->finish();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = outputSite.flush();
+    }
+
+    if (FAILED(flushEvents(site)))
+    {
+        m_pSink->emit(MessageType::ERR, "Unable to add events to output site.");
+    }
+
+    m_pSink->emit(MessageType::SPEAK_END, utteranceId, cbUtteranceId);
+
+    return hr;
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include "Portable.h"
+#include "AudioTap.h"
+#include "RenderQueue.h"
+#include "SpeakArena.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+ * Platform-independent implementation of `ISpTTSEngine::Speak`. The COM
+ * object in `ttsengobj.cpp` translates the Microsoft Speech API's data
+ * structures into the types declared here and supplies implementations of the
+ * `SpeakSite`, `MessageSink` and `Vocalizer` interfaces.
+ */
+
+enum class MessageType {
+    LIFECYCLE,
+    SPEECH,
+    ERR,
+    BOOKMARK,
+    SPEAK_BEGIN,
+    SPEAK_END
+};
+
+// Values match the SPVACTIONS enumeration.
+enum class FragmentAction : uint32_t {
+    Speak = 0,
+    Silence,
+    Pronounce,
+    Bookmark,
+    SpellOut,
+    Section,
+    ParseUnknownTag
+};
+
+// Values match the SPEVENTENUM enumeration.
+static const uint16_t SPEAK_EVENT_BOOKMARK = 4;
+
+// Values match the SPVESACTIONS enumeration.
+static const uint32_t SPEAK_ACTION_ABORT = 1;
+
+/**
+ * The subset of SPVTEXTFRAG which is consumed by the pipeline.
+ */
+struct SpeakFragment
+{
+    FragmentAction  eAction;
+    const char16_t* pTextStart;
+    uint32_t        ulTextLen;
+    uint32_t        ulTextSrcOffset;
+};
+
+/**
+ * An event destined for the output site. String parameters are owned by the
+ * pipeline's arena and remain valid until the `speak` call which produced
+ * them returns.
+ */
+struct SpeakEvent
+{
+    uint16_t        eEventId;
+    uint64_t        ullAudioStreamOffset;
+    uintptr_t       wParam;
+    const char16_t* pText;
+};
+
+/**
+ * The subset of ISpTTSEngineSite which is consumed by the pipeline.
+ */
+class SpeakSite
+{
+public:
+    virtual ~SpeakSite() {}
+    virtual uint32_t getActions() = 0;
+    virtual HRESULT getEventInterest(uint64_t* pullEventInterest) = 0;
+    virtual HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents) = 0;
+    virtual HRESULT write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten) = 0;
+};
+
+/**
+ * Destination for the messages which the driver observes. Message data is
+ * UTF-8 and is only valid for the duration of the call.
+ */
+class MessageSink
+{
+public:
+    virtual ~MessageSink() {}
+    virtual HRESULT emit(MessageType type, const char* pData, size_t cbData) = 0;
+
+    HRESULT emit(MessageType type, const char* pText)
+    {
+        return emit(type, pText, strlen(pText));
+    }
+};
+
+/**
+ * Renders text so that it is perceivable by a human operator. The text is
+ * UTF-8 and is only valid for the duration of the call. Audio written to the
+ * site advances the stream offset reported with subsequent events.
+ */
+class Vocalizer
+{
+public:
+    virtual ~Vocalizer() {}
+    virtual HRESULT vocalize(const char* pText, size_t cbText, SpeakSite& site) = 0;
+};
+
+class SpeakPipeline
+{
+public:
+    // Maximum number of events delivered to the output site in one call.
+    static const size_t EVENT_BATCH_SIZE = 64;
+    // Maximum number of bytes of audio written to the output site in one
+    // call, so that an abort is observed promptly.
+    static const size_t AUDIO_WRITE_SIZE = 4096;
+    // Space required for the longest utterance id and its terminator.
+    static const size_t UTTERANCE_ID_SIZE = sizeof("18446744073709551615");
+
+    SpeakPipeline(MessageSink& sink, Vocalizer& vocalizer);
+
+    void setSink(MessageSink& sink) { m_pSink = &sink; }
+    void setVocalizer(Vocalizer& vocalizer) { m_pVocalizer = &vocalizer; }
+
+    /**
+     * Deliver audio produced by `pRenderer` to the output site rather than
+     * using the vocalizer. The audio for up to `lookahead` fragments is
+     * rendered on worker threads while earlier fragments play. Passing NULL
+     * restores the use of the vocalizer.
+     */
+    void setRenderer(Renderer* pRenderer, size_t lookahead);
+
+    /**
+     * Mirror the audio written to the output site into `pTap`, tagged with
+     * the id of the utterance which produced it. Passing NULL stops doing so.
+     */
+    void setAudioTap(AudioTap* pTap) { m_pAudioTap = pTap; }
+
+    /**
+     * Report speech to the sink without vocalizing or rendering it, so that
+     * each call to `speak` returns as soon as its messages are emitted.
+     */
+    void setCaptureOnly(bool fCaptureOnly) { m_fCaptureOnly = fCaptureOnly; }
+
+    /**
+     * Play audio written to the output site faster than real time by
+     * discarding blocks of `cbBlock` bytes (one sample frame), keeping 100 of
+     * every `ulPercent`. Events remain aligned with the audio which is
+     * played. A rate of 100 or less plays every block.
+     *
+     * Writes need not be whole blocks: the bytes of a block which a write
+     * leaves incomplete are held until the next write completes it, and those
+     * which end an utterance are played as they are.
+     */
+    void setTimeCompression(uint32_t ulPercent, size_t cbBlock)
+    {
+        m_ulTimeCompression = ulPercent;
+        m_cbBlock = cbBlock;
+        m_partialBlock.resize(cbBlock);
+    }
+
+    /**
+     * Speak the fragments. The messages emitted for them are bracketed by
+     * `SPEAK_BEGIN` and `SPEAK_END` messages whose data is an id which
+     * identifies the call. Ids are unique across processes (with high
+     * probability), so the driver can tell when every utterance which has
+     * begun has ended.
+     */
+    HRESULT speak(const SpeakFragment* pFragments, size_t numFragments, SpeakSite& site);
+
+private:
+    friend class OffsetTrackingSite;
+
+    HRESULT queueEvent(SpeakSite& site, const SpeakEvent& event);
+    HRESULT flushEvents(SpeakSite& site);
+    HRESULT play(const std::vector<uint8_t>& audio, SpeakSite& site);
+    void tap(const void* pBuffer, size_t cbBuffer);
+    void compress(const void** ppBuffer, size_t* pcbBuffer);
+    bool keepBlock();
+    const char* convert(const SpeakFragment& fragment, size_t* pcbText);
+
+    MessageSink* m_pSink;
+    Vocalizer*   m_pVocalizer;
+    AudioTap*    m_pAudioTap;
+    SpeakArena   m_arena;
+    std::unique_ptr<RenderQueue> m_pRenderQueue;
+    bool         m_fCaptureOnly;
+    uint32_t     m_ulTimeCompression;
+    size_t       m_cbBlock;
+    // Reused by each write so that compressing audio does not allocate once
+    // it has grown to fit the largest write.
+    std::vector<uint8_t> m_compressed;
+
+    //--- State scoped to a single `speak` call
+    uint64_t   m_ullEventInterest;
+    uint64_t   m_ullAudioOffset;
+    uint64_t   m_ullUtteranceId;
+    SpeakEvent m_events[EVENT_BATCH_SIZE];
+    size_t     m_numEvents;
+    // Progress towards the next block kept by time compression.
+    uint32_t   m_ulCompressionPhase;
+    // The start of a block which time compression has yet to keep or
+    // discard, held until the rest of it is written.
+    std::vector<uint8_t> m_partialBlock;
+    size_t     m_cbPartialBlock;
+};
@@ -0,0 +1,388 @@
+#include "SpeakTrace.h"
+#include "EngineCounters.h"
+#include "FileFormat.h"
+#include <cstring>
+
+static const char TRACE_MAGIC[4] = { 'A', 'T', 'S', 'T' };
+static const uint32_t NULL_STRING = 0xFFFFFFFF;
+static const size_t RECORD_HEADER_SIZE = 44;
+static const size_t FRAGMENT_HEADER_SIZE = 40;
+static const size_t ACTIONS_SIZE = 16;
+
+template <typename T>
+static void put(std::vector<uint8_t>& buffer, T value)
+{
+    const uint8_t* p = (const uint8_t*)&value;
+    buffer.insert(buffer.end(), p, p + sizeof(value));
+}
+
+static void putString(std::vector<uint8_t>& buffer, const char16_t* text, size_t length)
+{
+    put<uint32_t>(buffer, (uint32_t)length);
+    const uint8_t* p = (const uint8_t*)text;
+    buffer.insert(buffer.end(), p, p + length * sizeof(char16_t));
+}
+
+static void putString(std::vector<uint8_t>& buffer, const char16_t* text)
+{
+    if (!text)
+    {
+        put<uint32_t>(buffer, NULL_STRING);
+        return;
+    }
+    putString(buffer, text, std::char_traits<char16_t>::length(text));
+}
+
+static FILE* openFile(const char* path, const char* mode)
+{
+#ifdef _WIN32
+    wchar_t widePath[MAX_PATH];
+    wchar_t wideMode[8];
+    if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, widePath, MAX_PATH) ||
+        !MultiByteToWideChar(CP_UTF8, 0, mode, -1, wideMode, 8))
+    {
+        return NULL;
+    }
+    return _wfopen(widePath, wideMode);
+#else
+    return fopen(path, mode);
+#endif
+}
+
+SpeakTraceWriter::SpeakTraceWriter()
+    : m_pFile(NULL), m_ullOrigin(0), m_ullSpeakStart(0), m_ulFragments(0), m_ulActionChanges(0),
+      m_ulActionCalls(0), m_ulLastActions(0)
+{
+}
+
+SpeakTraceWriter::~SpeakTraceWriter()
+{
+    close();
+}
+
+HRESULT SpeakTraceWriter::open(const char* path)
+{
+    close();
+
+    m_pFile = openFile(path, "wb");
+    if (!m_pFile)
+    {
+        return E_HANDLE;
+    }
+
+    uint32_t ulVersion = VERSION;
+    if (fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, m_pFile) != 1 ||
+        fwrite(&ulVersion, sizeof(ulVersion), 1, m_pFile) != 1)
+    {
+        close();
+        return E_FAIL;
+    }
+    m_ullOrigin = monotonicMicroseconds();
+
+    return S_OK;
+}
+
+void SpeakTraceWriter::close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+    }
+    m_pFile = NULL;
+}
+
+void SpeakTraceWriter::beginSpeak(uint32_t ulSpeakFlags)
+{
+    m_ullSpeakStart = monotonicMicroseconds();
+    m_ulFragments = 0;
+    m_ulActionChanges = 0;
+    m_ulActionCalls = 0;
+    m_ulLastActions = 0;
+    m_actions.clear();
+
+    // The header is completed by `endSpeak`.
+    m_record.assign(RECORD_HEADER_SIZE, 0);
+    memcpy(&m_record[20], &ulSpeakFlags, sizeof(ulSpeakFlags));
+}
+
+void SpeakTraceWriter::addFragment(const SpeakFragment& fragment, const SpeakTraceState& state)
+{
+    put<uint32_t>(m_record, (uint32_t)fragment.eAction);
+    put<uint32_t>(m_record, fragment.ulTextSrcOffset);
+    put<uint32_t>(m_record, state.ulLangId);
+    put<int32_t>(m_record, state.lEmphAdj);
+    put<int32_t>(m_record, state.lRateAdj);
+    put<uint32_t>(m_record, state.ulVolume);
+    put<int32_t>(m_record, state.lPitchMiddleAdj);
+    put<int32_t>(m_record, state.lPitchRangeAdj);
+    put<uint32_t>(m_record, state.ulSilenceMSecs);
+    put<uint32_t>(m_record, state.ulPartOfSpeech);
+    putString(m_record, fragment.pTextStart, fragment.ulTextLen);
+    putString(m_record, state.pPhoneIds);
+    putString(m_record, state.pCategory);
+    putString(m_record, state.pBefore);
+    putString(m_record, state.pAfter);
+
+    m_ulFragments += 1;
+}
+
+void SpeakTraceWriter::recordActions(uint32_t ulActions)
+{
+    if (ulActions != m_ulLastActions)
+    {
+        put<uint32_t>(m_actions, m_ulActionCalls);
+        put<uint32_t>(m_actions, ulActions);
+        put<uint64_t>(m_actions, monotonicMicroseconds() - m_ullSpeakStart);
+        m_ulLastActions = ulActions;
+        m_ulActionChanges += 1;
+    }
+    m_ulActionCalls += 1;
+}
+
+void SpeakTraceWriter::recordEventInterest(uint64_t ullEventInterest)
+{
+    memcpy(&m_record[28], &ullEventInterest, sizeof(ullEventInterest));
+}
+
+HRESULT SpeakTraceWriter::endSpeak()
+{
+    if (!m_pFile)
+    {
+        return E_HANDLE;
+    }
+
+    uint64_t ullStart = m_ullSpeakStart - m_ullOrigin;
+    uint64_t ullDuration = monotonicMicroseconds() - m_ullSpeakStart;
+    m_record.insert(m_record.end(), m_actions.begin(), m_actions.end());
+    uint32_t cbRecord = (uint32_t)(m_record.size() - 4);
+
+    memcpy(&m_record[0], &cbRecord, sizeof(cbRecord));
+    memcpy(&m_record[4], &ullStart, sizeof(ullStart));
+    memcpy(&m_record[12], &ullDuration, sizeof(ullDuration));
+    memcpy(&m_record[36], &m_ulFragments, sizeof(m_ulFragments));
+    memcpy(&m_record[40], &m_ulActionChanges, sizeof(m_ulActionChanges));
+
+    // Each record is flushed so that the trace remains useful if the host
+    // process terminates unexpectedly.
+    if (fwrite(m_record.data(), m_record.size(), 1, m_pFile) != 1 || fflush(m_pFile) != 0)
+    {
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+uint32_t TracingSpeakSite::getActions()
+{
+    uint32_t ulActions = m_site.getActions();
+    m_writer.recordActions(ulActions);
+    return ulActions;
+}
+
+HRESULT TracingSpeakSite::getEventInterest(uint64_t* pullEventInterest)
+{
+    HRESULT hr = m_site.getEventInterest(pullEventInterest);
+    m_writer.recordEventInterest(SUCCEEDED(hr) ? *pullEventInterest : 0);
+    return hr;
+}
+
+HRESULT TracingSpeakSite::addEvents(const SpeakEvent* pEvents, size_t numEvents)
+{
+    return m_site.addEvents(pEvents, numEvents);
+}
+
+HRESULT TracingSpeakSite::write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten)
+{
+    return m_site.write(pBuffer, cbBuffer, pcbWritten);
+}
+
+SpeakTraceReader::SpeakTraceReader() : m_pFile(NULL)
+{
+}
+
+SpeakTraceReader::~SpeakTraceReader()
+{
+    close();
+}
+
+HRESULT SpeakTraceReader::open(const char* path)
+{
+    close();
+
+    m_pFile = openFile(path, "rb");
+    if (!m_pFile)
+    {
+        return E_HANDLE;
+    }
+
+    char magic[4];
+    uint32_t ulVersion;
+    if (fread(magic, sizeof(magic), 1, m_pFile) != 1 ||
+        fread(&ulVersion, sizeof(ulVersion), 1, m_pFile) != 1 ||
+        memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+        ulVersion != SpeakTraceWriter::VERSION)
+    {
+        close();
+        return E_INVALIDARG;
+    }
+
+    return S_OK;
+}
+
+void SpeakTraceReader::close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+    }
+    m_pFile = NULL;
+}
+
+/**
+ * Sequential, bounds-checked access to a record's fields.
+ */
+class RecordCursor
+{
+public:
+    RecordCursor(const std::vector<uint8_t>& record) : m_record(record), m_position(0), m_valid(true) {}
+
+    bool valid() const { return m_valid; }
+
+    template <typename T>
+    T get()
+    {
+        T value = T();
+        if (take(sizeof(value)))
+        {
+            memcpy(&value, &m_record[m_position - sizeof(value)], sizeof(value));
+        }
+        return value;
+    }
+
+    /**
+     * Append a string to `strings`, followed by a null terminator.
+     *
+     * @returns {size_t} the string's offset within `strings`, or SIZE_MAX for
+     *                   a null string
+     */
+    size_t getString(std::u16string& strings, uint32_t* pulLength)
+    {
+        uint32_t ulLength = get<uint32_t>();
+        *pulLength = 0;
+        if (ulLength == NULL_STRING || !take((size_t)ulLength * sizeof(char16_t)))
+        {
+            return SIZE_MAX;
+        }
+
+        size_t offset = strings.size();
+        strings.resize(offset + ulLength + 1);
+        memcpy(&strings[offset], &m_record[m_position - ulLength * sizeof(char16_t)],
+            ulLength * sizeof(char16_t));
+        *pulLength = ulLength;
+        return offset;
+    }
+
+private:
+    bool take(size_t cb)
+    {
+        if (!m_valid || m_record.size() - m_position < cb)
+        {
+            m_valid = false;
+            return false;
+        }
+        m_position += cb;
+        return true;
+    }
+
+    const std::vector<uint8_t>& m_record;
+    size_t m_position;
+    bool m_valid;
+};
+
+bool SpeakTraceReader::next(TracedSpeak* pSpeak)
+{
+    uint32_t cbRecord;
+    if (!m_pFile || fread(&cbRecord, sizeof(cbRecord), 1, m_pFile) != 1 ||
+        cbRecord < RECORD_HEADER_SIZE - 4)
+    {
+        return false;
+    }
+
+    m_record.resize(cbRecord);
+    if (fread(m_record.data(), cbRecord, 1, m_pFile) != 1)
+    {
+        return false;
+    }
+
+    RecordCursor cursor(m_record);
+    pSpeak->ullStart = cursor.get<uint64_t>();
+    pSpeak->ullDuration = cursor.get<uint64_t>();
+    pSpeak->ulSpeakFlags = cursor.get<uint32_t>();
+    cursor.get<uint32_t>();
+    pSpeak->ullEventInterest = cursor.get<uint64_t>();
+    uint32_t ulFragments = cursor.get<uint32_t>();
+    uint32_t ulActions = cursor.get<uint32_t>();
+
+    if (ulFragments > cbRecord / FRAGMENT_HEADER_SIZE || ulActions > cbRecord / ACTIONS_SIZE)
+    {
+        return false;
+    }
+
+    pSpeak->fragments.resize(ulFragments);
+    pSpeak->states.resize(ulFragments);
+    pSpeak->actions.resize(ulActions);
+    pSpeak->strings.clear();
+
+    // Strings are resolved to pointers once `strings` has reached its final
+    // size.
+    std::vector<size_t> offsets(ulFragments * 5);
+
+    for (uint32_t i = 0; i < ulFragments; i += 1)
+    {
+        SpeakFragment& fragment = pSpeak->fragments[i];
+        SpeakTraceState& state = pSpeak->states[i];
+        uint32_t ulUnused;
+
+        fragment.eAction = (FragmentAction)cursor.get<uint32_t>();
+        fragment.ulTextSrcOffset = cursor.get<uint32_t>();
+        state.ulLangId = cursor.get<uint32_t>();
+        state.lEmphAdj = cursor.get<int32_t>();
+        state.lRateAdj = cursor.get<int32_t>();
+        state.ulVolume = cursor.get<uint32_t>();
+        state.lPitchMiddleAdj = cursor.get<int32_t>();
+        state.lPitchRangeAdj = cursor.get<int32_t>();
+        state.ulSilenceMSecs = cursor.get<uint32_t>();
+        state.ulPartOfSpeech = cursor.get<uint32_t>();
+        offsets[i * 5] = cursor.getString(pSpeak->strings, &fragment.ulTextLen);
+        offsets[i * 5 + 1] = cursor.getString(pSpeak->strings, &ulUnused);
+        offsets[i * 5 + 2] = cursor.getString(pSpeak->strings, &ulUnused);
+        offsets[i * 5 + 3] = cursor.getString(pSpeak->strings, &ulUnused);
+        offsets[i * 5 + 4] = cursor.getString(pSpeak->strings, &ulUnused);
+    }
+
+    for (uint32_t i = 0; i < ulActions; i += 1)
+    {
+        pSpeak->actions[i].ulCall = cursor.get<uint32_t>();
+        pSpeak->actions[i].ulActions = cursor.get<uint32_t>();
+        pSpeak->actions[i].ullOffset = cursor.get<uint64_t>();
+    }
+
+    if (!cursor.valid())
+    {
+        return false;
+    }
+
+    const char16_t* base = pSpeak->strings.data();
+    auto resolve = [base](size_t offset) { return offset == SIZE_MAX ? nullptr : base + offset; };
+    for (uint32_t i = 0; i < ulFragments; i += 1)
+    {
+        const char16_t* pText = resolve(offsets[i * 5]);
+        pSpeak->fragments[i].pTextStart = pText ? pText : u"";
+        pSpeak->states[i].pPhoneIds = resolve(offsets[i * 5 + 1]);
+        pSpeak->states[i].pCategory = resolve(offsets[i * 5 + 2]);
+        pSpeak->states[i].pBefore = resolve(offsets[i * 5 + 3]);
+        pSpeak->states[i].pAfter = resolve(offsets[i * 5 + 4]);
+    }
+
+    return true;
+}
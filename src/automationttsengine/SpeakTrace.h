@@ -0,0 +1,164 @@
+#pragma once
+#include "Portable.h"
+#include "SpeakPipeline.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Recording and playback of the input to `ISpTTSEngine::Speak`. Traces are
+ * captured by the engine on Windows and replayed against `SpeakPipeline` on
+ * any host (see `bench/replay.cpp`), providing realistic workloads for
+ * measuring changes to the pipeline.
+ *
+ * File layout (all integers little-endian):
+ *
+ *     "ATST", version (4)
+ *     records, each:
+ *       size (4)                    bytes which follow this field
+ *       start (8), duration (8)     microseconds relative to the first record
+ *       speakFlags (4), reserved (4)
+ *       eventInterest (8)
+ *       fragmentCount (4), actionCount (4)
+ *       fragments, each:
+ *         action, textSrcOffset, langId, emphAdj, rateAdj, volume,
+ *         pitchMiddleAdj, pitchRangeAdj, silenceMSecs, partOfSpeech (4 each)
+ *         text, phoneIds, category, before, after (strings)
+ *       actions, each:
+ *         call (4), actions (4), offset (8)
+ *
+ * Strings are stored as a character count (4) followed by UTF-16 code units;
+ * a count of 0xFFFFFFFF denotes a null pointer. Each action entry records the
+ * value returned by `GetActions` at the given (zero-based) call and time
+ * offset whenever it differs from the previously returned value.
+ */
+
+/**
+ * The voice state of a fragment; mirrors SPVSTATE. Strings are
+ * null-terminated and may be NULL.
+ */
+struct SpeakTraceState
+{
+    uint32_t        ulLangId;
+    int32_t         lEmphAdj;
+    int32_t         lRateAdj;
+    uint32_t        ulVolume;
+    int32_t         lPitchMiddleAdj;
+    int32_t         lPitchRangeAdj;
+    uint32_t        ulSilenceMSecs;
+    uint32_t        ulPartOfSpeech;
+    const char16_t* pPhoneIds;
+    const char16_t* pCategory;
+    const char16_t* pBefore;
+    const char16_t* pAfter;
+};
+
+struct SpeakTraceActions
+{
+    uint32_t ulCall;
+    uint32_t ulActions;
+    uint64_t ullOffset;
+};
+
+/**
+ * A `Speak` call read from a trace. The fragments' text and the states'
+ * strings refer to storage owned by this object.
+ */
+struct TracedSpeak
+{
+    uint64_t ullStart;
+    uint64_t ullDuration;
+    uint32_t ulSpeakFlags;
+    uint64_t ullEventInterest;
+    std::vector<SpeakFragment> fragments;
+    std::vector<SpeakTraceState> states;
+    std::vector<SpeakTraceActions> actions;
+    std::u16string strings;
+};
+
+class SpeakTraceWriter
+{
+public:
+    static const uint32_t VERSION = 1;
+
+    SpeakTraceWriter();
+    ~SpeakTraceWriter();
+
+    SpeakTraceWriter(const SpeakTraceWriter&) = delete;
+    SpeakTraceWriter& operator=(const SpeakTraceWriter&) = delete;
+
+    /**
+     * @param {const char*} path - UTF-8 encoded file system path; an existing
+     *                             file is replaced
+     */
+    HRESULT open(const char* path);
+    void close();
+    bool isOpen() const { return m_pFile != NULL; }
+
+    //--- Called for each `Speak`, in this order
+    void beginSpeak(uint32_t ulSpeakFlags);
+    void addFragment(const SpeakFragment& fragment, const SpeakTraceState& state);
+    HRESULT endSpeak();
+
+    //--- Called by `TracingSpeakSite`
+    void recordActions(uint32_t ulActions);
+    void recordEventInterest(uint64_t ullEventInterest);
+
+private:
+    FILE*                m_pFile;
+    uint64_t             m_ullOrigin;
+    std::vector<uint8_t> m_record;
+    std::vector<uint8_t> m_actions;
+
+    //--- State scoped to a single `Speak` call
+    uint64_t m_ullSpeakStart;
+    uint32_t m_ulFragments;
+    uint32_t m_ulActionChanges;
+    uint32_t m_ulActionCalls;
+    uint32_t m_ulLastActions;
+};
+
+/**
+ * Forwards to another site, recording the values which it returns.
+ */
+class TracingSpeakSite : public SpeakSite
+{
+public:
+    TracingSpeakSite(SpeakSite& site, SpeakTraceWriter& writer) : m_site(site), m_writer(writer) {}
+
+    uint32_t getActions();
+    HRESULT getEventInterest(uint64_t* pullEventInterest);
+    HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents);
+    HRESULT write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten);
+
+private:
+    SpeakSite&        m_site;
+    SpeakTraceWriter& m_writer;
+};
+
+class SpeakTraceReader
+{
+public:
+    SpeakTraceReader();
+    ~SpeakTraceReader();
+
+    SpeakTraceReader(const SpeakTraceReader&) = delete;
+    SpeakTraceReader& operator=(const SpeakTraceReader&) = delete;
+
+    HRESULT open(const char* path);
+    void close();
+
+    /**
+     * Read the next `Speak` call.
+     *
+     * @returns {bool} false at the end of the trace, including when the final
+     *                 record is incomplete (as when the recording process
+     *                 terminated while writing it)
+     */
+    bool next(TracedSpeak* pSpeak);
+
+private:
+    FILE*                m_pFile;
+    std::vector<uint8_t> m_record;
+};
@@ -0,0 +1,180 @@
+#include "SpeechPayload.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPEECH_PAYLOAD_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/** @returns {bool} whether `c` is ASCII whitespace (as matched by `\s`) */
+static inline bool isSpace(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/** @returns {bool} whether `c` is copied to the payload unchanged */
+static inline bool isPlain(unsigned char c)
+{
+    return c > ' ' && c != '"' && c != '\\';
+}
+
+/**
+ * Find the part of the text which remains once leading and trailing
+ * whitespace is removed.
+ */
+static void trim(const char* pText, size_t cbText, const unsigned char** ppStart, const unsigned char** ppEnd)
+{
+    const unsigned char* pStart = (const unsigned char*)pText;
+    const unsigned char* pEnd = pStart + cbText;
+    while (pStart < pEnd && isSpace(*pStart))
+    {
+        pStart += 1;
+    }
+    while (pEnd > pStart && isSpace(pEnd[-1]))
+    {
+        pEnd -= 1;
+    }
+    *ppStart = pStart;
+    *ppEnd = pEnd;
+}
+
+/**
+ * Write a byte which is not plain. Within a run of whitespace, only the first
+ * byte writes a space; nothing else which is written ends with a space, so
+ * the run has begun if the last byte written is one. The payload never begins
+ * with whitespace, so a byte has always been written before it.
+ *
+ * @returns {char*} the end of the payload
+ */
+static inline char* formatSpecial(unsigned char c, char* pOut)
+{
+    if (isSpace(c))
+    {
+        if (pOut[-1] != ' ')
+        {
+            *pOut++ = ' ';
+        }
+        return pOut;
+    }
+
+    *pOut++ = '\\';
+    if (c == '"' || c == '\\')
+    {
+        *pOut++ = (char)c;
+    }
+    else if (c == '\b')
+    {
+        *pOut++ = 'b';
+    }
+    else
+    {
+        *pOut++ = 'u';
+        *pOut++ = '0';
+        *pOut++ = '0';
+        *pOut++ = HEX_DIGITS[c >> 4];
+        *pOut++ = HEX_DIGITS[c & 0xf];
+    }
+    return pOut;
+}
+
+size_t formatSpeechPayloadScalar(const char* pText, size_t cbText, char* pPayload)
+{
+    const unsigned char* p;
+    const unsigned char* pEnd;
+    trim(pText, cbText, &p, &pEnd);
+
+    char* pOut = pPayload;
+    for (; p < pEnd; p += 1)
+    {
+        if (isPlain(*p))
+        {
+            *pOut++ = (char)*p;
+        }
+        else
+        {
+            pOut = formatSpecial(*p, pOut);
+        }
+    }
+    return pOut - pPayload;
+}
+
+#ifdef SPEECH_PAYLOAD_SSE2
+
+static inline size_t countTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return (size_t)__builtin_ctz(mask);
+#endif
+}
+
+size_t formatSpeechPayload(const char* pText, size_t cbText, char* pPayload)
+{
+    const unsigned char* pStart;
+    const unsigned char* pEnd;
+    trim(pText, cbText, &pStart, &pEnd);
+
+    const __m128i controlMax = _mm_set1_epi8(0x1f);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    char* pOut = pPayload;
+    for (const unsigned char* p = pStart; p < pEnd;)
+    {
+        // A block is compared with the same bytes shifted by one so that a
+        // space is plain only if it follows a byte which is not whitespace.
+        // The first byte has no predecessor, but is never whitespace.
+        if (p > pStart && pEnd - p >= 16)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+            __m128i previous = _mm_loadu_si128((const __m128i*)(p - 1));
+            __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(bytes, controlMax), controlMax);
+            __m128i escaped = _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash));
+            __m128i repeatedSpace = _mm_and_si128(_mm_cmpeq_epi8(bytes, space),
+                _mm_cmpeq_epi8(_mm_max_epu8(previous, space), space));
+            unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(control, escaped), repeatedSpace));
+
+            // The payload has space for six bytes per remaining byte of
+            // input, so the whole block may be stored even if only part of
+            // it is plain.
+            _mm_storeu_si128((__m128i*)pOut, bytes);
+            if (!mask)
+            {
+                pOut += 16;
+                p += 16;
+                continue;
+            }
+            size_t cbPlain = countTrailingZeros(mask);
+            pOut += cbPlain;
+            p += cbPlain;
+        }
+
+        if (isPlain(*p))
+        {
+            *pOut++ = (char)*p;
+        }
+        else
+        {
+            pOut = formatSpecial(*p, pOut);
+        }
+        p += 1;
+    }
+    return pOut - pPayload;
+}
+
+#else
+
+size_t formatSpeechPayload(const char* pText, size_t cbText, char* pPayload)
+{
+    return formatSpeechPayloadScalar(pText, cbText, pPayload);
+}
+
+#endif
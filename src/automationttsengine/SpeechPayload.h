@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Maximum number of bytes produced by formatting `cbText` bytes of speech as
+ * a payload (a control character is escaped as `\u00xx`).
+ */
+inline size_t maxSpeechPayloadLength(size_t cbText)
+{
+    return cbText * 6;
+}
+
+/**
+ * Format speech as the driver broadcasts it, so that the driver can splice it
+ * into the messages which it sends to its clients without decoding and
+ * encoding it again. Each run of ASCII whitespace becomes a single space,
+ * leading and trailing whitespace is removed, and the result is escaped as
+ * the content of a JSON string exactly as `JSON.stringify` escapes it:
+ * quotation marks, backslashes and control characters are escaped, and all
+ * other bytes (including those of multi-byte UTF-8 sequences) are copied.
+ *
+ * Where SSE2 is available, the text is scanned sixteen bytes at a time and
+ * each run of bytes which need no change is copied whole.
+ *
+ * @param {const char*} pText - UTF-8 input; need not be null-terminated
+ * @param {size_t} cbText - length of the input in bytes
+ * @param {char*} pPayload - destination with space for at least
+ *                           `maxSpeechPayloadLength(cbText)` bytes
+ *
+ * @returns {size_t} number of bytes written (no null terminator is appended)
+ */
+size_t formatSpeechPayload(const char* pText, size_t cbText, char* pPayload);
+
+/**
+ * The portable implementation of `formatSpeechPayload`, which examines one
+ * byte at a time. It produces the same output.
+ */
+size_t formatSpeechPayloadScalar(const char* pText, size_t cbText, char* pPayload);
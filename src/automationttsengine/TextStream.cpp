@@ -0,0 +1,85 @@
+#include "TextStream.h"
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static bool isContinuationByte(char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+size_t nextTextChunk(const char* pText, size_t cbText, size_t cbChunk)
+{
+    size_t cbLimit = cbText < cbChunk ? cbText : cbChunk;
+
+    for (size_t i = 0; i < cbLimit; i += 1)
+    {
+        if (pText[i] == '\0')
+        {
+            return i;
+        }
+    }
+
+    if (cbLimit == cbText)
+    {
+        return cbText;
+    }
+
+    for (size_t i = cbLimit; i > 0; i -= 1)
+    {
+        if (isSpace(pText[i - 1]))
+        {
+            return i;
+        }
+    }
+
+    // A single word is longer than a chunk, so it is divided between code
+    // points. Malformed text which contains nothing but continuation bytes is
+    // divided anywhere.
+    size_t cbBoundary = cbLimit;
+    while (cbBoundary > 0 && isContinuationByte(pText[cbBoundary]))
+    {
+        cbBoundary -= 1;
+    }
+    return cbBoundary > 0 ? cbBoundary : cbLimit;
+}
+
+HRESULT streamText(const char* pText, size_t cbText, TextStreamWriter& writer, size_t* pNumChunks)
+{
+    size_t numChunks = 0;
+    size_t offset = 0;
+
+    while (offset < cbText)
+    {
+        size_t cbChunk = nextTextChunk(pText + offset, cbText - offset);
+
+        if (cbChunk > 0)
+        {
+            HRESULT hr = writer.write(pText + offset, cbChunk);
+            if (SUCCEEDED(hr))
+            {
+                hr = writer.write("", 1);
+            }
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            numChunks += 1;
+        }
+
+        offset += cbChunk;
+        if (offset < cbText && pText[offset] == '\0')
+        {
+            offset += 1;
+        }
+    }
+
+    if (pNumChunks)
+    {
+        *pNumChunks = numChunks;
+    }
+
+    return S_OK;
+}
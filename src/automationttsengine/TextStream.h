@@ -0,0 +1,45 @@
+#pragma once
+#include "Portable.h"
+#include <cstddef>
+
+/**
+ * Maximum number of bytes of text in a chunk. The Vocalizer reads its input
+ * into a buffer of this size (plus the terminator), so the memory needed to
+ * speak a fragment does not depend on the fragment's length.
+ */
+static const size_t TEXT_CHUNK_SIZE = 4096;
+
+/**
+ * Receives the bytes of a text stream, e.g. by writing them to a pipe.
+ */
+class TextStreamWriter
+{
+public:
+    virtual ~TextStreamWriter() {}
+
+    /**
+     * Write all of the given bytes, blocking if necessary.
+     */
+    virtual HRESULT write(const void* pBuffer, size_t cbBuffer) = 0;
+};
+
+/**
+ * Determine the length of the first chunk of UTF-8 text. The chunk ends after
+ * the last whitespace character which fits within `cbChunk` bytes or, if
+ * there is none, at the last code point boundary which does, so that chunks
+ * may be decoded (and spoken) independently. An embedded null character ends
+ * the chunk before it.
+ *
+ * @returns {size_t} a number of bytes no greater than `cbChunk` (and greater
+ *                   than zero unless the text is empty or begins with a null
+ *                   character)
+ */
+size_t nextTextChunk(const char* pText, size_t cbText, size_t cbChunk = TEXT_CHUNK_SIZE);
+
+/**
+ * Write UTF-8 text as a sequence of null-terminated chunks of at most
+ * `TEXT_CHUNK_SIZE` bytes each. Null characters within the text are dropped.
+ *
+ * @param {size_t*} pNumChunks - optional; receives the number of chunks written
+ */
+HRESULT streamText(const char* pText, size_t cbText, TextStreamWriter& writer, size_t* pNumChunks = NULL);
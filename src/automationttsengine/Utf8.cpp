@@ -0,0 +1,54 @@
+#include "Utf8.h"
+
+size_t toUtf8(const char16_t* text, size_t length, char* pOutput)
+{
+    char* p = pOutput;
+
+    for (size_t i = 0; i < length; i += 1)
+    {
+        char32_t codePoint = text[i];
+
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < length &&
+            text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF)
+        {
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+            i += 1;
+        }
+        else if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+        {
+            codePoint = 0xFFFD;
+        }
+
+        if (codePoint < 0x80)
+        {
+            *p++ = (char)codePoint;
+        }
+        else if (codePoint < 0x800)
+        {
+            *p++ = (char)(0xC0 | (codePoint >> 6));
+            *p++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            *p++ = (char)(0xE0 | (codePoint >> 12));
+            *p++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            *p++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            *p++ = (char)(0xF0 | (codePoint >> 18));
+            *p++ = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            *p++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            *p++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    return p - pOutput;
+}
+
+std::string toUtf8(const char16_t* text, size_t length)
+{
+    std::string utf8(maxUtf8Length(length), '\0');
+    utf8.resize(toUtf8(text, length, &utf8[0]));
+    return utf8;
+}
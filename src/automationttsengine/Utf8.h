@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/**
+ * Maximum number of bytes produced by converting `length` UTF-16 code units
+ * to UTF-8 (a surrogate pair occupies two code units and four bytes).
+ */
+inline size_t maxUtf8Length(size_t length)
+{
+    return length * 3;
+}
+
+/**
+ * Convert a sequence of UTF-16 code units (as provided by the Microsoft Speech
+ * API) to UTF-8. Unpaired surrogates are replaced with U+FFFD.
+ *
+ * @param {const char16_t*} text - UTF-16 input; need not be null-terminated
+ * @param {size_t} length - number of code units to convert
+ * @param {char*} pOutput - destination with space for at least
+ *                          `maxUtf8Length(length)` bytes
+ *
+ * @returns {size_t} number of bytes written (no null terminator is appended)
+ */
+size_t toUtf8(const char16_t* text, size_t length, char* pOutput);
+
+std::string toUtf8(const char16_t* text, size_t length);
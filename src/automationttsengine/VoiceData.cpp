@@ -0,0 +1,660 @@
+#include "VoiceData.h"
+#include "FileFormat.h"
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char VOICE_DATA_MAGIC[4] = { 'A', 'T', 'V', 'D' };
+static const uint32_t NO_ENTRY = 0xFFFFFFFF;
+
+static const size_t OFFSET_MAGIC = 0;
+static const size_t OFFSET_VERSION = 4;
+static const size_t OFFSET_NUM_WORDS = 8;
+static const size_t OFFSET_NUM_BUCKETS = 12;
+static const size_t OFFSET_SAMPLES_PER_SECOND = 16;
+static const size_t OFFSET_BITS_PER_SAMPLE = 20;
+static const size_t OFFSET_CHANNELS = 22;
+static const size_t OFFSET_BUCKETS = 24;
+static const size_t OFFSET_ENTRIES = 28;
+static const size_t OFFSET_FILE_SIZE = 32;
+
+static const size_t ENTRY_HASH = 0;
+static const size_t ENTRY_NEXT = 4;
+static const size_t ENTRY_TEXT_OFFSET = 8;
+static const size_t ENTRY_TEXT_LENGTH = 12;
+static const size_t ENTRY_AUDIO_OFFSET = 16;
+static const size_t ENTRY_AUDIO_LENGTH = 20;
+
+const uint32_t VoiceData::VERSION;
+const size_t VoiceData::HEADER_SIZE;
+const size_t VoiceData::ENTRY_SIZE;
+const size_t VoiceData::MAX_WORD_LENGTH;
+const uint32_t VoiceDataVocalizer::UNKNOWN_WORD_SILENCE_MS;
+
+static uint32_t load32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint16_t load16(const uint8_t* p)
+{
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void store32(uint8_t* p, uint32_t value)
+{
+    memcpy(p, &value, sizeof(value));
+}
+
+static void store16(uint8_t* p, uint16_t value)
+{
+    memcpy(p, &value, sizeof(value));
+}
+
+static char16_t fold(char16_t c)
+{
+    return c >= u'A' && c <= u'Z' ? (char16_t)(c + (u'a' - u'A')) : c;
+}
+
+static uint32_t hashWord(const char16_t* pText, size_t length)
+{
+    uint32_t hash = FNV1A_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i += 1)
+    {
+        char16_t c = fold(pText[i]);
+        hash = fnv1a(hash, &c, sizeof(c));
+    }
+    return hash;
+}
+
+static bool wordsMatch(const char16_t* a, const char16_t* b, size_t length)
+{
+    for (size_t i = 0; i < length; i += 1)
+    {
+        if (fold(a[i]) != fold(b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Convert a word from UTF-8 to UTF-16.
+ *
+ * @returns {size_t} the number of code units written, or 0 if the input is
+ *                   malformed or does not fit
+ */
+static size_t toUtf16(const char* pUtf8, size_t cbUtf8, char16_t* pOutput, size_t capacity)
+{
+    const uint8_t* p = (const uint8_t*)pUtf8;
+    const uint8_t* pEnd = p + cbUtf8;
+    size_t length = 0;
+
+    while (p < pEnd)
+    {
+        uint32_t codePoint = *p;
+        size_t continuation = 0;
+        if (codePoint >= 0xF0)
+        {
+            codePoint &= 0x07;
+            continuation = 3;
+        }
+        else if (codePoint >= 0xE0)
+        {
+            codePoint &= 0x0F;
+            continuation = 2;
+        }
+        else if (codePoint >= 0xC0)
+        {
+            codePoint &= 0x1F;
+            continuation = 1;
+        }
+        else if (codePoint >= 0x80)
+        {
+            return 0;
+        }
+
+        if ((size_t)(pEnd - p) <= continuation)
+        {
+            return 0;
+        }
+        for (size_t i = 1; i <= continuation; i += 1)
+        {
+            if ((p[i] & 0xC0) != 0x80)
+            {
+                return 0;
+            }
+            codePoint = (codePoint << 6) | (p[i] & 0x3F);
+        }
+        p += continuation + 1;
+
+        if (codePoint >= 0x10000)
+        {
+            if (length + 2 > capacity)
+            {
+                return 0;
+            }
+            codePoint -= 0x10000;
+            pOutput[length++] = (char16_t)(0xD800 + (codePoint >> 10));
+            pOutput[length++] = (char16_t)(0xDC00 + (codePoint & 0x3FF));
+        }
+        else
+        {
+            if (length + 1 > capacity)
+            {
+                return 0;
+            }
+            pOutput[length++] = (char16_t)codePoint;
+        }
+    }
+
+    return length;
+}
+
+VoiceData::VoiceData()
+    : m_pView(NULL), m_cbView(0), m_ulNumWords(0), m_ulBucketMask(0), m_pBuckets(NULL), m_pEntries(NULL),
+      m_format{0, 0, 0}
+#ifdef _WIN32
+    , m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#endif
+{
+}
+
+VoiceData::~VoiceData()
+{
+    close();
+}
+
+HRESULT VoiceData::open(const char* path)
+{
+    close();
+
+    size_t cbView = 0;
+
+#ifdef _WIN32
+    int cchPath = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+    std::wstring widePath(cchPath, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], cchPath);
+
+    m_hFile = CreateFileW(
+        widePath.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return E_HANDLE;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size) || (uint64_t)size.QuadPart < HEADER_SIZE ||
+        (uint64_t)size.QuadPart > 0xFFFFFFFF)
+    {
+        close();
+        return E_FAIL;
+    }
+    cbView = (size_t)size.QuadPart;
+
+    m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_hMapping == NULL)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    m_pView = (const uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, cbView);
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return E_HANDLE;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (uint64_t)status.st_size < HEADER_SIZE ||
+        (uint64_t)status.st_size > 0xFFFFFFFF)
+    {
+        ::close(fd);
+        return E_FAIL;
+    }
+    cbView = (size_t)status.st_size;
+
+    // The mapping remains valid once the descriptor is closed.
+    void* pView = mmap(NULL, cbView, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    m_pView = pView == MAP_FAILED ? NULL : (const uint8_t*)pView;
+#endif
+
+    if (m_pView == NULL)
+    {
+        close();
+        return E_FAIL;
+    }
+
+    m_cbView = cbView;
+
+    HRESULT hr = validate();
+    if (FAILED(hr))
+    {
+        close();
+    }
+    return hr;
+}
+
+/**
+ * Check that every offset in the file refers to data within the file, and
+ * that every hash chain terminates.
+ */
+HRESULT VoiceData::validate()
+{
+    if (memcmp(m_pView + OFFSET_MAGIC, VOICE_DATA_MAGIC, sizeof(VOICE_DATA_MAGIC)) != 0 ||
+        load32(m_pView + OFFSET_VERSION) != VERSION ||
+        load32(m_pView + OFFSET_FILE_SIZE) != m_cbView)
+    {
+        return E_FAIL;
+    }
+
+    uint32_t ulNumWords = load32(m_pView + OFFSET_NUM_WORDS);
+    uint32_t ulNumBuckets = load32(m_pView + OFFSET_NUM_BUCKETS);
+    uint64_t ullBuckets = load32(m_pView + OFFSET_BUCKETS);
+    uint64_t ullEntries = load32(m_pView + OFFSET_ENTRIES);
+
+    if (ulNumBuckets == 0 || (ulNumBuckets & (ulNumBuckets - 1)) != 0 ||
+        ullBuckets < HEADER_SIZE || ullBuckets + (uint64_t)ulNumBuckets * 4 > m_cbView ||
+        ullEntries < HEADER_SIZE || ullEntries + (uint64_t)ulNumWords * ENTRY_SIZE > m_cbView)
+    {
+        return E_FAIL;
+    }
+
+    const uint8_t* pBuckets = m_pView + ullBuckets;
+    for (uint32_t i = 0; i < ulNumBuckets; i += 1)
+    {
+        uint32_t ulFirst = load32(pBuckets + (size_t)i * 4);
+        if (ulFirst != NO_ENTRY && ulFirst >= ulNumWords)
+        {
+            return E_FAIL;
+        }
+    }
+
+    const uint8_t* pEntries = m_pView + ullEntries;
+    for (uint32_t i = 0; i < ulNumWords; i += 1)
+    {
+        const uint8_t* pEntry = pEntries + (size_t)i * ENTRY_SIZE;
+        uint32_t ulNext = load32(pEntry + ENTRY_NEXT);
+        uint64_t ullText = load32(pEntry + ENTRY_TEXT_OFFSET);
+        uint64_t ullTextLength = load32(pEntry + ENTRY_TEXT_LENGTH);
+        uint64_t ullAudio = load32(pEntry + ENTRY_AUDIO_OFFSET);
+        uint64_t ullAudioLength = load32(pEntry + ENTRY_AUDIO_LENGTH);
+
+        // Chains link each entry to an earlier one, so they cannot cycle.
+        if ((ulNext != NO_ENTRY && ulNext >= i) ||
+            ullText % sizeof(char16_t) != 0 || ullTextLength == 0 || ullTextLength > MAX_WORD_LENGTH ||
+            ullText + (ullTextLength + 1) * sizeof(char16_t) > m_cbView ||
+            load16(m_pView + ullText + ullTextLength * sizeof(char16_t)) != 0 ||
+            ullAudio + ullAudioLength > m_cbView)
+        {
+            return E_FAIL;
+        }
+    }
+
+    m_ulNumWords = ulNumWords;
+    m_ulBucketMask = ulNumBuckets - 1;
+    m_pBuckets = pBuckets;
+    m_pEntries = pEntries;
+    m_format.ulSamplesPerSecond = load32(m_pView + OFFSET_SAMPLES_PER_SECOND);
+    m_format.usBitsPerSample = load16(m_pView + OFFSET_BITS_PER_SAMPLE);
+    m_format.usChannels = load16(m_pView + OFFSET_CHANNELS);
+
+    return S_OK;
+}
+
+void VoiceData::close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+    }
+    m_hMapping = NULL;
+    m_hFile = INVALID_HANDLE_VALUE;
+#else
+    if (m_pView)
+    {
+        munmap((void*)m_pView, m_cbView);
+    }
+#endif
+    m_pView = NULL;
+    m_cbView = 0;
+    m_ulNumWords = 0;
+    m_ulBucketMask = 0;
+    m_pBuckets = NULL;
+    m_pEntries = NULL;
+    m_format = VoiceAudioFormat{0, 0, 0};
+}
+
+bool VoiceData::word(uint32_t ulIndex, VoiceWord* pWord) const
+{
+    if (ulIndex >= m_ulNumWords)
+    {
+        return false;
+    }
+
+    const uint8_t* pEntry = m_pEntries + (size_t)ulIndex * ENTRY_SIZE;
+    pWord->pText = (const char16_t*)(m_pView + load32(pEntry + ENTRY_TEXT_OFFSET));
+    pWord->ulTextLen = load32(pEntry + ENTRY_TEXT_LENGTH);
+    pWord->ulNumAudioBytes = load32(pEntry + ENTRY_AUDIO_LENGTH);
+    pWord->pAudio = m_pView + load32(pEntry + ENTRY_AUDIO_OFFSET);
+    return true;
+}
+
+bool VoiceData::lookUp(const char16_t* pText, size_t length, VoiceWord* pWord) const
+{
+    if (!m_pView || length == 0 || length > MAX_WORD_LENGTH)
+    {
+        return false;
+    }
+
+    uint32_t hash = hashWord(pText, length);
+    uint32_t ulIndex = load32(m_pBuckets + (size_t)(hash & m_ulBucketMask) * 4);
+
+    while (ulIndex != NO_ENTRY)
+    {
+        const uint8_t* pEntry = m_pEntries + (size_t)ulIndex * ENTRY_SIZE;
+        if (load32(pEntry + ENTRY_HASH) == hash && load32(pEntry + ENTRY_TEXT_LENGTH) == length &&
+            wordsMatch((const char16_t*)(m_pView + load32(pEntry + ENTRY_TEXT_OFFSET)), pText, length))
+        {
+            return word(ulIndex, pWord);
+        }
+        ulIndex = load32(pEntry + ENTRY_NEXT);
+    }
+
+    return false;
+}
+
+bool VoiceData::lookUp(const char* pUtf8, size_t cbUtf8, VoiceWord* pWord) const
+{
+    char16_t text[MAX_WORD_LENGTH];
+    size_t length = toUtf16(pUtf8, cbUtf8, text, MAX_WORD_LENGTH);
+    return length > 0 && lookUp(text, length, pWord);
+}
+
+HRESULT writeVoiceData(const char* path, const VoiceAudioFormat& format, const VoiceDataEntry* pEntries,
+    size_t numEntries)
+{
+    std::vector<const VoiceDataEntry*> words;
+    std::unordered_set<std::u16string> seen;
+    try
+    {
+        for (size_t i = 0; i < numEntries; i += 1)
+        {
+            const std::u16string& text = pEntries[i].text;
+            if (text.empty() || text.size() > VoiceData::MAX_WORD_LENGTH ||
+                pEntries[i].audio.size() > 0xFFFFFFFF)
+            {
+                return E_INVALIDARG;
+            }
+
+            std::u16string folded(text);
+            for (char16_t& c : folded)
+            {
+                c = fold(c);
+            }
+            if (seen.insert(folded).second)
+            {
+                words.push_back(&pEntries[i]);
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // Keep chains short: at least two buckets per word.
+    uint32_t ulNumBuckets = 1;
+    while (ulNumBuckets < words.size() * 2)
+    {
+        ulNumBuckets *= 2;
+    }
+
+    uint64_t ullBuckets = VoiceData::HEADER_SIZE;
+    uint64_t ullEntries = ullBuckets + (uint64_t)ulNumBuckets * 4;
+    uint64_t ullText = ullEntries + (uint64_t)words.size() * VoiceData::ENTRY_SIZE;
+    uint64_t ullAudio = ullText;
+    for (const VoiceDataEntry* pEntry : words)
+    {
+        ullAudio += (pEntry->text.size() + 1) * sizeof(char16_t);
+    }
+    uint64_t ullSize = (ullAudio + 3) & ~(uint64_t)3;
+    for (const VoiceDataEntry* pEntry : words)
+    {
+        ullSize += (pEntry->audio.size() + 3) & ~(size_t)3;
+    }
+    if (ullSize > 0xFFFFFFFF)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::vector<uint8_t> file;
+    try
+    {
+        file.resize((size_t)ullSize, 0);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    uint8_t* p = file.data();
+    memcpy(p + OFFSET_MAGIC, VOICE_DATA_MAGIC, sizeof(VOICE_DATA_MAGIC));
+    store32(p + OFFSET_VERSION, VoiceData::VERSION);
+    store32(p + OFFSET_NUM_WORDS, (uint32_t)words.size());
+    store32(p + OFFSET_NUM_BUCKETS, ulNumBuckets);
+    store32(p + OFFSET_SAMPLES_PER_SECOND, format.ulSamplesPerSecond);
+    store16(p + OFFSET_BITS_PER_SAMPLE, format.usBitsPerSample);
+    store16(p + OFFSET_CHANNELS, format.usChannels);
+    store32(p + OFFSET_BUCKETS, (uint32_t)ullBuckets);
+    store32(p + OFFSET_ENTRIES, (uint32_t)ullEntries);
+    store32(p + OFFSET_FILE_SIZE, (uint32_t)ullSize);
+
+    for (uint32_t i = 0; i < ulNumBuckets; i += 1)
+    {
+        store32(p + ullBuckets + (size_t)i * 4, NO_ENTRY);
+    }
+
+    uint64_t ullNextText = ullText;
+    uint64_t ullNextAudio = (ullAudio + 3) & ~(uint64_t)3;
+    for (uint32_t i = 0; i < words.size(); i += 1)
+    {
+        const VoiceDataEntry& word = *words[i];
+        uint8_t* pEntry = p + ullEntries + (size_t)i * VoiceData::ENTRY_SIZE;
+        uint32_t hash = hashWord(word.text.data(), word.text.size());
+        uint8_t* pBucket = p + ullBuckets + (size_t)(hash & (ulNumBuckets - 1)) * 4;
+
+        store32(pEntry + ENTRY_HASH, hash);
+        store32(pEntry + ENTRY_NEXT, load32(pBucket));
+        store32(pBucket, i);
+
+        store32(pEntry + ENTRY_TEXT_OFFSET, (uint32_t)ullNextText);
+        store32(pEntry + ENTRY_TEXT_LENGTH, (uint32_t)word.text.size());
+        memcpy(p + ullNextText, word.text.data(), word.text.size() * sizeof(char16_t));
+        ullNextText += (word.text.size() + 1) * sizeof(char16_t);
+
+        store32(pEntry + ENTRY_AUDIO_OFFSET, (uint32_t)ullNextAudio);
+        store32(pEntry + ENTRY_AUDIO_LENGTH, (uint32_t)word.audio.size());
+        if (!word.audio.empty())
+        {
+            memcpy(p + ullNextAudio, word.audio.data(), word.audio.size());
+        }
+        ullNextAudio += (word.audio.size() + 3) & ~(size_t)3;
+    }
+
+    FILE* pFile = fopen(path, "wb");
+    if (!pFile)
+    {
+        return E_HANDLE;
+    }
+    bool fWritten = fwrite(file.data(), 1, file.size(), pFile) == file.size();
+    fWritten = fclose(pFile) == 0 && fWritten;
+
+    return fWritten ? S_OK : E_FAIL;
+}
+
+HRESULT parseSampleVoice(const uint8_t* pData, size_t cbData, std::vector<VoiceDataEntry>* pEntries)
+{
+    size_t offset = 0;
+    auto read32 = [&](uint32_t* pValue) {
+        if (cbData - offset < 4)
+        {
+            return false;
+        }
+        *pValue = load32(pData + offset);
+        offset += 4;
+        return true;
+    };
+
+    uint32_t ulVersion = 0;
+    uint32_t ulNumWords = 0;
+    if (!read32(&ulVersion) || ulVersion != 1 || !read32(&ulNumWords))
+    {
+        return E_FAIL;
+    }
+
+    try
+    {
+        pEntries->clear();
+        for (uint32_t i = 0; i < ulNumWords; i += 1)
+        {
+            uint32_t cbText = 0;
+            if (!read32(&cbText) || cbText < 2 * sizeof(char16_t) || cbText % sizeof(char16_t) != 0 ||
+                cbText > cbData - offset)
+            {
+                return E_FAIL;
+            }
+
+            // The text's length includes its null terminator.
+            VoiceDataEntry entry;
+            entry.text.resize(cbText / sizeof(char16_t) - 1);
+            memcpy(&entry.text[0], pData + offset, cbText - sizeof(char16_t));
+            offset += cbText;
+
+            uint32_t cbAudio = 0;
+            if (!read32(&cbAudio) || cbAudio > cbData - offset)
+            {
+                return E_FAIL;
+            }
+            entry.audio.assign(pData + offset, pData + offset + cbAudio);
+            offset += cbAudio;
+
+            pEntries->push_back(std::move(entry));
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+static bool isWordByte(char c)
+{
+    // Bytes of multi-byte sequences are treated as letters.
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '\'' ||
+        (uint8_t)c >= 0x80;
+}
+
+HRESULT VoiceDataVocalizer::writeSilence(SpeakSite& site, size_t cbSilence)
+{
+    static const uint8_t silence[SpeakPipeline::AUDIO_WRITE_SIZE] = {};
+
+    while (cbSilence > 0)
+    {
+        size_t cbChunk = cbSilence < sizeof(silence) ? cbSilence : sizeof(silence);
+        size_t cbWritten = 0;
+        HRESULT hr = site.write(silence, cbChunk, &cbWritten);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        cbSilence -= cbChunk;
+    }
+
+    return S_OK;
+}
+
+HRESULT VoiceDataVocalizer::vocalize(const char* pText, size_t cbText, SpeakSite& site)
+{
+    const VoiceAudioFormat& format = m_voiceData.format();
+    size_t cbBlock = (size_t)format.usChannels * format.usBitsPerSample / 8;
+    size_t cbUnknownWord = (size_t)format.ulSamplesPerSecond * UNKNOWN_WORD_SILENCE_MS / 1000 * cbBlock;
+
+    size_t i = 0;
+    while (i < cbText)
+    {
+        while (i < cbText && !isWordByte(pText[i]))
+        {
+            i += 1;
+        }
+        size_t start = i;
+        while (i < cbText && isWordByte(pText[i]))
+        {
+            i += 1;
+        }
+        if (start == i)
+        {
+            break;
+        }
+
+        if (site.getActions() & SPEAK_ACTION_ABORT)
+        {
+            return S_OK;
+        }
+
+        HRESULT hr = S_OK;
+        VoiceWord word;
+        if (m_voiceData.lookUp(pText + start, i - start, &word))
+        {
+            size_t cbWritten = 0;
+            ullKnownWords += 1;
+            hr = site.write(word.pAudio, word.ulNumAudioBytes, &cbWritten);
+        }
+        else
+        {
+            ullUnknownWords += 1;
+            hr = writeSilence(site, cbUnknownWord);
+        }
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "SpeakPipeline.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A recording of a single word, as stored in a voice data file. The fields
+ * mirror VOICEITEM (see AutomationTtsEngine.idl); both pointers refer
+ * directly to the mapped file.
+ */
+struct VoiceWord
+{
+    const char16_t* pText;      // null-terminated
+    uint32_t        ulTextLen;
+    uint32_t        ulNumAudioBytes;
+    const uint8_t*  pAudio;
+};
+
+struct VoiceAudioFormat
+{
+    uint32_t ulSamplesPerSecond;
+    uint16_t usBitsPerSample;
+    uint16_t usChannels;
+};
+
+/**
+ * A read-only, memory-mapped voice data file: a fixed vocabulary of words,
+ * each with PCM audio, which the engine can speak without synthesis.
+ *
+ * File layout (all integers little-endian; offsets are from the start of the
+ * file):
+ *
+ *     header (64 bytes)
+ *       0  magic "ATVD"          24 bucketsOffset
+ *       4  version               28 entriesOffset
+ *       8  numWords              32 fileSize
+ *       12 numBuckets (power     36 reserved
+ *          of two)
+ *       16 samplesPerSecond
+ *       20 bitsPerSample (2), channels (2)
+ *     buckets (numBuckets x 4 bytes): index of the first entry in the bucket,
+ *       or 0xFFFFFFFF
+ *     entries (numWords x 24 bytes)
+ *       hash, next (entry index or 0xFFFFFFFF), textOffset, textLength
+ *       (UTF-16 code units), audioOffset, audioLength (bytes)
+ *     text (null-terminated UTF-16) and audio (4-byte aligned), referenced by
+ *       the entries
+ *
+ * Words are matched without regard to ASCII case. The bucket of a word is
+ * `hash & (numBuckets - 1)`, where `hash` is the FNV-1a hash of the bytes of
+ * the word's case-folded UTF-16 code units. Words are at most
+ * `MAX_WORD_LENGTH` code units long.
+ */
+class VoiceData
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 64;
+    static const size_t ENTRY_SIZE = 24;
+    static const size_t MAX_WORD_LENGTH = 64;
+
+    VoiceData();
+    ~VoiceData();
+
+    VoiceData(const VoiceData&) = delete;
+    VoiceData& operator=(const VoiceData&) = delete;
+
+    /**
+     * Map the file at the given location. The file is validated in full so
+     * that lookups need not check bounds.
+     *
+     * @param {const char*} path - UTF-8 encoded file system path
+     */
+    HRESULT open(const char* path);
+    void close();
+    bool isOpen() const { return m_pView != NULL; }
+
+    uint32_t numWords() const { return m_ulNumWords; }
+    const VoiceAudioFormat& format() const { return m_format; }
+
+    bool word(uint32_t ulIndex, VoiceWord* pWord) const;
+    bool lookUp(const char16_t* pText, size_t length, VoiceWord* pWord) const;
+    bool lookUp(const char* pUtf8, size_t cbUtf8, VoiceWord* pWord) const;
+
+private:
+    HRESULT validate();
+
+    const uint8_t*   m_pView;
+    size_t           m_cbView;
+    uint32_t         m_ulNumWords;
+    uint32_t         m_ulBucketMask;
+    const uint8_t*   m_pBuckets;
+    const uint8_t*   m_pEntries;
+    VoiceAudioFormat m_format;
+#ifdef _WIN32
+    HANDLE           m_hFile;
+    HANDLE           m_hMapping;
+#endif
+};
+
+struct VoiceDataEntry
+{
+    std::u16string       text;
+    std::vector<uint8_t> audio;
+};
+
+/**
+ * Write a voice data file containing the given words. Where a word appears
+ * more than once, the first entry is used.
+ */
+HRESULT writeVoiceData(const char* path, const VoiceAudioFormat& format, const VoiceDataEntry* pEntries,
+    size_t numEntries);
+
+/**
+ * Parse the word list format of the Microsoft Speech SDK's sample voice
+ * (`SampleVoice.vce`): a version (1) and a word count, followed by each
+ * word's null-terminated UTF-16 text and its 11kHz 16-bit mono audio, each
+ * preceded by its length in bytes.
+ */
+HRESULT parseSampleVoice(const uint8_t* pData, size_t cbData, std::vector<VoiceDataEntry>* pEntries);
+
+/**
+ * Speaks the words of each fragment by writing their recorded audio, straight
+ * from the mapped file, to the output site. Words which are not in the
+ * vocabulary are replaced by a short silence.
+ */
+class VoiceDataVocalizer : public Vocalizer
+{
+public:
+    static const uint32_t UNKNOWN_WORD_SILENCE_MS = 100;
+
+    explicit VoiceDataVocalizer(const VoiceData& voiceData) : m_voiceData(voiceData) {}
+
+    HRESULT vocalize(const char* pText, size_t cbText, SpeakSite& site);
+
+    //--- Statistics
+    uint64_t ullKnownWords = 0;
+    uint64_t ullUnknownWords = 0;
+
+private:
+    HRESULT writeSilence(SpeakSite& site, size_t cbSilence);
+
+    const VoiceData& m_voiceData;
+};
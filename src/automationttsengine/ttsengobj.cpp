@@ -16,142 +16,807 @@
 #include "stdafx.h"
 #include "TtsEngObj.h"
 #include "..\Shared\branding.h"
+#include "..\Shared\DriverClient.h"
+#include "AudioTap.h"
+#include "CaptureJournal.h"
+#include "EngineSettings.h"
+#include "MessageFormat.h"
+#include "ResourceCounters.h"
+#include "SettingsReceiver.h"
+#include "SpeechPayload.h"
+#include "TextStream.h"
+#include "Utf8.h"
 #include <stdio.h>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
 #include <windows.h>
 
 // Number of milliseconds to wait between queries for "actions" from the
 // ISpTTSEngineSite.
 static const int ABORT_SIGNAL_POLLING_PERIOD = 100;
 
+// Number of milliseconds to wait between checks for output from a Vocalizer
+// which is rendering audio.
+static const int RENDER_POLLING_PERIOD = 5;
+static const DWORD RENDER_PIPE_SIZE = 64 * 1024;
+
+// Capacity of each capture journal, which is shared by every instance of the
+// engine which reports to the same driver.
+static const uint64_t CAPTURE_JOURNAL_DATA_CAPACITY = 8 * 1024 * 1024;
+static const uint32_t CAPTURE_JOURNAL_INDEX_CAPACITY = 65536;
+
+// The format of the audio which the engine writes to the output site, as
+// reported by `GetOutputFormat`. Voice data must be recorded in it, and the
+// audio tap describes it to the driver.
+static const SPSTREAMFORMAT OUTPUT_FORMAT = SPSF_11kHz16BitMono;
+
+// Capacity of each audio tap: about three minutes of audio in the output
+// format.
+static const uint64_t AUDIO_TAP_CAPACITY = 4 * 1024 * 1024;
+
+// Bursts of messages (as during say-all) are gathered into batches of up to
+// this many bytes, so that they cost one write to the driver rather than one
+// per message. No message is held for longer than the latency cap.
+static const size_t MESSAGE_BATCH_SIZE = 64 * 1024;
+static const uint32_t MESSAGE_BATCH_MIN_WINDOW_US = 250;
+static const uint32_t MESSAGE_BATCH_MAX_WINDOW_US = 1000;
+static const uint32_t MESSAGE_LATENCY_CAP_US = 4000;
+
+// Speech which the screen reader repeats (control types, states, headings
+// read again) is sent to the driver in full once per connection and by
+// reference thereafter. Dictionary memory is bounded on both sides by the
+// number of entries and the length of each; shorter speech costs less to send
+// than a reference would save.
+static const uint32_t MESSAGE_DICTIONARY_ENTRIES = 1024;
+static const size_t MESSAGE_DICTIONARY_MIN_ENTRY = 8;
+static const size_t MESSAGE_DICTIONARY_MAX_ENTRY = 256;
+
+// The resources held by the engine are reported to the driver once every so
+// many calls to Speak, as well as when each instance is destroyed, because
+// the screen reader may keep an instance for as long as it runs.
+static const uint64_t RESOURCE_REPORT_INTERVAL = 1000;
+
+// Available from Windows 10, version 1803; older versions reject the flag.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Locations used by a voice whose token does not name its own, as is the
+// case for the first voice registered by MakeVoice.
+#define DEFAULT_DRIVER_PIPE "\\\\.\\pipe\\my_pipe"
+#define DEFAULT_CAPTURE_JOURNAL AUTOMATION_VOICE_DATA "\\capture.journal"
+#define DEFAULT_AUDIO_TAP AUTOMATION_VOICE_DATA "\\audio.tap"
+// Used when the driver enables tracing for a voice whose token names no trace
+// directory.
+#define DEFAULT_TRACE_DIRECTORY AUTOMATION_VOICE_DATA "\\traces"
+
 //--- Local
-std::string to_utf8(const std::wstring& s, ULONG length)
+
+// Time at which the `Speak` call in progress on this thread began, or zero.
+static thread_local uint64_t t_ullSpeakEntry = 0;
+
+/**
+ * Handles are created and closed through these functions so that the engine's
+ * resource counters include them.
+ */
+static BOOL createPipe(PHANDLE phRead, PHANDLE phWrite, LPSECURITY_ATTRIBUTES pSecurity, DWORD cbSize)
+{
+    if (!CreatePipe(phRead, phWrite, pSecurity, cbSize))
+    {
+        return FALSE;
+    }
+    ResourceCounters::opened(ResourceCounters::HANDLES, 2);
+    return TRUE;
+}
+
+static void closeHandle(HANDLE handle)
 {
-    std::string utf8;
-    int len = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), length, NULL, 0, NULL, NULL);
-    if (len > 0)
+    if (CloseHandle(handle))
     {
-        utf8.resize(len);
-        WideCharToMultiByte(CP_UTF8, 0, s.c_str(), length, &utf8[0], len, NULL, NULL);
+        ResourceCounters::closed(ResourceCounters::HANDLES);
     }
-    return utf8;
 }
 
-enum class MessageType {
-    LIFECYCLE,
-    SPEECH,
-    ERR
+/**
+ * Describe `OUTPUT_FORMAT` as voice data and the audio tap do.
+ */
+static HRESULT getOutputFormat(VoiceAudioFormat* pFormat)
+{
+    GUID formatId;
+    WAVEFORMATEX* pCoMemWaveFormatEx = NULL;
+    HRESULT hr = SpConvertStreamFormatEnum(OUTPUT_FORMAT, &formatId, &pCoMemWaveFormatEx);
+    if (SUCCEEDED(hr))
+    {
+        pFormat->ulSamplesPerSecond = pCoMemWaveFormatEx->nSamplesPerSec;
+        pFormat->usBitsPerSample = pCoMemWaveFormatEx->wBitsPerSample;
+        pFormat->usChannels = pCoMemWaveFormatEx->nChannels;
+        ::CoTaskMemFree(pCoMemWaveFormatEx);
+    }
+    return hr;
+}
+
+/**
+ * Create the directory which contains the file at `path`, if necessary.
+ */
+static void createParentDirectory(const std::string& path)
+{
+    size_t separator = path.find_last_of('\\');
+    if (separator != std::string::npos)
+    {
+        CreateDirectoryA(path.substr(0, separator).c_str(), NULL);
+    }
+}
+
+/**
+ * The resources through which the engine reports to one driver: the
+ * connection to the driver, the capture journal and the audio tap. Each
+ * voice registered by `MakeVoice /instances` names its own in its token, so
+ * that each of several drivers on one host observes a different voice. Every
+ * engine object in the process which reports to the same driver shares one
+ * endpoint, and the connection persists between messages.
+ */
+class DriverEndpoint : public MessageSink
+{
+public:
+    DriverEndpoint(const std::string& pipe, const std::string& journalPath, const std::string& audioTapPath);
+    ~DriverEndpoint();
+
+    HRESULT emit(MessageType type, const char* pData, size_t cbData);
+
+    /**
+     * Emit a message from the system thread pool so that the caller does not
+     * wait for the driver. The module remains loaded until the message has
+     * been written. Messages emitted in this way are not ordered with respect
+     * to those emitted by `emit`, so this is reserved for lifecycle
+     * notifications.
+     */
+    void emitAsync(MessageType type, const std::string& data);
+
+    /**
+     * The journal is opened on first use so that its cost is not incurred by
+     * processes which only enumerate voices. If it cannot be opened, messages
+     * are delivered to the driver without being recorded.
+     */
+    CaptureJournal* captureJournal();
+
+    /**
+     * The audio tap is opened on first use, as the journal is. It is only
+     * written while the driver has enabled it.
+     */
+    AudioTap* audioTap();
+
+    DriverClientStatistics statistics() { return m_client.statistics(); }
+
+    /**
+     * The settings sent by the driver (see `EngineSettings`), which each
+     * engine object applies at the beginning of every call to Speak. Any
+     * settings which the driver has sent since the previous call are received
+     * first, so the driver can switch modes without the screen reader being
+     * restarted.
+     */
+    EngineSettings settings();
+
+    /**
+     * Write the messages held in the current batch once its deadline has
+     * passed. Invoked by the flush timer.
+     */
+    void flushHeld();
+
+private:
+    void scheduleFlush();
+    void receiveSettings();
+
+    DriverClient   m_client;
+    std::string    m_journalPath;
+    std::string    m_audioTapPath;
+    CaptureJournal m_journal;
+    std::once_flag m_journalOpened;
+    AudioTap       m_audioTap;
+    std::once_flag m_audioTapOpened;
+
+    // Signals the thread pool to write a batch whose sender has moved on.
+    HANDLE         m_hFlushTimer;
+    PTP_WAIT       m_pFlushWait;
+    std::atomic<bool> m_fFlushScheduled;
+
+    SettingsReceiver m_settings;
+    // Serializes receipt of the settings (see `SettingsReceiver::receive`),
+    // and guards the settings last mirrored below.
+    std::mutex     m_receiving;
+    EngineSettings m_applied;
+    // Mirror `EngineSettings::fEscapeSpeech` and the messages to which the
+    // driver's sessions subscribe, which apply to each message emitted after
+    // the settings are received rather than from the next call to Speak.
+    std::atomic<bool> m_fEscapeSpeech;
+    // One bit (`1 << type`) for each type of message which is journaled but
+    // not sent.
+    std::atomic<uint32_t> m_ulSuppressedTypes;
+    std::atomic<bool> m_fStampTimes;
 };
 
-HRESULT emit(MessageType type, std::string data) {
-    HANDLE pipe = CreateFile(
-        L"\\\\.\\pipe\\my_pipe",
-        GENERIC_WRITE,
-        FILE_SHARE_READ | FILE_SHARE_WRITE,
-        NULL,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
+static EngineSettings defaultSettings()
+{
+    EngineSettings settings;
+    settings.ulBatchMinWindowUs = MESSAGE_BATCH_MIN_WINDOW_US;
+    settings.ulBatchMaxWindowUs = MESSAGE_BATCH_MAX_WINDOW_US;
+    settings.ulBatchLatencyCapUs = MESSAGE_LATENCY_CAP_US;
+    return settings;
+}
+
+static void CALLBACK flushCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WAIT wait,
+    TP_WAIT_RESULT waitResult)
+{
+    ((DriverEndpoint*)context)->flushHeld();
+}
 
-    if (pipe == INVALID_HANDLE_VALUE)
+DriverEndpoint::DriverEndpoint(const std::string& pipe, const std::string& journalPath,
+    const std::string& audioTapPath)
+    : m_client(pipe.c_str()), m_journalPath(journalPath), m_audioTapPath(audioTapPath),
+      m_hFlushTimer(NULL), m_pFlushWait(NULL), m_fFlushScheduled(false),
+      m_settings(m_client, *this, defaultSettings()), m_applied(defaultSettings()),
+      m_fEscapeSpeech(false), m_ulSuppressedTypes(0), m_fStampTimes(true)
+{
+    // The system's timer resolution (usually 15.6ms) would exceed the latency
+    // cap, so a high-resolution timer is used where one is available.
+    m_hFlushTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!m_hFlushTimer)
+    {
+        m_hFlushTimer = CreateWaitableTimerW(NULL, FALSE, NULL);
+    }
+    if (m_hFlushTimer)
     {
-        fprintf(stderr, "Failed to connect to pipe.");
-        return E_HANDLE;
+        ResourceCounters::opened(ResourceCounters::HANDLES);
     }
 
-    std::string typeString;
-    if (type == MessageType::LIFECYCLE)
+    TP_CALLBACK_ENVIRON environment;
+    InitializeThreadpoolEnvironment(&environment);
+    SetThreadpoolCallbackLibrary(&environment, _Module.GetModuleInstance());
+    if (m_hFlushTimer)
     {
-        typeString = "lifecycle";
+        m_pFlushWait = CreateThreadpoolWait(flushCallback, this, &environment);
     }
-    else if (type == MessageType::SPEECH)
+    DestroyThreadpoolEnvironment(&environment);
+
+    // Without a timer, held messages could wait indefinitely for the next
+    // message, so every message is written at once.
+    if (m_pFlushWait)
     {
-        typeString = "speech";
+        DriverClientBatching batching;
+        batching.cbMaxBatch = MESSAGE_BATCH_SIZE;
+        batching.ulMinWindowUs = MESSAGE_BATCH_MIN_WINDOW_US;
+        batching.ulMaxWindowUs = MESSAGE_BATCH_MAX_WINDOW_US;
+        batching.ulLatencyCapUs = MESSAGE_LATENCY_CAP_US;
+        m_client.setBatching(batching);
     }
-    else
+
+    DriverClientDictionary dictionary;
+    dictionary.ulEntries = MESSAGE_DICTIONARY_ENTRIES;
+    dictionary.cbMinEntry = MESSAGE_DICTIONARY_MIN_ENTRY;
+    dictionary.cbMaxEntry = MESSAGE_DICTIONARY_MAX_ENTRY;
+    m_client.setDictionary(dictionary);
+}
+
+DriverEndpoint::~DriverEndpoint()
+{
+    if (m_pFlushWait)
     {
-        typeString = "internalError";
+        SetThreadpoolWait(m_pFlushWait, NULL, NULL);
+        CloseThreadpoolWait(m_pFlushWait);
+    }
+    if (m_hFlushTimer)
+    {
+        closeHandle(m_hFlushTimer);
+    }
+    m_client.flush();
+}
+
+void DriverEndpoint::scheduleFlush()
+{
+    // A scheduled flush which precedes the deadline (because the batch's
+    // window has since been extended) reschedules itself.
+    if (m_fFlushScheduled.exchange(true))
+    {
+        return;
     }
-    std::string message(typeString + ":" + data);
-    DWORD numBytesWritten = 0;
-    BOOL result = WriteFile(
-        pipe, // handle to our outbound pipe
-        message.c_str(), // data to send
-        message.size(),
-        &numBytesWritten, // will store actual amount of data sent
-        NULL // not using overlapped IO
-    );
 
-    // Close the pipe (automatically disconnects client too)
-    CloseHandle(pipe);
+    uint64_t ullDeadline = m_client.flushDeadline();
+    uint64_t ullNow = monotonicMicroseconds();
+    // A negative due time is relative, in units of 100 nanoseconds.
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -(LONGLONG)(ullDeadline > ullNow ? (ullDeadline - ullNow) * 10 : 1);
+    SetWaitableTimer(m_hFlushTimer, &dueTime, 0, NULL, NULL, FALSE);
+    SetThreadpoolWait(m_pFlushWait, m_hFlushTimer, NULL);
+}
+
+void DriverEndpoint::flushHeld()
+{
+    m_fFlushScheduled = false;
 
-    if (!result)
+    uint64_t ullDeadline = m_client.flushDeadline();
+    if (!ullDeadline)
     {
-        fprintf(stderr, "Failed to send data.");
-        return E_FAIL;
+        return;
+    }
+    if (ullDeadline > monotonicMicroseconds())
+    {
+        scheduleFlush();
+        return;
     }
+    m_client.flush();
+}
 
-    return S_OK;
+EngineSettings DriverEndpoint::settings()
+{
+    receiveSettings();
+    return m_settings.load();
 }
 
-#define SPEECH_BUFFER_SIZE 4096
+static uint32_t typeBit(MessageType type)
+{
+    return 1u << (uint32_t)type;
+}
 
 /**
- * Build an "environment block" as specified by ProcessCreate. This should
- * describe a process variable environment which is nearly identical to that of
- * the current process, with the sole difference of one additional variable
- * named "WORDS" set to the value specified by the `text` parameter.
+ * Apply the settings which the driver has sent (see `SettingsReceiver`),
+ * including the defaults which are restored when it disconnects, and mirror
+ * those which apply to each message emitted.
  */
-HRESULT createEnv(std::string text, TCHAR* newEnv)
+void DriverEndpoint::receiveSettings()
 {
-    LPTCH currentEnv = GetEnvironmentStrings();
-    LPTSTR currentEnvProgress, newEnvProgress;
+    // A thread which is already receiving applies the same settings.
+    std::unique_lock<std::mutex> lock(m_receiving, std::try_to_lock);
+    if (!lock.owns_lock() || !m_settings.receive())
+    {
+        return;
+    }
+
+    EngineSettings settings = m_settings.load();
+    m_fEscapeSpeech = settings.fEscapeSpeech;
+    m_ulSuppressedTypes = (settings.fEmitSpeech ? 0 : typeBit(MessageType::SPEECH)) |
+        (settings.fEmitLifecycle ? 0 : typeBit(MessageType::LIFECYCLE)) |
+        (settings.fEmitErrors ? 0 : typeBit(MessageType::ERR)) |
+        (settings.fEmitBookmarks ? 0 : typeBit(MessageType::BOOKMARK));
+    m_fStampTimes = settings.fStampTimes;
 
-    if (currentEnv == NULL)
+    // Without a flush timer, batching remains disabled (see the constructor).
+    if (m_pFlushWait && !settings.sameBatching(m_applied))
     {
-        return E_FAIL;
+        DriverClientBatching batching;
+        batching.cbMaxBatch = MESSAGE_BATCH_SIZE;
+        batching.ulMinWindowUs = settings.ulBatchMinWindowUs;
+        batching.ulMaxWindowUs = settings.ulBatchMaxWindowUs;
+        batching.ulLatencyCapUs = settings.ulBatchLatencyCapUs;
+        m_client.setBatching(batching);
     }
+    m_applied = settings;
+}
+
+CaptureJournal* DriverEndpoint::captureJournal()
+{
+    std::call_once(m_journalOpened, [this] {
+        createParentDirectory(m_journalPath);
+        if (FAILED(m_journal.open(m_journalPath.c_str(),
+            CAPTURE_JOURNAL_DATA_CAPACITY, CAPTURE_JOURNAL_INDEX_CAPACITY)))
+        {
+            // Reported asynchronously, since emitting a message opens the
+            // journal.
+            emitAsync(MessageType::ERR, "Failed to open capture journal.");
+        }
+    });
+
+    return m_journal.isOpen() ? &m_journal : NULL;
+}
+
+AudioTap* DriverEndpoint::audioTap()
+{
+    std::call_once(m_audioTapOpened, [this] {
+        createParentDirectory(m_audioTapPath);
+        VoiceAudioFormat format;
+        if (FAILED(getOutputFormat(&format)) || FAILED(m_audioTap.open(m_audioTapPath.c_str(), AUDIO_TAP_CAPACITY,
+            format.ulSamplesPerSecond, format.usBitsPerSample, format.usChannels)))
+        {
+            emitAsync(MessageType::ERR, "Failed to open audio tap.");
+        }
+    });
+
+    return m_audioTap.isOpen() ? &m_audioTap : NULL;
+}
 
-    currentEnvProgress = (LPTSTR)currentEnv;
-    newEnvProgress = (LPTSTR)newEnv;
+HRESULT DriverEndpoint::emit(MessageType type, const char* pData, size_t cbData) {
+    bool fStampTimes = m_fStampTimes.load(std::memory_order_relaxed);
+    uint64_t ullEmitted = fStampTimes ? monotonicMicroseconds() : 0;
 
-    while (*currentEnvProgress)
+    // Messages are recorded before delivery is attempted so that the driver
+    // can recover them if it is not currently listening. The sequence number
+    // allows the driver to recognize messages which it has already recovered.
+    char attributes[3 * MessageBuffer::ATTRIBUTE_SIZE];
+    size_t cbAttributes = 0;
+    bool fRecorded = false;
+    CaptureJournal* journal = captureJournal();
+    if (journal)
     {
-        if (FAILED(StringCchCopy(newEnvProgress, SPEECH_BUFFER_SIZE, currentEnvProgress)))
+        // Each thread reuses its own buffer so that recording a message does
+        // not allocate.
+        thread_local MessageBuffer t_record;
+        uint64_t ullSequence = 0;
+        if (SUCCEEDED(t_record.format(type, pData, cbData)) &&
+            SUCCEEDED(journal->append(t_record.data(), t_record.size(), CaptureJournal::now(), &ullSequence)))
         {
-            FreeEnvironmentStrings(currentEnv);
-            return E_FAIL;
+            cbAttributes = MessageBuffer::formatSequence(ullSequence, attributes);
+            fRecorded = true;
+        }
+    }
+
+    // Messages to which no session subscribes are recorded but not sent, so
+    // that a driver which starts later can recover them. The beginning and
+    // end of each utterance are always sent, since the driver relies on them
+    // to delimit speech.
+    if (m_ulSuppressedTypes.load(std::memory_order_relaxed) & typeBit(type))
+    {
+        return S_OK;
+    }
+
+    // Each message is stamped with the time at which it was emitted, and the
+    // beginning of each utterance with the time at which `Speak` was called,
+    // so that the driver can measure how long the screen reader takes to
+    // respond to a key press. The driver reads the same monotonic clock.
+    // The stamps are omitted when no session subscribes to timing.
+    if (fStampTimes)
+    {
+        if (cbAttributes)
+        {
+            attributes[cbAttributes++] = ' ';
+        }
+        cbAttributes += MessageBuffer::formatAttribute("t", ullEmitted, attributes + cbAttributes);
+        if (type == MessageType::SPEAK_BEGIN && t_ullSpeakEntry)
+        {
+            attributes[cbAttributes++] = ' ';
+            cbAttributes += MessageBuffer::formatAttribute("entry", t_ullSpeakEntry, attributes + cbAttributes);
         }
-        newEnvProgress += lstrlen(newEnvProgress) + 1;
-        currentEnvProgress += lstrlen(currentEnvProgress) + 1;
     }
 
-    FreeEnvironmentStrings(currentEnv);
+    // Speech is journaled as it was spoken, but may be delivered as a payload
+    // which the driver broadcasts without decoding it (marked by `esc=1`).
+    if (type == MessageType::SPEECH && m_fEscapeSpeech)
+    {
+        thread_local std::string t_payload;
+        try
+        {
+            if (t_payload.size() < maxSpeechPayloadLength(cbData))
+            {
+                t_payload.resize(maxSpeechPayloadLength(cbData));
+            }
+            cbData = formatSpeechPayload(pData, cbData, &t_payload[0]);
+            pData = t_payload.data();
+            if (cbAttributes)
+            {
+                attributes[cbAttributes++] = ' ';
+            }
+            cbAttributes += MessageBuffer::formatAttribute("esc", 1, attributes + cbAttributes);
+        }
+        catch (const std::bad_alloc&)
+        {
+            // The speech is delivered as it was spoken instead.
+        }
+    }
 
-    if (FAILED(StringCchCopy(newEnvProgress, SPEECH_BUFFER_SIZE, TEXT("WORDS="))))
+    // Speech may be gathered into batches, but the messages for which the
+    // driver waits (such as the end of an utterance or a bookmark) end them.
+    bool fBoundary = type != MessageType::SPEECH && type != MessageType::SPEAK_BEGIN;
+    int status = m_client.send(messageTypeName(type), cbAttributes ? attributes : NULL, pData, cbData, fBoundary);
+
+    // A message coalesced into another thread's write is delivered by that
+    // thread.
+    if (status == AT_DRIVER_CLIENT_OK || status == AT_DRIVER_CLIENT_COALESCED)
     {
-        return E_FAIL;
+        return S_OK;
+    }
+    if (status == AT_DRIVER_CLIENT_HELD)
+    {
+        scheduleFlush();
+        return S_OK;
     }
 
-    // Advance by the string length in order to overwrite the trailing NULL byte added
-    // by the previous invocation of `StringCchCopy` as the input value should be part of
-    // the same string.
-    newEnvProgress += lstrlen(newEnvProgress);
+    // Undelivered messages are retried by subsequent calls, and recorded
+    // messages are also recovered when the driver next starts. Dropped
+    // messages are counted in the client's statistics, which are reported
+    // when the voice is destroyed.
+    return status == AT_DRIVER_CLIENT_QUEUED || fRecorded ? S_FALSE : E_FAIL;
+}
 
-    std::wstring wideText(text.begin(), text.end());
-    if (FAILED(StringCchCopy(newEnvProgress, SPEECH_BUFFER_SIZE, (STRSAFE_LPCWSTR)wideText.c_str())))
+struct AsyncMessage
+{
+    DriverEndpoint* pEndpoint;
+    MessageType type;
+    std::string data;
+};
+
+static void CALLBACK emitAsyncCallback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+    AsyncMessage* message = (AsyncMessage*)context;
+    message->pEndpoint->emit(message->type, message->data.data(), message->data.size());
+    delete message;
+}
+
+void DriverEndpoint::emitAsync(MessageType type, const std::string& data)
+{
+    // Lifecycle messages are informational, so one which cannot be
+    // allocated is not sent.
+    AsyncMessage* message = NULL;
+    try
     {
-        return E_FAIL;
+        message = new AsyncMessage{ this, type, data };
+    }
+    catch (const std::bad_alloc&)
+    {
+        return;
     }
 
-    // Terminate the block with a null byte
-    newEnvProgress += lstrlen(newEnvProgress) + 1;
-    *newEnvProgress = (TCHAR)0;
+    TP_CALLBACK_ENVIRON environment;
+    InitializeThreadpoolEnvironment(&environment);
+    SetThreadpoolCallbackLibrary(&environment, _Module.GetModuleInstance());
 
-    return S_OK;
+    if (!TrySubmitThreadpoolCallback(emitAsyncCallback, message, &environment))
+    {
+        delete message;
+    }
+
+    DestroyThreadpoolEnvironment(&environment);
+}
+
+/**
+ * Endpoints are keyed by the driver's pipe and persist until the module is
+ * unloaded, so messages emitted asynchronously may refer to them.
+ *
+ * @returns {DriverEndpoint*} the endpoint for the driver listening at `pipe`;
+ *                            the journal and audio tap locations of the
+ *                            first engine object to report to it apply
+ */
+static DriverEndpoint* driverEndpoint(const std::string& pipe, const std::string& journalPath,
+    const std::string& audioTapPath)
+{
+    static std::mutex s_mutex;
+    static std::map<std::string, std::unique_ptr<DriverEndpoint>> s_endpoints;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::unique_ptr<DriverEndpoint>& endpoint = s_endpoints[pipe];
+    if (!endpoint)
+    {
+        endpoint.reset(new DriverEndpoint(pipe, journalPath, audioTapPath));
+    }
+    return endpoint.get();
+}
+
+static DriverEndpoint* defaultEndpoint()
+{
+    return driverEndpoint(DEFAULT_DRIVER_PIPE, DEFAULT_CAPTURE_JOURNAL, DEFAULT_AUDIO_TAP);
 }
 
+/**
+ * @returns {std::string} the UTF-8 encoded string value of the token with the
+ *                        given name, or `defaultValue` if it has none
+ */
+static std::string tokenString(ISpObjectToken* pToken, LPCWSTR name, const char* defaultValue)
+{
+    CSpDynamicString dstrValue;
+    if (FAILED(pToken->GetStringValue(name, &dstrValue)))
+    {
+        return defaultValue;
+    }
+    return toUtf8((const char16_t*)(WCHAR*)dstrValue, wcslen(dstrValue));
+}
+
+/**
+ * Writes a text stream to the pipe connected to a Vocalizer's standard input.
+ */
+class PipeTextWriter : public TextStreamWriter
+{
+public:
+    explicit PipeTextWriter(HANDLE hPipe) : m_hPipe(hPipe) {}
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer)
+    {
+        const char* p = static_cast<const char*>(pBuffer);
+        while (cbBuffer > 0)
+        {
+            DWORD cbWritten = 0;
+            if (!WriteFile(m_hPipe, p, (DWORD)cbBuffer, &cbWritten, NULL))
+            {
+                return HRESULT_FROM_WIN32(GetLastError());
+            }
+            p += cbWritten;
+            cbBuffer -= cbWritten;
+        }
+        return S_OK;
+    }
+
+private:
+    HANDLE m_hPipe;
+};
+
+/**
+ * A subprocess of the project's C++/CLI solution named "Vocalizer", which
+ * reads the text to speak from its standard input.
+ *
+ * The text is streamed as null-terminated chunks of at most `TEXT_CHUNK_SIZE`
+ * bytes through a pipe whose buffer holds one chunk, so fragments of any
+ * length are spoken with a fixed amount of memory on either side of the pipe.
+ * (Text was formerly passed via an environment block of fixed size, which
+ * limited each fragment to a few thousand characters.) The chunks are written
+ * from a separate thread because the subprocess only reads the next chunk
+ * once it has spoken the previous one, and the caller must remain free to
+ * observe requests to abort.
+ */
+class VocalizerProcess
+{
+public:
+    VocalizerProcess() : m_fStarted(false)
+    {
+        ZeroMemory(&m_processInfo, sizeof(m_processInfo));
+    }
+
+    ~VocalizerProcess()
+    {
+        if (m_fStarted)
+        {
+            terminate();
+            finish(NULL);
+        }
+    }
+
+    VocalizerProcess(const VocalizerProcess&) = delete;
+    VocalizerProcess& operator=(const VocalizerProcess&) = delete;
+
+    /**
+     * @param {HANDLE} hStdOutput - inheritable handle to which the subprocess
+     *                              writes audio instead of playing it, or NULL
+     */
+    HRESULT start(const char* pText, size_t cbText, HANDLE hStdOutput)
+    {
+        SECURITY_ATTRIBUTES security = { sizeof(security), NULL, TRUE };
+        HANDLE hInputRead = NULL;
+        HANDLE hInputWrite = NULL;
+        if (!createPipe(&hInputRead, &hInputWrite, &security, (DWORD)TEXT_CHUNK_SIZE + 1))
+        {
+            return E_FAIL;
+        }
+        SetHandleInformation(hInputWrite, HANDLE_FLAG_INHERIT, 0);
+
+        // Only this subprocess's own pipes are inherited. Renders run
+        // concurrently, and a subprocess which inherited another's pipe would
+        // hold it open after that subprocess exited, leaving its writer
+        // blocked.
+        HANDLE inherited[] = { hInputRead, hStdOutput };
+        SIZE_T cbAttributes = 0;
+        InitializeProcThreadAttributeList(NULL, 1, 0, &cbAttributes);
+        alignas(void*) BYTE attributes[256];
+        LPPROC_THREAD_ATTRIBUTE_LIST pAttributes = (LPPROC_THREAD_ATTRIBUTE_LIST)attributes;
+        if (cbAttributes > sizeof(attributes) ||
+            !InitializeProcThreadAttributeList(pAttributes, 1, 0, &cbAttributes))
+        {
+            closeHandle(hInputRead);
+            closeHandle(hInputWrite);
+            return E_FAIL;
+        }
+
+        STARTUPINFOEXW startup_info;
+        ZeroMemory(&startup_info, sizeof(startup_info));
+        startup_info.StartupInfo.cb = sizeof(startup_info);
+        startup_info.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+        startup_info.StartupInfo.hStdInput = hInputRead;
+        startup_info.StartupInfo.hStdOutput = hStdOutput;
+        startup_info.lpAttributeList = pAttributes;
+        TCHAR application[] = TEXT(AUTOMATION_VOICE_HOME "\\Vocalizer.exe");
+        TCHAR playCommand[] = TEXT("Vocalizer.exe");
+        TCHAR renderCommand[] = TEXT("Vocalizer.exe --stdout");
+
+        bool result = UpdateProcThreadAttribute(
+                pAttributes,
+                0,
+                PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                inherited,
+                (hStdOutput ? 2 : 1) * sizeof(HANDLE),
+                NULL,
+                NULL
+            ) &&
+            CreateProcessW(
+                application,
+                hStdOutput ? renderCommand : playCommand,
+                NULL,
+                NULL,
+                true,
+                CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT,
+                NULL,
+                NULL,
+                &startup_info.StartupInfo,
+                &m_processInfo
+            );
+
+        DeleteProcThreadAttributeList(pAttributes);
+        // Only the subprocess retains the read end, so the pipe breaks when
+        // the subprocess exits.
+        closeHandle(hInputRead);
+
+        if (!result)
+        {
+            closeHandle(hInputWrite);
+            return E_FAIL;
+        }
+        ResourceCounters::opened(ResourceCounters::HANDLES, 2);
+        ResourceCounters::opened(ResourceCounters::PROCESSES);
+
+        try
+        {
+            m_writer = std::thread([hInputWrite, pText, cbText]() {
+                PipeTextWriter writer(hInputWrite);
+                streamText(pText, cbText, writer);
+                // The end of the stream tells the subprocess to exit once it
+                // has spoken the final chunk.
+                closeHandle(hInputWrite);
+            });
+        }
+        catch (const std::system_error&)
+        {
+            closeHandle(hInputWrite);
+            TerminateProcess(m_processInfo.hProcess, 0);
+            closeHandle(m_processInfo.hProcess);
+            closeHandle(m_processInfo.hThread);
+            ResourceCounters::closed(ResourceCounters::PROCESSES);
+            return E_FAIL;
+        }
+        ResourceCounters::opened(ResourceCounters::THREADS);
+
+        m_fStarted = true;
+        return S_OK;
+    }
+
+    HANDLE process() const
+    {
+        return m_processInfo.hProcess;
+    }
+
+    void terminate()
+    {
+        TerminateProcess(m_processInfo.hProcess, 0);
+    }
+
+    /**
+     * Wait for the subprocess to exit and release it.
+     *
+     * @param {DWORD*} pdwExitCode - optional; receives the exit code
+     */
+    HRESULT finish(DWORD* pdwExitCode)
+    {
+        WaitForSingleObject(m_processInfo.hProcess, INFINITE);
+        // The subprocess has exited, so any pending write fails.
+        m_writer.join();
+        ResourceCounters::closed(ResourceCounters::THREADS);
+        m_fStarted = false;
+
+        HRESULT hr = S_OK;
+        if (pdwExitCode && !GetExitCodeProcess(m_processInfo.hProcess, pdwExitCode))
+        {
+            hr = E_FAIL;
+        }
+
+        closeHandle(m_processInfo.hProcess);
+        closeHandle(m_processInfo.hThread);
+        ResourceCounters::closed(ResourceCounters::PROCESSES);
+
+        return hr;
+    }
+
+private:
+    PROCESS_INFORMATION m_processInfo;
+    std::thread         m_writer;
+    bool                m_fStarted;
+};
+
 /**
  * Vocalize a string of text.
  *
@@ -162,94 +827,228 @@ HRESULT createEnv(std::string text, TCHAR* newEnv)
  * Evidence: "Stack Overflow - Speaking with an ISpVoice from a ISpTTSEngine"
  * https://stackoverflow.com/questions/69655189/speaking-with-an-ispvoice-from-a-ispttsengine
  *
- * This function performs the vocalization by creating a subprocess for the
- * project's C++/CLI solution named "Vocalizer" and passing it the desired text
- * via an environment variable.
+ * This function performs the vocalization by creating a Vocalizer subprocess
+ * and streaming the desired text to it.
  */
-HRESULT vocalize(std::string text, ISpTTSEngineSite* pOutputSite)
-{
-    STARTUPINFO startup_info;
-    PROCESS_INFORMATION process_info;
-    ZeroMemory(&startup_info, sizeof(startup_info));
-    startup_info.cb = sizeof(startup_info);
-    ZeroMemory(&process_info, sizeof(process_info));
-    TCHAR command[] = TEXT(AUTOMATION_VOICE_HOME "\\Vocalizer.exe");
-    DWORD dwFlags = CREATE_NO_WINDOW;
-    TCHAR newEnv[SPEECH_BUFFER_SIZE];
-
-#ifdef UNICODE
-    dwFlags |= CREATE_UNICODE_ENVIRONMENT;
-#endif
-
-    if (FAILED(createEnv(text, newEnv))) {
-        return E_FAIL;
-    }
-
-    bool result = CreateProcessW(
-        NULL,
-        command,
-        NULL,
-        NULL,
-        false,
-        dwFlags,
-        (LPVOID)newEnv,
-        NULL,
-        &startup_info,
-        &process_info
-    );
+HRESULT vocalize(const char* pText, size_t cbText, SpeakSite& site)
+{
+    VocalizerProcess vocalizer;
 
-    if (!result)
+    if (FAILED(vocalizer.start(pText, cbText, NULL)))
     {
         return E_FAIL;
     }
 
     // Wait for speech to be rendered or for the ISpTTSEngineSite to signal
     // that rendering should be aborted.
-    while (WaitForSingleObject(process_info.hProcess, ABORT_SIGNAL_POLLING_PERIOD) == WAIT_TIMEOUT)
+    while (WaitForSingleObject(vocalizer.process(), ABORT_SIGNAL_POLLING_PERIOD) == WAIT_TIMEOUT)
     {
-        if (pOutputSite->GetActions() & SPVES_ABORT)
+        if (site.getActions() & SPVES_ABORT)
         {
-            TerminateProcess(process_info.hProcess, 0);
+            vocalizer.terminate();
         }
     }
 
-    CloseHandle(process_info.hProcess);
-    CloseHandle(process_info.hThread);
+    vocalizer.finish(NULL);
 
     return S_OK;
 }
 
-
-/*****************************************************************************
-* CTTSEngObj::FinalConstruct *
-*----------------------------*
-*   Description:
-*       Constructor
-*****************************************************************************/
-HRESULT CTTSEngObj::FinalConstruct()
+/**
+ * Render a string of text to audio in the format reported by
+ * `GetOutputFormat`, without playing it.
+ *
+ * The Vocalizer subprocess writes the audio to its standard output when it is
+ * given the argument "--stdout". Several renders may run at once, so the pipe
+ * is polled rather than read with a blocking call in order that cancellation
+ * is observed promptly.
+ */
+HRESULT renderAudio(const char* pText, size_t cbText, const std::atomic<bool>& cancelled,
+    std::vector<uint8_t>* pAudio)
 {
-    HRESULT hr = S_OK;
+    SECURITY_ATTRIBUTES security = { sizeof(security), NULL, TRUE };
+    HANDLE hRead = NULL;
+    HANDLE hWrite = NULL;
+    if (!createPipe(&hRead, &hWrite, &security, RENDER_PIPE_SIZE))
+    {
+        return E_FAIL;
+    }
+    SetHandleInformation(hRead, HANDLE_FLAG_INHERIT, 0);
 
-    //--- Init vars
-    m_hVoiceData = NULL;
-    m_pVoiceData = NULL;
-    m_pWordList  = NULL;
-    m_ulNumWords = 0;
+    VocalizerProcess vocalizer;
+    HRESULT hr = vocalizer.start(pText, cbText, hWrite);
 
-    hr = m_cpVoice.CoCreateInstance(CLSID_SpVoice);
+    // Only the subprocess retains the write end, so the pipe breaks when the
+    // subprocess exits.
+    closeHandle(hWrite);
 
     if (FAILED(hr))
     {
-        emit(MessageType::ERR, "Voice initialization failed");
+        closeHandle(hRead);
+        return E_FAIL;
+    }
+
+    for (;;)
+    {
+        if (cancelled)
+        {
+            vocalizer.terminate();
+            hr = E_ABORT;
+            break;
+        }
+
+        DWORD cbAvailable = 0;
+        if (!PeekNamedPipe(hRead, NULL, 0, NULL, &cbAvailable, NULL))
+        {
+            break;
+        }
+        if (cbAvailable == 0)
+        {
+            WaitForSingleObject(vocalizer.process(), RENDER_POLLING_PERIOD);
+            continue;
+        }
+
+        size_t cbAudio = pAudio->size();
+        DWORD cbRead = 0;
+        try
+        {
+            pAudio->resize(cbAudio + cbAvailable);
+        }
+        catch (const std::bad_alloc&)
+        {
+            vocalizer.terminate();
+            hr = E_OUTOFMEMORY;
+            break;
+        }
+        if (!ReadFile(hRead, pAudio->data() + cbAudio, cbAvailable, &cbRead, NULL))
+        {
+            cbRead = 0;
+        }
+        pAudio->resize(cbAudio + cbRead);
     }
-    else
+
+    DWORD dwExitCode = 0;
+    HRESULT hrFinish = vocalizer.finish(&dwExitCode);
+    if (SUCCEEDED(hr) && (FAILED(hrFinish) || dwExitCode != 0))
     {
-        emit(MessageType::LIFECYCLE, "Voice initialization succeeded");
+        hr = E_FAIL;
     }
 
+    closeHandle(hRead);
+
     return hr;
 }
 
+/**
+ * Adapts the ISpTTSEngineSite supplied to `Speak` to the interface consumed by
+ * the platform-independent pipeline.
+ */
+class CSpeakSite : public SpeakSite
+{
+public:
+    CSpeakSite(ISpTTSEngineSite* pOutputSite) : m_pOutputSite(pOutputSite) {}
+
+    uint32_t getActions()
+    {
+        return m_pOutputSite->GetActions();
+    }
+
+    HRESULT getEventInterest(uint64_t* pullEventInterest)
+    {
+        ULONGLONG ullEventInterest = 0;
+        HRESULT hr = m_pOutputSite->GetEventInterest(&ullEventInterest);
+        *pullEventInterest = ullEventInterest;
+        return hr;
+    }
+
+    HRESULT addEvents(const SpeakEvent* pEvents, size_t numEvents)
+    {
+        SPEVENT events[SpeakPipeline::EVENT_BATCH_SIZE];
+
+        for (size_t i = 0; i < numEvents; i += 1)
+        {
+            events[i].eEventId = (SPEVENTENUM)pEvents[i].eEventId;
+            events[i].elParamType = SPET_LPARAM_IS_STRING;
+            events[i].ulStreamNum = 0;
+            events[i].ullAudioStreamOffset = pEvents[i].ullAudioStreamOffset;
+            events[i].wParam = (WPARAM)pEvents[i].wParam;
+            events[i].lParam = (LPARAM)pEvents[i].pText;
+        }
+
+        return m_pOutputSite->AddEvents(events, (ULONG)numEvents);
+    }
+
+    HRESULT write(const void* pBuffer, size_t cbBuffer, size_t* pcbWritten)
+    {
+        ULONG cbWritten = 0;
+        HRESULT hr = m_pOutputSite->Write(pBuffer, (ULONG)cbBuffer, &cbWritten);
+        *pcbWritten = cbWritten;
+        return hr;
+    }
+
+private:
+    ISpTTSEngineSite* m_pOutputSite;
+};
+
+class CProcessVocalizer : public Vocalizer
+{
+public:
+    HRESULT vocalize(const char* pText, size_t cbText, SpeakSite& site)
+    {
+        return ::vocalize(pText, cbText, site);
+    }
+};
+
+class CProcessRenderer : public Renderer
+{
+public:
+    HRESULT render(const char* pText, size_t cbText, const std::atomic<bool>& cancelled,
+        std::vector<uint8_t>* pAudio)
+    {
+        return ::renderAudio(pText, cbText, cancelled, pAudio);
+    }
+};
+
+static SpeakTraceState toTraceState(const SPVSTATE& state)
+{
+    SpeakTraceState traceState = {
+        state.LangID,
+        state.EmphAdj,
+        state.RateAdj,
+        state.Volume,
+        state.PitchAdj.MiddleAdj,
+        state.PitchAdj.RangeAdj,
+        state.SilenceMSecs,
+        (uint32_t)state.ePartOfSpeech,
+        (const char16_t*)state.pPhoneIds,
+        (const char16_t*)state.Context.pCategory,
+        (const char16_t*)state.Context.pBefore,
+        (const char16_t*)state.Context.pAfter
+    };
+    return traceState;
+}
+
+static CProcessVocalizer s_vocalizer;
+static CProcessRenderer s_renderer;
+
+CTTSEngObj::CTTSEngObj()
+    : m_pEndpoint(defaultEndpoint()), m_voiceDataVocalizer(m_voiceData), m_pipeline(*m_pEndpoint, s_vocalizer),
+      m_fTokenTrace(false), m_ulSettingsGeneration(0)
+{
+}
+
+
+/*****************************************************************************
+* CTTSEngObj::FinalConstruct *
+*----------------------------*
+*   Description:
+*       Constructor
+*****************************************************************************/
+HRESULT CTTSEngObj::FinalConstruct()
+{
+    return S_OK;
+}
+
 /*****************************************************************************
 * CTTSEngObj::FinalRelease *
 *--------------------------*
@@ -258,19 +1057,17 @@ HRESULT CTTSEngObj::FinalConstruct()
 *****************************************************************************/
 void CTTSEngObj::FinalRelease()
 {
-    delete m_pWordList;
+    m_voiceData.close();
 
-    if (m_pVoiceData)
+    try
     {
-        ::UnmapViewOfFile((void*)m_pVoiceData);
+        m_pEndpoint->emitAsync(MessageType::LIFECYCLE, "Voice destroyed");
+        m_pEndpoint->emitAsync(MessageType::LIFECYCLE, m_pEndpoint->statistics().describe());
+        m_pEndpoint->emitAsync(MessageType::LIFECYCLE, m_counters.describeResources(ResourceCounters::snapshot()));
     }
-
-    if (m_hVoiceData)
+    catch (const std::bad_alloc&)
     {
-        ::CloseHandle(m_hVoiceData);
     }
-
-    emit(MessageType::LIFECYCLE, "Voice destroyed");
 }
 
 //
@@ -287,7 +1084,91 @@ void CTTSEngObj::FinalRelease()
 *****************************************************************************/
 STDMETHODIMP CTTSEngObj::SetObjectToken(ISpObjectToken * pToken)
 {
-    return SpGenericSetObjectToken(pToken, m_cpToken);
+    m_counters.ullTokenBegin = monotonicMicroseconds();
+    HRESULT hr = SpGenericSetObjectToken(pToken, m_cpToken);
+
+    // Each registered instance of the voice may name the driver to which it
+    // reports, along with its own capture journal and audio tap.
+    if (SUCCEEDED(hr))
+    {
+        try
+        {
+            m_pEndpoint = driverEndpoint(
+                tokenString(m_cpToken, L"DriverPipe", DEFAULT_DRIVER_PIPE),
+                tokenString(m_cpToken, L"CaptureJournal", DEFAULT_CAPTURE_JOURNAL),
+                tokenString(m_cpToken, L"AudioTap", DEFAULT_AUDIO_TAP));
+            m_pipeline.setSink(*m_pEndpoint);
+
+            // Screen readers instantiate the voice at startup and whenever
+            // the user switches voices, so initialization must not wait on
+            // the driver.
+            m_pEndpoint->emitAsync(MessageType::LIFECYCLE, "Voice initialization succeeded");
+        }
+        catch (const std::bad_alloc&)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+    }
+
+    // When the token names a trace directory, the input to every call to
+    // Speak is recorded for replay by `bench-replay`. The driver may also
+    // enable tracing while the voice is in use (see `applySettings`).
+    CSpDynamicString dstrTraceDirectory;
+    if (SUCCEEDED(hr))
+    {
+        m_fTokenTrace = SUCCEEDED(m_cpToken->GetStringValue(L"SpeakTraceDirectory", &dstrTraceDirectory));
+        m_traceDirectory = tokenString(m_cpToken, L"SpeakTraceDirectory", DEFAULT_TRACE_DIRECTORY);
+        if (m_fTokenTrace)
+        {
+            openTrace();
+        }
+    }
+
+    // When the token names a voice data file, words are spoken from the
+    // recordings it contains. The file is mapped rather than read so that
+    // every instance of the engine shares one copy of the audio, and the
+    // audio is written to the output site directly from the mapped view.
+    CSpDynamicString dstrVoiceData;
+    if (SUCCEEDED(hr) && SUCCEEDED(m_cpToken->GetStringValue(L"VoiceData", &dstrVoiceData)))
+    {
+        std::string voiceDataPath = toUtf8((const char16_t*)(WCHAR*)dstrVoiceData, wcslen(dstrVoiceData));
+        const VoiceAudioFormat& format = m_voiceData.format();
+        VoiceAudioFormat outputFormat;
+
+        if (FAILED(m_voiceData.open(voiceDataPath.c_str())))
+        {
+            m_pEndpoint->emitAsync(MessageType::ERR, "Unable to open voice data.");
+        }
+        else if (FAILED(getOutputFormat(&outputFormat)) ||
+            format.ulSamplesPerSecond != outputFormat.ulSamplesPerSecond ||
+            format.usBitsPerSample != outputFormat.usBitsPerSample || format.usChannels != outputFormat.usChannels)
+        {
+            // The audio must match the format reported by GetOutputFormat.
+            m_voiceData.close();
+            m_pEndpoint->emitAsync(MessageType::ERR, "Voice data is not in the output format.");
+        }
+        else
+        {
+            m_pipeline.setVocalizer(m_voiceDataVocalizer);
+        }
+    }
+
+    // When the token specifies a number of sentences to render ahead, audio
+    // is delivered through the output site rather than played by the
+    // Vocalizer, and upcoming sentences are rendered while earlier ones play.
+    // Recorded words require no rendering, so the setting does not apply to
+    // voice data.
+    DWORD dwPrerenderSentences = 0;
+    if (SUCCEEDED(hr) && !m_voiceData.isOpen() &&
+        SUCCEEDED(m_cpToken->GetDWORD(L"PrerenderSentences", &dwPrerenderSentences)) &&
+        dwPrerenderSentences > 0)
+    {
+        m_pipeline.setRenderer(&s_renderer, dwPrerenderSentences);
+    }
+
+    m_counters.ullConstructEnd = monotonicMicroseconds();
+
+    return hr;
 }
 
 
@@ -295,6 +1176,51 @@ STDMETHODIMP CTTSEngObj::SetObjectToken(ISpObjectToken * pToken)
 //=== ISpTTSEngine Implementation ============================================
 //
 
+/**
+ * Begin recording the input to Speak in a file of the trace directory. Each
+ * engine instance writes its own file.
+ */
+void CTTSEngObj::openTrace()
+{
+    static volatile LONG s_traceCount = 0;
+    char tracePath[MAX_PATH];
+    snprintf(tracePath, sizeof(tracePath), "%s\\speak-%lu-%ld.trace",
+        m_traceDirectory.c_str(), GetCurrentProcessId(), InterlockedIncrement(&s_traceCount));
+    createParentDirectory(tracePath);
+
+    if (FAILED(m_trace.open(tracePath)))
+    {
+        m_pEndpoint->emitAsync(MessageType::ERR, "Unable to create Speak trace.");
+    }
+}
+
+/**
+ * Apply the settings sent by the driver to the call to Speak which is about to
+ * begin.
+ */
+void CTTSEngObj::applySettings(const EngineSettings& settings, const WAVEFORMATEX* pWaveFormatEx)
+{
+    m_pipeline.setCaptureOnly(!settings.fVocalize);
+    m_pipeline.setTimeCompression(settings.ulTimeCompression, pWaveFormatEx ? pWaveFormatEx->nBlockAlign : 0);
+
+    // A trace is opened once for each generation of settings which enables
+    // it, so that a directory which cannot be written is not retried by every
+    // call. Traces requested by the token are never closed.
+    if (settings.ulGeneration == m_ulSettingsGeneration)
+    {
+        return;
+    }
+    m_ulSettingsGeneration = settings.ulGeneration;
+    if (settings.fTrace && !m_trace.isOpen())
+    {
+        openTrace();
+    }
+    else if (!settings.fTrace && !m_fTokenTrace && m_trace.isOpen())
+    {
+        m_trace.close();
+    }
+}
+
 /*****************************************************************************
 * CTTSEngObj::Speak *
 *-------------------*
@@ -337,59 +1263,74 @@ STDMETHODIMP CTTSEngObj::Speak(DWORD dwSpeakFlags,
     const SPVTEXTFRAG* pTextFragList,
     ISpTTSEngineSite* pOutputSite)
 {
+    t_ullSpeakEntry = monotonicMicroseconds();
+
     //--- Check args
     if (SP_IS_BAD_INTERFACE_PTR(pOutputSite) || SP_IS_BAD_READ_PTR(pTextFragList))
     {
         return E_INVALIDARG;
     }
-    HRESULT hr = S_OK;
 
-    for (const SPVTEXTFRAG* textFrag = pTextFragList; textFrag != NULL; textFrag = textFrag->pNext)
+    AllocationPeakScope peak(&m_counters.cbPeakSpeak);
+    m_counters.ullSpeaks += 1;
+
+    EngineSettings settings;
+    try
     {
-        if (textFrag->State.eAction == SPVA_Bookmark)
+        if (m_counters.ullSpeaks % RESOURCE_REPORT_INTERVAL == 0)
         {
-            ULONGLONG pullEventInterest;
-            hr = pOutputSite->GetEventInterest(&pullEventInterest);
-
-            if (FAILED(hr))
-            {
-                emit(MessageType::ERR, "Unable to query output site for event interest.");
-                continue;
-            }
-
-            if (pullEventInterest & SPEI_TTS_BOOKMARK)
-            {
-                std::string part = to_utf8(textFrag->pTextStart, textFrag->ulTextLen);
-                SPEVENT event;
-                event.eEventId = SPEI_TTS_BOOKMARK;
-                event.elParamType = SPET_LPARAM_IS_STRING;
-                event.wParam = atol(part.c_str());
-                char* p = (char*)calloc(textFrag->ulTextLen + 1, sizeof(textFrag->pTextStart));
-                strcpy(p, part.c_str());
-                event.lParam = (LPARAM)p;
-                pOutputSite->AddEvents(&event, 1);
-                free(p);
-            }
-            continue;
+            m_pEndpoint->emitAsync(MessageType::LIFECYCLE, m_counters.describeResources(ResourceCounters::snapshot()));
         }
 
-        std::string part = to_utf8(textFrag->pTextStart, textFrag->ulTextLen);
-        hr = emit(MessageType::SPEECH, part);
+        m_fragments.clear();
 
-        if (FAILED(hr))
+        for (const SPVTEXTFRAG* textFrag = pTextFragList; textFrag != NULL; textFrag = textFrag->pNext)
         {
-            emit(MessageType::ERR, "Emission failed");
-            break;
+            SpeakFragment fragment;
+            fragment.eAction = (FragmentAction)textFrag->State.eAction;
+            fragment.pTextStart = (const char16_t*)textFrag->pTextStart;
+            fragment.ulTextLen = textFrag->ulTextLen;
+            fragment.ulTextSrcOffset = textFrag->ulTextSrcOffset;
+            m_fragments.push_back(fragment);
         }
 
-        hr = vocalize(part, pOutputSite);
-
-        if (FAILED(hr))
+        if (!m_counters.ullFirstSpeak)
         {
-            emit(MessageType::ERR, "Vocalization failed");
+            m_counters.ullFirstSpeak = monotonicMicroseconds();
+            m_pEndpoint->emitAsync(MessageType::LIFECYCLE, m_counters.describeStartup());
         }
+
+        // Receiving and applying settings from the driver allocates.
+        settings = m_pEndpoint->settings();
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    CSpeakSite site(pOutputSite);
+    // The audio tap is opened only once the driver enables it, when it reads
+    // the tap and a session may capture audio.
+    m_pipeline.setAudioTap(settings.fAudioTap ? m_pEndpoint->audioTap() : NULL);
+    applySettings(settings, pWaveFormatEx);
+
+    if (!m_trace.isOpen())
+    {
+        return m_pipeline.speak(m_fragments.data(), m_fragments.size(), site);
+    }
+
+    m_trace.beginSpeak(dwSpeakFlags);
+    size_t i = 0;
+    for (const SPVTEXTFRAG* textFrag = pTextFragList; textFrag != NULL; textFrag = textFrag->pNext)
+    {
+        m_trace.addFragment(m_fragments[i], toTraceState(textFrag->State));
+        i += 1;
     }
 
+    TracingSpeakSite tracingSite(site, m_trace);
+    HRESULT hr = m_pipeline.speak(m_fragments.data(), m_fragments.size(), tracingSite);
+    m_trace.endSpeak();
+
     return hr;
 }
 
@@ -404,5 +1345,5 @@ STDMETHODIMP CTTSEngObj::Speak(DWORD dwSpeakFlags,
 STDMETHODIMP CTTSEngObj::GetOutputFormat(const GUID* pTargetFormatId, const WAVEFORMATEX* pTargetWaveFormatEx,
     GUID* pDesiredFormatId, WAVEFORMATEX** ppCoMemDesiredWaveFormatEx)
 {
-    return SpConvertStreamFormatEnum(SPSF_11kHz16BitMono, pDesiredFormatId, ppCoMemDesiredWaveFormatEx);
+    return SpConvertStreamFormatEnum(OUTPUT_FORMAT, pDesiredFormatId, ppCoMemDesiredWaveFormatEx);
 }
\ No newline at end of file
@@ -28,10 +28,18 @@
 #endif
 
 #include "resource.h"
+#include "EngineCounters.h"
+#include "EngineSettings.h"
+#include "SpeakPipeline.h"
+#include "SpeakTrace.h"
+#include "VoiceData.h"
+#include <string>
+#include <vector>
 
 //=== Constants ====================================================
 
 //=== Class, Enum, Struct and Union Declarations ===================
+class DriverEndpoint;
 
 //=== Enumerated Set Definitions ===================================
 
@@ -79,6 +87,7 @@ class ATL_NO_VTABLE CTTSEngObj :
   /*=== Methods =======*/
   public:
     /*--- Constructors/Destructors ---*/
+    CTTSEngObj();
     HRESULT FinalConstruct();
     void FinalRelease();
 
@@ -98,16 +107,27 @@ class ATL_NO_VTABLE CTTSEngObj :
     STDMETHOD(GetOutputFormat)( const GUID * pTargetFormatId, const WAVEFORMATEX * pTargetWaveFormatEx,
                                 GUID * pDesiredFormatId, WAVEFORMATEX ** ppCoMemDesiredWaveFormatEx );
 
+  /*=== Implementation ===*/
+  private:
+    void openTrace();
+    void applySettings(const EngineSettings& settings, const WAVEFORMATEX* pWaveFormatEx);
+
   /*=== Member Data ===*/
   private:
+    //--- Constructed first, so that the startup profile includes the
+    //    construction of every other member
+    EngineCounters      m_counters;
+
     CComPtr<ISpObjectToken> m_cpToken;
-    HANDLE                  m_hVoiceData;
-    void*                   m_pVoiceData;
-    //--- Voice (word/audio data) list
-    //  Note: You will probably have something more sophisticated here
-    //        we are just trying to keep it simple for the example.
-    VOICEITEM*          m_pWordList;
-    ULONG               m_ulNumWords;
+
+    //--- Connection to the driver, selected by the token (see
+    //    SetObjectToken)
+    DriverEndpoint*     m_pEndpoint;
+
+    //--- Voice (word/audio data) list, mapped from the file named by the
+    //    token (see SetObjectToken)
+    VoiceData           m_voiceData;
+    VoiceDataVocalizer  m_voiceDataVocalizer;
 
     //--- Working variables to walk the text fragment list during Speak()
     const SPVTEXTFRAG*  m_pCurrFrag;
@@ -115,7 +135,17 @@ class ATL_NO_VTABLE CTTSEngObj :
     const WCHAR*        m_pEndChar;
     ULONGLONG           m_ullAudioOff;
 
-    CComPtr<ISpVoice> m_cpVoice;
+    //--- Platform-independent implementation of Speak()
+    SpeakPipeline              m_pipeline;
+    std::vector<SpeakFragment> m_fragments;
+
+    //--- Optional record of Speak() input (see SetObjectToken)
+    SpeakTraceWriter    m_trace;
+    std::string         m_traceDirectory;
+    bool                m_fTokenTrace;
+
+    //--- Generation of the driver's settings last applied (see Speak)
+    uint32_t            m_ulSettingsGeneration;
 };
 
 #endif // This must be the last line in the file
\ No newline at end of file
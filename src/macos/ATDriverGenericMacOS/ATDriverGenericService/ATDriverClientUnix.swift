@@ -7,25 +7,25 @@
 
 import Foundation
 
+/// Delivers events to the driver through the shared `DriverClient`, which
+/// keeps a single connection open for the lifetime of the service and
+/// reconnects automatically when the driver restarts.
 class ATDriverClientUnix {
 
-  class SocketResource {
-    var descriptor: Int32
-    init() throws {
-      descriptor = socket(
-        AF_UNIX,
-        SOCK_STREAM,
-        0)
-      guard descriptor > -1 else {
-        throw ATDriverEventError.badSocketSettings(posixErrorString())
-      }
-    }
-    deinit {
-      close(descriptor)
-    }
+  static let pipe = "/tmp/at_driver_generic/driver.socket"
+
+  let client: OpaquePointer?
+
+  init() {
+    client = at_driver_client_create(ATDriverClientUnix.pipe)
   }
 
-  static let pipe = "/tmp/at_driver_generic/driver.socket"
+  deinit {
+    if let client = client {
+      _ = at_driver_client_flush(client)
+      at_driver_client_destroy(client)
+    }
+  }
 
   func sendInitEvent() throws {
     try self._sendEvent(name: "lifecycle", data: "hello")
@@ -43,45 +43,26 @@ class ATDriverClientUnix {
     try self._sendEvent(name: "lifecycle", data: "cancel")
   }
 
-  func _connect() throws -> SocketResource {
-    let socket = try SocketResource()
-
-    var unixAddr = sockaddr_un()
-    let pathSize = size_t(MemoryLayout.size(ofValue: unixAddr.sun_path))
-    unixAddr.sun_family = sa_family_t(AF_UNIX)
-    ATDriverClientUnix.pipe.withCString { pipeAddress in
-      strncpy(&unixAddr.sun_path, pipeAddress, pathSize)
-      return
+  func _sendEvent(name: String, data: String) throws {
+    guard let client = client else {
+      throw ATDriverEventError.badSocketSettings("client could not be allocated")
     }
 
-    let unixAddrSize = socklen_t(MemoryLayout.size(ofValue: unixAddr))
-    // Get UnsafePointer to addr
-    try withUnsafePointer(to: &unixAddr) { unsafeUnixAddr in
-      // Cast UnsafePointer<sockaddr_un> to UnsafePointer<sockaddr>
-      try unsafeUnixAddr.withMemoryRebound(to: sockaddr.self, capacity: 1) { addr in
-        guard connect(socket.descriptor, addr, unixAddrSize) > -1 else {
-          throw ATDriverEventError.didNotConnect(posixErrorString())
-        }
+    var data = data
+    let status = data.withUTF8 { bytes in
+      bytes.withMemoryRebound(to: CChar.self) { chars in
+        at_driver_client_send(client, name, chars.baseAddress, chars.count)
       }
     }
 
-    return socket
-  }
-
-  func _makeMessage(name: String, data: String) -> String {
-    return "\(name):\(data)"
-  }
-
-  func _sendEvent(name: String, data: String) throws {
-    let socket = try _connect()
-
-    let message = _makeMessage(name: name, data: data)
-
-    try message.utf8CString.withUnsafeBufferPointer { unsafeMessageBuffer in
-      let unsafeMessage = unsafeMessageBuffer.baseAddress!
-      guard write(socket.descriptor, unsafeMessage, strlen(unsafeMessage)) > -1 else {
-        throw ATDriverEventError.sendFailure(posixErrorString())
-      }
+    switch status {
+    case AT_DRIVER_CLIENT_OK, AT_DRIVER_CLIENT_COALESCED:
+      return
+    case AT_DRIVER_CLIENT_QUEUED:
+      // Delivered once the driver can be reached.
+      throw ATDriverEventError.didNotConnect("message queued until the driver is available")
+    default:
+      throw ATDriverEventError.sendFailure("message dropped; the client's buffer is full")
     }
   }
 }
@@ -0,0 +1,6 @@
+//
+//  ATDriverGenericService-Bridging-Header.h
+//  ATDriverGenericService
+//
+
+#include "../../../Shared/ATDriverClient.h"
@@ -14,24 +14,84 @@
 #include "stdafx.h"
 #include "WindowsRegistry.h"
 #include "..\Shared\branding.h"
+#include "VoiceData.h"
 #include <AutomationTtsEngine_i.c>
 #include <direct.h>
 #include <fstream>
+#include <string>
+#include <vector>
 
 // A default text to speech voice is chosen when first used.Vocalize some
 // text to make the system chooseand save a default from the currently
 // installed voices.Additionally test that text to speech works locally.
 #define UTTERANCE_FOR_SETTING_DEFAULT_VOICE _T("Installing voice named " AUTOMATION_VOICE_NAME)
 
+// Location of the voice data file which is installed with the "/voicedata"
+// option.
+#define VOICE_DATA_PATH AUTOMATION_VOICE_HOME "\\voice.atvd"
+
 // Registry path storing voice tokens.
 #define SPCAT_VOICE_TOKENS _T(SPCAT_VOICES "\\Tokens")
 
+// Greatest number of instances of the voice which may be registered (see
+// `voiceInstance`).
+#define MAX_VOICE_INSTANCES 64
+
 #ifdef UNICODE
 #define tputenv_s _wputenv_s
 #else
 #define tputenv_s _putenv_s
 #endif
 
+/**
+ * Several instances of the voice may be registered so that several drivers
+ * can run on one host, each observing a different screen reader session.
+ * The first instance uses the names and locations which the voice has always
+ * used. Each subsequent instance N appends N to its token's id and name, and
+ * "-N" to the names of its driver pipe, capture journal and audio tap, which
+ * the engine reads from its token. The driver derives the same names (see
+ * `lib/voice-instances.js`).
+ */
+struct VoiceInstance
+{
+    std::wstring id;
+    std::wstring name;
+    std::wstring pipe;
+    std::wstring journal;
+    std::wstring audioTap;
+};
+
+/**
+ * @param {const std::wstring&} path - a location used by the first instance
+ * @param {int} instance - one-based instance number
+ * @returns {std::wstring} the location used by the given instance
+ */
+std::wstring instancePath(const std::wstring& path, int instance)
+{
+    if (instance == 1)
+    {
+        return path;
+    }
+    size_t extension = path.find_last_of(L'.');
+    size_t separator = path.find_last_of(L'\\');
+    if (extension == std::wstring::npos || (separator != std::wstring::npos && extension < separator))
+    {
+        extension = path.length();
+    }
+    return path.substr(0, extension) + L"-" + std::to_wstring(instance) + path.substr(extension);
+}
+
+VoiceInstance voiceInstance(int instance)
+{
+    VoiceInstance voice;
+    voice.id = std::wstring(L"" AUTOMATION_VOICE_ID) + (instance == 1 ? L"" : std::to_wstring(instance));
+    voice.name = std::wstring(L"" AUTOMATION_VOICE_NAME) + (instance == 1 ? L"" : L" " + std::to_wstring(instance));
+    voice.pipe = instancePath(L"\\\\.\\pipe\\my_pipe", instance);
+    voice.journal = instancePath(L"" AUTOMATION_VOICE_DATA L"\\capture.journal", instance);
+    voice.audioTap = instancePath(L"" AUTOMATION_VOICE_DATA L"\\audio.tap", instance);
+    return voice;
+}
+
 HRESULT createDirectoryIfAbsent(LPCWSTR location)
 {
     if (CreateDirectory(location, NULL))
@@ -124,6 +184,80 @@ HRESULT updateDllRegistry(const tstring& fileName, DllAction action)
     return runSubprocess(command);
 }
 
+/**
+ * Convert the word list of the sample voice to the engine's voice data format
+ * and configure the voices to speak from it in place of the Vocalizer. Every
+ * instance maps the same file.
+ */
+HRESULT installVoiceData(const std::vector<CComPtr<ISpObjectToken>>& tokens)
+{
+    std::ifstream source(getSiblingFilePath(_T("SampleVoice.vce")).c_str(), std::ios::binary);
+    std::vector<uint8_t> sampleVoice(
+        (std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+    std::vector<VoiceDataEntry> entries;
+    VoiceAudioFormat format = { 11025, 16, 1 };
+
+    HRESULT hr = parseSampleVoice(sampleVoice.data(), sampleVoice.size(), &entries);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = writeVoiceData(VOICE_DATA_PATH, format, entries.data(), entries.size());
+    }
+
+    for (size_t i = 0; SUCCEEDED(hr) && i < tokens.size(); i += 1)
+    {
+        hr = tokens[i]->SetStringValue(L"VoiceData", L"" VOICE_DATA_PATH);
+    }
+
+    return hr;
+}
+
+/**
+ * @param {int} argc - number of arguments
+ * @param {WCHAR**} argv - arguments
+ * @returns {bool} whether the voice should speak from recorded voice data
+ */
+bool parseVoiceDataArg(int argc, WCHAR* argv[])
+{
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (wcscmp(argv[i], L"/voicedata") == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @param {int} argc - number of arguments
+ * @param {WCHAR**} argv - arguments
+ * @returns {int} the number of instances of the voice to register, as given
+ *                by the "/instances:N" option (1 by default), or 0 if the
+ *                option is invalid
+ */
+int parseInstancesArg(int argc, WCHAR* argv[])
+{
+    const WCHAR prefix[] = L"/instances:";
+    const size_t cchPrefix = ARRAYSIZE(prefix) - 1;
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (wcsncmp(argv[i], prefix, cchPrefix) == 0)
+        {
+            WCHAR* end = NULL;
+            long numInstances = wcstol(argv[i] + cchPrefix, &end, 10);
+            if (end == argv[i] + cchPrefix || *end != L'\0' || numInstances < 1 ||
+                numInstances > MAX_VOICE_INSTANCES)
+            {
+                return 0;
+            }
+            return (int)numInstances;
+        }
+    }
+    return 1;
+}
+
 /**
  * @param {int} argc - number of arguments
  * @param {WCHAR**} argv - arguments
@@ -141,49 +275,74 @@ DllAction parseArgs(int argc, WCHAR* argv[])
     return DllAction::install;
 }
 
-HRESULT install()
+/**
+ * Programatically create a token for an instance of the voice and set its
+ * attributes.
+ */
+HRESULT registerVoice(const VoiceInstance& voice, ISpObjectToken** ppToken)
 {
-    HRESULT hr = updateDllRegistry(_T("AutomationTtsEngine.dll"), DllAction::install);
+    CComPtr<ISpDataKey> cpDataKeyAttribs;
+    HRESULT hr = SpCreateNewTokenEx(
+        SPCAT_VOICES,
+        voice.id.c_str(),
+        &CLSID_SampleTTSEngine,
+        voice.name.c_str(),
+        0x409,
+        voice.name.c_str(),
+        ppToken,
+        &cpDataKeyAttribs
+    );
 
-    // Programatically create a token for the new voice and set its attributes.
+    //--- Set additional attributes for searching.
     if (SUCCEEDED(hr))
     {
-        CComPtr<ISpObjectToken> cpToken;
-        CComPtr<ISpDataKey> cpDataKeyAttribs;
-        hr = SpCreateNewTokenEx(
-            SPCAT_VOICES,
-            L"" AUTOMATION_VOICE_ID,
-            &CLSID_SampleTTSEngine,
-            L"" AUTOMATION_VOICE_NAME,
-            0x409,
-            L"" AUTOMATION_VOICE_NAME,
-            &cpToken,
-            &cpDataKeyAttribs
-        );
-
-        //--- Set additional attributes for searching.
+        hr = cpDataKeyAttribs->SetStringValue(L"Gender", L"Male");
         if (SUCCEEDED(hr))
         {
-            hr = cpDataKeyAttribs->SetStringValue(L"Gender", L"Male");
-            if (SUCCEEDED(hr))
-            {
-                hr = cpDataKeyAttribs->SetStringValue(L"Name", TEXT(AUTOMATION_VOICE_NAME));
-            }
-            if (SUCCEEDED(hr))
-            {
-                hr = cpDataKeyAttribs->SetStringValue(L"Language", L"409");
-            }
-            if (SUCCEEDED(hr))
-            {
-                hr = cpDataKeyAttribs->SetStringValue(L"Age", L"Adult");
-            }
-            if (SUCCEEDED(hr))
-            {
-                hr = cpDataKeyAttribs->SetStringValue(L"Vendor", TEXT(AUTOMATION_VOICE_VENDOR));
-            }
+            hr = cpDataKeyAttribs->SetStringValue(L"Name", voice.name.c_str());
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = cpDataKeyAttribs->SetStringValue(L"Language", L"409");
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = cpDataKeyAttribs->SetStringValue(L"Age", L"Adult");
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = cpDataKeyAttribs->SetStringValue(L"Vendor", TEXT(AUTOMATION_VOICE_VENDOR));
         }
     }
 
+    //--- Name the driver to which the instance reports (see
+    //    CTTSEngObj::SetObjectToken).
+    if (SUCCEEDED(hr))
+    {
+        hr = (*ppToken)->SetStringValue(L"DriverPipe", voice.pipe.c_str());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = (*ppToken)->SetStringValue(L"CaptureJournal", voice.journal.c_str());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = (*ppToken)->SetStringValue(L"AudioTap", voice.audioTap.c_str());
+    }
+
+    return hr;
+}
+
+HRESULT install(bool fVoiceData, int numInstances)
+{
+    std::vector<CComPtr<ISpObjectToken>> tokens(numInstances);
+    HRESULT hr = updateDllRegistry(_T("AutomationTtsEngine.dll"), DllAction::install);
+
+    for (int i = 0; SUCCEEDED(hr) && i < numInstances; i += 1)
+    {
+        hr = registerVoice(voiceInstance(i + 1), &tokens[i]);
+    }
+
     if (SUCCEEDED(hr))
     {
         hr = createDirectoryIfAbsent(
@@ -204,6 +363,11 @@ HRESULT install()
         }
     }
 
+    if (SUCCEEDED(hr) && fVoiceData)
+    {
+        hr = installVoiceData(tokens);
+    }
+
     if (SUCCEEDED(hr))
     {
         hr = runSubprocess(tstring(_T(AUTOMATION_VOICE_HOME "\\Vocalizer.exe")));
@@ -225,10 +389,12 @@ HRESULT uninstall()
         hr = WindowsRegistry::splitRegistryPath(SPCAT_VOICE_TOKENS, &pathParts);
     }
 
-    if (SUCCEEDED(hr))
+    // Every instance which may have been registered is removed (keys which
+    // do not exist are disregarded).
+    for (int instance = 1; SUCCEEDED(hr) && instance <= MAX_VOICE_INSTANCES; instance += 1)
     {
         bresult = WindowsRegistry::deleteNode(
-            pathParts.root, pathParts.rest + _T("\\") + _T(AUTOMATION_VOICE_ID)
+            pathParts.root, pathParts.rest + _T("\\") + voiceInstance(instance).id
         );
         hr = bresult ? S_OK : E_FAIL;
     }
@@ -252,7 +418,17 @@ int wmain(int argc, __in_ecount(argc) WCHAR* argv[])
     {
         if (action == DllAction::install)
         {
-            hr = install();
+            int numInstances = parseInstancesArg(argc, argv);
+            if (numInstances == 0)
+            {
+                fwprintf(stderr, L"Error: /instances must specify between 1 and %d instances.\n",
+                    MAX_VOICE_INSTANCES);
+                hr = E_INVALIDARG;
+            }
+            else
+            {
+                hr = install(parseVoiceDataArg(argc, argv), numInstances);
+            }
         }
         else
         {
@@ -0,0 +1,252 @@
+'use strict';
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const { AudioCapture, encodeAudioFrame } = require('../lib/audio-capture');
+const { AudioTap, encodeWav } = require('../lib/audio-tap');
+const { AudioTapWriter } = require('./helpers/audio-tap-writer');
+
+suite('audio tap', () => {
+  let directory, tapPath;
+  setup(() => {
+    directory = fs.mkdtempSync(path.join(os.tmpdir(), 'at-driver-audio-tap-'));
+    tapPath = path.join(directory, 'audio.tap');
+  });
+  teardown(() => {
+    fs.rmSync(directory, { recursive: true, force: true });
+  });
+
+  test('missing tap', () => {
+    assert.strictEqual(AudioTap.open(tapPath), null);
+  });
+
+  test('invalid tap', () => {
+    fs.writeFileSync(tapPath, Buffer.alloc(4096));
+    assert.strictEqual(AudioTap.open(tapPath), null);
+  });
+
+  test('reads the format', () => {
+    new AudioTapWriter(tapPath, 1024).close();
+    const tap = AudioTap.open(tapPath);
+    assert.deepStrictEqual(tap.format, { samplesPerSec: 11025, bitsPerSample: 16, channels: 1 });
+    tap.close();
+  });
+
+  test('enables the voice to write', () => {
+    const writer = new AudioTapWriter(tapPath, 1024);
+    const tap = AudioTap.open(tapPath);
+    assert.strictEqual(writer.enabled, false);
+    tap.setEnabled(true);
+    assert.strictEqual(writer.enabled, true);
+    tap.setEnabled(false);
+    assert.strictEqual(writer.enabled, false);
+    tap.close();
+    writer.close();
+  });
+
+  test('drains records in order and releases their space', () => {
+    const writer = new AudioTapWriter(tapPath, 1024);
+    const utteranceId = 0xfedcba9876543210n;
+    writer.write(utteranceId, 0, Buffer.from([1, 2, 3]));
+    writer.write(utteranceId, 3, Buffer.from([4, 5]));
+
+    const tap = AudioTap.open(tapPath);
+    assert.deepStrictEqual(tap.drain(), [
+      {
+        utteranceId: '18364758544493064720',
+        offset: 0,
+        timestamp: 1000,
+        samples: Buffer.from([1, 2, 3]),
+      },
+      {
+        utteranceId: '18364758544493064720',
+        offset: 3,
+        timestamp: 1000,
+        samples: Buffer.from([4, 5]),
+      },
+    ]);
+    assert.deepStrictEqual(tap.drain(), []);
+    const { readOffset, reserveOffset } = tap.readHeader();
+    assert.strictEqual(readOffset, reserveOffset);
+    tap.close();
+    writer.close();
+  });
+
+  test('wraps around the end of the ring', () => {
+    const writer = new AudioTapWriter(tapPath, 512);
+    const tap = AudioTap.open(tapPath);
+    const received = [];
+    for (let i = 0; i < 20; i += 1) {
+      assert.ok(writer.write(1n, i * 100, Buffer.alloc(100, i)));
+      if (i % 2 === 1) {
+        received.push(...tap.drain());
+      }
+    }
+    assert.deepStrictEqual(
+      received.map(record => record.samples[0]),
+      Array.from({ length: 20 }, (_, i) => i),
+    );
+    assert.ok(tap.readHeader().readOffset > 512);
+    tap.close();
+    writer.close();
+  });
+
+  test('writers cannot overwrite records which have not been drained', () => {
+    const writer = new AudioTapWriter(tapPath, 512);
+    let written = 0;
+    while (writer.write(1n, written * 100, Buffer.alloc(100, written))) {
+      written += 1;
+    }
+    assert.strictEqual(written, 3);
+    const tap = AudioTap.open(tapPath);
+    assert.strictEqual(tap.drain().length, 3);
+    assert.ok(writer.write(1n, 300, Buffer.alloc(100)));
+    tap.close();
+    writer.close();
+  });
+
+  test('waits for unpublished records', () => {
+    const writer = new AudioTapWriter(tapPath, 1024);
+    writer.write(1n, 0, Buffer.from([1]));
+    writer.write(1n, 1, Buffer.from([2]), { publish: false });
+    writer.write(1n, 2, Buffer.from([3]));
+
+    const tap = AudioTap.open(tapPath);
+    assert.deepStrictEqual(tap.drain(0).map(record => record.samples[0]), [1]);
+    assert.deepStrictEqual(tap.drain(10), []);
+    assert.ok(tap.readHeader().readOffset < tap.readHeader().reserveOffset);
+    tap.close();
+    writer.close();
+  });
+
+  test('skips records which are never published', () => {
+    const writer = new AudioTapWriter(tapPath, 1024);
+    writer.write(1n, 0, Buffer.from([1]), { publish: false });
+
+    const tap = AudioTap.open(tapPath);
+    assert.deepStrictEqual(tap.drain(0), []);
+    assert.deepStrictEqual(tap.drain(999), []);
+    assert.ok(tap.readHeader().readOffset < tap.readHeader().reserveOffset);
+    assert.deepStrictEqual(tap.drain(1000), []);
+    assert.strictEqual(tap.readHeader().readOffset, tap.readHeader().reserveOffset);
+
+    writer.write(1n, 1, Buffer.from([2]));
+    assert.deepStrictEqual(tap.drain(1001).map(record => record.samples[0]), [2]);
+    tap.close();
+    writer.close();
+  });
+
+  test('encodes WAV files', () => {
+    const wav = encodeWav(
+      { samplesPerSec: 11025, bitsPerSample: 16, channels: 1 },
+      Buffer.from([1, 2, 3, 4]),
+    );
+    assert.strictEqual(wav.length, 48);
+    assert.strictEqual(wav.toString('latin1', 0, 4), 'RIFF');
+    assert.strictEqual(wav.readUInt32LE(4), 40);
+    assert.strictEqual(wav.toString('latin1', 8, 16), 'WAVEfmt ');
+    assert.strictEqual(wav.readUInt32LE(24), 11025);
+    assert.strictEqual(wav.readUInt32LE(28), 22050);
+    assert.strictEqual(wav.readUInt16LE(32), 2);
+    assert.strictEqual(wav.readUInt32LE(40), 4);
+    assert.deepStrictEqual(wav.subarray(44), Buffer.from([1, 2, 3, 4]));
+  });
+
+  suite('capture', () => {
+    test('enables the tap only while retained', () => {
+      const writer = new AudioTapWriter(tapPath, 1024);
+      const capture = new AudioCapture(tapPath);
+      capture.retain();
+      capture.retain();
+      assert.strictEqual(writer.enabled, true);
+      capture.release();
+      assert.strictEqual(writer.enabled, true);
+      capture.release();
+      assert.strictEqual(writer.enabled, false);
+      capture.close();
+      writer.close();
+    });
+
+    test('enables a tap which is created later', () => {
+      const capture = new AudioCapture(tapPath);
+      capture.retain();
+      capture.poll();
+      const writer = new AudioTapWriter(tapPath, 1024);
+      capture.poll();
+      assert.strictEqual(writer.enabled, true);
+      capture.close();
+      writer.close();
+    });
+
+    test('streams samples', () => {
+      const writer = new AudioTapWriter(tapPath, 1024);
+      const capture = new AudioCapture(tapPath);
+      const samples = [];
+      capture.on('samples', record => samples.push(record));
+      capture.retain();
+      writer.write(7n, 0, Buffer.from([1, 2]));
+      capture.poll();
+      assert.deepStrictEqual(
+        samples.map(({ utteranceId, offset }) => ({ utteranceId, offset })),
+        [{ utteranceId: '7', offset: 0 }],
+      );
+      capture.close();
+      writer.close();
+    });
+
+    test('records each utterance when it ends', () => {
+      const writer = new AudioTapWriter(tapPath, 1024);
+      const capture = new AudioCapture(tapPath);
+      const utterances = [];
+      capture.on('utterance', utterance => utterances.push(utterance));
+      capture.retain();
+      writer.write(7n, 0, Buffer.from([1, 2]));
+      writer.write(8n, 0, Buffer.from([9, 9]));
+      capture.poll();
+      writer.write(7n, 2, Buffer.from([3, 4]));
+
+      capture.deliver({ type: 'event', name: 'speakEnd', data: '7' });
+      assert.strictEqual(utterances.length, 1);
+      assert.strictEqual(utterances[0].utteranceId, '7');
+      assert.deepStrictEqual(utterances[0].wav.subarray(44), Buffer.from([1, 2, 3, 4]));
+
+      capture.deliver({ type: 'event', name: 'speakEnd', data: '9' });
+      assert.strictEqual(utterances.length, 1);
+      capture.close();
+      writer.close();
+    });
+
+    test('limits the audio retained for an utterance', () => {
+      const writer = new AudioTapWriter(tapPath, 1024);
+      const capture = new AudioCapture(tapPath, { maxUtteranceBytes: 3 });
+      const utterances = [];
+      capture.on('utterance', utterance => utterances.push(utterance));
+      capture.retain();
+      writer.write(7n, 0, Buffer.from([1, 2]));
+      writer.write(7n, 2, Buffer.from([3, 4]));
+      capture.deliver({ type: 'event', name: 'speakEnd', data: '7' });
+      assert.deepStrictEqual(utterances[0].wav.subarray(44), Buffer.from([1, 2]));
+      capture.close();
+      writer.close();
+    });
+
+    test('encodes binary frames', () => {
+      const frame = encodeAudioFrame(
+        { utteranceId: '7', offset: 4, timestamp: 1000, samples: Buffer.from([1, 2]) },
+        { samplesPerSec: 11025, bitsPerSample: 16, channels: 1 },
+      );
+      const headerLength = frame.readUInt32LE(0);
+      assert.deepStrictEqual(JSON.parse(frame.toString('utf8', 4, 4 + headerLength)), {
+        utteranceId: '7',
+        offset: 4,
+        timestamp: 1000,
+        samplesPerSec: 11025,
+        bitsPerSample: 16,
+        channels: 1,
+      });
+      assert.deepStrictEqual(frame.subarray(4 + headerLength), Buffer.from([1, 2]));
+    });
+  });
+});
@@ -0,0 +1,251 @@
+'use strict';
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const { CaptureJournal } = require('../lib/capture-journal');
+const {
+  MAX_DICTIONARY_ENTRIES,
+  MAX_DICTIONARY_ENTRY_LENGTH,
+  parseMessage,
+} = require('../lib/create-voice-server');
+const { JournalReplayer } = require('../lib/journal-replayer');
+const { CaptureJournalWriter } = require('./helpers/capture-journal-writer');
+
+suite('capture journal', () => {
+  let directory, journalPath;
+  setup(() => {
+    directory = fs.mkdtempSync(path.join(os.tmpdir(), 'at-driver-journal-'));
+    journalPath = path.join(directory, 'capture.journal');
+  });
+  teardown(() => {
+    fs.rmSync(directory, { recursive: true, force: true });
+  });
+
+  test('missing journal', () => {
+    assert.strictEqual(CaptureJournal.open(journalPath), null);
+  });
+
+  test('invalid journal', () => {
+    fs.writeFileSync(journalPath, Buffer.alloc(4096));
+    assert.strictEqual(CaptureJournal.open(journalPath), null);
+  });
+
+  test('reads records in order', () => {
+    const writer = new CaptureJournalWriter(journalPath, 4096, 16);
+    writer.append('speech:first', 1000);
+    writer.append('speech:second', 2000);
+    writer.append('lifecycle:Voice destroyed', 3000);
+    writer.close();
+
+    const journal = CaptureJournal.open(journalPath);
+    assert.deepStrictEqual(journal.readRange(1), [
+      { sequence: 1, timestamp: 1000, data: 'speech:first' },
+      { sequence: 2, timestamp: 2000, data: 'speech:second' },
+      { sequence: 3, timestamp: 3000, data: 'lifecycle:Voice destroyed' },
+    ]);
+    journal.close();
+  });
+
+  test('omits evicted records', () => {
+    const writer = new CaptureJournalWriter(journalPath, 1024, 8);
+    for (let i = 1; i <= 20; i += 1) {
+      writer.append(`speech:${i}`, i * 10);
+    }
+    writer.close();
+
+    const journal = CaptureJournal.open(journalPath);
+    const records = journal.readRange(1);
+    assert.deepStrictEqual(
+      records.map(record => record.data),
+      ['13', '14', '15', '16', '17', '18', '19', '20'].map(text => `speech:${text}`),
+    );
+    assert.strictEqual(journal.read(2), null);
+    journal.close();
+  });
+
+  test('queries by time', () => {
+    const writer = new CaptureJournalWriter(journalPath, 4096, 64);
+    for (let i = 1; i <= 40; i += 1) {
+      writer.append(`speech:${i}`, i * 10);
+    }
+    writer.close();
+
+    const journal = CaptureJournal.open(journalPath);
+    assert.strictEqual(journal.findByTimestamp(0), 1);
+    assert.strictEqual(journal.findByTimestamp(105), 11);
+    assert.strictEqual(journal.findByTimestamp(1000), 41);
+    assert.deepStrictEqual(
+      journal.readBetween(200, 240).map(record => record.data),
+      ['speech:20', 'speech:21', 'speech:22', 'speech:23'],
+    );
+    journal.close();
+  });
+
+  test('rejects corrupt records', () => {
+    const writer = new CaptureJournalWriter(journalPath, 4096, 16);
+    writer.append('speech:intact', 1000);
+    writer.close();
+
+    const fd = fs.openSync(journalPath, 'r+');
+    fs.writeSync(fd, Buffer.from('X'), 0, 1, 64 + 16 * 24 + 24);
+    fs.closeSync(fd);
+
+    const journal = CaptureJournal.open(journalPath);
+    assert.strictEqual(journal.read(1), null);
+    journal.close();
+  });
+
+  suite('replayer', () => {
+    const flush = () => new Promise(resolve => setImmediate(resolve));
+
+    test('recovers messages emitted while the driver was not running', async () => {
+      const writer = new CaptureJournalWriter(journalPath, 4096, 16);
+      writer.append('speech:before', 1000);
+      writer.append('internalError:Emission failed', 2000);
+
+      const replayer = new JournalReplayer(journalPath);
+      assert.deepStrictEqual(replayer.recover(), [
+        { type: 'event', name: 'speech', data: 'before', sequence: 1 },
+        { type: 'event', name: 'internalError', data: 'Emission failed', sequence: 2 },
+      ]);
+      await flush();
+      replayer.close();
+
+      // A subsequent instance resumes from the acknowledged position.
+      writer.append('speech:after', 3000);
+      const next = new JournalReplayer(journalPath);
+      assert.deepStrictEqual(next.recover(), [
+        { type: 'event', name: 'speech', data: 'after', sequence: 3 },
+      ]);
+      next.close();
+      writer.close();
+    });
+
+    test('fills gaps and suppresses duplicates', () => {
+      const writer = new CaptureJournalWriter(journalPath, 4096, 16);
+      const replayer = new JournalReplayer(journalPath);
+      assert.deepStrictEqual(replayer.recover(), []);
+
+      for (const text of ['one', 'two', 'three']) {
+        writer.append(`speech:${text}`, 1000);
+      }
+
+      const live = parseMessage('speech seq=3:three');
+      assert.deepStrictEqual(replayer.accept(live), [
+        { type: 'event', name: 'speech', data: 'one', sequence: 1 },
+        { type: 'event', name: 'speech', data: 'two', sequence: 2 },
+        live,
+      ]);
+      assert.deepStrictEqual(replayer.accept(parseMessage('speech seq=2:two')), []);
+
+      const unrecorded = parseMessage('speech:unrecorded');
+      assert.deepStrictEqual(replayer.accept(unrecorded), [unrecorded]);
+
+      replayer.close();
+      writer.close();
+    });
+
+    test('restarts with a re-created journal', () => {
+      let writer = new CaptureJournalWriter(journalPath, 4096, 16);
+      writer.append('speech:one', 1000);
+      writer.append('speech:two', 1000);
+      writer.close();
+
+      const replayer = new JournalReplayer(journalPath);
+      assert.strictEqual(replayer.recover().length, 2);
+
+      writer = new CaptureJournalWriter(journalPath, 8192, 16);
+      writer.append('speech:new', 2000);
+      writer.close();
+
+      const live = parseMessage('speech seq=1:new');
+      assert.deepStrictEqual(replayer.accept(live), [live]);
+      replayer.close();
+    });
+  });
+});
+
+suite('voice messages', () => {
+  test('without attributes', () => {
+    assert.deepStrictEqual(parseMessage('speech:Hello, world'), {
+      type: 'event',
+      name: 'speech',
+      data: 'Hello, world',
+    });
+  });
+
+  test('with a sequence number', () => {
+    assert.deepStrictEqual(parseMessage('lifecycle seq=42:Voice destroyed'), {
+      type: 'event',
+      name: 'lifecycle',
+      data: 'Voice destroyed',
+      sequence: 42,
+    });
+  });
+
+  test('with timestamps', () => {
+    assert.deepStrictEqual(parseMessage('speakBegin seq=3 t=5081221 entry=5081100:17'), {
+      type: 'event',
+      name: 'speakBegin',
+      data: '17',
+      sequence: 3,
+      emittedAt: 5081221,
+      speakEntryAt: 5081100,
+    });
+  });
+
+  test('bookmark', () => {
+    assert.deepStrictEqual(parseMessage('bookmark seq=7:marker-1'), {
+      type: 'event',
+      name: 'bookmark',
+      data: 'marker-1',
+      sequence: 7,
+    });
+  });
+
+  test('unrecognized', () => {
+    assert.deepStrictEqual(parseMessage('shout:Hello'), {
+      type: 'event',
+      name: 'internalError',
+      data: 'unrecognized message: "shout:Hello"',
+    });
+  });
+
+  test('defining and referring to dictionary entries', () => {
+    const dictionary = [];
+    assert.deepStrictEqual(parseMessage('speech seq=1 def=3:Quarterly revenue', dictionary), {
+      type: 'event',
+      name: 'speech',
+      data: 'Quarterly revenue',
+      sequence: 1,
+    });
+    assert.deepStrictEqual(parseMessage('speech seq=2 ref=3:', dictionary), {
+      type: 'event',
+      name: 'speech',
+      data: 'Quarterly revenue',
+      sequence: 2,
+    });
+    parseMessage('speech seq=3 def=3:button', dictionary);
+    assert.strictEqual(parseMessage('speech seq=4 ref=3:', dictionary).data, 'button');
+  });
+
+  test('referring to an undefined dictionary entry', () => {
+    assert.deepStrictEqual(parseMessage('speech seq=5 ref=9:', []), {
+      type: 'event',
+      name: 'internalError',
+      data: 'unknown reference: "speech seq=5 ref=9:"',
+    });
+  });
+
+  test('definitions beyond the bounds of the dictionary are ignored', () => {
+    const dictionary = [];
+    const long = 'x'.repeat(MAX_DICTIONARY_ENTRY_LENGTH + 1);
+    assert.strictEqual(parseMessage(`speech def=0:${long}`, dictionary).data, long);
+    const outOfRange = `speech def=${MAX_DICTIONARY_ENTRIES}:heading`;
+    assert.strictEqual(parseMessage(outOfRange, dictionary).data, 'heading');
+    assert.deepStrictEqual(dictionary, []);
+    assert.strictEqual(parseMessage('speech ref=0:', dictionary).name, 'internalError');
+  });
+});
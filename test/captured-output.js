@@ -0,0 +1,238 @@
+'use strict';
+const assert = require('assert');
+const { EventEmitter } = require('events');
+
+const { CapturedOutput } = require('../lib/captured-output');
+const { OutputHistory } = require('../lib/output-history');
+const { Subscriptions } = require('../lib/subscriptions');
+const captureModule = require('../lib/modules/capture');
+
+const speech = data => ({ type: 'event', name: 'speech', data });
+const bookmark = data => ({ type: 'event', name: 'bookmark', data });
+const speakBegin = id => ({ type: 'event', name: 'speakBegin', data: id });
+const speakEnd = id => ({ type: 'event', name: 'speakEnd', data: id });
+const delay = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+suite('captured output', () => {
+  let output;
+  setup(() => {
+    output = new CapturedOutput({ bookmarkHistory: 2 });
+  });
+
+  suite('waitForBookmark', () => {
+    test('resolves when the bookmark is reached', async () => {
+      let resolved = false;
+      const wait = output.waitForBookmark('b').then(() => (resolved = true));
+
+      output.deliver(speech('Hello'));
+      output.deliver(bookmark('a'));
+      await Promise.resolve();
+      assert.strictEqual(resolved, false);
+
+      output.deliver(bookmark('b'));
+      await wait;
+      assert.strictEqual(output.listenerCount('bookmark'), 0);
+    });
+
+    test('resolves immediately for a recently reached bookmark', async () => {
+      output.deliver(bookmark('a'));
+      output.deliver(bookmark('b'));
+      await output.waitForBookmark('a');
+    });
+
+    test('forgets bookmarks beyond its history', async () => {
+      output.deliver(bookmark('a'));
+      output.deliver(bookmark('b'));
+      output.deliver(bookmark('c'));
+      await assert.rejects(output.waitForBookmark('a', { timeout: 0 }), /timed out/);
+      assert.strictEqual(output.listenerCount('bookmark'), 0);
+    });
+
+    test('is abandoned when the connection closes', async () => {
+      const connection = new EventEmitter();
+      const wait = output.waitForBookmark('a', { cancellation: connection });
+      connection.emit('close');
+      await assert.rejects(wait, /connection closed/);
+      assert.strictEqual(connection.listenerCount('close'), 0);
+    });
+  });
+
+  suite('waitForSettled', () => {
+    const quietPeriod = 30;
+    let settledAt;
+    const waitForSettled = options => {
+      const start = Date.now();
+      return output.waitForSettled({ quietPeriod, ...options }).then(() => {
+        settledAt = Date.now() - start;
+      });
+    };
+
+    test('waits for the quiet period when there is no output', async () => {
+      await waitForSettled();
+      assert(settledAt >= quietPeriod - 1, `settled after ${settledAt} ms`);
+    });
+
+    test('waits for output which begins during the quiet period', async () => {
+      const settled = waitForSettled();
+      await delay(10);
+      output.deliver(speakBegin('1'));
+      output.deliver(speech('Hello'));
+      await delay(quietPeriod * 2);
+      output.deliver(speakEnd('1'));
+      await settled;
+      assert(settledAt >= 10 + quietPeriod * 3, `settled after ${settledAt} ms`);
+    });
+
+    test('waits for utterances which have not ended', async () => {
+      output.deliver(speakBegin('1'));
+      output.deliver(speakBegin('2'));
+      let settled = false;
+      const wait = waitForSettled().then(() => (settled = true));
+      output.deliver(speakEnd('1'));
+      await delay(quietPeriod * 2);
+      assert.strictEqual(settled, false);
+      output.deliver(speakEnd('2'));
+      await wait;
+    });
+
+    test('disregards utterances which never end', async () => {
+      output = new CapturedOutput({ utteranceTimeout: quietPeriod });
+      output.deliver(speakBegin('1'));
+      await waitForSettled({ timeout: quietPeriod * 10 });
+    });
+
+    test('times out', async () => {
+      output.deliver(speakBegin('1'));
+      await assert.rejects(waitForSettled({ timeout: 5 }), /timed out waiting for output/);
+      assert.strictEqual(output.listenerCount('activity'), 0);
+    });
+
+    test('emits "settled" after activity', async () => {
+      output = new CapturedOutput({ quietPeriod });
+      let count = 0;
+      output.on('settled', () => (count += 1));
+      output.deliver(speakBegin('1'));
+      output.deliver(speech('Hello'));
+      await delay(quietPeriod * 2);
+      assert.strictEqual(count, 0);
+      output.deliver(speakEnd('1'));
+      await delay(quietPeriod * 2);
+      assert.strictEqual(count, 1);
+    });
+  });
+
+  suite('waitForOutput', () => {
+    test('resolves with the speech which satisfies the predicate', async () => {
+      output.deliver(speech('Submit button'));
+      const wait = output.waitForOutput({ contains: 'button' });
+      output.deliver(speech('Cancel'));
+      output.deliver(speech('Cancel button'));
+      assert.deepStrictEqual(await wait, ['Cancel button']);
+      assert.strictEqual(output.outputMatcher.size, 0);
+    });
+
+    test('times out', async () => {
+      await assert.rejects(
+        output.waitForOutput({ contains: 'button' }, { timeout: 5 }),
+        /timed out waiting for output/,
+      );
+      assert.strictEqual(output.outputMatcher.size, 0);
+    });
+
+    test('is abandoned when the connection closes', async () => {
+      const connection = new EventEmitter();
+      const wait = output.waitForOutput({ contains: 'a' }, { cancellation: connection });
+      connection.emit('close');
+      await assert.rejects(wait, /connection closed/);
+      assert.strictEqual(connection.listenerCount('close'), 0);
+      assert.strictEqual(output.outputMatcher.size, 0);
+    });
+  });
+
+  suite('commands', () => {
+    const waitForBookmark = captureModule['interaction.waitForBookmark'];
+    const waitForOutput = captureModule['interaction.waitForOutput'];
+    const waitForSettled = captureModule['interaction.waitForSettled'];
+    const getOutputSince = captureModule['interaction.getOutputSince'];
+    let history;
+    let subscriptions;
+    setup(() => {
+      history = new OutputHistory();
+      subscriptions = new Subscriptions();
+    });
+    const server = () => ({ capturedOutput: output, outputHistory: history, subscriptions });
+
+    test('interaction.waitForBookmark validates its parameters', async () => {
+      const websocket = new EventEmitter();
+      await assert.rejects(waitForBookmark(websocket, { name: 4 }, server()), /"name"/);
+      await assert.rejects(
+        waitForBookmark(websocket, { name: 'a', timeout: -1 }, server()),
+        /"timeout"/,
+      );
+    });
+
+    test('interaction.waitForSettled validates its parameters', async () => {
+      await assert.rejects(
+        waitForSettled(new EventEmitter(), { quietPeriod: '1' }, server()),
+        /"quietPeriod"/,
+      );
+    });
+
+    test('interaction.waitForBookmark responds once the bookmark is reached', async () => {
+      const result = waitForBookmark(new EventEmitter(), { name: 'a' }, server());
+      output.deliver(bookmark('a'));
+      assert.deepStrictEqual(await result, {});
+    });
+
+    test('interaction.waitForOutput validates its parameters', async () => {
+      const websocket = new EventEmitter();
+      await assert.rejects(waitForOutput(websocket, { contains: 4 }, server()), /"contains"/);
+      await assert.rejects(
+        waitForOutput(websocket, { contains: 'a', timeout: -1 }, server()),
+        /"timeout"/,
+      );
+      await assert.rejects(waitForOutput(websocket, {}, server()), /exactly one/);
+    });
+
+    test('interaction.waitForOutput responds with the matching speech', async () => {
+      const result = waitForOutput(
+        new EventEmitter(),
+        { sequence: ['dialog', 'button'] },
+        server(),
+      );
+      output.deliver(speech('Settings dialog'));
+      output.deliver(speech('Close button'));
+      assert.deepStrictEqual(await result, { output: ['Settings dialog', 'Close button'] });
+    });
+
+    test('commands which depend on unsubscribed messages are rejected', async () => {
+      subscriptions.add(new EventEmitter(), {
+        types: ['lifecycle'],
+        origins: ['keyPress', 'unprompted'],
+        bookmarks: false,
+        timing: false,
+        audio: false,
+      });
+      await assert.rejects(
+        waitForOutput(new EventEmitter(), { contains: 'a' }, server()),
+        /interaction.waitForOutput requires a session which subscribes to speech/,
+      );
+      await assert.rejects(
+        waitForBookmark(new EventEmitter(), { name: 'a' }, server()),
+        /subscribes to bookmarks/,
+      );
+    });
+
+    test('interaction.getOutputSince returns the output from the cursor onwards', () => {
+      history.append('a');
+      history.append('b', 3);
+      assert.deepStrictEqual(getOutputSince(null, { cursor: 1 }, server()), {
+        output: [{ seq: 1, data: 'b', pressId: 3 }],
+        cursor: 2,
+        missed: 0,
+      });
+      assert.throws(() => getOutputSince(null, { cursor: 3 }, server()), /"cursor"/);
+      assert.throws(() => getOutputSince(null, { cursor: 0, limit: 0 }, server()), /"limit"/);
+    });
+  });
+});
@@ -0,0 +1,345 @@
+'use strict';
+const assert = require('assert');
+const { EventEmitter } = require('events');
+const { fork } = require('child_process');
+const path = require('path');
+
+const WebSocket = require('ws');
+
+const { createCoordinator } = require('../lib/federation-coordinator');
+const { FRAME_TYPES, FrameReader, MAX_FRAME_SIZE, encodeFrame } = require('../lib/federation-link');
+const { parseAddress } = require('../lib/federation-uplink');
+const { MergedStream } = require('../lib/merged-stream');
+const { createHost } = require('./helpers/federated-host');
+
+const delay = ms => new Promise(resolve => setTimeout(resolve, ms));
+const tick = () => new Promise(resolve => setImmediate(resolve));
+
+/**
+ * A client of the coordinator which records the events it receives.
+ */
+class Client extends EventEmitter {
+  /**
+   * @param {number} port
+   */
+  static async connect(port) {
+    const websocket = new WebSocket(`ws://localhost:${port}/session`);
+    await new Promise((resolve, reject) => {
+      websocket.on('error', reject);
+      websocket.on('open', resolve);
+    });
+    return new Client(websocket);
+  }
+
+  constructor(websocket) {
+    super();
+    this.websocket = websocket;
+    this.nextId = 1;
+    /** @type {object[]} */
+    this.events = [];
+    websocket.on('message', data => {
+      const message = JSON.parse(data);
+      if (message.method) {
+        this.events.push(message);
+        this.emit('event', message);
+      } else {
+        this.emit(`response ${message.id}`, message);
+      }
+    });
+  }
+
+  /**
+   * @param {string} method
+   * @param {object} [params]
+   * @param {string} [host]
+   */
+  command(method, params = {}, host = undefined) {
+    const id = this.nextId++;
+    this.websocket.send(JSON.stringify({ id, method, params, host }));
+    return new Promise(resolve => this.once(`response ${id}`, resolve));
+  }
+
+  /**
+   * @param {function(object[]): boolean} predicate
+   */
+  async waitForEvents(predicate) {
+    while (!predicate(this.events)) {
+      await new Promise(resolve => this.once('event', resolve));
+    }
+  }
+
+  /** @returns {object[]} the `interaction.capturedOutput` events received */
+  get output() {
+    return this.events.filter(({ method }) => method === 'interaction.capturedOutput');
+  }
+
+  /**
+   * @param {string} [host]
+   *
+   * @returns {string[]} each message of the output received (from the given
+   *                     driver, if any)
+   */
+  spoken(host = undefined) {
+    return this.output
+      .filter(({ params }) => host === undefined || params.host === host)
+      .flatMap(({ params }) => params.batch || [params.data]);
+  }
+
+  close() {
+    this.websocket.close();
+  }
+}
+
+suite('federation', () => {
+  suite('frames', () => {
+    test('are read however the data is divided', () => {
+      const frames = [
+        encodeFrame(FRAME_TYPES.HELLO, 0, '{"host":"café"}'),
+        encodeFrame(FRAME_TYPES.CLOSE, 7),
+        encodeFrame(FRAME_TYPES.BINARY, 4294967295, Buffer.from([0, 1, 2])),
+      ];
+      const data = Buffer.concat(frames);
+      for (let split = 0; split <= data.length; split += 1) {
+        const reader = new FrameReader();
+        const read = [
+          ...reader.push(data.subarray(0, split)),
+          ...reader.push(data.subarray(split)),
+        ];
+        assert.deepStrictEqual(
+          read.map(({ type, channel, body }) => [type, channel, body.toString('hex')]),
+          [
+            [FRAME_TYPES.HELLO, 0, Buffer.from('{"host":"café"}').toString('hex')],
+            [FRAME_TYPES.CLOSE, 7, ''],
+            [FRAME_TYPES.BINARY, 4294967295, '000102'],
+          ],
+        );
+      }
+    });
+
+    test('larger than the limit are rejected', () => {
+      const header = Buffer.alloc(9);
+      header.writeUInt32BE(MAX_FRAME_SIZE + 1, 0);
+      assert.throws(() => new FrameReader().push(header), /exceeds the limit/);
+    });
+
+    test('are addressed by "host:port"', () => {
+      assert.deepStrictEqual(parseAddress('coordinator.local:4383'), {
+        host: 'coordinator.local',
+        port: 4383,
+      });
+      assert.deepStrictEqual(parseAddress('[::1]:80'), { host: '[::1]', port: 80 });
+      assert.throws(() => parseAddress('4383'), /"host:port"/);
+      assert.throws(() => parseAddress('a:0'), /"host:port"/);
+    });
+  });
+
+  suite('merged stream', () => {
+    let time;
+    let stream;
+    let released;
+    setup(() => {
+      time = 1000;
+      stream = new MergedStream({ window: 20, clock: () => time });
+      released = [];
+      stream.on('release', items => released.push(...items.map(({ item }) => item)));
+    });
+    teardown(() => stream.close());
+
+    test('orders the items of its sources by time', async () => {
+      stream.addSource('a');
+      stream.addSource('b');
+      stream.push('a', 995, 'a1');
+      stream.push('a', 998, 'a2');
+      stream.push('b', 996, 'b1');
+      stream.push('b', 999, 'b2');
+      await tick();
+      // The last item is held until the other source has an item pending.
+      assert.deepStrictEqual(released, ['a1', 'b1', 'a2']);
+      stream.push('a', 1000, 'a3');
+      await tick();
+      assert.deepStrictEqual(released, ['a1', 'b1', 'a2', 'b2']);
+    });
+
+    test('releases an item once it has been held for the window', async () => {
+      stream.addSource('a');
+      stream.addSource('b');
+      stream.push('a', 1000, 'a1');
+      await tick();
+      assert.deepStrictEqual(released, []);
+      time = 1020;
+      await delay(30);
+      assert.deepStrictEqual(released, ['a1']);
+    });
+
+    test('measures the window from the arrival of an item', async () => {
+      stream.addSource('a');
+      stream.addSource('b');
+      // Captured long before it arrives, as when its driver is busy.
+      stream.push('a', 900, 'a1');
+      await tick();
+      assert.deepStrictEqual(released, []);
+      time = 1020;
+      await delay(30);
+      assert.deepStrictEqual(released, ['a1']);
+    });
+
+    test('keeps the order of each source', async () => {
+      stream.addSource('a');
+      stream.push('a', 990, 'a1');
+      stream.push('a', 980, 'a2');
+      await tick();
+      assert.deepStrictEqual(released, ['a1', 'a2']);
+      assert.strictEqual(stream.late, 0);
+    });
+
+    test('no longer awaits a source which is removed', async () => {
+      stream.addSource('a');
+      stream.addSource('b');
+      stream.push('a', 1000, 'a1');
+      stream.push('b', 1001, 'b1');
+      stream.removeSource('b');
+      await tick();
+      // The remaining source may yet have an earlier item.
+      assert.deepStrictEqual(released, ['a1']);
+      time = 1021;
+      await delay(30);
+      assert.deepStrictEqual(released, ['a1', 'b1']);
+      assert.ok(!stream.sources.has('b'));
+    });
+  });
+
+  suite('coordinator', () => {
+    let coordinator;
+    let federationPort;
+    let hosts;
+    let clients;
+    const connect = async () => {
+      const client = await Client.connect(coordinator.address().port);
+      clients.push(client);
+      await client.command('session.new');
+      return client;
+    };
+    const join = async (...names) => {
+      for (const name of names) {
+        const joined = new Promise(resolve => coordinator.once('hostConnected', resolve));
+        hosts.set(name, createHost(federationPort, name));
+        await joined;
+      }
+    };
+    setup(async () => {
+      coordinator = await createCoordinator(0, { federationPort: 0, mergeWindow: 20 });
+      federationPort = coordinator.federation.address().port;
+      // Events sent to clients as they disconnect fail.
+      coordinator.on('error', () => {});
+      hosts = new Map();
+      clients = [];
+    });
+    teardown(async () => {
+      clients.forEach(client => client.close());
+      hosts.forEach(host => host.close());
+      await new Promise(resolve => coordinator.close(resolve));
+    });
+
+    test('tags the output of each driver and orders it by time', async () => {
+      await join('a', 'b');
+      const client = await connect();
+      await client.command('test.speak', { texts: ['one', 'two'], pressId: 1 }, 'a');
+      await delay(5);
+      await client.command(
+        'test.speak',
+        { texts: ['three'], event: { method: 'interaction.outputSettled', params: {} } },
+        'b',
+      );
+      await client.waitForEvents(events =>
+        events.some(({ method }) => method === 'interaction.outputSettled'),
+      );
+
+      const [first, second] = client.output;
+      assert.deepStrictEqual(
+        { ...first.params, time: 0 },
+        { data: 'one\ntwo', batch: ['one', 'two'], pressId: 1, host: 'a', time: 0 },
+      );
+      assert.deepStrictEqual(
+        { ...second.params, time: 0 },
+        { data: 'three', host: 'b', time: 0 },
+      );
+      assert.ok(first.params.time <= second.params.time);
+      const settled = client.events.find(({ method }) => method === 'interaction.outputSettled');
+      assert.strictEqual(settled.params.host, 'b');
+    });
+
+    test('relays each command to the named driver', async () => {
+      await join('a', 'b');
+      const client = await connect();
+      assert.deepStrictEqual(await client.command('test.whoami', {}, 'b'), {
+        id: 2,
+        result: { name: 'b' },
+      });
+      assert.deepStrictEqual(await client.command('test.whoami', {}, 'c'), {
+        id: 3,
+        error: 'unknown error',
+        message: 'unknown host "c"',
+      });
+      const { result } = await client.command('federation.hosts');
+      assert.deepStrictEqual(result.hosts.map(({ host }) => host).sort(), ['a', 'b']);
+    });
+
+    test('fails commands which a driver has yet to answer when it disconnects', async () => {
+      await join('a');
+      const client = await connect();
+      const response = client.command('test.hold', {}, 'a');
+      await delay(10);
+      hosts.get('a').close();
+      assert.deepStrictEqual(await response, {
+        id: 2,
+        error: 'unknown error',
+        message: 'host "a" disconnected',
+      });
+      await client.waitForEvents(events =>
+        events.some(({ method }) => method === 'federation.hostDisconnected'),
+      );
+    });
+
+    test('tells a driver when a client disconnects', async () => {
+      await join('a');
+      const holder = await connect();
+      const observer = await connect();
+      holder.command('test.hold', {}, 'a');
+      await delay(10);
+      holder.close();
+      await observer.waitForEvents(events => events.length > 0);
+      assert.deepStrictEqual(observer.spoken(), ['released']);
+    });
+
+    test('merges the output of several driver processes', async function () {
+      this.timeout(10000);
+      const names = ['p1', 'p2', 'p3'];
+      const joined = new Promise(resolve => {
+        let remaining = names.length;
+        coordinator.on('hostConnected', () => --remaining === 0 && resolve(undefined));
+      });
+      const children = names.map(name =>
+        fork(path.join(__dirname, 'helpers', 'federated-host.js'), [federationPort, name]),
+      );
+      try {
+        await joined;
+        const client = await connect();
+        const texts = name => ['a', 'b', 'c'].map(suffix => `${name}${suffix}`);
+        await Promise.all(
+          names.map(name => client.command('test.speak', { texts: texts(name) }, name)),
+        );
+        await client.waitForEvents(() => client.spoken().length === 9);
+        const times = client.output.map(({ params }) => params.time);
+        assert.deepStrictEqual(
+          times,
+          times.slice().sort((a, b) => a - b),
+        );
+        for (const name of names) {
+          assert.deepStrictEqual(client.spoken(name), texts(name));
+        }
+      } finally {
+        children.forEach(child => child.kill());
+      }
+    });
+  });
+});
@@ -0,0 +1,93 @@
+'use strict';
+
+const fs = require('fs');
+
+const { readUInt64, writeUInt64 } = require('../../lib/capture-journal');
+
+/**
+ * A minimal implementation of the writer side of the audio tap (see
+ * `src/automationttsengine/AudioTap.cpp`), used to produce taps in the format
+ * which the automation voice writes.
+ */
+class AudioTapWriter {
+  /**
+   * @param {string} path
+   * @param {number} capacity - a multiple of 16
+   */
+  constructor(path, capacity) {
+    this.capacity = capacity;
+    this.fd = fs.openSync(path, 'w+');
+    fs.writeSync(this.fd, Buffer.alloc(capacity, 0xff), 0, capacity, 64);
+
+    const header = Buffer.alloc(64);
+    header.write('ATAP', 0, 'latin1');
+    header.writeUInt32LE(1, 4);
+    writeUInt64(header, capacity, 8);
+    header.writeUInt32LE(11025, 44);
+    header.writeUInt16LE(16, 48);
+    header.writeUInt16LE(1, 50);
+    fs.writeSync(this.fd, header, 0, 64, 0);
+  }
+
+  /**
+   * @param {number} offset
+   */
+  readUInt64(offset) {
+    const value = Buffer.alloc(8);
+    fs.readSync(this.fd, value, 0, 8, offset);
+    return readUInt64(value, 0);
+  }
+
+  get enabled() {
+    const value = Buffer.alloc(4);
+    fs.readSync(this.fd, value, 0, 4, 40);
+    return value.readUInt32LE(0) !== 0;
+  }
+
+  /**
+   * @param {bigint} utteranceId
+   * @param {number} offset
+   * @param {Buffer} samples
+   * @param {object} [options]
+   * @param {boolean} [options.publish] - false to reserve space for the
+   *                                      record without publishing it
+   *
+   * @returns {boolean} false if the record did not fit
+   */
+  write(utteranceId, offset, samples, { publish = true } = {}) {
+    const size = Math.ceil((48 + samples.length) / 16) * 16;
+    let reserveOffset = this.readUInt64(16);
+    const remaining = this.capacity - (reserveOffset % this.capacity);
+    const padding = remaining < size ? remaining : 0;
+    if (reserveOffset + padding + size - this.readUInt64(24) > this.capacity) {
+      return false;
+    }
+    const reservation = Buffer.alloc(8);
+    writeUInt64(reservation, reserveOffset + padding + size, 0);
+    fs.writeSync(this.fd, reservation, 0, 8, 16);
+
+    if (padding) {
+      const record = Buffer.alloc(16);
+      writeUInt64(record, reserveOffset + 1, 0);
+      record.writeUInt32LE(0xffffffff, 8);
+      fs.writeSync(this.fd, record, 0, 16, 64 + (reserveOffset % this.capacity));
+      reserveOffset += padding;
+    }
+
+    const record = Buffer.alloc(48 + samples.length);
+    writeUInt64(record, publish ? reserveOffset + 1 : 0, 0);
+    record.writeUInt32LE(samples.length, 8);
+    record.writeBigUInt64LE(utteranceId, 16);
+    writeUInt64(record, offset, 24);
+    writeUInt64(record, 1000, 32);
+    samples.copy(record, 48);
+    fs.writeSync(this.fd, record, 0, record.length, 64 + (reserveOffset % this.capacity));
+    return true;
+  }
+
+  close() {
+    fs.closeSync(this.fd);
+  }
+}
+
+module.exports = { AudioTapWriter };
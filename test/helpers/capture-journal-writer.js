@@ -0,0 +1,101 @@
+'use strict';
+
+const fs = require('fs');
+
+const { checksum, writeUInt64 } = require('../../lib/capture-journal');
+
+/**
+ * A minimal implementation of the writer side of the capture journal (see
+ * `src/automationttsengine/CaptureJournal.cpp`), used to produce journals in
+ * the format which the automation voice writes.
+ */
+class CaptureJournalWriter {
+  /**
+   * @param {string} path
+   * @param {number} dataCapacity
+   * @param {number} indexCapacity
+   */
+  constructor(path, dataCapacity, indexCapacity) {
+    this.dataCapacity = dataCapacity;
+    this.indexCapacity = indexCapacity;
+    this.firstSequence = 1;
+    this.nextSequence = 1;
+    this.writeOffset = 0;
+    /** @type {number[]} */
+    this.offsets = [];
+    this.fd = fs.openSync(path, 'w+');
+    fs.ftruncateSync(this.fd, 64 + indexCapacity * 24 + dataCapacity);
+
+    const header = Buffer.alloc(64);
+    header.write('ATDJ', 0, 'latin1');
+    header.writeUInt32LE(1, 4);
+    writeUInt64(header, dataCapacity, 8);
+    writeUInt64(header, indexCapacity, 16);
+    fs.writeSync(this.fd, header, 0, 64, 0);
+    this.writeHeader();
+  }
+
+  writeHeader() {
+    const counters = Buffer.alloc(8);
+    for (const [offset, value] of [
+      [24, this.firstSequence],
+      [32, this.nextSequence],
+      [48, this.writeOffset],
+    ]) {
+      writeUInt64(counters, value, 0);
+      fs.writeSync(this.fd, counters, 0, 8, offset);
+    }
+  }
+
+  /**
+   * @param {string} data
+   * @param {number} timestamp - microseconds since the Unix epoch
+   *
+   * @returns {number} the record's sequence number
+   */
+  append(data, timestamp) {
+    const payload = Buffer.from(data, 'utf8');
+    const size = Math.ceil((24 + payload.length) / 8) * 8;
+    const sequence = this.nextSequence;
+
+    if ((this.writeOffset % this.dataCapacity) + size > this.dataCapacity) {
+      this.writeOffset += this.dataCapacity - (this.writeOffset % this.dataCapacity);
+    }
+    const end = this.writeOffset + size;
+    while (
+      this.firstSequence < this.nextSequence &&
+      (end - this.offsets[this.firstSequence] > this.dataCapacity ||
+        this.nextSequence - this.firstSequence >= this.indexCapacity)
+    ) {
+      this.firstSequence += 1;
+    }
+
+    const record = Buffer.alloc(24 + payload.length);
+    record.writeUInt32LE(payload.length, 0);
+    record.writeUInt32LE(checksum(sequence, timestamp, payload), 4);
+    writeUInt64(record, sequence, 8);
+    writeUInt64(record, timestamp, 16);
+    payload.copy(record, 24);
+    const position = 64 + this.indexCapacity * 24 + (this.writeOffset % this.dataCapacity);
+    fs.writeSync(this.fd, record, 0, record.length, position);
+
+    const entry = Buffer.alloc(24);
+    writeUInt64(entry, sequence, 0);
+    writeUInt64(entry, timestamp, 8);
+    writeUInt64(entry, this.writeOffset, 16);
+    fs.writeSync(this.fd, entry, 0, 24, 64 + (sequence % this.indexCapacity) * 24);
+
+    this.offsets[sequence] = this.writeOffset;
+    this.writeOffset = end;
+    this.nextSequence += 1;
+    this.writeHeader();
+
+    return sequence;
+  }
+
+  close() {
+    fs.closeSync(this.fd);
+  }
+}
+
+module.exports = { CaptureJournalWriter };
@@ -0,0 +1,64 @@
+'use strict';
+
+/**
+ * A stand-in for the key injection helper (see `src/KeyInjector`) which
+ * presses no keys. It appends "start" and each request it receives to the log
+ * file named by its first argument, and otherwise behaves as the helper does:
+ * it serves one connection at the address named by its second argument,
+ * waits for each chord's delay and responds with the time at which each chord
+ * completed.
+ *
+ * Key code 999 cannot be pressed, and key code 998 causes the helper to exit
+ * without responding.
+ *
+ * Usage: node test/helpers/fake-key-injector.js <log> <address>
+ */
+
+const fs = require('fs');
+const net = require('net');
+
+const { monotonicMicroseconds } = require('../../lib/key-press-latency');
+
+const [logPath, address] = process.argv.slice(2);
+const log = line => fs.appendFileSync(logPath, `${line}\n`);
+
+/**
+ * @param {string} line
+ *
+ * @returns {Promise<string>}
+ */
+const respond = async line => {
+  const [id, ...chords] = line.split(' ');
+  const completedAt = [];
+  for (const chord of chords) {
+    const [delay, keys] = chord.split(':');
+    await new Promise(resolve => setTimeout(resolve, Number(delay) / 1000));
+    const codes = keys.split('+').map(Number);
+    if (codes.includes(998)) {
+      process.exit(1);
+    }
+    if (codes.includes(999)) {
+      return `${id} error keys could not be injected`;
+    }
+    completedAt.push(monotonicMicroseconds());
+  }
+  return `${id} ok ${completedAt.join(' ')}`;
+};
+
+log('start');
+const server = net.createServer(socket => {
+  server.close();
+  let received = '';
+  let responses = Promise.resolve();
+  socket.setEncoding('utf8');
+  socket.on('data', data => {
+    const lines = (received + data).split('\n');
+    received = lines.pop();
+    for (const line of lines) {
+      log(line);
+      responses = responses.then(async () => socket.write(`${await respond(line)}\n`));
+    }
+  });
+  socket.on('close', () => process.exit(0));
+});
+server.listen(address, () => console.log('ready'));
@@ -0,0 +1,68 @@
+'use strict';
+
+/**
+ * A stand-in for a driver which is a member of a federation (see
+ * `serve --coordinator`). It has no voice; instead, the commands which the
+ * coordinator relays to it produce output:
+ *
+ * - `test.speak` captures each of `params.texts` (caused by `params.pressId`,
+ *   if given) and then broadcasts `params.event`, if given
+ * - `test.whoami` responds with the driver's name
+ * - `test.hold` responds once the client disconnects, and reports that it
+ *   did so by capturing "released"
+ *
+ * Run as a script, it connects to the coordinator and sends "ready" to its
+ * parent once connected.
+ *
+ * Usage: node test/helpers/federated-host.js <port> <name>
+ */
+
+const { FederationUplink } = require('../../lib/federation-uplink');
+
+/**
+ * @param {number} port - the coordinator's federation port
+ * @param {string} name
+ *
+ * @returns {FederationUplink}
+ */
+const createHost = (port, name) => {
+  const uplink = new FederationUplink(
+    { host: '127.0.0.1', port },
+    {
+      name,
+      retryDelay: 50,
+      accept: socket => {
+        socket.on('message', data => {
+          const { id, method, params } = JSON.parse(data);
+          const respond = result => socket.send(JSON.stringify({ id, result }));
+          if (method === 'test.speak') {
+            for (const text of params.texts) {
+              uplink.output(text, params.pressId === undefined ? null : params.pressId);
+            }
+            if (params.event) {
+              uplink.event(params.event);
+            }
+            respond({});
+          } else if (method === 'test.whoami') {
+            respond({ name });
+          } else if (method === 'test.hold') {
+            socket.once('close', () => uplink.output('released'));
+          } else {
+            socket.send(JSON.stringify({ id, error: 'unknown command' }));
+          }
+        });
+      },
+    },
+  );
+  uplink.on('error', () => {});
+  return uplink;
+};
+
+if (require.main === module) {
+  const [port, name] = process.argv.slice(2);
+  const uplink = createHost(Number(port), name);
+  uplink.once('connected', () => process.send('ready'));
+  process.on('disconnect', () => process.exit(0));
+}
+
+module.exports = { createHost };
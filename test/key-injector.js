@@ -0,0 +1,129 @@
+'use strict';
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const { virtualKeyCode } = require('../lib/helpers/win32/VirtualKey');
+const { KeyInjector, pressKeySequenceCommand } = require('../lib/key-injector');
+const { monotonicMicroseconds } = require('../lib/key-press-latency');
+
+suite('key injector', () => {
+  let directory, logPath, injector;
+  const logged = () => fs.readFileSync(logPath, 'utf8').trim().split('\n');
+  setup(() => {
+    directory = fs.mkdtempSync(path.join(os.tmpdir(), 'at-driver-keys-'));
+    logPath = path.join(directory, 'requests.log');
+    injector = new KeyInjector({
+      helper: process.execPath,
+      args: [path.join(__dirname, 'helpers', 'fake-key-injector.js'), logPath],
+    });
+  });
+  teardown(() => {
+    injector.close();
+    fs.rmSync(directory, { recursive: true, force: true });
+  });
+
+  test('starts the helper once and sends it each sequence', async () => {
+    const before = monotonicMicroseconds();
+    const completedAt = await injector.press([
+      { codes: [45, 40] },
+      { codes: [9], delay: 20 },
+      { codes: [16, 9], delay: 1.5 },
+    ]);
+    await injector.press([{ codes: [13] }]);
+
+    assert.deepStrictEqual(logged(), ['start', '1 0:45+40 20000:9 1500:16+9', '2 0:13']);
+    assert.strictEqual(completedAt.length, 3);
+    assert.ok(completedAt[0] >= before);
+    assert.ok(completedAt[1] - completedAt[0] >= 20000, 'the delay is observed');
+  });
+
+  test('answers concurrent requests in order', async () => {
+    const presses = [[{ codes: [1], delay: 10 }], [{ codes: [2] }], [{ codes: [3] }]];
+    const results = await Promise.all(presses.map(chords => injector.press(chords)));
+    assert.ok(results[0][0] <= results[1][0] && results[1][0] <= results[2][0]);
+    assert.strictEqual(logged().filter(line => line === 'start').length, 1);
+  });
+
+  test('reports keys which cannot be pressed', async () => {
+    await assert.rejects(injector.press([{ codes: [999] }]), /keys could not be injected/);
+    await assert.rejects(injector.press([{ codes: [] }]), /invalid key codes/);
+    await assert.rejects(injector.press([{ codes: [-1] }]), /invalid key codes/);
+    assert.deepStrictEqual(await injector.press([]), []);
+  });
+
+  test('restarts a helper which has exited', async () => {
+    await assert.rejects(injector.press([{ codes: [998] }]), /exited|disconnected/);
+    assert.strictEqual((await injector.press([{ codes: [9] }])).length, 1);
+    assert.deepStrictEqual(logged(), ['start', '1 0:998', 'start', '2 0:9']);
+  });
+
+  test('rejects outstanding requests once closed', async () => {
+    const pending = injector.press([{ codes: [9], delay: 1000 }]);
+    await new Promise(resolve => setTimeout(resolve, 200));
+    injector.close();
+    await assert.rejects(pending, /closed/);
+  });
+
+  test('reports a helper which cannot be started', async () => {
+    injector = new KeyInjector({ helper: path.join(directory, 'missing') });
+    await assert.rejects(injector.press([{ codes: [9] }]), /ENOENT/);
+  });
+});
+
+suite('interaction.pressKeySequence', () => {
+  /** @type {string[][]} */
+  let pressed;
+  const pressKeys = async (websocket, { keys }) => {
+    pressed.push(keys);
+    return {};
+  };
+  const toCodes = keys => keys.map(key => key.charCodeAt(0));
+  const command = pressKeySequenceCommand(toCodes, pressKeys);
+  setup(() => {
+    pressed = [];
+  });
+
+  test('presses each chord through the key injector', async () => {
+    const sent = [];
+    const keyInjector = {
+      press: async chords => {
+        sent.push(...chords);
+        return chords.map((_, index) => index);
+      },
+    };
+    const chords = [{ keys: ['a', 'b'] }, { keys: ['c'], delay: 5 }];
+    const result = await command(null, { chords }, { keyInjector });
+    assert.deepStrictEqual(result, { completedAt: [0, 1] });
+    assert.deepStrictEqual(sent, [
+      { codes: [97, 98], delay: 0 },
+      { codes: [99], delay: 5 },
+    ]);
+    assert.deepStrictEqual(pressed, []);
+  });
+
+  test('waits for each delay and presses each chord without a key injector', async () => {
+    const chords = [{ keys: ['a'] }, { keys: ['b', 'c'], delay: 30 }];
+    const { completedAt } = await command(null, { chords }, { keyInjector: null });
+    assert.deepStrictEqual(pressed, [['a'], ['b', 'c']]);
+    assert.ok(completedAt[1] - completedAt[0] >= 29000);
+  });
+
+  test('rejects an empty sequence', async () => {
+    await assert.rejects(command(null, { chords: [] }, { keyInjector: null }), /non-empty/);
+  });
+});
+
+suite('virtual-key codes', () => {
+  test('of named keys, letters and digits', () => {
+    assert.deepStrictEqual(
+      ['insert', 'down', 'control', 'f12', 'a', 'Z', '7', ';'].map(virtualKeyCode),
+      [0x2d, 0x28, 0x11, 0x7b, 0x41, 0x5a, 0x37, 0xba],
+    );
+  });
+
+  test('of an unmapped key', () => {
+    assert.throws(() => virtualKeyCode('é'), /no virtual-key code/);
+  });
+});
@@ -0,0 +1,172 @@
+'use strict';
+const assert = require('assert');
+
+const { parseMessage } = require('../lib/create-voice-server');
+const { KeyPressLatency } = require('../lib/key-press-latency');
+const { OutputBroadcaster } = require('../lib/output-broadcaster');
+
+/**
+ * Stands in for the voice: produces the messages with which it responds to a
+ * key press, stamped (as the voice stamps them) with the times at which the
+ * screen reader called `Speak` and at which each message was emitted.
+ */
+class SimulatedEngine {
+  /**
+   * @param {{now: number}} clock - microseconds
+   */
+  constructor(clock) {
+    this.clock = clock;
+    this.nextUtteranceId = 1;
+  }
+
+  /**
+   * @param {string[]} texts
+   * @param {number} entryDelay - microseconds before the screen reader calls
+   *                              `Speak`
+   *
+   * @returns {import('../lib/create-voice-server').VoiceMessage[]}
+   */
+  speak(texts, entryDelay) {
+    this.clock.now += entryDelay;
+    const entry = this.clock.now;
+    const id = this.nextUtteranceId++;
+    const emitted = [`speakBegin t=${(this.clock.now += 50)} entry=${entry}:${id}`];
+    for (const text of texts) {
+      emitted.push(`speech t=${(this.clock.now += 200)}:${text}`);
+    }
+    emitted.push(`speakEnd t=${(this.clock.now += 100)}:${id}`);
+    return emitted.map(parseMessage);
+  }
+}
+
+suite('key press latency', () => {
+  let clock;
+  let engine;
+  let latency;
+  /** @type {string[][]} */
+  let injected;
+  setup(() => {
+    clock = { now: 1000000 };
+    engine = new SimulatedEngine(clock);
+    latency = new KeyPressLatency({ now: () => clock.now });
+    injected = [];
+  });
+
+  // The fake input backend takes 300 microseconds to inject keys.
+  const inject = keys => {
+    injected.push(keys);
+    clock.now += 300;
+  };
+
+  test('assigns each press an id and injects its keys', async () => {
+    assert.strictEqual(await latency.press(['\ue004'], inject), 1);
+    assert.strictEqual(await latency.press(['\ue008', '\ue004'], inject), 2);
+    assert.deepStrictEqual(injected, [['\ue004'], ['\ue008', '\ue004']]);
+    assert.deepStrictEqual(latency.reports().map(report => report.injected), [0.3, 0.3]);
+  });
+
+  test('reports the stages through which a press becomes broadcast speech', async () => {
+    const pressId = await latency.press(['\ue015'], inject);
+    const messages = engine.speak(['Quarterly revenue', 'row 3'], 2000);
+    clock.now += 700;
+    assert.deepStrictEqual(
+      messages.map(message => latency.deliver(message)),
+      [pressId, pressId, pressId, null],
+    );
+    clock.now += 1000;
+    latency.broadcast(pressId);
+
+    assert.deepStrictEqual(latency.report(pressId), {
+      pressId,
+      keys: ['\ue015'],
+      injected: 0.3,
+      speakEntry: 2.3,
+      emitted: 2.55,
+      received: 3.55,
+      broadcast: 4.55,
+    });
+  });
+
+  test('attributes output to the most recent press which preceded it', async () => {
+    const first = await latency.press(['a'], inject);
+    const late = engine.speak(['from the first press'], 1000);
+    const second = await latency.press(['b'], inject);
+    const prompt = engine.speak(['from the second press'], 500);
+
+    // Output emitted before the second press is attributed to the first,
+    // even though it is delivered afterwards.
+    assert.strictEqual(latency.deliver(late[1]), first);
+    assert.strictEqual(latency.deliver(prompt[1]), second);
+    assert.strictEqual(latency.report(first).emitted, 1.55);
+    assert.strictEqual(latency.report(second).emitted, 1.05);
+  });
+
+  test('measures Speak entry rather than emission where the voice reports it', async () => {
+    const pressId = await latency.press(['a'], inject);
+    const [speakBegin] = engine.speak(['text'], 4000);
+    latency.deliver(speakBegin);
+    assert.strictEqual(latency.report(pressId).speakEntry, 4.3);
+  });
+
+  test('falls back to the time of receipt for messages without timestamps', async () => {
+    const pressId = await latency.press(['a'], inject);
+    clock.now += 5000;
+    assert.strictEqual(latency.deliver(parseMessage('speech:Hello')), pressId);
+    assert.strictEqual(latency.report(pressId).emitted, 5.3);
+    assert.strictEqual(latency.report(pressId).speakEntry, null);
+  });
+
+  test('does not attribute output which precedes every press or follows the window', async () => {
+    const early = engine.speak(['before'], 0);
+    latency = new KeyPressLatency({ now: () => clock.now, attributionWindow: 10 });
+    await latency.press(['a'], inject);
+    assert.strictEqual(latency.deliver(early[1]), null);
+    assert.strictEqual(latency.deliver(engine.speak(['much later'], 20000)[1]), null);
+    assert.strictEqual(latency.deliver(parseMessage('lifecycle:Voice destroyed')), null);
+  });
+
+  test('forgets the oldest presses beyond its history', async () => {
+    latency = new KeyPressLatency({ now: () => clock.now, history: 2 });
+    await latency.press(['a'], inject);
+    await latency.press(['b'], inject);
+    await latency.press(['c'], inject);
+    assert.deepStrictEqual(latency.reports().map(report => report.pressId), [2, 3]);
+    assert.strictEqual(latency.report(1), null);
+  });
+
+  test('carries the press id into broadcast output and reports once broadcast', async () => {
+    const client = {
+      sessionId: 'session',
+      bufferedAmount: 0,
+      received: [],
+      send(data, callback) {
+        this.received.push(JSON.parse(data));
+        callback();
+      },
+    };
+    const broadcaster = new OutputBroadcaster(() => [client], { batchWindow: 0 });
+    broadcaster.on('sent', pressId => latency.broadcast(pressId));
+    const reports = [];
+    latency.on('report', report => reports.push(report));
+
+    const pressId = await latency.press(['\ue015'], inject);
+    for (const message of engine.speak(['Quarterly revenue', 'row 3'], 2000)) {
+      const cause = latency.deliver(message);
+      if (message.name === 'speech') {
+        broadcaster.output(message.data, cause);
+      }
+    }
+    broadcaster.output('unprompted');
+    broadcaster.close();
+
+    assert.deepStrictEqual(
+      client.received.map(event => event.params),
+      [
+        { data: 'Quarterly revenue', pressId },
+        { data: 'row 3', pressId },
+        { data: 'unprompted' },
+      ],
+    );
+    assert.deepStrictEqual(reports.map(report => report.pressId), [pressId]);
+  });
+});
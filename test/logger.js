@@ -0,0 +1,32 @@
+'use strict';
+const assert = require('assert');
+
+const { Logger } = require('../lib/logger');
+
+suite('logger', () => {
+  let written;
+  const write = (...args) => written.push(args.slice(1));
+  setup(() => {
+    written = [];
+  });
+
+  test('writes messages of its level and those before it', () => {
+    const log = new Logger('warn', { write });
+    log.error('a');
+    log.warn('b');
+    log.info('c');
+    log.debug('d');
+    assert.deepStrictEqual(written, [['a'], ['b']]);
+    assert.ok(log.enabled('error'));
+    assert.ok(!log.enabled('info'));
+  });
+
+  test('prefixes the messages of its children', () => {
+    new Logger('debug', { write }).child('[instance 2]').debug('a', 1);
+    assert.deepStrictEqual(written, [['[instance 2]', 'a', 1]]);
+  });
+
+  test('rejects an unrecognized level', () => {
+    assert.throws(() => new Logger('verbose'), /unrecognized log level: "verbose"/);
+  });
+});
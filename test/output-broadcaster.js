@@ -0,0 +1,352 @@
+'use strict';
+const assert = require('assert');
+
+const { OutputBroadcaster, encodeBatch, escapeOutput } = require('../lib/output-broadcaster');
+
+const delay = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+/**
+ * A stand-in for a WebSocket whose unsent data accumulates until `drain` is
+ * called, as it does when the client reads slowly.
+ */
+class FakeWebSocket {
+  constructor() {
+    this.sessionId = 'session';
+    this.bufferedAmount = 0;
+    /** @type {Array<{data: string, callback: function(Error=): void}>} */
+    this.pending = [];
+    /** @type {object[]} */
+    this.received = [];
+    this.closeCode = null;
+  }
+
+  send(data, callback) {
+    this.bufferedAmount += data.length;
+    this.pending.push({ data, callback });
+  }
+
+  drain() {
+    while (this.pending.length > 0) {
+      const { data, callback } = this.pending.shift();
+      this.bufferedAmount -= data.length;
+      this.received.push(JSON.parse(data));
+      callback();
+    }
+  }
+
+  close(code) {
+    this.closeCode = code;
+  }
+}
+
+suite('output broadcaster', () => {
+  /** @type {FakeWebSocket[]} */
+  let clients;
+  let broadcaster;
+  const create = options => {
+    broadcaster = new OutputBroadcaster(() => clients, options);
+    return broadcaster;
+  };
+  setup(() => {
+    clients = [new FakeWebSocket()];
+  });
+  teardown(() => {
+    broadcaster.close();
+  });
+
+  suite('batching', () => {
+    test('sends output immediately when idle', () => {
+      create({ batchWindow: 20 }).output('Hello');
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received, [
+        { method: 'interaction.capturedOutput', params: { data: 'Hello' } },
+      ]);
+    });
+
+    test('batches output which follows other output within the window', async () => {
+      create({ batchWindow: 20 });
+      broadcaster.output('a');
+      broadcaster.output('b');
+      broadcaster.output('c');
+      clients[0].drain();
+      assert.strictEqual(clients[0].received.length, 1);
+
+      await delay(40);
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received[1], {
+        method: 'interaction.capturedOutput',
+        params: { data: 'b\nc', batch: ['b', 'c'] },
+      });
+
+      // The window has closed, so output is once again sent immediately.
+      await delay(40);
+      broadcaster.output('d');
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received[2].params, { data: 'd' });
+    });
+
+    test('sends a batch once it reaches its maximum size', () => {
+      create({ batchWindow: 1000, maxBatchSize: 2 });
+      broadcaster.output('a');
+      broadcaster.output('b');
+      broadcaster.output('c');
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received.map(({ params }) => params.data), ['a', 'b\nc']);
+    });
+
+    test('sends pending output before other events', () => {
+      create({ batchWindow: 1000 });
+      broadcaster.output('a');
+      broadcaster.output('b');
+      broadcaster.broadcast({ method: 'interaction.bookmarkReached', params: { name: 'x' } });
+      clients[0].drain();
+      assert.deepStrictEqual(
+        clients[0].received.map(({ method }) => method),
+        ['interaction.capturedOutput', 'interaction.capturedOutput', 'interaction.bookmarkReached'],
+      );
+    });
+
+    test('does not batch output caused by different key presses', () => {
+      create({ batchWindow: 1000 });
+      broadcaster.output('a', 1);
+      broadcaster.output('b', 1);
+      broadcaster.output('c', 1);
+      broadcaster.output('d', 2);
+      broadcaster.flush();
+      clients[0].drain();
+      assert.deepStrictEqual(
+        clients[0].received.map(({ params }) => params),
+        [
+          { data: 'a', pressId: 1 },
+          { data: 'b\nc', batch: ['b', 'c'], pressId: 1 },
+          { data: 'd', pressId: 2 },
+        ],
+      );
+    });
+
+    test('labels each batch with the cursor which follows it', () => {
+      create({ batchWindow: 1000 });
+      broadcaster.output('a', null, 1);
+      broadcaster.output('b', null, 2);
+      broadcaster.output('c', null, 3);
+      broadcaster.flush();
+      clients[0].drain();
+      assert.deepStrictEqual(
+        clients[0].received.map(({ params }) => params),
+        [
+          { data: 'a', cursor: 1 },
+          { data: 'b\nc', batch: ['b', 'c'], cursor: 3 },
+        ],
+      );
+    });
+
+    test('replays missed output to one client', () => {
+      create({ batchWindow: 1000 });
+      clients.push(new FakeWebSocket());
+      broadcaster.replay(clients[1], ['b', 'c'], 1, 7);
+      clients[0].drain();
+      clients[1].drain();
+      assert.deepStrictEqual(clients[0].received, []);
+      assert.deepStrictEqual(clients[1].received, [
+        { method: 'interaction.capturedOutputDropped', params: { count: 1 } },
+        {
+          method: 'interaction.capturedOutput',
+          params: { data: 'b\nc', batch: ['b', 'c'], cursor: 7 },
+        },
+      ]);
+    });
+
+    test('sends each message individually when batching is disabled', () => {
+      create({ batchWindow: 0 });
+      broadcaster.output('a');
+      broadcaster.output('b');
+      clients[0].drain();
+      assert.strictEqual(clients[0].received.length, 2);
+    });
+
+    test('ignores clients without a session', () => {
+      clients[0].sessionId = undefined;
+      create().output('a');
+      assert.strictEqual(clients[0].pending.length, 0);
+    });
+
+    test('sends each client only the topics which it accepts', () => {
+      clients.push(new FakeWebSocket());
+      create({
+        batchWindow: 0,
+        accepts: (websocket, topic) => websocket === clients[0] || topic === 'keyPress',
+      });
+      broadcaster.output('a');
+      broadcaster.output('b', 1);
+      broadcaster.broadcast({ method: 'interaction.bookmarkReached', params: {} }, 'bookmark');
+      broadcaster.broadcast({ method: 'interaction.outputSettled', params: {} });
+      clients.forEach(client => client.drain());
+      assert.strictEqual(clients[0].received.length, 4);
+      assert.deepStrictEqual(
+        clients[1].received.map(({ method, params }) => params.data || method),
+        ['b', 'interaction.outputSettled'],
+      );
+    });
+  });
+
+  suite('encoding', () => {
+    const messages = ['plain', 'say "caf\u00e9"', 'back\\slash\nline\u0007', '\u{1f600}'];
+    const serialize = (batch, pressId, cursor) => {
+      const params = batch.length === 1 ? { data: batch[0] } : { data: batch.join('\n'), batch };
+      if (pressId !== null) {
+        params.pressId = pressId;
+      }
+      if (cursor !== null) {
+        params.cursor = cursor;
+      }
+      return JSON.stringify({ method: 'interaction.capturedOutput', params });
+    };
+
+    test('events are identical to those serialized by JSON.stringify', () => {
+      for (const batch of [messages.slice(0, 1), messages.slice(1, 2), messages]) {
+        for (const [pressId, cursor] of [
+          [null, null],
+          [3, null],
+          [null, 17],
+          [3, 17],
+        ]) {
+          assert.strictEqual(
+            encodeBatch(batch.map(escapeOutput), pressId, cursor),
+            serialize(batch, pressId, cursor),
+          );
+        }
+      }
+    });
+
+    test('output escaped by the voice is sent as it was received', () => {
+      create({ batchWindow: 0 }).output('say "hi"', null, null, 'say \\u0022hi\\u0022');
+      assert.strictEqual(
+        clients[0].pending[0].data,
+        '{"method":"interaction.capturedOutput","params":{"data":"say \\u0022hi\\u0022"}}',
+      );
+      clients[0].drain();
+      assert.strictEqual(clients[0].received[0].params.data, 'say "hi"');
+    });
+  });
+
+  suite('lagging clients', () => {
+    const watermarks = { batchWindow: 0, highWatermark: 200, lowWatermark: 50 };
+    // Only the first client lags; any others read promptly.
+    const outputUntilLagging = () => {
+      let count = 0;
+      while (!broadcaster.stateOf(clients[0]).lagging) {
+        broadcaster.output(`message ${count}`);
+        clients.slice(1).forEach(client => client.drain());
+        count += 1;
+      }
+      return count;
+    };
+
+    test('are queued and receive their backlog as one batch', () => {
+      const events = [];
+      create({ ...watermarks, laggingClientPolicy: 'queue' });
+      clients.push(new FakeWebSocket());
+      broadcaster.on('lagging', client => events.push(['lagging', clients.indexOf(client)]));
+      broadcaster.on('recovered', client => events.push(['recovered', clients.indexOf(client)]));
+
+      const sent = outputUntilLagging();
+      broadcaster.output('queued 1');
+      broadcaster.output('queued 2');
+      broadcaster.broadcast({ method: 'interaction.bookmarkReached', params: { name: 'x' } });
+      broadcaster.output('queued 3');
+      assert.strictEqual(clients[0].pending.length, sent);
+      clients[1].drain();
+      assert.strictEqual(clients[1].received.length, sent + 4);
+
+      clients[0].drain();
+      clients[0].drain();
+      assert.deepStrictEqual(
+        events.filter(([, index]) => index === 0),
+        [
+          ['lagging', 0],
+          ['recovered', 0],
+        ],
+      );
+      assert.deepStrictEqual(
+        clients[0].received.slice(sent).map(({ params }) => params),
+        [
+          { data: 'queued 1\nqueued 2', batch: ['queued 1', 'queued 2'] },
+          { name: 'x' },
+          { data: 'queued 3' },
+        ],
+      );
+    });
+
+    test('receive the cursor of the last output queued', () => {
+      create({ ...watermarks, laggingClientPolicy: 'queue' });
+      const sent = outputUntilLagging();
+      broadcaster.output('queued 1', null, 10);
+      broadcaster.output('queued 2', null, 11);
+
+      clients[0].drain();
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received[sent].params, {
+        data: 'queued 1\nqueued 2',
+        batch: ['queued 1', 'queued 2'],
+        cursor: 11,
+      });
+    });
+
+    test('discard the oldest output beyond the queue limit', () => {
+      create({ ...watermarks, laggingClientPolicy: 'queue', maxQueuedMessages: 2 });
+      const sent = outputUntilLagging();
+      broadcaster.output('a');
+      broadcaster.output('b');
+      broadcaster.output('c');
+
+      clients[0].drain();
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received.slice(sent), [
+        { method: 'interaction.capturedOutputDropped', params: { count: 1 } },
+        { method: 'interaction.capturedOutput', params: { data: 'b\nc', batch: ['b', 'c'] } },
+      ]);
+    });
+
+    test('have their output dropped and counted', () => {
+      create({ ...watermarks, laggingClientPolicy: 'drop' });
+      const sent = outputUntilLagging();
+      broadcaster.output('a');
+      broadcaster.broadcast({ method: 'interaction.outputSettled', params: {} });
+      broadcaster.output('b');
+      assert.strictEqual(clients[0].pending.length, sent + 1);
+
+      clients[0].drain();
+      clients[0].drain();
+      assert.deepStrictEqual(
+        clients[0].received.slice(sent).map(({ method }) => method),
+        ['interaction.outputSettled', 'interaction.capturedOutputDropped'],
+      );
+      assert.strictEqual(clients[0].received[sent + 1].params.count, 2);
+
+      broadcaster.output('c');
+      clients[0].drain();
+      assert.deepStrictEqual(clients[0].received[sent + 2].params, { data: 'c' });
+    });
+
+    test('are disconnected', () => {
+      create({ ...watermarks, laggingClientPolicy: 'disconnect' });
+      outputUntilLagging();
+      assert.strictEqual(clients[0].closeCode, 1008);
+    });
+
+    test('remain lagging until they fall below the low watermark', () => {
+      create({ ...watermarks, laggingClientPolicy: 'drop' });
+      outputUntilLagging();
+      const { data, callback } = clients[0].pending.shift();
+      clients[0].bufferedAmount -= data.length;
+      callback();
+      assert.ok(clients[0].bufferedAmount > watermarks.lowWatermark);
+      assert.strictEqual(broadcaster.stateOf(clients[0]).lagging, true);
+    });
+  });
+
+  test('rejects an unrecognized policy', () => {
+    assert.throws(() => create({ laggingClientPolicy: 'ignore' }), /unrecognized/);
+    create();
+  });
+});
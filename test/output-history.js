@@ -0,0 +1,82 @@
+'use strict';
+const assert = require('assert');
+
+const { OutputHistory } = require('../lib/output-history');
+
+// The bytes which the history accounts to a message of `length` characters.
+const sizeOf = length => 48 + 2 * length;
+
+suite('output history', () => {
+  test('numbers messages consecutively', () => {
+    const history = new OutputHistory();
+    assert.strictEqual(history.append('a'), 0);
+    assert.strictEqual(history.append('b', 7), 1);
+    assert.strictEqual(history.cursor, 2);
+    assert.deepStrictEqual(history.since(0), {
+      output: [
+        { seq: 0, data: 'a' },
+        { seq: 1, data: 'b', pressId: 7 },
+      ],
+      cursor: 2,
+      missed: 0,
+    });
+  });
+
+  test('returns the output from a cursor onwards, up to a limit', () => {
+    const history = new OutputHistory();
+    for (let i = 0; i < 100; i += 1) {
+      history.append(`message ${i}`);
+    }
+    const { output, cursor } = history.since(40, 3);
+    assert.deepStrictEqual(
+      output.map(({ data }) => data),
+      ['message 40', 'message 41', 'message 42'],
+    );
+    assert.strictEqual(cursor, 43);
+    assert.deepStrictEqual(history.since(100), { output: [], cursor: 100, missed: 0 });
+  });
+
+  test('discards the oldest output beyond its size', () => {
+    const history = new OutputHistory({ maxBytes: 3 * sizeOf(1) });
+    for (const data of ['a', 'b', 'c', 'd', 'e']) {
+      history.append(data);
+    }
+    assert.deepStrictEqual(history.since(1), {
+      output: [
+        { seq: 2, data: 'c' },
+        { seq: 3, data: 'd' },
+        { seq: 4, data: 'e' },
+      ],
+      cursor: 5,
+      missed: 1,
+    });
+    assert.strictEqual(history.bytes, 3 * sizeOf(1));
+  });
+
+  test('preserves the order of messages as its ring grows', () => {
+    const history = new OutputHistory({ maxBytes: 20 * sizeOf(2) });
+    for (let i = 0; i < 100; i += 1) {
+      history.append(String(i).padStart(2, '0'));
+    }
+    assert.deepStrictEqual(
+      history.since(0).output.map(({ seq, data }) => [seq, Number(data)]),
+      Array.from({ length: 20 }, (_, i) => [80 + i, 80 + i]),
+    );
+  });
+
+  test('numbers messages which it cannot hold', () => {
+    const history = new OutputHistory({ maxBytes: 0 });
+    assert.strictEqual(history.append('a'), 0);
+    assert.strictEqual(history.append('b'), 1);
+    assert.deepStrictEqual(history.since(0), { output: [], cursor: 2, missed: 2 });
+  });
+
+  test('validates cursors', () => {
+    const history = new OutputHistory();
+    history.append('a');
+    history.validateCursor('cursor', 1);
+    assert.throws(() => history.validateCursor('cursor', -1), /"cursor" must be/);
+    assert.throws(() => history.validateCursor('cursor', 0.5), /"cursor" must be/);
+    assert.throws(() => history.validateCursor('cursor', 2), /beyond the most recent output/);
+  });
+});
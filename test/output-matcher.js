@@ -0,0 +1,110 @@
+'use strict';
+const assert = require('assert');
+
+const { OutputMatcher, PatternAutomaton } = require('../lib/output-matcher');
+
+suite('output matcher', () => {
+  suite('PatternAutomaton', () => {
+    test('finds every pattern which occurs, including overlapping ones', () => {
+      const automaton = new PatternAutomaton(['he', 'she', 'his', 'hers', 'button']);
+      assert.deepStrictEqual([...automaton.search('ushers')].sort(), ['he', 'hers', 'she']);
+      assert.deepStrictEqual([...automaton.search('Submit button')], ['button']);
+      assert.deepStrictEqual([...automaton.search('heading level 2')], ['he']);
+      assert.deepStrictEqual([...automaton.search('link')], []);
+    });
+
+    test('agrees with a search for each pattern in turn', () => {
+      const patterns = ['a', 'ab', 'bab', 'bc', 'bca', 'c', 'caa', 'aaa'];
+      const automaton = new PatternAutomaton(patterns);
+      let seed = 7;
+      for (let i = 0; i < 200; i += 1) {
+        let text = '';
+        for (let j = 0; j < 12; j += 1) {
+          seed = (seed * 1103515245 + 12345) % 2147483648;
+          text += 'abcd'[seed % 4];
+        }
+        const expected = patterns.filter(pattern => text.includes(pattern)).sort();
+        assert.deepStrictEqual([...automaton.search(text)].sort(), expected, text);
+      }
+    });
+  });
+
+  suite('OutputMatcher', () => {
+    let matcher;
+    let matched;
+    const add = predicate => matcher.add(predicate, output => matched.push(output));
+    setup(() => {
+      matcher = new OutputMatcher();
+      matched = [];
+    });
+
+    test('fulfills a wait for text which an utterance contains', () => {
+      add({ contains: 'button' });
+      matcher.match('Submit');
+      assert.deepStrictEqual(matched, []);
+      matcher.match('Submit button');
+      matcher.match('Cancel button');
+      assert.deepStrictEqual(matched, [['Submit button']]);
+      assert.strictEqual(matcher.size, 0);
+    });
+
+    test('fulfills a wait for a regular expression', () => {
+      add({ matches: '^heading level [1-6]$', flags: 'i' });
+      matcher.match('Heading level 2, Introduction');
+      matcher.match('Heading Level 3');
+      assert.deepStrictEqual(matched, [['Heading Level 3']]);
+    });
+
+    test('fulfills a wait for a sequence, one utterance per step', () => {
+      add({ sequence: ['dialog', 'OK button'] });
+      matcher.match('OK button');
+      matcher.match('Confirm dialog, OK button');
+      assert.deepStrictEqual(matched, []);
+      matcher.match('OK button');
+      assert.deepStrictEqual(matched, [['Confirm dialog, OK button', 'OK button']]);
+    });
+
+    test('evaluates every wait which awaits the same text', () => {
+      add({ contains: 'link' });
+      add({ sequence: ['link', 'visited'] });
+      add({ contains: 'link' });
+      matcher.match('Home link');
+      assert.deepStrictEqual(matched, [['Home link'], ['Home link']]);
+      assert.strictEqual(matcher.size, 1);
+      matcher.match('visited link');
+      assert.deepStrictEqual(matched[2], ['Home link', 'visited link']);
+    });
+
+    test('disregards removed waits', () => {
+      const wait = add({ contains: 'link' });
+      add({ contains: 'button' });
+      matcher.remove(wait);
+      matcher.match('link button');
+      assert.deepStrictEqual(matched, [['link button']]);
+    });
+
+    test('rebuilds its automaton only for text which it does not know', () => {
+      add({ contains: 'link' });
+      matcher.match('');
+      const { automaton } = matcher;
+      add({ contains: 'link' });
+      matcher.match('');
+      assert.strictEqual(matcher.automaton, automaton);
+      add({ contains: 'button' });
+      matcher.match('');
+      assert.notStrictEqual(matcher.automaton, automaton);
+    });
+
+    test('validates predicates', () => {
+      assert.throws(() => add({}), /exactly one/);
+      assert.throws(() => add({ contains: 'a', matches: 'b' }), /exactly one/);
+      assert.throws(() => add({ contains: '' }), /"contains"/);
+      assert.throws(() => add({ matches: '(' }), /not a valid regular expression/);
+      assert.throws(() => add({ matches: 'a', flags: 'g' }), /"flags"/);
+      assert.throws(() => add({ contains: 'a', flags: 'i' }), /"flags"/);
+      assert.throws(() => add({ sequence: [] }), /"sequence"/);
+      assert.throws(() => add({ sequence: ['a', 4] }), /"sequence\[1\]"/);
+      assert.strictEqual(matcher.size, 0);
+    });
+  });
+});
@@ -0,0 +1,125 @@
+'use strict';
+const assert = require('assert');
+const { EventEmitter } = require('events');
+
+const {
+  Subscriptions,
+  DEFAULT_SUBSCRIPTION,
+  EMPTY_SUBSCRIPTION,
+  FULL_SUBSCRIPTION,
+  encodeSubscription,
+  parseSubscription,
+} = require('../lib/subscriptions');
+const { VoiceSettings } = require('../lib/voice-settings');
+
+suite('subscriptions', () => {
+  test('are parsed from the parameters of session.new', () => {
+    assert.strictEqual(parseSubscription(undefined), DEFAULT_SUBSCRIPTION);
+    assert.deepStrictEqual(parseSubscription({ types: ['lifecycle'], audio: false }), {
+      ...DEFAULT_SUBSCRIPTION,
+      types: ['lifecycle'],
+      audio: false,
+    });
+    assert.throws(() => parseSubscription([]), /"subscriptions" must be an object/);
+    assert.throws(() => parseSubscription({ types: ['audio'] }), /"types" must be a list/);
+    assert.throws(() => parseSubscription({ origins: 'keyPress' }), /"origins" must be a list/);
+    assert.throws(() => parseSubscription({ timing: 1 }), /"timing" must be a boolean/);
+    assert.throws(() => parseSubscription({ volume: true }), /unknown subscription "volume"/);
+  });
+
+  test('are encoded as the messages which the voice need not emit', () => {
+    assert.strictEqual(encodeSubscription(FULL_SUBSCRIPTION), 'audioTap=1');
+    assert.strictEqual(encodeSubscription({ ...FULL_SUBSCRIPTION, audio: false }), '');
+    assert.strictEqual(
+      encodeSubscription(DEFAULT_SUBSCRIPTION),
+      'emitLifecycle=0 emitErrors=0 audioTap=1',
+    );
+    assert.strictEqual(
+      encodeSubscription({ ...DEFAULT_SUBSCRIPTION, origins: [], timing: false, audio: false }),
+      'emitSpeech=0 emitLifecycle=0 emitErrors=0 stampTimes=0',
+    );
+  });
+
+  suite('of a server', () => {
+    let subscriptions;
+    let changes;
+    setup(() => {
+      subscriptions = new Subscriptions({ ...EMPTY_SUBSCRIPTION, types: ['internalError'] });
+      changes = [];
+      subscriptions.on('change', union => changes.push(encodeSubscription(union)));
+    });
+
+    test('include everything until a session begins', () => {
+      assert.strictEqual(subscriptions.union, FULL_SUBSCRIPTION);
+      const websocket = new EventEmitter();
+      subscriptions.add(websocket, parseSubscription({ types: [], bookmarks: false }));
+      subscriptions.remove(websocket);
+      assert.deepStrictEqual(changes, [
+        'emitSpeech=0 emitLifecycle=0 emitBookmarks=0 audioTap=1',
+        'audioTap=1',
+      ]);
+    });
+
+    test('combine those of every session and the server', () => {
+      const first = new EventEmitter();
+      const second = new EventEmitter();
+      subscriptions.add(first, parseSubscription({ types: ['speech'], origins: ['keyPress'] }));
+      subscriptions.add(second, parseSubscription({ types: ['lifecycle'], audio: false }));
+      assert.deepStrictEqual(subscriptions.union, {
+        types: ['speech', 'lifecycle', 'internalError'],
+        origins: ['keyPress', 'unprompted'],
+        bookmarks: true,
+        timing: true,
+        audio: true,
+      });
+      subscriptions.remove(first);
+      assert.strictEqual(changes[changes.length - 1], 'emitSpeech=0');
+    });
+
+    test('determine the events which each client accepts', () => {
+      const websocket = new EventEmitter();
+      subscriptions.add(
+        websocket,
+        parseSubscription({ types: ['speech', 'internalError'], origins: ['keyPress'] }),
+      );
+      assert.ok(subscriptions.accepts(websocket, 'keyPress'));
+      assert.ok(!subscriptions.accepts(websocket, 'unprompted'));
+      assert.ok(subscriptions.accepts(websocket, 'internalError'));
+      assert.ok(!subscriptions.accepts(websocket, 'lifecycle'));
+      assert.ok(subscriptions.accepts(websocket, 'bookmark'));
+      assert.ok(subscriptions.accepts(new EventEmitter(), 'unprompted'));
+    });
+
+    test('reject commands which depend on messages to which none subscribes', () => {
+      subscriptions.demand('audio', 'interaction.startAudioCapture');
+      subscriptions.add(new EventEmitter(), parseSubscription({ audio: false }));
+      assert.throws(
+        () => subscriptions.demand('audio', 'interaction.startAudioCapture'),
+        /interaction.startAudioCapture requires a session which subscribes to audio/,
+      );
+      subscriptions.demand('speech', 'interaction.waitForOutput');
+    });
+  });
+
+  test('are sent to the voice with its settings', () => {
+    const settings = new VoiceSettings();
+    const sent = [];
+    settings.on('change', message => sent.push(message));
+    settings.setSubscription(FULL_SUBSCRIPTION);
+    settings.setSubscription({ ...FULL_SUBSCRIPTION, bookmarks: false });
+    settings.setSubscription({ ...FULL_SUBSCRIPTION, bookmarks: false });
+    assert.strictEqual(sent.length, 1);
+    assert.match(sent[0], /^configure gen=1:vocalize=1 .* trace=0 emitBookmarks=0\0$/);
+    assert.strictEqual(settings.update({ trace: true }).generation, 2);
+    assert.match(settings.encode(), / trace=1 emitBookmarks=0\0$/);
+  });
+
+  test('enable the audio tap only while the driver reads it', () => {
+    assert.strictEqual(new VoiceSettings().encode(), null);
+    const settings = new VoiceSettings({ audioTap: true });
+    // Until a session begins, any client may capture audio.
+    assert.match(settings.encode(), /^configure gen=1:.* audioTap=1\0$/);
+    settings.setSubscription({ ...FULL_SUBSCRIPTION, audio: false });
+    assert.match(settings.encode(), /^configure gen=2:.* trace=0\0$/);
+  });
+});
@@ -0,0 +1,55 @@
+'use strict';
+const assert = require('assert');
+
+const { instancePath, voiceInstances } = require('../lib/voice-instances');
+
+suite('voice instances', () => {
+  suite('instancePath', () => {
+    test('leaves the locations of the first instance unchanged', () => {
+      assert.strictEqual(instancePath('C:\\data\\capture.journal', 1), 'C:\\data\\capture.journal');
+    });
+
+    test('suffixes the name of a file before its extension', () => {
+      assert.strictEqual(
+        instancePath('C:\\data\\capture.journal', 3),
+        'C:\\data\\capture-3.journal',
+      );
+      assert.strictEqual(instancePath('/tmp/audio.tap', 2), '/tmp/audio-2.tap');
+    });
+
+    test('suffixes names without an extension', () => {
+      assert.strictEqual(instancePath('\\\\?\\pipe\\my_pipe', 2), '\\\\?\\pipe\\my_pipe-2');
+      assert.strictEqual(instancePath('\\\\.\\pipe\\my_pipe', 2), '\\\\.\\pipe\\my_pipe-2');
+      assert.strictEqual(instancePath('C:\\my.data\\journal', 2), 'C:\\my.data\\journal-2');
+    });
+  });
+
+  suite('voiceInstances', () => {
+    test('assigns consecutive ports and distinct locations', () => {
+      assert.deepStrictEqual(
+        voiceInstances(2, {
+          port: 4382,
+          socketPath: '\\\\?\\pipe\\my_pipe',
+          journal: 'C:\\data\\capture.journal',
+          audioTap: null,
+        }),
+        [
+          {
+            instance: 1,
+            port: 4382,
+            socketPath: '\\\\?\\pipe\\my_pipe',
+            journal: 'C:\\data\\capture.journal',
+            audioTap: null,
+          },
+          {
+            instance: 2,
+            port: 4383,
+            socketPath: '\\\\?\\pipe\\my_pipe-2',
+            journal: 'C:\\data\\capture-2.journal',
+            audioTap: null,
+          },
+        ],
+      );
+    });
+  });
+});
@@ -0,0 +1,175 @@
+'use strict';
+const assert = require('assert');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+
+const createVoiceServer = require('../lib/create-voice-server');
+const { VoiceSettings } = require('../lib/voice-settings');
+
+suite('voice server', () => {
+  let server, socketPath;
+  setup(async () => {
+    socketPath =
+      process.platform === 'win32'
+        ? `\\\\?\\pipe\\at-driver-test-${process.pid}`
+        : path.join(os.tmpdir(), `at-driver-test-${process.pid}.socket`);
+    server = await createVoiceServer(socketPath);
+  });
+  teardown(() => new Promise(resolve => server.close(resolve)));
+
+  const connect = () =>
+    new Promise((resolve, reject) => {
+      const stream = net.connect(socketPath);
+      stream.on('error', reject);
+      stream.on('connect', () => resolve(stream));
+    });
+  const collect = count =>
+    new Promise(resolve => {
+      const messages = [];
+      server.on('message', message => {
+        messages.push(message);
+        if (messages.length === count) {
+          resolve(messages);
+        }
+      });
+    });
+
+  test('one message per connection', async () => {
+    const received = collect(1);
+    const stream = await connect();
+    stream.end('speech:Hello, world');
+
+    assert.deepStrictEqual(await received, [
+      { type: 'event', name: 'speech', data: 'Hello, world' },
+    ]);
+  });
+
+  test('null-terminated messages on a persistent connection', async () => {
+    const received = collect(3);
+    const stream = await connect();
+    // Messages may be divided arbitrarily between writes, including within
+    // multi-byte characters.
+    const bytes = Buffer.from('lifecycle:hello\0speech seq=7:café\0speech:two\0', 'utf8');
+    for (let i = 0; i < bytes.length; i += 5) {
+      stream.write(bytes.subarray(i, i + 5));
+    }
+
+    assert.deepStrictEqual(await received, [
+      { type: 'event', name: 'lifecycle', data: 'hello' },
+      { type: 'event', name: 'speech', data: 'café', sequence: 7 },
+      { type: 'event', name: 'speech', data: 'two' },
+    ]);
+    stream.end();
+  });
+
+  test('dictionary entries are scoped to their connection', async () => {
+    const received = collect(3);
+    const first = await connect();
+    first.write('speech def=0:Quarterly revenue\0speech ref=0:\0');
+    await new Promise(resolve => setTimeout(resolve, 50));
+    const second = await connect();
+    second.write('speech ref=0:\0');
+
+    const [defined, referred, unknown] = await received;
+    assert.strictEqual(defined.data, 'Quarterly revenue');
+    assert.strictEqual(referred.data, 'Quarterly revenue');
+    assert.strictEqual(unknown.name, 'internalError');
+    first.end();
+    second.end();
+  });
+
+  test('incomplete message on a persistent connection', async () => {
+    const received = collect(2);
+    const stream = await connect();
+    stream.end('speech:complete\0speech:inter');
+
+    const [complete, incomplete] = await received;
+    assert.deepStrictEqual(complete, { type: 'event', name: 'speech', data: 'complete' });
+    assert.strictEqual(incomplete.name, 'internalError');
+  });
+
+  test('speech sent as a payload is decoded and retained as it was sent', async () => {
+    const received = collect(4);
+    const stream = await connect();
+    stream.write(
+      'speech esc=1:link, Annual report\0' +
+        'speech esc=1 def=1:say \\"caf\u00e9\\"\\u0007\0' +
+        'speech esc=1 ref=1:\0' +
+        'speech esc=1:unescaped "quote\0',
+    );
+
+    const [plain, defined, referred, malformed] = await received;
+    assert.deepStrictEqual(plain, {
+      type: 'event',
+      name: 'speech',
+      data: 'link, Annual report',
+      escaped: 'link, Annual report',
+    });
+    assert.strictEqual(defined.data, 'say "caf\u00e9"\u0007');
+    assert.strictEqual(defined.escaped, 'say \\"caf\u00e9\\"\\u0007');
+    assert.deepStrictEqual(referred, defined);
+    // The payload would not be valid within a JSON string.
+    assert.strictEqual(malformed.name, 'internalError');
+    stream.end();
+  });
+});
+
+suite('voice server with settings', () => {
+  let server, settings, socketPath;
+  setup(async () => {
+    socketPath =
+      process.platform === 'win32'
+        ? `\\\\?\\pipe\\at-driver-test-settings-${process.pid}`
+        : path.join(os.tmpdir(), `at-driver-test-settings-${process.pid}.socket`);
+    settings = new VoiceSettings();
+    server = await createVoiceServer(socketPath, { settings });
+  });
+  teardown(() => new Promise(resolve => server.close(resolve)));
+
+  const connect = () =>
+    new Promise((resolve, reject) => {
+      const stream = net.connect(socketPath);
+      stream.setEncoding('utf8');
+      stream.on('error', reject);
+      stream.on('connect', () => resolve(stream));
+    });
+  const read = stream => new Promise(resolve => stream.once('data', resolve));
+
+  test('sends the settings to each connection when they change', async () => {
+    const first = await connect();
+    const second = await connect();
+    await new Promise(resolve => setTimeout(resolve, 50));
+    const received = [read(first), read(second)];
+    settings.update({ vocalize: false });
+
+    for (const data of await Promise.all(received)) {
+      assert.match(data, /^configure gen=1:vocalize=0 timeCompression=100 [^\0]*\0$/);
+    }
+    first.end();
+    second.end();
+  });
+
+  test('sends the current settings to a new connection', async () => {
+    settings.update({ trace: true });
+    settings.update({ timeCompression: 2 });
+    const stream = await connect();
+
+    assert.match(await read(stream), /^configure gen=2:.*timeCompression=200 .*trace=1\0$/);
+    stream.end();
+  });
+
+  test('interprets the acknowledgement of settings', async () => {
+    const received = new Promise(resolve => server.once('message', resolve));
+    const stream = await connect();
+    stream.write('configured gen=4:vocalize=0 trace=1\0');
+
+    assert.deepStrictEqual(await received, {
+      type: 'event',
+      name: 'configured',
+      data: 'vocalize=0 trace=1',
+      generation: 4,
+    });
+    stream.end();
+  });
+});
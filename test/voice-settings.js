@@ -0,0 +1,94 @@
+'use strict';
+const assert = require('assert');
+
+const captureModule = require('../lib/modules/capture');
+const {
+  VoiceSettings,
+  DEFAULT_VOICE_SETTINGS,
+  decodeSettings,
+  encodeSettings,
+} = require('../lib/voice-settings');
+
+suite('voice settings', () => {
+  let settings;
+  setup(() => {
+    settings = new VoiceSettings();
+  });
+
+  test('are not sent until they are changed', () => {
+    assert.strictEqual(settings.encode(), null);
+  });
+
+  test('accumulate changes, numbering each', () => {
+    const sent = [];
+    settings.on('change', message => sent.push(message));
+
+    assert.deepStrictEqual(settings.update({ vocalize: false }), {
+      settings: { ...DEFAULT_VOICE_SETTINGS, vocalize: false },
+      generation: 1,
+    });
+    const { settings: changed, generation } = settings.update({
+      timeCompression: 2.5,
+      trace: true,
+    });
+    assert.strictEqual(generation, 2);
+    assert.deepStrictEqual(changed, {
+      ...DEFAULT_VOICE_SETTINGS,
+      vocalize: false,
+      timeCompression: 2.5,
+      trace: true,
+    });
+    assert.deepStrictEqual(sent, [
+      'configure gen=1:vocalize=0 timeCompression=100 batchMinWindowUs=250 ' +
+        'batchMaxWindowUs=1000 batchLatencyCapUs=4000 trace=0\0',
+      'configure gen=2:vocalize=0 timeCompression=250 batchMinWindowUs=250 ' +
+        'batchMaxWindowUs=1000 batchLatencyCapUs=4000 trace=1\0',
+    ]);
+    assert.strictEqual(settings.encode(), sent[1]);
+  });
+
+  test('restores defaults given null', () => {
+    settings.update({ vocalize: false, batchMaxWindow: 500 });
+    assert.deepStrictEqual(
+      settings.update({ vocalize: null, batchMaxWindow: null }).settings,
+      DEFAULT_VOICE_SETTINGS,
+    );
+  });
+
+  test('rejects invalid changes without applying any', () => {
+    assert.throws(() => settings.update({ vocalize: 'no' }), /"vocalize" must be a boolean/);
+    assert.throws(() => settings.update({ timeCompression: 0.5 }), /"timeCompression"/);
+    assert.throws(() => settings.update({ timeCompression: 11 }), /"timeCompression"/);
+    assert.throws(() => settings.update({ batchLatencyCap: 1.5 }), /"batchLatencyCap"/);
+    assert.throws(() => settings.update({ pitch: 3 }), /unknown voice setting "pitch"/);
+    assert.throws(
+      () => settings.update({ trace: true, batchMinWindow: 2000 }),
+      /"batchMinWindow" must not exceed "batchMaxWindow"/,
+    );
+    assert.strictEqual(settings.generation, 0);
+    assert.deepStrictEqual(settings.settings, DEFAULT_VOICE_SETTINGS);
+  });
+
+  test('are decoded from the acknowledgement of the voice', () => {
+    const changed = { ...DEFAULT_VOICE_SETTINGS, vocalize: false, timeCompression: 3 };
+    assert.deepStrictEqual(decodeSettings(encodeSettings(changed)), changed);
+    assert.deepStrictEqual(decodeSettings('trace=1 volume=3'), { trace: true });
+  });
+
+  test('request escaped speech from the first connection if the driver chooses', () => {
+    const escaping = new VoiceSettings({ escapeSpeech: true });
+    assert.match(escaping.encode(), /^configure gen=1:vocalize=1 .* escapeSpeech=1\0$/);
+    assert.strictEqual(escaping.update({ trace: true }).generation, 2);
+    assert.match(escaping.encode(), / trace=1 escapeSpeech=1\0$/);
+  });
+
+  test('interaction.configureVoice changes the settings', () => {
+    const configureVoice = captureModule['interaction.configureVoice'];
+    const server = { voiceSettings: settings };
+    assert.deepStrictEqual(configureVoice(null, { vocalize: false }, server), {
+      settings: { ...DEFAULT_VOICE_SETTINGS, vocalize: false },
+      generation: 1,
+    });
+    assert.throws(() => configureVoice(null, [], server), /parameters must be an object/);
+  });
+});